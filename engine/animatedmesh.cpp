@@ -6,12 +6,15 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "opengl.h"
 
 #include "animatedmesh.h"
 #include <assimp/anim.h>
 #include "assetmanager.h"
+#include "skinning.h"
+#include "shaderobject.h"
 
 namespace vortex {
 /**
@@ -22,11 +25,19 @@ namespace vortex {
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+// vertices blended together by skinVertices
+static const int SKINNING_BLOCK = 64;
+
 AnimatedMesh::AnimatedMesh(std::string name) :
     Mesh(name),
     mNumBones(0),
     mBones(NULL),
-    mResources(NULL)
+    mResources(NULL),
+    mInfluencesPerVertex(4),
+    mJointsSkeleton(NULL),
+    mGpuSkinning(false),
+    mInfluenceBuffer(0),
+    mPaletteTexture(NULL)
 {
 }
 
@@ -34,7 +45,12 @@ AnimatedMesh::AnimatedMesh(std::string name, VertexData *vertices, int numVertic
     Mesh(name, vertices, numVertices, indices, numIndices),
     mNumBones(numBones),
     mBones(NULL),
-    mResources(resources) {
+    mResources(resources),
+    mInfluencesPerVertex(4),
+    mJointsSkeleton(NULL),
+    mGpuSkinning(false),
+    mInfluenceBuffer(0),
+    mPaletteTexture(NULL) {
     mBones = new BoneData[mNumBones];
     assert(mBones);
 
@@ -45,6 +61,24 @@ AnimatedMesh::AnimatedMesh(std::string name, VertexData *vertices, int numVertic
         assert(mBones[i].mWeights);
         memcpy(mBones[i].mWeights, bones[i].mWeights, mBones[i].mNumWeights * sizeof(WeightData));
     }
+
+    buildInfluences();
+    mBindBbox = mBbox;
+}
+
+AnimatedMesh::AnimatedMesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, const BBox &bbox,
+                           BoneData *bones, int numBones, AssetManager *resources) :
+    Mesh(name, vertices, numVertices, indices, numIndices, bbox),
+    mNumBones(numBones),
+    mBones(bones),
+    mResources(resources),
+    mInfluencesPerVertex(4),
+    mJointsSkeleton(NULL),
+    mGpuSkinning(false),
+    mInfluenceBuffer(0),
+    mPaletteTexture(NULL) {
+    buildInfluences();
+    mBindBbox = mBbox;
 }
 
 AnimatedMesh::~AnimatedMesh() {
@@ -52,86 +86,366 @@ AnimatedMesh::~AnimatedMesh() {
         delete[] mBones[i].mWeights;
     }
     delete[] mBones;
+    delete mPaletteTexture;
 }
 
 /**
- *
- * @author Alexandre Bonhomme
- * @date Last edit : 09/05/12
+ * Sort the bone weights by vertex, keeping the MAX_INFLUENCES heaviest ones.
+ */
+void AnimatedMesh::buildInfluences() {
+    std::vector<int> counts(mNumVertices, 0);
+    int maxCount = 0;
+    for (unsigned int i = 0; i < mNumBones; ++i)
+        for (unsigned int w = 0; w < mBones[i].mNumWeights; ++w)
+            maxCount = std::max(maxCount, ++counts[mBones[i].mWeights[w].mVertexId]);
+
+    mInfluencesPerVertex = (maxCount <= 4) ? 4 : MAX_INFLUENCES;
+    mInfluenceBones.assign(mInfluencesPerVertex * mNumVertices, 0);
+    mInfluenceWeights.assign(mInfluencesPerVertex * mNumVertices, 0.f);
+
+    std::fill(counts.begin(), counts.end(), 0);
+    int numDropped = 0;
+    for (unsigned int i = 0; i < mNumBones; ++i) {
+        for (unsigned int w = 0; w < mBones[i].mNumWeights; ++w) {
+            int vertexId = mBones[i].mWeights[w].mVertexId;
+            float weight = mBones[i].mWeights[w].mWeight;
+            int slot = counts[vertexId];
+            if (slot < mInfluencesPerVertex) {
+                ++counts[vertexId];
+            } else {
+                // replace the lightest influence if this one is heavier
+                ++numDropped;
+                slot = 0;
+                for (int k = 1; k < mInfluencesPerVertex; ++k)
+                    if (mInfluenceWeights[k*mNumVertices + vertexId] < mInfluenceWeights[slot*mNumVertices + vertexId])
+                        slot = k;
+                if (mInfluenceWeights[slot*mNumVertices + vertexId] >= weight)
+                    continue;
+            }
+            mInfluenceBones[slot*mNumVertices + vertexId] = i;
+            mInfluenceWeights[slot*mNumVertices + vertexId] = weight;
+        }
+    }
+
+    if (numDropped) {
+        std::cerr << "AnimatedMesh " << mName << " : " << numDropped << " bone influences dropped" << std::endl;
+        for (int v = 0; v < mNumVertices; ++v) {
+            float sum = 0.f;
+            for (int k = 0; k < mInfluencesPerVertex; ++k)
+                sum += mInfluenceWeights[k*mNumVertices + v];
+            if (sum > 0.f)
+                for (int k = 0; k < mInfluencesPerVertex; ++k)
+                    mInfluenceWeights[k*mNumVertices + v] /= sum;
+        }
+    }
+}
+
+/**
+ * Skin the mesh on the CPU and upload it.
  */
 void AnimatedMesh::update() {
+    std::vector<AnimatedMesh *> meshes(1, this);
+    SkinningEngine engine;
+    engine.update(meshes);
+}
 
-    BBox updatedBbox;
+void AnimatedMesh::updateBonePalette() {
     //TODO
     // work with only one animation
     SkeletonGraph *skeleton = mResources->getCurrentAnimation()->getSkeleton();
+    if (skeleton != mJointsSkeleton) {
+        // resolve the joint of each bone once per skeleton
+        mBoneJoints.resize(mNumBones);
+        for (unsigned int i = 0; i < mNumBones; ++i) {
+            mBoneJoints[i] = skeleton->jointIndex(mBones[i].mName);
+            if (mBoneJoints[i] < 0)
+                std::cerr << "AnimatedMesh " << mName << " : no joint for the bone " << mBones[i].mName
+                          << ", its vertices keep their bind pose" << std::endl;
+        }
+        mJointsSkeleton = skeleton;
+    }
 
-    // new vertices
-    VertexData *animVertex = new VertexData[mNumVertices];
-    memset(animVertex, 0, mNumVertices * sizeof(VertexData));
-    // Parcours des bones
+    mBonePalette.resize(mNumBones * BONE_PALETTE_FLOATS);
     for (unsigned int i = 0; i < mNumBones; ++i) {
+        float *entry = &(mBonePalette[i * BONE_PALETTE_FLOATS]);
 
-        // get the transform matrix
-        SkeletonGraph::Node* boneNode = skeleton->getBone(mBones[i].mName);
-        assert(boneNode); // TODO check
-        if (boneNode){
-            glm::mat4x4 transformMatrix = boneNode->globalTransform();
-            glm::mat4x4 offsetMatrix = boneNode->offsetTransform();
-
-            // Calcul vect :  Vect * M_transf
-            // Calcul normal : Normal * inv( transp( M_transf )
-            // Calcul tangente : Tang * inv( transp( M_transf )
-            for (unsigned int w = 0; w < mBones[i].mNumWeights; ++w) {
-                unsigned int vertexId = mBones[i].mWeights[w].mVertexId;
-                float weight = mBones[i].mWeights[w].mWeight;
-
-                // Vertex
-                glm::vec4 vertex(mVertices[vertexId].mVertex.x,
-                                 mVertices[vertexId].mVertex.y,
-                                 mVertices[vertexId].mVertex.z,
-                                 1.0
-                );
-                vertex = transformMatrix * offsetMatrix * vertex;
-                updatedBbox += glm::vec3(vertex.x, vertex.y, vertex.z);
-                animVertex[vertexId].mVertex += glm::vec3(vertex) * weight;
-
-                // Normal
-                glm::vec4 normal(mVertices[vertexId].mNormal.x,
-                                 mVertices[vertexId].mNormal.y,
-                                 mVertices[vertexId].mNormal.z,
-                                 0.0
-                );
-                glm::mat4x4 temp = glm::inverse(glm::transpose(transformMatrix)); // opti
-
-                normal = temp * offsetMatrix * normal;
-
-                animVertex[vertexId].mNormal += glm::vec3(normal) * weight;
-
-                // Tangent
-                glm::vec4 tangent(mVertices[vertexId].mTangent.x,
-                                  mVertices[vertexId].mTangent.y,
-                                  mVertices[vertexId].mTangent.z,
-                                  0.0
-                );
-                tangent = temp * offsetMatrix * tangent;
-
-                animVertex[vertexId].mTangent += glm::vec3(tangent) * weight;
-
-                // Texture coord
-                animVertex[vertexId].mTexCoord = mVertices[vertexId].mTexCoord;
+        // Calcul vect :  M_transf * M_offset * Vect
+        // Calcul normal and tangent : inv( transp( M_transf * M_offset ) ) * Normal
+        // an unknown bone leaves its vertices in the bind pose
+        glm::mat4x4 skinning(1.f);
+        glm::mat3x3 normal(1.f);
+        if (mBoneJoints[i] >= 0) {
+            skinning = skeleton->globalTransform(mBoneJoints[i]) * mBones[i].mOffsetMatrix;
+            normal = glm::inverse(glm::transpose(glm::mat3x3(skinning)));
+        }
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 3; ++r)
+                entry[3*c + r] = skinning[c][r];
+        for (int c = 0; c < 3; ++c)
+            for (int r = 0; r < 3; ++r)
+                entry[12 + 3*c + r] = normal[c][r];
+    }
 
-            }
+    if (int(mSkinnedVertices.size()) != mNumVertices)
+        mSkinnedVertices.resize(mNumVertices);
+}
+
+void AnimatedMesh::skinVertices(int begin, int end, BBox &box) {
+    const float *palette = mNumBones ? &(mBonePalette[0]) : NULL;
+
+    for (int blockBegin = begin; blockBegin < end; blockBegin += SKINNING_BLOCK) {
+        int blockSize = std::min(SKINNING_BLOCK, end - blockBegin);
+
+        // blend the bone matrices of each vertex of the block, one matrix coefficient at a time
+        float blend[BONE_PALETTE_FLOATS][SKINNING_BLOCK];
+        for (int e = 0; e < BONE_PALETTE_FLOATS; ++e)
+            for (int v = 0; v < blockSize; ++v)
+                blend[e][v] = 0.f;
+        for (int k = 0; k < mInfluencesPerVertex && palette; ++k) {
+            const int *bones = &(mInfluenceBones[k*mNumVertices + blockBegin]);
+            const float *weights = &(mInfluenceWeights[k*mNumVertices + blockBegin]);
+            for (int e = 0; e < BONE_PALETTE_FLOATS; ++e)
+                for (int v = 0; v < blockSize; ++v)
+                    blend[e][v] += weights[v] * palette[bones[v] * BONE_PALETTE_FLOATS + e];
+        }
+
+        for (int v = 0; v < blockSize; ++v) {
+            const VertexData &in = mVertices[blockBegin + v];
+            VertexData &out = mSkinnedVertices[blockBegin + v];
+            const glm::vec3 &p = in.mVertex;
+            const glm::vec3 &n = in.mNormal;
+            const glm::vec3 &t = in.mTangent;
+            out.mVertex = glm::vec3(blend[0][v]*p.x + blend[3][v]*p.y + blend[6][v]*p.z + blend[9][v],
+                                    blend[1][v]*p.x + blend[4][v]*p.y + blend[7][v]*p.z + blend[10][v],
+                                    blend[2][v]*p.x + blend[5][v]*p.y + blend[8][v]*p.z + blend[11][v]);
+            out.mNormal = glm::vec3(blend[12][v]*n.x + blend[15][v]*n.y + blend[18][v]*n.z,
+                                    blend[13][v]*n.x + blend[16][v]*n.y + blend[19][v]*n.z,
+                                    blend[14][v]*n.x + blend[17][v]*n.y + blend[20][v]*n.z);
+            out.mTangent = glm::vec3(blend[12][v]*t.x + blend[15][v]*t.y + blend[18][v]*t.z,
+                                     blend[13][v]*t.x + blend[16][v]*t.y + blend[19][v]*t.z,
+                                     blend[14][v]*t.x + blend[17][v]*t.y + blend[20][v]*t.z);
+            out.mTexCoord = in.mTexCoord;
+            box += out.mVertex;
         }
     }
+}
+
+/**
+ * Influences are stored per vertex as (indices, weights) groups of 4, integer indices are kept as integers.
+ */
+void AnimatedMesh::setInfluenceAttributes() {
+    GLsizei stride = mInfluencesPerVertex * (sizeof(GLint) + sizeof(GLfloat));
+    glAssert( glBindBuffer(GL_ARRAY_BUFFER, mInfluenceBuffer) );
+    for (int group = 0; group < mInfluencesPerVertex / 4; ++group) {
+        GLuint index = 4 + 2*group;
+        glAssert( glVertexAttribIPointer(index, 4, GL_INT, stride, BUFFER_OFFSET(group * 4 * sizeof(GLint))) );
+        glAssert( glEnableVertexAttribArray(index) );
+        glAssert( glVertexAttribPointer(index + 1, 4, GL_FLOAT, GL_FALSE, stride,
+                                        BUFFER_OFFSET(mInfluencesPerVertex * sizeof(GLint) + group * 4 * sizeof(GLfloat))) );
+        glAssert( glEnableVertexAttribArray(index + 1) );
+    }
+}
+
+void AnimatedMesh::init() {
+    Mesh::init();
 
-    // bind vertexdata
+    // interleave the influences, the vertex array object is still bound
+    int groupSize = mInfluencesPerVertex * (sizeof(GLint) + sizeof(GLfloat));
+    std::vector<char> influences(mNumVertices * groupSize);
+    for (int v = 0; v < mNumVertices; ++v) {
+        GLint *bones = reinterpret_cast<GLint *>(&(influences[v * groupSize]));
+        GLfloat *weights = reinterpret_cast<GLfloat *>(bones + mInfluencesPerVertex);
+        for (int k = 0; k < mInfluencesPerVertex; ++k) {
+            bones[k] = mInfluenceBones[k*mNumVertices + v];
+            weights[k] = mInfluenceWeights[k*mNumVertices + v];
+        }
+    }
+    glAssert( glGenBuffers(1, &mInfluenceBuffer) );
+    glAssert( glBindBuffer(GL_ARRAY_BUFFER, mInfluenceBuffer) );
+    glAssert( glBufferData(GL_ARRAY_BUFFER, influences.size(), influences.empty() ? NULL : &(influences[0]), GL_STATIC_DRAW) );
+    setInfluenceAttributes();
+}
+
+void AnimatedMesh::release() {
+    if (mInfluenceBuffer) {
+        glAssert( glDeleteBuffers(1, &mInfluenceBuffer) );
+        mInfluenceBuffer = 0;
+    }
+    if (mPaletteTexture) {
+        mPaletteTexture->deleteGL();
+        delete mPaletteTexture;
+        mPaletteTexture = NULL;
+    }
+    Mesh::release();
+}
+
+bool AnimatedMesh::gpuSkinningSupported(int numBones) {
+    GLint maxAttributes = 0;
+    GLint maxVertexTextureUnits = 0;
+    GLint maxTexelsBuffer = 0;
+    glAssert( glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes) );
+    glAssert( glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &maxVertexTextureUnits) );
+    glAssert( glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexelsBuffer) );
+    return maxAttributes >= 8 && maxVertexTextureUnits > ShaderProgram::BONE_PALETTE_UNIT && maxTexelsBuffer >= 6 * numBones;
+}
+
+bool AnimatedMesh::setGpuSkinning(bool enable) {
+    if (enable && !gpuSkinningSupported(mNumBones)) {
+        std::cerr << "AnimatedMesh " << mName << " : GPU skinning not supported, using the CPU" << std::endl;
+        enable = false;
+    }
+    if (enable && !mGpuSkinning && mInfluenceBuffer) {
+        // the GPU path is checked once against the CPU one, a driver skinning wrongly keeps the CPU
+        float error = gpuSkinningError();
+        float tolerance = 1e-4f * glm::length(mBindBbox.getExtend());
+        if (error < 0.f || error > tolerance) {
+            std::cerr << "AnimatedMesh " << mName << " : GPU skinning error " << error << " above " << tolerance
+                      << ", using the CPU" << std::endl;
+            enable = false;
+        } else {
+            // the vertex shader skins the bind pose
+            reset();
+        }
+    }
+    mGpuSkinning = enable;
+    return mGpuSkinning;
+}
+
+void AnimatedMesh::addShaderProperties(ShaderConfiguration &configuration) const {
+    static const int gpuSkinning = ShaderConfiguration::propertyId(SkinningEngine::GPU_SKINNING_PROPERTY);
+    static const int gpuSkinning8 = ShaderConfiguration::propertyId(SkinningEngine::GPU_SKINNING_8_PROPERTY);
+    if (mGpuSkinning) {
+        configuration.addProperty(gpuSkinning);
+        if (mInfluencesPerVertex > 4)
+            configuration.addProperty(gpuSkinning8);
+    }
+}
+
+void AnimatedMesh::uploadBonePalette() {
+    if (mNumBones == 0)
+        return;
+    mGpuPalette.resize(6 * mNumBones);
+    for (unsigned int i = 0; i < mNumBones; ++i) {
+        const float *entry = &(mBonePalette[i * BONE_PALETTE_FLOATS]);
+        glm::vec4 *texels = &(mGpuPalette[6 * i]);
+        for (int r = 0; r < 3; ++r)
+            texels[r] = glm::vec4(entry[r], entry[3 + r], entry[6 + r], entry[9 + r]);
+        for (int c = 0; c < 3; ++c)
+            texels[3 + c] = glm::vec4(entry[12 + 3*c], entry[12 + 3*c + 1], entry[12 + 3*c + 2], 0.f);
+    }
+    int size = mGpuPalette.size() * sizeof(glm::vec4);
+    if (!mPaletteTexture) {
+        mPaletteTexture = new Texture(mName + "_bones", GL_TEXTURE_BUFFER);
+        mPaletteTexture->bufferInitGL(GL_RGBA32F, size, &(mGpuPalette[0]));
+    } else {
+        mPaletteTexture->bufferUpdateGL(size, &(mGpuPalette[0]));
+    }
+}
+
+void AnimatedMesh::draw() {
+    if (mGpuSkinning && mPaletteTexture)
+        mPaletteTexture->bind(ShaderProgram::BONE_PALETTE_UNIT);
+    Mesh::draw();
+}
+
+float AnimatedMesh::gpuSkinningError() {
+    if (mNumVertices == 0 || mNumBones == 0 || !mInfluenceBuffer || !gpuSkinningSupported(mNumBones))
+        return -1.f;
+
+    // CPU reference, without touching the vertex buffer
+    updateBonePalette();
+    BBox box;
+    skinVertices(0, mNumVertices, box);
+    uploadBonePalette();
+
+    // capture program : skinned positions are written to a buffer, nothing is rasterized
+    std::string source = "#version 410\n";
+    std::vector<std::string> properties;
+    properties.push_back(SkinningEngine::GPU_SKINNING_PROPERTY);
+    if (mInfluencesPerVertex > 4)
+        properties.push_back(SkinningEngine::GPU_SKINNING_8_PROPERTY);
+    for (unsigned int i = 0; i < properties.size(); ++i)
+        source += "#define " + properties[i] + "\n";
+    source += SkinningEngine::gpuShaderSource();
+    source += "in vec3 inPosition;\n"
+              "out vec3 capturedPosition;\n"
+              "void main(void) {\n"
+              "    capturedPosition = inPosition;\n"
+              "    skinPosition(capturedPosition);\n"
+              "}\n";
+    const char *code = source.c_str();
+    GLuint shader, program;
+    glAssert( shader = glCreateShader(GL_VERTEX_SHADER) );
+    glAssert( glShaderSource(shader, 1, &code, NULL) );
+    glAssert( glCompileShader(shader) );
+    glAssert( program = glCreateProgram() );
+    glAssert( glAttachShader(program, shader) );
+    glAssert( glBindAttribLocation(program, 0, "inPosition") );
+    glAssert( glBindAttribLocation(program, 4, "inBoneIndices") );
+    glAssert( glBindAttribLocation(program, 5, "inBoneWeights") );
+    glAssert( glBindAttribLocation(program, 6, "inBoneIndices2") );
+    glAssert( glBindAttribLocation(program, 7, "inBoneWeights2") );
+    const char *varyings[] = { "capturedPosition" };
+    glAssert( glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS) );
+    glAssert( glLinkProgram(program) );
+    GLint linked = 0;
+    glAssert( glGetProgramiv(program, GL_LINK_STATUS, &linked) );
+    if (!linked) {
+        std::cerr << "AnimatedMesh::gpuSkinningError : capture program not linked" << std::endl;
+        glAssert( glDeleteProgram(program) );
+        glAssert( glDeleteShader(shader) );
+        return -1.f;
+    }
+    glAssert( glProgramUniform1i(program, glGetUniformLocation(program, "uniBonePalette"), ShaderProgram::BONE_PALETTE_UNIT) );
+
+    // bind pose positions and influences, in a vertex array of our own
+    std::vector<glm::vec3> positions(mNumVertices);
+    for (int v = 0; v < mNumVertices; ++v)
+        positions[v] = mVertices[v].mVertex;
+    GLuint vertexArray, buffers[2];
+    glAssert( glGenVertexArrays(1, &vertexArray) );
+    glAssert( glBindVertexArray(vertexArray) );
+    glAssert( glGenBuffers(2, buffers) );
+    glAssert( glBindBuffer(GL_ARRAY_BUFFER, buffers[0]) );
+    glAssert( glBufferData(GL_ARRAY_BUFFER, mNumVertices * sizeof(glm::vec3), &(positions[0]), GL_STATIC_DRAW) );
+    glAssert( glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), BUFFER_OFFSET(0)) );
+    glAssert( glEnableVertexAttribArray(0) );
+    setInfluenceAttributes();
+
+    glAssert( glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffers[1]) );
+    glAssert( glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, mNumVertices * sizeof(glm::vec3), NULL, GL_STATIC_READ) );
+    glAssert( glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1]) );
+
+    mPaletteTexture->bind(ShaderProgram::BONE_PALETTE_UNIT);
+    glAssert( glUseProgram(program) );
+    glAssert( glEnable(GL_RASTERIZER_DISCARD) );
+    glAssert( glBeginTransformFeedback(GL_POINTS) );
+    glAssert( glDrawArrays(GL_POINTS, 0, mNumVertices) );
+    glAssert( glEndTransformFeedback() );
+    glAssert( glDisable(GL_RASTERIZER_DISCARD) );
+
+    glAssert( glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, mNumVertices * sizeof(glm::vec3), &(positions[0])) );
+    float error = 0.f;
+    for (int v = 0; v < mNumVertices; ++v)
+        error = std::max(error, glm::distance(positions[v], mSkinnedVertices[v].mVertex));
+
+    glAssert( glUseProgram(0) );
+    glAssert( glBindVertexArray(0) );
+    glAssert( glDeleteBuffers(2, buffers) );
+    glAssert( glDeleteVertexArrays(1, &vertexArray) );
+    glAssert( glDeleteProgram(program) );
+    glAssert( glDeleteShader(shader) );
+    return error;
+}
+
+void AnimatedMesh::uploadSkinnedVertices() {
+    if (int(mSkinnedVertices.size()) != mNumVertices)
+        return;
+    // bind vertexdata, in the layout chosen by init
+    packVertices(&(mSkinnedVertices[0]), mPackedVertices);
     glAssert( glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObjects[VBO_VERTICES]) );
     // No need to allocate buffer, just replace its content
-    glAssert( glBufferSubData(GL_ARRAY_BUFFER, 0, mNumVertices * sizeof(VertexData), animVertex) );
-
-    delete [] animVertex;
-    mBbox = updatedBbox;
+    glAssert( glBufferSubData(GL_ARRAY_BUFFER, 0, mPackedVertices.size(), &(mPackedVertices[0])) );
 }
 
 
@@ -7,9 +7,12 @@
 #ifndef ANIMATEDMESH_H
 #define ANIMATEDMESH_H
 
+#include <vector>
+
 #include "scenegraph.h"
 #include "mesh.h"
 #include "skeleton.h"
+#include "texture.h"
 
 /**
  * @author Alexandre Bonhomme
@@ -23,6 +26,11 @@ namespace vortex {
 
 class AnimatedMesh : public Mesh {
 public:
+    /**
+     * Maximum number of bones influencing a vertex. Extra influences are dropped, the remaining weights renormalized.
+     */
+    static const int MAX_INFLUENCES = 8;
+
     /**
      * Weight structure representation
      */
@@ -76,6 +84,15 @@ public:
      * @param nulBones Number of bones in "bones".
      */
     AnimatedMesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, BoneData *bones, int numBones, AssetManager *resources);
+
+    /**
+     * Constructor, the AnimatedMesh takes the ownership of the pointed data, allocated with new[], bone weights included.
+     *
+     * @param bbox Bounding box of the vertices, computed by the caller while filling them.
+     * @see Mesh::Mesh(std::string, VertexData *, int, int *, int, const BBox &)
+     */
+    AnimatedMesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, const BBox &bbox,
+                 BoneData *bones, int numBones, AssetManager *resources);
     ~AnimatedMesh();
 
     /**
@@ -85,6 +102,69 @@ public:
      */
     void update();
 
+    /**
+     * Compute the skinning and normal matrices of the bones from the current skeleton pose.
+     */
+    void updateBonePalette();
+
+    /**
+     * Skin the vertices [begin, end) into the skinned vertex buffer.
+     * Disjoint ranges may be skinned concurrently once the bone palette is up to date.
+     *
+     * @param box Extended by the skinned positions.
+     */
+    void skinVertices(int begin, int end, BBox &box);
+
+    /**
+     * Replace the vertex buffer content by the skinned vertices.
+     */
+    void uploadSkinnedVertices();
+
+    /**
+     * @return The number of influences stored per vertex : 4, or MAX_INFLUENCES if some vertex needs more
+     */
+    int influencesPerVertex() const {
+        return mInfluencesPerVertex;
+    }
+
+    /*********** GPU skinning ***********/
+    /**
+     * Skin the mesh in the vertex shader instead of on the CPU.
+     * The mesh then only uploads its bone palette each frame, and its shaders are configured with the GPU_SKINNING property :
+     * rendering loops must be rebuilt after a change. Must be called from the OpenGL thread.
+     * When enabled on an initialized mesh, the GPU path is first compared to the CPU one (see gpuSkinningError).
+     *
+     * @return true if GPU skinning is enabled, false if it was requested but is not supported or not accurate.
+     */
+    bool setGpuSkinning(bool enable);
+
+    bool gpuSkinning() const {
+        return mGpuSkinning;
+    }
+
+    /**
+     * @return true if the OpenGL implementation can skin a mesh of numBones bones in the vertex shader.
+     */
+    static bool gpuSkinningSupported(int numBones);
+
+    /**
+     * Upload the bone palette for GPU skinning.
+     */
+    void uploadBonePalette();
+
+    /**
+     * Skin the mesh with both the CPU and the GPU paths, the later through transform feedback, and compare the positions.
+     * Must be called from the OpenGL thread, works with software implementations.
+     *
+     * @return The largest distance between a CPU and a GPU skinned position, or -1 if the GPU path could not run.
+     */
+    float gpuSkinningError();
+
+    void init();
+    void release();
+    void draw();
+    void addShaderProperties(ShaderConfiguration &configuration) const;
+
     /*********** Bones ***********/
     /**
      * @return The numbers of bones
@@ -103,12 +183,45 @@ public:
     }
 
 private:
+    friend class SkinningEngine;
+
+    // skinning matrix (4x3) and normal matrix (3x3) of a bone
+    static const int BONE_PALETTE_FLOATS = 21;
+
+    void buildInfluences();
+    void setInfluenceAttributes();
 
     unsigned int mNumBones;
     BoneData *mBones;   // Bones data struct array
 
     AssetManager *mResources;
 
+    // Vertex major influences, as structure of arrays : slot k of vertex v is at k*mNumVertices + v
+    // unused slots have a null weight
+    int mInfluencesPerVertex;
+    std::vector<int> mInfluenceBones;
+    std::vector<float> mInfluenceWeights;
+
+    // Skeleton joint of each bone, resolved for mJointsSkeleton
+    SkeletonGraph *mJointsSkeleton;
+    std::vector<int> mBoneJoints;
+
+    // Per bone skinning matrix (4 columns of 3 floats) followed by its normal matrix (3 columns of 3 floats)
+    std::vector<float> mBonePalette;
+
+    // Skinning output, kept from frame to frame
+    std::vector<VertexData> mSkinnedVertices;
+    std::vector<char> mPackedVertices; // mSkinnedVertices in the layout of the vertex buffer
+
+    // GPU skinning : static influences buffer and per frame palette (3 rows of the skinning matrix, 3 columns of the normal matrix)
+    bool mGpuSkinning;
+    GLuint mInfluenceBuffer;
+    Texture *mPaletteTexture;
+    std::vector<glm::vec4> mGpuPalette;
+
+    // Bounding box of the mesh in bind pose
+    BBox mBindBbox;
+
 };
 
 } //vortex
@@ -5,24 +5,23 @@
  */
 
 #include "animation.h"
-namespace vortex {
-
-
-inline float clamp(float x, float a, float b)
 
-{
-
-    return x < a ? a : (x > b ? b : x);
+#include <fstream>
+#include <cstring>
+#include <cmath>
 
-}
+namespace vortex {
 
 Animation::Animation() :
     mDuration(0),
     mTicksPerSecond(0),
+    mCurrentTime(0.0),
     mNumChannels(0),
     mChannels(),
     mSkeleton(NULL),
-    mNumMeshNames(0)
+    mNumMeshNames(0),
+    mBakedRate(0.0),
+    mNumBakedSamples(0)
 {
 }
 
@@ -32,32 +31,26 @@ Animation::Animation(std::string name, double duration, double ticksPerSecond,
     mName(name),
     mDuration(duration),
     mTicksPerSecond(ticksPerSecond),
+    mCurrentTime(0.0),
     mNumChannels(numChannels),
     mChannels(channels),
     mSkeleton(NULL),
     mNumMeshNames(numMeshNames),
-    mMeshNames(names)
+    mMeshNames(names),
+    mBakedRate(0.0),
+    mNumBakedSamples(0)
 {
+    buildChannelMap();
 }
 
-/*
-static void print_map(const std::map<std::string, Animation::BoneAnim *>& map)
-{
-    std::map<std::string, Animation::BoneAnim*>::const_iterator it = map.begin();
-    for(; it != map.end(); ++it)
-    {
-        std::cout << "name map: " << it->first << " bone name: ";
-        std::cout << it->second->mBoneName << std::endl;
-    }
-    std::cout << std::endl;
-}
-*/
-
 /*
  * Copy feild by feild
  */
 Animation::Animation(aiAnimation *animation) :
-    mSkeleton(NULL)
+    mCurrentTime(0.0),
+    mSkeleton(NULL),
+    mBakedRate(0.0),
+    mNumBakedSamples(0)
 {
 
     mName = std::string(animation->mName.data);
@@ -79,57 +72,40 @@ Animation::Animation(aiAnimation *animation) :
         boneAnim->mBoneName = std::string(aiAnim->mNodeName.data);
 
         // Position keys
-        boneAnim->mNumPositionKeys = aiAnim->mNumPositionKeys;
-        boneAnim->mPositionKeys.resize(boneAnim->mNumPositionKeys);
-
-        for (unsigned int j = 0; j < boneAnim->mNumPositionKeys; ++j) {
-
+        boneAnim->mPositionKeys.resize(aiAnim->mNumPositionKeys);
+        for (unsigned int j = 0; j < aiAnim->mNumPositionKeys; ++j) {
             // Convertion aiVector3D to glm::vec3
-            glm::vec3 posVec(aiAnim->mPositionKeys[j].mValue.x,
-                             aiAnim->mPositionKeys[j].mValue.y,
-                             aiAnim->mPositionKeys[j].mValue.z);
-
-            boneAnim->mPositionKeys[j] = new VectorKey(aiAnim->mPositionKeys[j].mTime / mTicksPerSecond, posVec);
+            boneAnim->mPositionKeys.mTimes[j] = aiAnim->mPositionKeys[j].mTime / mTicksPerSecond;
+            boneAnim->mPositionKeys.mValues[j] = glm::vec3(aiAnim->mPositionKeys[j].mValue.x,
+                                                           aiAnim->mPositionKeys[j].mValue.y,
+                                                           aiAnim->mPositionKeys[j].mValue.z);
         }
 
         // Rotation keys
-        boneAnim->mNumRotationKeys = aiAnim->mNumRotationKeys;
-        boneAnim->mRotationKeys.resize(boneAnim->mNumRotationKeys);
-
-        for (unsigned int j = 0; j < boneAnim->mNumRotationKeys; ++j) {
-
+        boneAnim->mRotationKeys.resize(aiAnim->mNumRotationKeys);
+        for (unsigned int j = 0; j < aiAnim->mNumRotationKeys; ++j) {
             // Convertion aiQuatKey to local glm::quat representation
-
-            glm::quat quat(aiAnim->mRotationKeys[j].mValue.w,
-                           aiAnim->mRotationKeys[j].mValue.x,
-                            aiAnim->mRotationKeys[j].mValue.y,
-                            aiAnim->mRotationKeys[j].mValue.z
-                            );
-
-            boneAnim->mRotationKeys[j] = new QuatKey(aiAnim->mRotationKeys[j].mTime / mTicksPerSecond, quat);
+            boneAnim->mRotationKeys.mTimes[j] = aiAnim->mRotationKeys[j].mTime / mTicksPerSecond;
+            boneAnim->mRotationKeys.mValues[j] = glm::quat(aiAnim->mRotationKeys[j].mValue.w,
+                                                           aiAnim->mRotationKeys[j].mValue.x,
+                                                           aiAnim->mRotationKeys[j].mValue.y,
+                                                           aiAnim->mRotationKeys[j].mValue.z);
         }
 
         // Scaling keys
-        boneAnim->mNumScalingKeys = aiAnim->mNumScalingKeys;
-        boneAnim->mScalingKeys.resize(boneAnim->mNumScalingKeys);
-
-        for (unsigned int j = 0; j < boneAnim->mNumScalingKeys; ++j) {
-
+        boneAnim->mScalingKeys.resize(aiAnim->mNumScalingKeys);
+        for (unsigned int j = 0; j < aiAnim->mNumScalingKeys; ++j) {
             // Convertion aiVector3D to glm::vec3
-            glm::vec3 posVec(aiAnim->mScalingKeys[j].mValue.x,
-                             aiAnim->mScalingKeys[j].mValue.y,
-                             aiAnim->mScalingKeys[j].mValue.z);
-
-            boneAnim->mScalingKeys[j] = new VectorKey(aiAnim->mScalingKeys[j].mTime / mTicksPerSecond, posVec);
+            boneAnim->mScalingKeys.mTimes[j] = aiAnim->mScalingKeys[j].mTime / mTicksPerSecond;
+            boneAnim->mScalingKeys.mValues[j] = glm::vec3(aiAnim->mScalingKeys[j].mValue.x,
+                                                          aiAnim->mScalingKeys[j].mValue.y,
+                                                          aiAnim->mScalingKeys[j].mValue.z);
         }
 
         // Add the BoneAnim to vector
         mChannels[i] = boneAnim;
-
-        // Add to map
-        //TODO Check if any animation is UNIQUE
-        mAnimByBoneName[boneAnim->mBoneName] = boneAnim;
     }
+    buildChannelMap();
 
     // list of mesh anim name
     mNumMeshNames = animation->mNumMeshChannels;
@@ -140,181 +116,284 @@ Animation::Animation(aiAnimation *animation) :
 
 }
 
-Animation::~Animation() { }
+Animation::~Animation() {
+    for (unsigned int i = 0; i < mChannels.size(); ++i)
+        delete mChannels[i];
+}
 
+void Animation::buildChannelMap() {
+    //TODO Check if any animation is UNIQUE
+    mAnimByBoneName.clear();
+    for (unsigned int i = 0; i < mChannels.size(); ++i)
+        mAnimByBoneName[mChannels[i]->mBoneName] = i;
+}
 
 /*******************************************************/
 
+void Animation::setSkeleton(SkeletonGraph *skeleton) {
+    mSkeleton = skeleton;
+    mJointChannels.assign(skeleton ? skeleton->nJoints() : 0, -1);
+    for (unsigned int i = 0; i < mNumChannels && skeleton; ++i) {
+        int joint = skeleton->jointIndex(mChannels[i]->mBoneName);
+        if (joint >= 0)
+            mJointChannels[joint] = i;
+    }
+}
+
 void Animation::update(double time) {
     if (time >=0) {
         mCurrentTime = time;
-        updateSkeletonTransform(mSkeleton->getRoot());
+        updateSkeletonTransform();
     } else {
         std::cerr << "Set at bind pose" << std::endl;
         mCurrentTime = 0.0;
-        setAtBindPose(mSkeleton->getRoot());
+        setAtBindPose();
     }
 }
 
 /**
  * Update global transformation matrix
  */
-void Animation::updateSkeletonTransform(SkeletonGraph::Node *node) {
-    /*
-     * Update current node
-     */
-    // Calcul local transform
-    std::map<std::string, BoneAnim *>::iterator it = mAnimByBoneName.find(node->name());
-    if(it != mAnimByBoneName.end()) { // Node found
-
-        // Calcul local transform matrix with animation datas
-        // and update the matrix in the node...
-        node->setLocalTransform(computeLocalTransform(it->second));
-    }
-
-    // Calcul global transform
-    if(mSkeleton->getRoot() != node) {
-        // G * L (G: parent global, L: Child local)
-        node->setGlobalTransform( node->parent()->globalTransform() * node->localTransform() );
-
-    } else {
-        // Root node
-        // global == local
-        node->setGlobalTransform(node->localTransform());
-    }
+void Animation::updateSkeletonTransform() {
+    double time = mCurrentTime;
+    if(mDuration > 0.0)
+        time = fmod(time, mDuration);
 
-    /*
-     * Recursive update
-     */
-    for(unsigned int i = 0; i < node->nChilds(); ++i) {
-        updateSkeletonTransform(node->child(i));
+    // Calcul local transform matrix of the animated joints with animation datas
+    for (unsigned int j = 0; j < mJointChannels.size(); ++j) {
+        if (mJointChannels[j] >= 0)
+            mSkeleton->setLocalTransform(j, computeLocalTransform(mJointChannels[j], float(time)));
     }
+    mSkeleton->updateGlobalTransforms();
 }
 
 /**
  * Update global transformation matrix
  */
-void Animation::setAtBindPose(SkeletonGraph::Node *node) {
-    /*
-     * Update current node
-     */
-    // Calcul local transform
-    std::map<std::string, BoneAnim *>::iterator it = mAnimByBoneName.find(node->name());
-    if(it != mAnimByBoneName.end()) { // Node found
-
-        // Calcul local transform matrix with animation datas
-        // and update the matrix in the node...
-        node->setLocalTransform(node->bindTransform());
+void Animation::setAtBindPose() {
+    for (unsigned int j = 0; j < mJointChannels.size(); ++j) {
+        if (mJointChannels[j] >= 0)
+            mSkeleton->setLocalTransform(j, mSkeleton->bindTransform(j));
     }
+    mSkeleton->updateGlobalTransforms();
+}
 
-    // Calcul global transform
-    if(mSkeleton->getRoot() != node) {
-        // G * L (G: parent global, L: Child local)
-        node->setGlobalTransform(node->parent()->globalTransform() * node->localTransform());
+namespace {
 
-    } else {
-        // Root node
-        // global == local
-        node->setGlobalTransform(node->localTransform());
-    }
+glm::vec3 sampleTrack(Animation::KeyTrack<glm::vec3> &track, float time, const glm::vec3 &defaultValue) {
+    if (track.size() == 0)
+        return defaultValue;
+    float factor;
+    unsigned int key = track.findKey(time, factor);
+    if (factor == 0.f)
+        return track.mValues[key];
+    return (1.f - factor) * track.mValues[key] + factor * track.mValues[key + 1];
+}
+
+glm::quat sampleTrack(Animation::KeyTrack<glm::quat> &track, float time) {
+    if (track.size() == 0)
+        return glm::quat();
+    float factor;
+    unsigned int key = track.findKey(time, factor);
+    if (factor == 0.f)
+        return track.mValues[key];
+    return glm::slerp(track.mValues[key], track.mValues[key + 1], factor);
+}
 
-    /*
-     * Recursive update
-     */
-    for(unsigned int i = 0; i < node->nChilds(); ++i) {
-        setAtBindPose(node->child(i));
-    }
 }
 
 /**
  * Calcul local tranformation matrix of a bone
  */
-glm::mat4x4 Animation::computeLocalTransform(BoneAnim *channel) {
+glm::mat4x4 Animation::computeLocalTransform(unsigned int channel, float time) {
+    glm::vec3 p, s;
+    glm::quat q;
+    if (mNumBakedSamples) {
+        // interpolate the two nearest samples
+        float x = time * mBakedRate;
+        unsigned int sample = std::min((unsigned int)std::max(x, 0.f), mNumBakedSamples - 1);
+        unsigned int next = std::min(sample + 1, mNumBakedSamples - 1);
+        float factor = std::min(std::max(x - sample, 0.f), 1.f);
+        unsigned int base = channel * mNumBakedSamples;
+        p = (1.f - factor) * mBakedPositions[base + sample] + factor * mBakedPositions[base + next];
+        q = glm::slerp(mBakedRotations[base + sample], mBakedRotations[base + next], factor);
+        s = (1.f - factor) * mBakedScalings[base + sample] + factor * mBakedScalings[base + next];
+    } else {
+        BoneAnim *anim = mChannels[channel];
+        p = sampleTrack(anim->mPositionKeys, time, glm::vec3(0.f));
+        q = sampleTrack(anim->mRotationKeys, time);
+        // TODO : try logarithmic interpolation
+        s = sampleTrack(anim->mScalingKeys, time, glm::vec3(1.f));
+    }
+
+    glm::mat4x4 rotationMatrix(glm::mat3_cast(q));
+    glm::mat4x4 positionMatrix = glm::translate(glm::mat4(1.f), p);
+    glm::mat4x4 scaleMatrix = glm::scale(glm::mat4(1.f), s);
 
-    // Calcul du numéro de la frame
-    unsigned int frame = 0; // Frame dans l'animation
+    // Calcule de la matrice de transformation
+    glm::mat4x4 transformMatrix = positionMatrix * rotationMatrix * scaleMatrix; // MATHIAS
 
-    float timeRemains=0.0;
-#define TIME
-#ifdef TIME
-    float time = mCurrentTime;
-    if(mDuration > 0.0)
-        time = fmod(time, mDuration);
-#endif
+    return transformMatrix;
+}
+
+void Animation::bake(double samplesPerSecond) {
+    mBakedPositions.clear();
+    mBakedRotations.clear();
+    mBakedScalings.clear();
+    mNumBakedSamples = 0;
+    mBakedRate = 0.0;
+    if (samplesPerSecond <= 0.0)
+        return;
+
+    unsigned int numSamples = (unsigned int)(std::ceil(mDuration * samplesPerSecond)) + 1;
+    mBakedPositions.resize(mNumChannels * numSamples);
+    mBakedRotations.resize(mNumChannels * numSamples);
+    mBakedScalings.resize(mNumChannels * numSamples);
+    for (unsigned int c = 0; c < mNumChannels; ++c) {
+        // monotonic sampling : the key cursors make it linear in the number of keys
+        BoneAnim *anim = mChannels[c];
+        for (unsigned int i = 0; i < numSamples; ++i) {
+            float time = float(i / samplesPerSecond);
+            mBakedPositions[c*numSamples + i] = sampleTrack(anim->mPositionKeys, time, glm::vec3(0.f));
+            mBakedRotations[c*numSamples + i] = sampleTrack(anim->mRotationKeys, time);
+            mBakedScalings[c*numSamples + i] = sampleTrack(anim->mScalingKeys, time, glm::vec3(1.f));
+        }
+    }
+    mBakedRate = samplesPerSecond;
+    mNumBakedSamples = numSamples;
+}
+
+/*******************************************************/
+
+namespace {
+
+const char ANIMATION_MAGIC[4] = {'V', 'X', 'A', 'N'};
+const unsigned int ANIMATION_VERSION = 1;
 
-    //@TODO Interpolation des position
+}
+
+void Animation::write(BinaryWriter &writer) const {
+    writer.write(mName);
+    writer.write(mDuration);
+    writer.write(mTicksPerSecond);
+
+    writer.write(mNumMeshNames);
+    for (unsigned int i = 0; i < mNumMeshNames; ++i)
+        writer.write(mMeshNames[i]);
+
+    writer.write(mNumChannels);
+    for (unsigned int i = 0; i < mNumChannels; ++i) {
+        const BoneAnim *anim = mChannels[i];
+        writer.write(anim->mBoneName);
+        writer.write(anim->mPositionKeys.mTimes);
+        writer.write(anim->mPositionKeys.mValues);
+        writer.write(anim->mRotationKeys.mTimes);
+        writer.write(anim->mRotationKeys.mValues);
+        writer.write(anim->mScalingKeys.mTimes);
+        writer.write(anim->mScalingKeys.mValues);
+    }
 
-    /******* Rotation *******/
+    writer.write(mBakedRate);
+    writer.write(mNumBakedSamples);
+    writer.write(mBakedPositions);
+    writer.write(mBakedRotations);
+    writer.write(mBakedScalings);
+}
 
-#ifdef TIME
-    //@TODO cleanup clamp, timeRemains should stay between 0 1 but if frame = 0 there is an hitch -> mTime for first frame is not necessary 0.
-    frame = 0;
-    while( frame < channel->mNumRotationKeys - 1)
-    {
-        if( time < channel->mRotationKeys[frame+1]->mTime)
-            break;
-        frame++;
+Animation *Animation::read(BinaryReader &reader) {
+    Animation *animation = new Animation();
+    reader.read(animation->mName);
+    reader.read(animation->mDuration);
+    reader.read(animation->mTicksPerSecond);
+
+    // counts are checked against the buffer size before allocating
+    bool consistent = true;
+    reader.read(animation->mNumMeshNames);
+    consistent = animation->mNumMeshNames <= reader.size();
+    for (unsigned int i = 0; i < animation->mNumMeshNames && consistent && !reader.error(); ++i) {
+        animation->mMeshNames.push_back(std::string());
+        reader.read(animation->mMeshNames.back());
     }
-    timeRemains = (channel->mRotationKeys[(frame+1)%channel->mNumRotationKeys]->mTime - time) /
-                  (channel->mRotationKeys[(frame+1)%channel->mNumRotationKeys]->mTime - channel->mRotationKeys[frame]->mTime);
-    timeRemains = clamp(timeRemains, 0.f, 1.f);
-#endif
-
-    glm::quat q0;
-    glm::quat q1;
-    q0 = channel->mRotationKeys[frame]->mValue;
-    q1 = channel->mRotationKeys[(frame+1)%channel->mNumRotationKeys]->mValue;
-    glm::quat q = glm::slerp(q0, q1, 1.f-timeRemains);
-
-    glm::mat3x3 kRotation;
-    kRotation = glm::mat3_cast(q);
-    glm::mat4x4 rotationMatrix(kRotation);
-
-    /******* Position *******/
-#ifdef TIME
-    frame = 0;
-    while( frame < channel->mNumPositionKeys - 1)
-    {
-        if( time < channel->mPositionKeys[frame+1]->mTime)
-            break;
-        frame++;
+
+    unsigned int numChannels = 0;
+    reader.read(numChannels);
+    for (unsigned int i = 0; i < numChannels && consistent && !reader.error(); ++i) {
+        BoneAnim *anim = new BoneAnim();
+        animation->mChannels.push_back(anim);
+        reader.read(anim->mBoneName);
+        reader.read(anim->mPositionKeys.mTimes);
+        reader.read(anim->mPositionKeys.mValues);
+        reader.read(anim->mRotationKeys.mTimes);
+        reader.read(anim->mRotationKeys.mValues);
+        reader.read(anim->mScalingKeys.mTimes);
+        reader.read(anim->mScalingKeys.mValues);
+        if (anim->mPositionKeys.mTimes.size() != anim->mPositionKeys.mValues.size() ||
+            anim->mRotationKeys.mTimes.size() != anim->mRotationKeys.mValues.size() ||
+            anim->mScalingKeys.mTimes.size() != anim->mScalingKeys.mValues.size())
+            consistent = false;
     }
-    timeRemains = (channel->mPositionKeys[(frame+1)%channel->mNumPositionKeys]->mTime - time) /
-                  (channel->mPositionKeys[(frame+1)%channel->mNumPositionKeys]->mTime - channel->mPositionKeys[frame]->mTime);
-    timeRemains = clamp(timeRemains, 0.f, 1.f);
-#endif
-    glm::vec3 p0 = channel->mPositionKeys[frame]->mValue;
-    glm::vec3 p1 = channel->mPositionKeys[(frame+1)%channel->mNumPositionKeys]->mValue;
-    glm::vec3 p = timeRemains*p0 + (1.0f-timeRemains)*p1;
-    //p=p0;
-    glm::mat4x4 positionMatrix = glm::translate(glm::mat4(1.f), p );
-
-    /******* Scale *******/
-#ifdef TIME
-    frame = 0;
-    while( frame < channel->mNumScalingKeys - 1)
-    {
-        if( time < channel->mScalingKeys[frame+1]->mTime)
-            break;
-        frame++;
+    animation->mNumChannels = animation->mChannels.size();
+
+    reader.read(animation->mBakedRate);
+    reader.read(animation->mNumBakedSamples);
+    reader.read(animation->mBakedPositions);
+    reader.read(animation->mBakedRotations);
+    reader.read(animation->mBakedScalings);
+
+    unsigned int numBaked = animation->mNumChannels * animation->mNumBakedSamples;
+    if (reader.error() || !consistent || animation->mNumChannels != numChannels ||
+        animation->mBakedPositions.size() != numBaked || animation->mBakedRotations.size() != numBaked ||
+        animation->mBakedScalings.size() != numBaked) {
+        delete animation;
+        return NULL;
     }
-    timeRemains = (channel->mScalingKeys[(frame+1)%channel->mNumScalingKeys]->mTime - time) /
-                  (channel->mScalingKeys[(frame+1)%channel->mNumScalingKeys]->mTime - channel->mScalingKeys[frame]->mTime);
-    timeRemains = clamp(timeRemains, 0.f, 1.f);
-#endif
-    // TODO : try logarithmic interpolation
-    glm::vec3 s0 = channel->mScalingKeys[frame]->mValue;
-    glm::vec3 s1 = channel->mScalingKeys[(frame+1)%channel->mNumScalingKeys]->mValue;
-    glm::vec3 s = timeRemains*s0 + (1.0f-timeRemains)*s1; // channel->mPositionKeys[frame]->mValue
-
-    //s = s0;
-    glm::mat4x4 scaleMatrix = glm::scale(glm::mat4(1.f), s);
+    animation->buildChannelMap();
+    return animation;
+}
 
-    // Calcule de la matrice de transformation
-    glm::mat4x4 transformMatrix = positionMatrix * rotationMatrix * scaleMatrix; // MATHIAS
+bool Animation::save(const std::string &fileName) const {
+    BinaryWriter writer;
+    writer.write(ANIMATION_MAGIC, 4);
+    writer.write(ANIMATION_VERSION);
+    write(writer);
 
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+    if (!file) {
+        std::cerr << "Animation::save : could not open " << fileName << std::endl;
+        return false;
+    }
+    file.write(&(writer.mBuffer[0]), writer.mBuffer.size());
+    return bool(file);
+}
 
-    return transformMatrix;
+Animation *Animation::load(const std::string &fileName) {
+    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+        std::cerr << "Animation::load : could not open " << fileName << std::endl;
+        return NULL;
+    }
+    file.seekg(0, std::ios::end);
+    std::vector<char> buffer(size_t(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    if (buffer.empty() || !file.read(&(buffer[0]), buffer.size())) {
+        std::cerr << "Animation::load : could not read " << fileName << std::endl;
+        return NULL;
+    }
+
+    BinaryReader reader(&(buffer[0]), buffer.size());
+    char magic[4];
+    unsigned int version = 0;
+    reader.read(magic, 4);
+    reader.read(version);
+    if (reader.error() || memcmp(magic, ANIMATION_MAGIC, 4) || version != ANIMATION_VERSION) {
+        std::cerr << "Animation::load : " << fileName << " is not an animation file" << std::endl;
+        return NULL;
+    }
+
+    Animation *animation = read(reader);
+    if (!animation)
+        std::cerr << "Animation::load : " << fileName << " is corrupted" << std::endl;
+    return animation;
 }
 
 } // namespace vortex
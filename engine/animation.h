@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 
 #include "opengl.h"
 
@@ -18,6 +19,7 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include "skeleton.h"
+#include "binarystream.h"
 
 namespace vortex {
 
@@ -25,32 +27,54 @@ class Animation {
 
 public:
 
-    struct VectorKey {
-        double mTime;
-        glm::vec3 mValue;
-
-        // Default constructor
-        VectorKey() { }
+    /**
+     * Keys of an animated value, stored as contiguous arrays of times (in seconds) and values.
+     * A cursor keeps the last interval found : monotonic playback finds its keys in constant time,
+     * seeks fall back to a binary search.
+     */
+    template <typename T>
+    struct KeyTrack {
+        std::vector<float> mTimes;
+        std::vector<T> mValues;
+        unsigned int mCursor;
 
-        // Construction from a given time and key value
-        VectorKey(double time, const glm::vec3 &value) :
-            mTime(time),
-            mValue(value)
-        { }
-    };
+        KeyTrack() : mCursor(0) { }
 
-    struct QuatKey {
-        double mTime;
-        glm::quat mValue;
+        unsigned int size() const {
+            return mTimes.size();
+        }
 
-        // Default constructor
-        QuatKey() { }
+        void resize(unsigned int numKeys) {
+            mTimes.resize(numKeys);
+            mValues.resize(numKeys);
+            mCursor = 0;
+        }
 
-        // Construction from a given time and key value
-        QuatKey(double time, const glm::quat &value) :
-            mTime(time),
-            mValue(value)
-        { }
+        /**
+         * Find the keys surrounding a time, the track must not be empty.
+         * Before the first key and after the last one, the end key is held.
+         *
+         * @param factor Interpolation factor from the returned key to the next one.
+         * @return The index of the key starting the interval containing time.
+         */
+        unsigned int findKey(float time, float &factor) {
+            unsigned int n = mTimes.size();
+            factor = 0.f;
+            if (n < 2 || time <= mTimes[0])
+                return 0;
+            if (time >= mTimes[n - 1])
+                return n - 1;
+            if (mCursor + 1 >= n || time < mTimes[mCursor]) {
+                mCursor = std::upper_bound(mTimes.begin(), mTimes.end(), time) - mTimes.begin() - 1;
+            } else if (time >= mTimes[mCursor + 1]) {
+                // playback usually moves to the next interval
+                ++mCursor;
+                if (time >= mTimes[mCursor + 1])
+                    mCursor = std::upper_bound(mTimes.begin() + mCursor, mTimes.end(), time) - mTimes.begin() - 1;
+            }
+            factor = (time - mTimes[mCursor]) / (mTimes[mCursor + 1] - mTimes[mCursor]);
+            return mCursor;
+        }
     };
 
     /**
@@ -59,22 +83,20 @@ public:
     struct BoneAnim {
         std::string mBoneName;
 
-        unsigned int mNumPositionKeys;
-        std::vector<VectorKey *> mPositionKeys;
-
-        unsigned int mNumRotationKeys;
-        std::vector<QuatKey *> mRotationKeys;
-
-        unsigned int mNumScalingKeys;
-        std::vector<VectorKey *> mScalingKeys;
+        KeyTrack<glm::vec3> mPositionKeys;
+        KeyTrack<glm::quat> mRotationKeys;
+        KeyTrack<glm::vec3> mScalingKeys;
 
         // Default constructors
-        BoneAnim() : mNumPositionKeys(0), mNumRotationKeys(0), mNumScalingKeys(0) { }
+        BoneAnim() { }
         ~BoneAnim() { }
     };
 
     // Default constructors
     Animation();
+    /**
+     * Constructor, the animation takes the ownership of the channels
+     */
     Animation(std::string name, double duration, double ticksPerSecond,
               unsigned int numChannels, std::vector<BoneAnim *> channels,
               unsigned int numMeshNames, std::vector<std::string> names);
@@ -123,12 +145,10 @@ public:
     }
 
     /**
-     * Set the skeleton of the animation
-     * @param skeleton The skeleton
+     * Set the skeleton of the animation and resolve the joint of each channel
+     * @param skeleton The skeleton, flattened by buildBonesMap
      */
-    void setSkeleton(SkeletonGraph *skeleton) {
-        mSkeleton = skeleton;
-    }
+    void setSkeleton(SkeletonGraph *skeleton);
 
     /**
      * @return The skeleton root
@@ -150,9 +170,9 @@ public:
      * @return Animation attached to the bone
      */
     BoneAnim* getAnimByBoneName(std::string boneName) {
-        std::map<std::string, BoneAnim *>::iterator it = mAnimByBoneName.find(boneName);
+        std::map<std::string, unsigned int>::iterator it = mAnimByBoneName.find(boneName);
         if(it != mAnimByBoneName.end()) {
-            return it->second;
+            return mChannels[it->second];
         } else {
             return NULL;
         }
@@ -164,12 +184,47 @@ public:
      */
     void update(double time);
 
+    /**
+     * Sample all the channels at a fixed rate. Sampling then interpolates the two nearest samples
+     * instead of searching the keys.
+     * @param samplesPerSecond Sampling rate, 0 removes the samples.
+     */
+    void bake(double samplesPerSecond);
+
+    bool isBaked() const {
+        return mNumBakedSamples > 0;
+    }
+
+    /**
+     * Save the animation to a binary file, in the native byte order. The skeleton is not saved.
+     * @return false if the file could not be written
+     */
+    bool save(const std::string &fileName) const;
+
+    /**
+     * Load an animation saved by save(), the file is read at once.
+     * @return The animation, without skeleton, or NULL if the file could not be read
+     */
+    static Animation *load(const std::string &fileName);
+
+    /**
+     * Append the animation to a binary stream, as save() does without the file header.
+     */
+    void write(BinaryWriter &writer) const;
+
+    /**
+     * Read an animation appended by write().
+     * @return The animation, without skeleton, or NULL if the stream is corrupted
+     */
+    static Animation *read(BinaryReader &reader);
+
 private:
 
-    void updateSkeletonTransform(SkeletonGraph::Node *node);
-    void setAtBindPose(SkeletonGraph::Node *node);
+    void updateSkeletonTransform();
+    void setAtBindPose();
 
-    glm::mat4x4 computeLocalTransform(BoneAnim *channel);
+    glm::mat4x4 computeLocalTransform(unsigned int channel, float time);
+    void buildChannelMap();
 
     // Name of animation (may be empty)
     std::string mName;
@@ -190,13 +245,23 @@ private:
     // Skeleton of animation
     SkeletonGraph *mSkeleton;
 
-    // Map of anim by bone name
-    std::map<std::string, BoneAnim *> mAnimByBoneName;
+    // Channel animating each joint of the skeleton, -1 for none
+    std::vector<int> mJointChannels;
+
+    // Map of channel index by bone name
+    std::map<std::string, unsigned int> mAnimByBoneName;
 
     // list of name mesh
     unsigned int mNumMeshNames;
     std::vector<std::string> mMeshNames;
 
+    // Baked samples, sample s of channel c is at c*mNumBakedSamples + s
+    double mBakedRate;
+    unsigned int mNumBakedSamples;
+    std::vector<glm::vec3> mBakedPositions;
+    std::vector<glm::quat> mBakedRotations;
+    std::vector<glm::vec3> mBakedScalings;
+
 };
 
 } // namespace vortex
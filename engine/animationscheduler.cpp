@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "animationscheduler.h"
+
+#include <map>
+
+#include "timer.h"
+
+namespace vortex {
+
+AnimationScheduler::AnimationScheduler() : mTime(0.)
+{
+}
+
+void AnimationScheduler::evaluate(const std::vector<Animation *> &animations, const std::vector<AnimatedMesh *> &meshes, double time)
+{
+    Timer timer;
+    timer.start();
+
+    // group the animations by skeleton, keeping their order inside a group
+    std::map<SkeletonGraph *, std::vector<Animation *> > bySkeleton;
+    std::vector<SkeletonGraph *> skeletons;
+    for (unsigned int i = 0; i < animations.size(); ++i) {
+        SkeletonGraph *skeleton = animations[i]->getSkeleton();
+        if (!skeleton)
+            continue;
+        std::vector<Animation *> &group = bySkeleton[skeleton];
+        if (group.empty())
+            skeletons.push_back(skeleton);
+        group.push_back(animations[i]);
+    }
+    mAnimations.clear();
+    mGroups.clear();
+    for (unsigned int s = 0; s < skeletons.size(); ++s) {
+        mGroups.push_back(mAnimations.size());
+        const std::vector<Animation *> &group = bySkeleton[skeletons[s]];
+        mAnimations.insert(mAnimations.end(), group.begin(), group.end());
+    }
+    mGroups.push_back(mAnimations.size());
+    mTime = time;
+
+    parallelFor(0, skeletons.size(), *this, 1);
+
+    timer.stop();
+    mTiming.mPoseTime = timer.value();
+    mTiming.mNumPoses = skeletons.size();
+
+    timer.reset();
+    timer.start();
+    mSkinningEngine.skin(meshes);
+    timer.stop();
+    mTiming.mSkinTime = timer.value();
+    mTiming.mNumMeshes = meshes.size();
+}
+
+void AnimationScheduler::operator()(int begin, int end)
+{
+    for (int g = begin; g < end; ++g)
+        for (int i = mGroups[g]; i < mGroups[g + 1]; ++i)
+            mAnimations[i]->update(mTime);
+}
+
+void AnimationScheduler::upload(const std::vector<AnimatedMesh *> &meshes)
+{
+    Timer timer;
+    timer.start();
+    mSkinningEngine.upload(meshes);
+    timer.stop();
+    mTiming.mUploadTime = timer.value();
+}
+
+std::ostream & operator << (std::ostream &out, const AnimationScheduler::Timing &timing)
+{
+    out << "Animation : " << timing.mNumPoses << " poses in " << timing.mPoseTime*1000. << " ms, "
+        << timing.mNumMeshes << " meshes skinned in " << timing.mSkinTime*1000. << " ms, uploaded in "
+        << timing.mUploadTime*1000. << " ms" << std::endl;
+    return out;
+}
+
+} // namespace vortex
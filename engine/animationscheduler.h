@@ -0,0 +1,76 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef ANIMATIONSCHEDULER_H
+#define ANIMATIONSCHEDULER_H
+
+#include <vector>
+#include <iostream>
+
+#include "animation.h"
+#include "animatedmesh.h"
+#include "skinning.h"
+#include "parallel.h"
+
+namespace vortex {
+
+/**
+ * Frame update of the animations and the animated meshes.
+ * The skeleton poses are evaluated in parallel, then all the meshes are skinned in parallel, without any OpenGL call.
+ * The upload of the skinned meshes is a separate phase, run on the OpenGL thread.
+ */
+class AnimationScheduler : private ParallelLoop {
+public:
+    /**
+     * Duration of the phases of the last frame, in seconds
+     */
+    struct Timing {
+        Timing() : mPoseTime(0.), mSkinTime(0.), mUploadTime(0.), mNumPoses(0), mNumMeshes(0) {}
+
+        double mPoseTime;
+        double mSkinTime;
+        double mUploadTime;
+        int mNumPoses;
+        int mNumMeshes;
+    };
+
+    AnimationScheduler();
+
+    /**
+     * Evaluate the animations at a time, then skin the meshes in the new poses. No OpenGL call is made.
+     * Animations sharing a skeleton are evaluated in order, so that the last one sets the pose, as a serial update would.
+     *
+     * @param time Time in seconds, negative to set the skeletons at bind pose.
+     */
+    void evaluate(const std::vector<Animation *> &animations, const std::vector<AnimatedMesh *> &meshes, double time);
+
+    /**
+     * Upload the skinned meshes, or their bone palettes when skinned on the GPU. Must be called from the OpenGL thread.
+     */
+    void upload(const std::vector<AnimatedMesh *> &meshes);
+
+    const Timing &timing() const {
+        return mTiming;
+    }
+
+private:
+    /** Evaluate the skeletons [begin, end) */
+    void operator()(int begin, int end);
+
+    // animations grouped by skeleton, group g is [mGroups[g], mGroups[g+1])
+    std::vector<Animation *> mAnimations;
+    std::vector<int> mGroups;
+    double mTime;
+
+    SkinningEngine mSkinningEngine;
+    Timing mTiming;
+};
+
+std::ostream & operator << (std::ostream &out, const AnimationScheduler::Timing &timing);
+
+} // namespace vortex
+
+#endif // ANIMATIONSCHEDULER_H
@@ -6,16 +6,67 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
 
 #include "assetmanager.h"
+#include "binarystream.h"
+#include "parallel.h"
+#include "timer.h"
 
 namespace vortex {
 
+namespace {
+
+const char PROGRAM_CACHE_MAGIC[4] = {'V', 'X', 'P', 'B'};
+// version 2 : source length of each stage, fully mixing hash
+const unsigned int PROGRAM_CACHE_VERSION = 2;
+
+struct ShaderStage {
+    ShaderConfiguration::ShaderType mType;
+    GLenum mGLType;
+};
+
+// in the order of the ShaderObjects of the programs
+const ShaderStage SHADER_STAGES[] = {
+    { ShaderConfiguration::VERTEX_SHADER, GL_VERTEX_SHADER },
+    { ShaderConfiguration::FRAGMENT_SHADER, GL_FRAGMENT_SHADER },
+    { ShaderConfiguration::GEOMETRY_SHADER, GL_GEOMETRY_SHADER }
+};
+
+}
+
+/**
+ * Read the sources of the programs to warm up
+ */
+class AssetManager::ProgramSourceReader : public ParallelLoop {
+public:
+    ProgramSourceReader(const AssetManager *assetManager, std::vector<AssetManager::ProgramSource> &sources) :
+        mAssetManager(assetManager), mSources(sources) {}
+
+    void operator()(int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            mAssetManager->readProgramSource(mSources[i]);
+    }
+
+private:
+    const AssetManager *mAssetManager;
+    std::vector<AssetManager::ProgramSource> &mSources;
+};
+
 AssetManager::AssetManager() : mDefaultShaderProgram(NULL),
     mDefaultTexture(NULL),
+    mAsyncTextures(true),
     mDefaultMaterial(NULL),
     mNumAnimations(0),
-    mNumAnimatedMeshs(0)
+    mNumAnimatedMeshs(0),
+    mProgramBinaries(false),
+    mProgramsFromCache(0),
+    mProgramsCompiled(0),
+    mProgramBuildTime(0.)
 {
     mDefaultMaterial = new Material("default");
     mVertFileExt = std::string(".vert");
@@ -27,6 +78,10 @@ AssetManager::~AssetManager()
     for (unsigned int i = 0; i < mTextures.size(); ++i) {
         mTextures[i]->deleteGL();
     }
+    if (mDefaultTexture) {
+        mDefaultTexture->deleteGL();
+        delete mDefaultTexture;
+    }
     for (unsigned int i = 0; i < mMaterials.size(); ++i) {
         delete mMaterials[i];
     }
@@ -56,7 +111,21 @@ int AssetManager::addTexture(std::string fileName)
             fileName.replace (found,  1,  "/");
 
         std::string textureFile = mFolder + fileName;
-        Texture * theTexture = Texture::loadFromImage(textureFile);
+        Texture * theTexture;
+        if (mAsyncTextures) {
+            if (!mDefaultTexture) {
+                // white, so that the placeholder does not change the material colors
+                unsigned char white[4*4];
+                memset(white, 255, sizeof(white));
+                mDefaultTexture = new Texture("default", GL_TEXTURE_2D);
+                mDefaultTexture->initGL(GL_RGBA, 2, 2, GL_RGBA, GL_UNSIGNED_BYTE, white);
+            }
+            theTexture = new Texture(textureFile, GL_TEXTURE_2D);
+            theTexture->setPlaceholder(mDefaultTexture);
+            mTextureLoader.load(theTexture, textureFile);
+        } else {
+            theTexture = Texture::loadFromImage(textureFile);
+        }
 
         mTextures.push_back(theTexture);
         int pos = mTextures.size() - 1;
@@ -65,9 +134,15 @@ int AssetManager::addTexture(std::string fileName)
     }
 }
 
-int AssetManager::addShaderProgram(ShaderProgram *program)
+bool AssetManager::uploadTextures(int byteBudget)
+{
+    return mTextureLoader.upload(byteBudget);
+}
+
+int AssetManager::addShaderProgram(ShaderProgram *program, uint64_t key)
 {
     mShaderProgram.push_back(program);
+    mProgramKeys.push_back(key);
     return mShaderProgram.size() - 1;
 }
 
@@ -80,6 +155,7 @@ unsigned int AssetManager::numMeshs() const
 void AssetManager::addMesh(Mesh::MeshPtr themesh){
     themesh->setMeshId(mMeshs.size());
     mMeshs.push_back(themesh);
+    mLodGenerator.generate(themesh);
 }
 
 Mesh::MeshPtr AssetManager::getMesh(unsigned int meshId) {
@@ -90,11 +166,11 @@ Mesh::MeshPtr AssetManager::getMesh(unsigned int meshId) {
 int AssetManager::addShaderProgram(std::string fileName){
     std::string shaderFile = mShaderBasePath + fileName;
     ShaderConfiguration programConfiguration(ShaderConfiguration::DEFAULT, shaderFile);
-    ShaderProgram *theProgram = getShaderProgram(programConfiguration);
-    if (theProgram) {
-        std::map<ShaderConfiguration , int>::iterator it = mConfiguredPrograms.find(programConfiguration);
-        return it->second;
-    }
+    getShaderProgram(programConfiguration);
+    // not found if the compilation failed
+    int *index = mConfiguredPrograms.find(programConfiguration);
+    if (index)
+        return *index;
     else
         return -1;
 }
@@ -125,63 +201,27 @@ ShaderProgram *AssetManager::getShaderProgram(int index) const
 ShaderProgram *AssetManager::getShaderProgram(const ShaderConfiguration &configuration)
 {
 
-    /// @todo use std::pair<iterator, bool> map.insert(...) instead of find + =
-    std::map<ShaderConfiguration, int>::iterator it = mConfiguredPrograms.find(configuration);
+    int *index = mConfiguredPrograms.find(configuration);
 
-    if (it == mConfiguredPrograms.end()) {
+    if (!index) {
         // Shader non existant, l'ajouter
-        std::stringstream defineString;
-        for (int i = 0; i < configuration.numProperties(); ++i) {
-            defineString << "#define " << configuration.getPropertyName(i) << "\n";
-        }
-
-        for (int i = 0; i < configuration.numDefaultProperties(); ++i) {
-            defineString << "#define " << configuration.getDefaultPropertyName(i) << "\n";
-        }
-        ShaderProgram *theProgram = new ShaderProgram();
-        theProgram->setConfiguration(configuration);
-        theProgram->create();
-
-        int shadersOK = 0;
-        std::string shaderFile =  configuration.getProgramName();
-        if (configuration.getType() & ShaderConfiguration::VERTEX_SHADER) {
-            ShaderObject *vs = new ShaderObject;
-            vs->create(GL_VERTEX_SHADER);
-            vs->configure(defineString.str());
-            vs->load(shaderFile + mVertFileExt);
-            vs->compile();
-            shadersOK = vs->check();
-            theProgram->add(vs);
-        }
-        if (configuration.getType() & ShaderConfiguration::FRAGMENT_SHADER) {
-            ShaderObject *fs = new ShaderObject;
-            fs->create(GL_FRAGMENT_SHADER);
-            fs->configure(defineString.str());
-            fs->load(shaderFile + mFragFileExt);
-            fs->compile();
-            shadersOK = shadersOK && fs->check();
-            theProgram->add(fs);
-        }
-
-        if (configuration.getType() & ShaderConfiguration::GEOMETRY_SHADER) {
-            ShaderObject *gs = new ShaderObject;
-            gs->create(GL_GEOMETRY_SHADER);
-            gs->configure(defineString.str());
-            gs->load(shaderFile + ".glsl"); // use this extension to have syntaxic coloration and differentiate shaders
-            gs->compile();
-            shadersOK = shadersOK && gs->check();
-            theProgram->add(gs);
-        }
-
-        theProgram->link();
-        shadersOK = shadersOK && theProgram->check();
+        Timer buildTimer;
+        buildTimer.start();
+        initProgramCache();
+        ProgramSource source;
+        source.mConfiguration = configuration;
+        readProgramSource(source);
+        ShaderProgram *theProgram = createProgram(source);
+        bool shadersOK = finishProgram(source, theProgram);
+        buildTimer.stop();
+        mProgramBuildTime += buildTimer.value();
         if (shadersOK) {
-            //           std::cerr << "Adding Programm ..." << std::endl;
             //            std::cerr << "AssetManager::getShaderProgram AJOUT de " << configuration << std::endl;
-            int numShader = addShaderProgram(theProgram);
-            mConfiguredPrograms[configuration] = numShader;
+            int numShader = addShaderProgram(theProgram, source.mKey);
+            mConfiguredPrograms.insert(configuration, numShader);
             return theProgram;
         } else {
+            theProgram->clear();
             delete theProgram;
             std::cerr << "Return Default Program" << std::endl;
             return getShaderProgram(-1);
@@ -190,15 +230,234 @@ ShaderProgram *AssetManager::getShaderProgram(const ShaderConfiguration &configu
         // shader existant, l'utiliser
         //         std::cerr << "EXISTANT" << std::endl;
         //        std::cerr << "AssetManager::getShaderProgram RECUP de " << configuration << std::endl;
-        return getShaderProgram(it->second);
+        return getShaderProgram(*index);
+    }
+}
+
+void AssetManager::warmUpShaderPrograms(const std::vector<ShaderConfiguration> &configurations)
+{
+    Timer buildTimer;
+    buildTimer.start();
+    initProgramCache();
+
+    std::vector<ProgramSource> sources;
+    std::set<ShaderConfiguration> seen;
+    for (unsigned int i = 0; i < configurations.size(); ++i) {
+        if (mConfiguredPrograms.find(configurations[i]) || !seen.insert(configurations[i]).second)
+            continue;
+        sources.push_back(ProgramSource());
+        sources.back().mConfiguration = configurations[i];
+    }
+
+    ProgramSourceReader reader(this, sources);
+    parallelFor(0, sources.size(), reader, 1);
+
+    // no status query until all the programs are submitted : it would wait for the driver
+    std::vector<ShaderProgram *> programs(sources.size());
+    for (unsigned int i = 0; i < sources.size(); ++i)
+        programs[i] = createProgram(sources[i]);
+
+    for (unsigned int i = 0; i < sources.size(); ++i) {
+        if (finishProgram(sources[i], programs[i])) {
+            mConfiguredPrograms.insert(sources[i].mConfiguration, addShaderProgram(programs[i], sources[i].mKey));
+        } else {
+            programs[i]->clear();
+            delete programs[i];
+        }
+    }
+    buildTimer.stop();
+    mProgramBuildTime += buildTimer.value();
+}
+
+void AssetManager::initProgramCache()
+{
+    if (!mDriverString.empty())
+        return;
+    const GLubyte *str;
+    glAssert(str = glGetString(GL_VENDOR));
+    mDriverString = std::string((const char *) str) + "\n";
+    glAssert(str = glGetString(GL_RENDERER));
+    mDriverString += std::string((const char *) str) + "\n";
+    glAssert(str = glGetString(GL_VERSION));
+    mDriverString += std::string((const char *) str);
+
+    GLint numFormats = 0;
+    glAssert(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats));
+    mProgramBinaries = numFormats > 0;
+
+#ifdef GL_ARB_parallel_shader_compile
+    GLint numExtensions = 0;
+    glAssert(glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions));
+    for (int i = 0; i < numExtensions; ++i) {
+        if (!strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), "GL_ARB_parallel_shader_compile")) {
+            // let the driver use as many compiler threads as it wants
+            glAssert(glMaxShaderCompilerThreadsARB(0xFFFFFFFF));
+            break;
+        }
+    }
+#endif
+}
+
+void AssetManager::readProgramSource(ProgramSource &source) const
+{
+    const ShaderConfiguration &configuration = source.mConfiguration;
+    std::stringstream defineString;
+    for (int i = 0; i < configuration.numProperties(); ++i) {
+        defineString << "#define " << configuration.getPropertyName(i) << "\n";
+    }
+
+    for (int i = 0; i < configuration.numDefaultProperties(); ++i) {
+        defineString << "#define " << configuration.getDefaultPropertyName(i) << "\n";
+    }
+
+    std::string shaderFile = configuration.getProgramName();
+    source.mFileName[0] = shaderFile + mVertFileExt;
+    source.mFileName[1] = shaderFile + mFragFileExt;
+    source.mFileName[2] = shaderFile + ".glsl"; // use this extension to have syntaxic coloration and differentiate shaders
+
+    uint64_t key = hashBytes(mDriverString.data(), mDriverString.size());
+    for (int i = 0; i < NUM_SHADER_STAGES; ++i) {
+        if (!(configuration.getType() & SHADER_STAGES[i].mType))
+            continue;
+        source.mConfigurationString[i] = defineString.str();
+        if (SHADER_STAGES[i].mType == ShaderConfiguration::VERTEX_SHADER &&
+                configuration.hasProperty(SkinningEngine::GPU_SKINNING_PROPERTY))
+            source.mConfigurationString[i] += SkinningEngine::gpuShaderSource();
+        source.mCode[i] = ShaderObject::readSource(source.mFileName[i], source.mConfigurationString[i]);
+        key = hashBytes((const char *) &(SHADER_STAGES[i].mGLType), sizeof(GLenum), key);
+        key = hashBytes(source.mCode[i].data(), source.mCode[i].size(), key);
+    }
+    source.mKey = key;
+    source.mBinaryFormat = 0;
+    source.mBinary.clear();
+    readProgramBinary(source);
+}
+
+ShaderProgram *AssetManager::createProgram(ProgramSource &source)
+{
+    ShaderProgram *theProgram = new ShaderProgram();
+    theProgram->setConfiguration(source.mConfiguration);
+    theProgram->create();
+    if (theProgram->loadBinary(source.mBinaryFormat, source.mBinary))
+        return theProgram;
+
+    // not in the cache, or rejected by the driver
+    source.mBinary.clear();
+    for (int i = 0; i < NUM_SHADER_STAGES; ++i) {
+        if (!(source.mConfiguration.getType() & SHADER_STAGES[i].mType))
+            continue;
+        ShaderObject *shader = new ShaderObject;
+        shader->create(SHADER_STAGES[i].mGLType);
+        shader->configure(source.mConfigurationString[i]);
+        shader->load(source.mFileName[i], source.mCode[i]);
+        shader->compile();
+        theProgram->add(shader);
+    }
+    theProgram->startLink();
+    return theProgram;
+}
+
+bool AssetManager::finishProgram(ProgramSource &source, ShaderProgram *program)
+{
+    if (!source.mBinary.empty()) {
+        ++mProgramsFromCache;
+        return true;
+    }
+    bool shadersOK = program->checkShaders();
+    shadersOK = program->finishLink() && shadersOK;
+    if (shadersOK) {
+        ++mProgramsCompiled;
+        writeProgramBinary(source, program);
+    }
+    return shadersOK;
+}
+
+std::string AssetManager::programCacheFile(uint64_t key) const
+{
+    char name[32];
+    sprintf(name, "%016llx.vxprog", (unsigned long long) key);
+    return mProgramCacheFolder + "/" + name;
+}
+
+bool AssetManager::readProgramBinary(ProgramSource &source) const
+{
+    if (mProgramCacheFolder.empty() || !mProgramBinaries)
+        return false;
+    std::ifstream file(programCacheFile(source.mKey).c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    BinaryReader reader(content.empty() ? NULL : &(content[0]), content.size());
+    char magic[4] = {0, 0, 0, 0};
+    unsigned int version = 0;
+    uint64_t key = 0;
+    uint64_t sourceLengths[NUM_SHADER_STAGES];
+    uint64_t binaryHash = 0;
+    unsigned int format = 0;
+    reader.read(magic, 4);
+    reader.read(version);
+    reader.read(key);
+    reader.read(sourceLengths, NUM_SHADER_STAGES);
+    reader.read(binaryHash);
+    reader.read(format);
+    reader.read(source.mBinary);
+    // a key collision still needs the same source lengths
+    bool sameSources = !reader.error();
+    for (int i = 0; i < NUM_SHADER_STAGES && sameSources; ++i)
+        sameSources = (sourceLengths[i] == source.mCode[i].size());
+    if (reader.error() || memcmp(magic, PROGRAM_CACHE_MAGIC, 4) || version != PROGRAM_CACHE_VERSION || key != source.mKey ||
+            !sameSources || source.mBinary.empty() || hashBytes(&(source.mBinary[0]), source.mBinary.size()) != binaryHash) {
+        std::cerr << "AssetManager : invalid program cache file " << programCacheFile(source.mKey) << std::endl;
+        source.mBinary.clear();
+        return false;
+    }
+    source.mBinaryFormat = format;
+    return true;
+}
+
+void AssetManager::writeProgramBinary(const ProgramSource &source, ShaderProgram *program) const
+{
+    if (mProgramCacheFolder.empty() || !mProgramBinaries)
+        return;
+    GLenum format;
+    std::vector<char> binary;
+    if (!program->getBinary(format, binary))
+        return;
+
+    BinaryWriter writer;
+    writer.write(PROGRAM_CACHE_MAGIC, 4);
+    writer.write(PROGRAM_CACHE_VERSION);
+    writer.write(source.mKey);
+    for (int i = 0; i < NUM_SHADER_STAGES; ++i)
+        writer.write(uint64_t(source.mCode[i].size()));
+    writer.write(hashBytes(&(binary[0]), binary.size()));
+    writer.write((unsigned int) format);
+    writer.write(binary);
+
+    // an interrupted write leaves no truncated file under the final name
+    std::string cacheFile = programCacheFile(source.mKey);
+    std::string tempFile = cacheFile + ".tmp";
+    {
+        std::ofstream file(tempFile.c_str(), std::ios::out | std::ios::binary);
+        if (!file || !file.write(&(writer.mBuffer[0]), writer.mBuffer.size())) {
+            std::cerr << "AssetManager : could not write " << tempFile << std::endl;
+            std::remove(tempFile.c_str());
+            return;
+        }
+    }
+    std::remove(cacheFile.c_str());
+    if (std::rename(tempFile.c_str(), cacheFile.c_str())) {
+        std::cerr << "AssetManager : could not write " << cacheFile << std::endl;
+        std::remove(tempFile.c_str());
     }
 }
 
 ShaderConfiguration AssetManager::getShaderConfiguration(ShaderProgram *program)
 {
-    for (std::map<ShaderConfiguration , int>::iterator it = mConfiguredPrograms.begin(); it != mConfiguredPrograms.end(); ++it) {
-        if (mShaderProgram[it->second] == program) {
-            return it->first;
+    for (unsigned int i = 0; i < mConfiguredPrograms.capacity(); ++i) {
+        if (mConfiguredPrograms.used(i) && mShaderProgram[mConfiguredPrograms.value(i)] == program) {
+            return mConfiguredPrograms.key(i);
         }
     }
     // TODO add invalid shader conf
@@ -218,18 +477,59 @@ Texture *AssetManager::getTexture(int index) const
 
 void AssetManager::reloadShaders()
 {
-    for (unsigned int i = 0; i < mShaderProgram.size(); ++i) {
-        std::cerr << "reload shader " << i  << std::endl;
-        mShaderProgram[i]->reload();
+    initProgramCache();
+    for (unsigned int i = 0; i < mConfiguredPrograms.capacity(); ++i) {
+        if (!mConfiguredPrograms.used(i))
+            continue;
+        int index = mConfiguredPrograms.value(i);
+        ProgramSource source;
+        source.mConfiguration = mConfiguredPrograms.key(i);
+        readProgramSource(source);
+        if (source.mKey == mProgramKeys[index])
+            continue;
+        std::cerr << "reload shader " << index  << std::endl;
+        ShaderProgram *theProgram = createProgram(source);
+        if (finishProgram(source, theProgram)) {
+            // keep the ShaderProgram object, the RenderStates point to it
+            mShaderProgram[index]->clear();
+            *mShaderProgram[index] = *theProgram;
+            mProgramKeys[index] = source.mKey;
+        } else {
+            theProgram->clear();
+        }
+        delete theProgram;
     }
 }
 
 void AssetManager::statistics(){
     std::cerr << "Total number of programs :          \t" << mShaderProgram.size() << std::endl;
     std::cerr << "Number of programs configurations : \t" << mConfiguredPrograms.size() << std::endl;
+    std::cerr << "Programs from cache / compiled :    \t" << mProgramsFromCache << " / " << mProgramsCompiled
+              << " in " << mProgramBuildTime*1000. << " ms" << std::endl;
     std::cerr << "Total number of textures :          \t" << mTextures.size() << std::endl;
     std::cerr << "Number of unique textures :         \t" << mTextureMap.size() << std::endl;
     std::cerr << "Number of materials :               \t" << mMaterials.size() << std::endl;
+    long long vertexBytes = 0;
+    long long floatVertexBytes = 0;
+    long long indexBytes = 0;
+    double misses = 0.;
+    int numTriangles = 0;
+    for (unsigned int i = 0; i < mMeshs.size(); ++i) {
+        const Mesh *mesh = mMeshs[i];
+        vertexBytes += mesh->vertexBufferSize();
+        floatVertexBytes += (long long) mesh->numVertices() * sizeof(Mesh::VertexData);
+        indexBytes += mesh->indexBufferSize();
+        misses += averageCacheMissRatio(mesh->indices(), mesh->numIndices(), mesh->numVertices()) * (mesh->numIndices() / 3);
+        numTriangles += mesh->numIndices() / 3;
+    }
+    std::cerr << "Vertex buffers memory :             \t" << vertexBytes / 1024 << " KB (" << floatVertexBytes / 1024
+              << " KB unpacked)" << std::endl;
+    std::cerr << "Index buffers memory :              \t" << indexBytes / 1024 << " KB" << std::endl;
+    std::cerr << "Average cache miss ratio :          \t" << (numTriangles ? misses / numTriangles : 0.) << std::endl;
+    std::cerr << "HDR textures memory saved :         \t" << Texture::hdrMemorySaved() / (1024*1024) << " MB" << std::endl;
+    std::cerr << mTextureLoader.statistics();
+    std::cerr << mMeshOptimizer.statistics();
+    std::cerr << mLodGenerator.statistics();
 }
 
 /**
@@ -255,11 +555,22 @@ void AssetManager::addAnimatedMesh(AnimatedMesh::AnimatedMeshPtr mesh) {
     ++mNumAnimatedMeshs;
 }
 
+void AssetManager::uploadAnimatedMeshes() {
+    if (mNumAnimations)
+        mAnimationScheduler.upload(mAnimatedMeshs);
+}
+
+bool AssetManager::setGpuSkinning(bool enable) {
+    bool allSet = true;
+    for (unsigned int i = 0; i < mAnimatedMeshs.size(); ++i)
+        allSet = (mAnimatedMeshs[i]->setGpuSkinning(enable) == enable) && allSet;
+    return allSet;
+}
+
 bool AssetManager::updateAnimations(double time) {
     bool modified=(mNumAnimations!=0);
-    for (unsigned int i = 0; i < mNumAnimations; ++i) {
-        mAnimations[i]->update(time);
-    }
+    if (modified)
+        mAnimationScheduler.evaluate(mAnimations, mAnimatedMeshs, time);
     return modified;
 }
 
@@ -267,7 +578,7 @@ double AssetManager::setAnimationsAt(int percent){
     if (mNumAnimations) {
         ///@todo : generalize animation control : only anim 0 is trigerred here
         double time = mAnimations[0]->duration()*(double)percent/100;
-        mAnimations[0]->update(time);
+        mAnimationScheduler.evaluate(std::vector<Animation *>(1, mAnimations[0]), mAnimatedMeshs, time);
         return time;
     } else
         return 0.;
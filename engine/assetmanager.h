@@ -10,13 +10,19 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <stdint.h>
 
 #include "shaderobject.h"
+#include "flathashmap.h"
 #include "texture.h"
+#include "textureloader.h"
+#include "meshoptimizer.h"
+#include "lodgenerator.h"
 #include "material.h"
 
 #include "animatedmesh.h"
 #include "animation.h"
+#include "animationscheduler.h"
 
 
 namespace vortex {
@@ -86,6 +92,106 @@ public :
          */
     int addTexture(std::string fileName);
 
+    /**
+         * Default per frame budget of uploadTextures, in bytes
+         */
+    static const int TEXTURE_UPLOAD_BUDGET = 16*1024*1024;
+
+    /**
+         * Decode the Textures added by addTexture on a thread pool (default) or load them immediately.
+         * Until their upload, the asynchronous Textures bind the default Texture.
+         */
+    void setAsyncTextureLoading(bool enable) {
+        mAsyncTextures = enable;
+    }
+
+    /**
+         * Upload the decoded Textures, within a budget. To be called once per frame from the OpenGL thread.
+         *
+         * @param byteBudget Number of bytes to upload, at least one Texture is uploaded if one is ready
+         * @return true if some Textures were uploaded
+         */
+    bool uploadTextures(int byteBudget = TEXTURE_UPLOAD_BUDGET);
+
+    /**
+         * Wait for all the Textures being decoded and upload them. Must be called from the OpenGL thread.
+         */
+    void finishTextureLoading() {
+        mTextureLoader.finish();
+    }
+
+    /**
+         * @return true while some Textures are not uploaded
+         */
+    bool texturesPending() const {
+        return mTextureLoader.pending();
+    }
+
+    /**
+         * Metrics of the asynchronous Texture loading
+         */
+    const TextureLoader::Statistics &textureLoadStatistics() const {
+        return mTextureLoader.statistics();
+    }
+
+    /**
+         * Reorder the vertices and triangles of a Mesh for the vertex cache in the background, see MeshOptimizer.
+         * To be called once the Mesh is no longer modified at each frame.
+         */
+    void optimizeMesh(Mesh *mesh) {
+        mMeshOptimizer.optimize(mesh);
+    }
+
+    /**
+         * Replace the data of the Meshes optimized since the last call. To be called once per frame from the OpenGL thread.
+         *
+         * @return true if some Meshes were modified
+         */
+    bool uploadOptimizedMeshes() {
+        return mMeshOptimizer.upload();
+    }
+
+    /**
+         * @return true while some Meshes are being optimized
+         */
+    bool meshesOptimizing() const {
+        return mMeshOptimizer.pending();
+    }
+
+    /**
+         * Set the simplification generating the levels of detail of the Meshes, NULL (default) to not generate them.
+         * Once set, the levels of the Meshes added by addMesh are generated in the background.
+         * The simplifier is not owned, it must live as long as the AssetManager.
+         */
+    void setMeshSimplifier(MeshSimplifier *simplifier) {
+        mLodGenerator.setSimplifier(simplifier);
+    }
+
+    /**
+         * Generate the levels of detail of a Mesh in the background, see LodGenerator.
+         * To be called once the Mesh is no longer modified at each frame.
+         */
+    void generateLods(Mesh *mesh) {
+        mLodGenerator.generate(mesh);
+    }
+
+    /**
+         * Give their levels of detail to the Meshes generated since the last call. To be called once per frame from the
+         * OpenGL thread.
+         *
+         * @return true if some Meshes have new levels
+         */
+    bool uploadLods() {
+        return mLodGenerator.upload();
+    }
+
+    /**
+         * @return true while some levels of detail are being generated
+         */
+    bool lodsPending() const {
+        return mLodGenerator.pending();
+    }
+
     /**
          * Create a new Material
          *
@@ -127,9 +233,34 @@ public :
 
 
     /**
-         * Reload all shaders
+         * Create the ShaderPrograms of configurations ahead of their first use, e.g. at startup.
+         * The sources and the cached binaries are read on the worker threads, then all the compilations are submitted
+         * before any of them is checked, so that a driver compiling on its own threads runs them concurrently.
          *
-         * If shader compilation occurs, a log message is written on the error out put
+         * @param configurations The configurations to build, the ones already built are skipped.
+         */
+    void warmUpShaderPrograms(const std::vector<ShaderConfiguration> &configurations);
+
+    /**
+         * Store the binaries of the linked ShaderPrograms in folder and load them instead of compiling the sources.
+         * A binary is found by a hash of the shader sources, defines included, and of the OpenGL driver strings,
+         * so that an edited shader or an updated driver misses the cache. The length of each stage source is stored
+         * with the binary and compared too.
+         *
+         * @param folder An existing folder, an empty name disables the cache (default).
+         */
+    void setProgramCacheFolder(const std::string &folder) {
+        mProgramCacheFolder = folder;
+    }
+
+    const std::string &programCacheFolder() const {
+        return mProgramCacheFolder;
+    }
+
+    /**
+         * Reload all shaders, only the programs whose sources changed are compiled again
+         *
+         * If shader compilation occurs, a log message is written on the error out put and the previous program is kept
          */
     void reloadShaders();
     /**
@@ -172,7 +303,8 @@ public :
     }
 
     /**
-     * Update all animations of the scene
+     * Update all animations of the scene and skin the animated meshes, on the worker threads.
+     * No OpenGL call is made : the meshes are uploaded by uploadAnimatedMeshes.
      * @param time The current time in second
      * @return true if scene was modified, false otherwise
      */
@@ -180,7 +312,7 @@ public :
 
 
     /**
-     * Update all animations of the scene
+     * Update all animations of the scene, as updateAnimations
      * @param percent The position in the animation
      * @return the time corresponding to the position
      */
@@ -202,6 +334,27 @@ public :
       */
     void addAnimatedMesh(AnimatedMesh::AnimatedMeshPtr mesh);
 
+    /**
+      * Upload the animated meshes skinned by the last updateAnimations or setAnimationsAt.
+      * Must be called from the OpenGL thread.
+      */
+    void uploadAnimatedMeshes();
+
+    /**
+      * Duration of the last animation update and upload
+      */
+    const AnimationScheduler::Timing &animationTiming() const {
+        return mAnimationScheduler.timing();
+    }
+
+    /**
+      * Skin the animated meshes in their vertex shaders, the meshes the OpenGL implementation can not skin stay on the CPU.
+      * Shader programs and rendering loops must be built again after a change. Must be called from the OpenGL thread.
+      *
+      * @return true if all the animated meshes use the requested path
+      */
+    bool setGpuSkinning(bool enable);
+
     void setCurrentFrame(unsigned int frame) { mCurrentFrame = frame; }
     unsigned int getCurrentFrame() const { return mCurrentFrame; }
 
@@ -229,6 +382,7 @@ public :
 
     unsigned int numMeshs() const;
 
+    /** Add a Mesh and request its levels of detail if a MeshSimplifier is set */
     void addMesh(Mesh::MeshPtr themesh);
     Mesh::MeshPtr getMesh(unsigned int meshId);
 private:
@@ -237,19 +391,67 @@ private:
          * Record a new ShaderProgram
          *
          * @param program Pointer to the ShaderProgram to be recorded
+         * @param key Hash of the ShaderProgram sources
          *
          * @return The index of "program" in ShaderProgram storage. This index may be used used as "AssetManager::getShaderProgram" parameter to access this ShaderProgram
          */
-    int addShaderProgram(ShaderProgram *program);
+    int addShaderProgram(ShaderProgram *program, uint64_t key);
+
+    /// vertex, fragment and geometry shaders
+    static const int NUM_SHADER_STAGES = 3;
+
+    /**
+     * Sources of a ShaderProgram and its cached binary, gathered without OpenGL call
+     */
+    struct ProgramSource {
+        ShaderConfiguration mConfiguration;
+        std::string mFileName[NUM_SHADER_STAGES];
+        std::string mConfigurationString[NUM_SHADER_STAGES];
+        std::string mCode[NUM_SHADER_STAGES];   // empty for the stages not in the configuration
+        uint64_t mKey;
+        GLenum mBinaryFormat;
+        std::vector<char> mBinary;              // empty if not in the cache
+    };
+
+    class ProgramSourceReader;
+
+    /**
+     * Query the driver strings and the program binary support. Must be called from the OpenGL thread.
+     */
+    void initProgramCache();
+
+    /**
+     * Read the shader files of source.mConfiguration, hash them and read the cached binary. Thread safe.
+     */
+    void readProgramSource(ProgramSource &source) const;
+
+    /**
+     * Create a ShaderProgram from its cached binary, or compile it and start its link.
+     */
+    ShaderProgram *createProgram(ProgramSource &source);
+
+    /**
+     * Check a ShaderProgram returned by createProgram and store its binary if it was compiled.
+     *
+     * @return True if the ShaderProgram may be used.
+     */
+    bool finishProgram(ProgramSource &source, ShaderProgram *program);
+
+    std::string programCacheFile(uint64_t key) const;
+    bool readProgramBinary(ProgramSource &source) const;
+    void writeProgramBinary(const ProgramSource &source, ShaderProgram *program) const;
 
     std::vector<ShaderProgram *> mShaderProgram;
-    std::map<ShaderConfiguration , int> mConfiguredPrograms;
+    std::vector<uint64_t> mProgramKeys;
+    FlatHashMap<ShaderConfiguration, int> mConfiguredPrograms;
     ShaderProgram *mDefaultShaderProgram;
 
     std::map<std::string, int> mTextureMap;
 
     std::vector<Texture *> mTextures;
     Texture *mDefaultTexture;
+    bool mAsyncTextures;
+    TextureLoader mTextureLoader;
 
     std::vector<Material *> mMaterials;
     Material *mDefaultMaterial;
@@ -266,11 +468,21 @@ private:
 
     unsigned int mNumAnimatedMeshs;
     std::vector<AnimatedMesh::AnimatedMeshPtr> mAnimatedMeshs;
+    AnimationScheduler mAnimationScheduler;
 
     unsigned int mNumMeshs;
     std::vector<Mesh::MeshPtr> mMeshs;
+    MeshOptimizer mMeshOptimizer;
+    LodGenerator mLodGenerator;
 
     std::string mShaderBasePath;
+
+    std::string mProgramCacheFolder;
+    std::string mDriverString;
+    bool mProgramBinaries;
+    int mProgramsFromCache;
+    int mProgramsCompiled;
+    double mProgramBuildTime;
 };
 
 } // namespace vortex
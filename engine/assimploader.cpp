@@ -16,6 +16,9 @@
 #include "animatedmesh.h"
 
 #include "timer.h"
+#include "parallel.h"
+#include "scenecache.h"
+#include "meshoptimizer.h"
 
 namespace vortex {
 
@@ -24,6 +27,32 @@ bool AssimpLoader::loadScene(const std::string &filename, AssetManager &am, Scen
 
     mResources = &am;
     mSceneGraph = sg;
+    mSceneMaterials.clear();
+    mSceneAnimations.clear();
+
+    std::cerr << "Loading scene : " << filename << std::endl;
+
+    // textures are searched next to the scene
+    size_t found = filename.find_last_of("/\\");
+    std::string textureFolder = filename.substr(0, found + 1);
+    mResources->setTextureFolder(textureFolder);
+
+    SceneCache::Source source;
+    bool cacheable = mUseCache && SceneCache::readSource(filename, source);
+    std::string cacheFile = SceneCache::cacheFileName(filename);
+    if (cacheable) {
+        Timer timeCache;
+        timeCache.start();
+        std::vector<Animation *> animations;
+        if (SceneCache::load(cacheFile, source, am, sg, animations)) {
+            finishScene(animations);
+            timeCache.stop();
+            std::cerr << "Scene cache loading time : " << timeCache.value() << std::endl;
+            mLastErrorNum = 0;
+            mLastErrorString = "No Error";
+            return true;
+        }
+    }
 
     Assimp::DefaultLogger::create("monlog.txt",Assimp::Logger::VERBOSE);
 
@@ -35,7 +64,6 @@ bool AssimpLoader::loadScene(const std::string &filename, AssetManager &am, Scen
 //     And have it read the given file with some example postprocessing
 //     Usually - if speed is not the most important aspect for you - you'll
 //     propably to request more postprocessing than we do in this example.
-    std::cerr << "Loading scene : " << filename << std::endl;
     Timer timeAssimp;
     timeAssimp.start();
 
@@ -70,6 +98,9 @@ bool AssimpLoader::loadScene(const std::string &filename, AssetManager &am, Scen
         timeConverter.stop();
         std::cerr << "Conversion time : " << timeConverter.value() << std::endl;
 
+        if (cacheable && !SceneCache::save(cacheFile, source, textureFolder, mSceneMaterials, *mSceneGraph, mSceneAnimations))
+            std::cerr << "Scene cache not written" << std::endl;
+
         mLastErrorNum = 0;
         mLastErrorString = "No Error";
     } else {
@@ -89,7 +120,13 @@ int AssimpLoader::lastError() const
     return mLastErrorNum;
 }
 
-Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *resources)
+/**
+ * Convert an ASSIMP mesh, without any OpenGL call nor registration in the AssetManager : called on the worker threads.
+ * The converted arrays are adopted by the Mesh, reordered for the vertex cache.
+ *
+ * @param missRatios Set to the average cache miss ratio of the ASSIMP order and of the optimized order.
+ */
+static Mesh *buildMesh(const aiMesh *inputMesh, const std::string &meshName, AssetManager *resources, float missRatios[2])
 {
 
     if (!inputMesh->HasFaces()) {
@@ -105,21 +142,27 @@ Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *re
     int numIndices = inputMesh->mNumFaces * 3;
     int *indices   = new int[numIndices];
 
+    // the attributes presence is the same for all the vertices
+    bool hasNormals = inputMesh->HasNormals();
+    bool hasTexCoords = inputMesh->HasTextureCoords(0);
+    bool hasTangents = inputMesh->HasTangentsAndBitangents();
+    BBox bbox;
     for (unsigned int i = 0; i < inputMesh->mNumVertices; ++i) {
         vertices[i].mVertex = glm::vec3(inputMesh->mVertices[i][0],
                                         inputMesh->mVertices[i][1],
                                         inputMesh->mVertices[i][2]);
-        if (inputMesh->HasNormals())
+        bbox += vertices[i].mVertex;
+        if (hasNormals)
             vertices[i].mNormal = glm::vec3(inputMesh->mNormals[i][0],
                                             inputMesh->mNormals[i][1],
                                             inputMesh->mNormals[i][2]);
 
-        if (inputMesh->HasTextureCoords(0))
+        if (hasTexCoords)
             vertices[i].mTexCoord = glm::vec4(inputMesh->mTextureCoords[0][i][0],
                                               inputMesh->mTextureCoords[0][i][1],
                                               inputMesh->mTextureCoords[0][i][2],
                                               1.f);
-        if (inputMesh->HasTangentsAndBitangents())
+        if (hasTangents)
             vertices[i].mTangent = glm::vec3(inputMesh->mTangents[i][0],
                                              inputMesh->mTangents[i][1],
                                              inputMesh->mTangents[i][2]);
@@ -127,7 +170,7 @@ Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *re
     }
 
     for (unsigned int i = 0; i < inputMesh->mNumFaces; ++i) {
-        aiFace f = inputMesh->mFaces[i];
+        const aiFace &f = inputMesh->mFaces[i];
         // TODO : corriger ce BEURK !
         assert( (f.mNumIndices == 3) || (f.mNumIndices == 2 ) || (f.mNumIndices == 1 ) );
         if (f.mNumIndices == 3) {
@@ -148,6 +191,12 @@ Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *re
         }
     }
 
+    missRatios[0] = averageCacheMissRatio(indices, numIndices, numVertices);
+    optimizeVertexCache(indices, numIndices, numVertices);
+    std::vector<int> remap;
+    optimizeVertexFetch(vertices, numVertices, indices, numIndices, remap);
+    missRatios[1] = averageCacheMissRatio(indices, numIndices, numVertices);
+
     //@todo verify for animation
     // Alexandre
     if(inputMesh->HasBones()) {
@@ -157,10 +206,11 @@ Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *re
 
         // Array of bones
         for (unsigned int i = 0; i < inputMesh->mNumBones; ++i) {
+            const aiBone *inputBone = inputMesh->mBones[i];
             // Name of bone
-            bones[i].mName = std::string(inputMesh->mBones[i]->mName.data);
+            bones[i].mName = std::string(inputBone->mName.data);
 
-            aiMatrix4x4 aiMatrix = inputMesh->mBones[i]->mOffsetMatrix;
+            const aiMatrix4x4 &aiMatrix = inputBone->mOffsetMatrix;
             glm::mat4x4 offset(
                 aiMatrix[0][0], aiMatrix[1][0], aiMatrix[2][0], aiMatrix[3][0],
                 aiMatrix[0][1], aiMatrix[1][1], aiMatrix[2][1], aiMatrix[3][1],
@@ -171,36 +221,55 @@ Mesh *buildMesh(aiMesh *inputMesh, const std::string &meshName, AssetManager *re
             bones[i].mOffsetMatrix = offset;
 
             // Array of weights
-            bones[i].mNumWeights = inputMesh->mBones[i]->mNumWeights;
+            bones[i].mNumWeights = inputBone->mNumWeights;
             bones[i].mWeights = new AnimatedMesh::WeightData[bones[i].mNumWeights];
 
             for (unsigned int j = 0; j < bones[i].mNumWeights; ++j) {
-                bones[i].mWeights[j].mVertexId = inputMesh->mBones[i]->mWeights[j].mVertexId;
-                bones[i].mWeights[j].mWeight = inputMesh->mBones[i]->mWeights[j].mWeight;
+                bones[i].mWeights[j].mVertexId = remap[inputBone->mWeights[j].mVertexId];
+                bones[i].mWeights[j].mWeight = inputBone->mWeights[j].mWeight;
             }
         }
 
-        AnimatedMesh *newMesh = new AnimatedMesh(meshName, vertices, numVertices, indices, numIndices, bones, numBones, resources);
-        newMesh->init();
-
-        delete [] vertices;
-        delete [] indices;
-        delete [] bones;
-
-        // Add mesh ptr to the manager
-        resources->addAnimatedMesh(newMesh);
-        resources->addMesh(newMesh);
-        return newMesh;
+        return new AnimatedMesh(meshName, vertices, numVertices, indices, numIndices, bbox, bones, numBones, resources);
     }  else {
-        Mesh *newMesh = new Mesh(meshName, vertices, numVertices, indices, numIndices);
-        newMesh->init();
+        return new Mesh(meshName, vertices, numVertices, indices, numIndices, bbox);
+    }
+}
 
-        delete [] vertices;
-        delete [] indices;
+void AssimpLoader::operator()(int begin, int end)
+{
+    for (int i = begin; i < end; ++i)
+        mMeshJobs[i].mMesh = buildMesh(mMeshJobs[i].mInput, mMeshJobs[i].mName, mResources, mMeshJobs[i].mMissRatios);
+}
 
-        resources->addMesh(newMesh);
-        return newMesh;
+void AssimpLoader::convertMeshes()
+{
+    // one mesh per chunk : mesh sizes vary a lot
+    parallelFor(0, mMeshJobs.size(), *this, 1);
+
+    // OpenGL initialization and registration, in the scene order
+    double missesBefore = 0.;
+    double missesAfter = 0.;
+    int numTriangles = 0;
+    for (unsigned int i = 0; i < mMeshJobs.size(); ++i) {
+        MeshJob &job = mMeshJobs[i];
+        Mesh *mesh = job.mMesh;
+        (*job.mNode)[job.mSlot] = mesh;
+        if (!mesh)
+            continue;
+        int meshTriangles = mesh->numIndices() / 3;
+        missesBefore += job.mMissRatios[0] * meshTriangles;
+        missesAfter += job.mMissRatios[1] * meshTriangles;
+        numTriangles += meshTriangles;
+        mesh->init();
+        if (job.mInput->HasBones())
+            mResources->addAnimatedMesh(static_cast<AnimatedMesh *>(mesh));
+        mResources->addMesh(mesh);
     }
+    mMeshJobs.clear();
+    if (numTriangles)
+        std::cerr << "Vertex cache optimization : ACMR " << missesBefore / numTriangles << " -> "
+                  << missesAfter / numTriangles << std::endl;
 }
 
 void  AssimpLoader::fillLeafNode(aiNode *currentInputNode, SceneGraph::LeafMeshNode * currentOutputNode, const aiScene *inputScene)
@@ -218,9 +287,14 @@ void  AssimpLoader::fillLeafNode(aiNode *currentInputNode, SceneGraph::LeafMeshN
     if (currentInputNode->mNumMeshes > 0) {
         currentOutputNode->initMeshes(currentInputNode->mNumMeshes);
         if (currentInputNode->mNumMeshes == 1) {
-            std::string meshName = currentInputNode->mName.data;
-            aiMesh *inputMesh = inputScene->mMeshes[currentInputNode->mMeshes[0]];
-            (*currentOutputNode)[0] = buildMesh(inputMesh, meshName, mResources);
+            MeshJob job;
+            job.mName = currentInputNode->mName.data;
+            job.mInput = inputScene->mMeshes[currentInputNode->mMeshes[0]];
+            job.mNode = currentOutputNode;
+            job.mSlot = 0;
+            job.mMesh = NULL;
+            mMeshJobs.push_back(job);
+            const aiMesh *inputMesh = job.mInput;
             Material *meshMaterial = mResources->getMaterial(inputMesh->mMaterialIndex);
             currentOutputNode->getRenderState(0)->setMaterial(meshMaterial);
 
@@ -228,9 +302,14 @@ void  AssimpLoader::fillLeafNode(aiNode *currentInputNode, SceneGraph::LeafMeshN
             for (unsigned int i = 0; i < currentInputNode->mNumMeshes; ++i) {
                 std::stringstream str;
                 str << currentInputNode->mName.data << "_submesh_" << i;
-                std::string meshName(str.str());
-                aiMesh *inputMesh = inputScene->mMeshes[currentInputNode->mMeshes[i]];
-                (*currentOutputNode)[i] = buildMesh(inputMesh, meshName, mResources);
+                MeshJob job;
+                job.mName = str.str();
+                job.mInput = inputScene->mMeshes[currentInputNode->mMeshes[i]];
+                job.mNode = currentOutputNode;
+                job.mSlot = i;
+                job.mMesh = NULL;
+                mMeshJobs.push_back(job);
+                const aiMesh *inputMesh = job.mInput;
                 Material *meshMaterial = mResources->getMaterial(inputMesh->mMaterialIndex);
                 currentOutputNode->getRenderState(i)->setMaterial(meshMaterial);
             }
@@ -279,10 +358,6 @@ void AssimpLoader::buildInternalRepresentation(const std::string &name, const ai
 //     send expected value to asset manager -> resize vectors
     mResources->expectedValues(scene->mNumTextures, scene->mNumMaterials);
 
-    size_t found;
-    found = name.find_last_of("/\\");
-    mResources->setTextureFolder(name.substr(0, found + 1));
-
 //     construit le graphe interne et charge les différentes données
 
 //     parse materials
@@ -297,6 +372,7 @@ void AssimpLoader::buildInternalRepresentation(const std::string &name, const ai
         aiColor3D c(0.f, 0.f, 0.f);
         float f;
         Material *mat = mResources->getMaterial(matIndex);
+        mSceneMaterials.push_back(mat);
 
 //         material -- fill all avalable properties
         if (AI_SUCCESS == tmpMat->Get(AI_MATKEY_COLOR_DIFFUSE, c)) {
@@ -385,26 +461,16 @@ void AssimpLoader::buildInternalRepresentation(const std::string &name, const ai
         rootNode = new SceneGraph::LeafMeshNode(name);
         fillLeafNode(sceneNode, static_cast<SceneGraph::LeafMeshNode *>(rootNode), scene);
     }
+    convertMeshes();
 
     delete *mSceneGraph;
     *mSceneGraph = new SceneGraph(rootNode);
 
     // Parse aiScene graph and select animations
-
+    std::vector<Animation *> animations;
     for (unsigned int i = 0; i < scene->mNumAnimations; ++i) {
-
         // Create animation
-        Animation *anim = new Animation(scene->mAnimations[i]);
-
-        // Create & Attach skeleton to anim
-        SkeletonGraph *skeleton = buildInternalSkeleton(anim);
-        if (skeleton) {
-            anim->setSkeleton(skeleton);
-            // Add animation
-            mResources->addAnimation(anim);
-        } else {
-            delete anim;
-        }
+        animations.push_back(new Animation(scene->mAnimations[i]));
     }
 
     // TODO if thereis no animation data but animated meshese in the scene, extract only skeleton
@@ -414,9 +480,8 @@ void AssimpLoader::buildInternalRepresentation(const std::string &name, const ai
         std::cerr << "Light Source " << scene->mLights[i]->mName.data << std::endl;
         (*mSceneGraph)->mLights.push_back(Light(scene->mLights[i]));
     }
-    LightTransformVisitor transformLightAction(*mSceneGraph);
-    SceneGraph::PreOrderVisitor transformLight(*mSceneGraph, transformLightAction);
-    transformLight.go(glm::mat4x4(1.0), glm::mat4x4(1.0));
+
+    finishScene(animations);
 
     //setup cameras
     for (unsigned int i = 0; i < scene->mNumCameras; ++i) {
@@ -433,6 +498,27 @@ void AssimpLoader::buildInternalRepresentation(const std::string &name, const ai
 #endif
 }
 
+void AssimpLoader::finishScene(const std::vector<Animation *> &animations)
+{
+    for (unsigned int i = 0; i < animations.size(); ++i) {
+        Animation *anim = animations[i];
+        // Create & Attach skeleton to anim
+        SkeletonGraph *skeleton = buildInternalSkeleton(anim);
+        if (skeleton) {
+            anim->setSkeleton(skeleton);
+            // Add animation
+            mResources->addAnimation(anim);
+            mSceneAnimations.push_back(anim);
+        } else {
+            delete anim;
+        }
+    }
+
+    LightTransformVisitor transformLightAction(*mSceneGraph);
+    SceneGraph::PreOrderVisitor transformLight(*mSceneGraph, transformLightAction);
+    transformLight.go(glm::mat4x4(1.0), glm::mat4x4(1.0));
+}
+
 SkeletonGraph* AssimpLoader::buildInternalSkeleton(Animation *anim) {
 
     // Find the "root"
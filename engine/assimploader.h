@@ -21,6 +21,7 @@
 #include "loader.h"
 
 #include "visitors.h"
+#include "parallel.h"
 
 namespace vortex {
 
@@ -28,12 +29,20 @@ namespace vortex {
  * Abstract class Loader implementation for ASSIMP library loading
  *
  */
-class AssimpLoader : public Loader {
+class AssimpLoader : public Loader, private ParallelLoop {
 
 public :
-    AssimpLoader() {}
+    AssimpLoader() : mUseCache(true) {}
     ~AssimpLoader() {}
 
+    /**
+     * Load the scenes from their binary cache when it is up to date, and write it after an import (default).
+     * See SceneCache.
+     */
+    void setUseCache(bool useCache) {
+        mUseCache = useCache;
+    }
+
     bool loadScene(const std::string &filename, AssetManager &am, SceneGraph **sg);
 
     const char *getLastErrorString() const;
@@ -49,6 +58,36 @@ private :
 
     SceneGraph **mSceneGraph;
 
+    bool mUseCache;
+
+    /**
+     * Conversion of an ASSIMP mesh to the slot of a leaf node
+     */
+    struct MeshJob {
+        const aiMesh *mInput;
+        std::string mName;
+        SceneGraph::LeafMeshNode *mNode;
+        unsigned int mSlot;
+        Mesh *mMesh;
+        float mMissRatios[2]; // average cache miss ratio before and after the optimization
+    };
+
+    // meshes of the scene graph being built, converted in parallel once the graph is complete
+    std::vector<MeshJob> mMeshJobs;
+
+    /** Convert the meshes of the jobs [begin, end) */
+    void operator()(int begin, int end);
+
+    /**
+     * Convert the collected meshes on the worker threads, then initialize them and add them to the AssetManager
+     * in the scene order, from the calling OpenGL thread.
+     */
+    void convertMeshes();
+
+    // materials and animations of the scene being loaded, for the cache
+    std::vector<Material *> mSceneMaterials;
+    std::vector<Animation *> mSceneAnimations;
+
     /**
      * Transform ASSIMP's leaf nodes in SceneGraph::LeafNodes
      *
@@ -75,6 +114,14 @@ private :
      */
     void buildInternalRepresentation(const std::string &name, const aiScene* scene);
 
+    /**
+     * Attach their skeletons to the animations and add them to the AssetManager, then place the lights.
+     * Shared by the import and the cache load, once the scene graph and the meshes are built.
+     *
+     * @param animations The animations of the scene, the ones without skeleton are deleted
+     */
+    void finishScene(const std::vector<Animation *> &animations);
+
      /**
      * Create a skeleton (a tree of bone) from the scene graph
      * @param sceneNode The root of the skeleton in the scene graph
@@ -0,0 +1,170 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef BINARYSTREAM_H
+#define BINARYSTREAM_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+namespace vortex {
+
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+const uint64_t HASH_MULTIPLIER = 0xc6a4a7935bd1e995ULL;
+
+/**
+ * 64 bits hash (MurmurHash64A), 64 bits words at a time : every bit of a word is mixed into all the hash bits.
+ * @param hash The hash of the previous bytes, to chain several buffers.
+ */
+inline uint64_t hashBytes(const char *data, size_t size, uint64_t hash = HASH_SEED)
+{
+    const int SHIFT = 47;
+    hash ^= size * HASH_MULTIPLIER;
+    size_t numWords = size / sizeof(uint64_t);
+    for (size_t i = 0; i < numWords; ++i) {
+        uint64_t word;
+        memcpy(&word, data + i*sizeof(uint64_t), sizeof(uint64_t));
+        word *= HASH_MULTIPLIER;
+        word ^= word >> SHIFT;
+        word *= HASH_MULTIPLIER;
+        hash = (hash ^ word) * HASH_MULTIPLIER;
+    }
+    size_t tail = size - numWords*sizeof(uint64_t);
+    if (tail) {
+        uint64_t word = 0;
+        memcpy(&word, data + numWords*sizeof(uint64_t), tail);
+        hash = (hash ^ word) * HASH_MULTIPLIER;
+    }
+    hash ^= hash >> SHIFT;
+    hash *= HASH_MULTIPLIER;
+    hash ^= hash >> SHIFT;
+    return hash;
+}
+
+/**
+ * Append raw values to a byte buffer, in the native byte order.
+ * Used by the engine binary files (animations, scene cache ...).
+ */
+class BinaryWriter {
+public:
+    template <typename T>
+    void write(const T *data, unsigned int count) {
+        const char *bytes = reinterpret_cast<const char *>(data);
+        mBuffer.insert(mBuffer.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    template <typename T>
+    void write(const T &value) {
+        write(&value, 1);
+    }
+
+    void write(const std::string &value) {
+        write((unsigned int) value.size());
+        write(value.data(), value.size());
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &values) {
+        write((unsigned int) values.size());
+        if (!values.empty())
+            write(&(values[0]), values.size());
+    }
+
+    /**
+     * Pad with zeros up to a multiple of alignment bytes, so that a reader may use the next values in place.
+     */
+    void align(unsigned int alignment) {
+        mBuffer.resize((mBuffer.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    std::vector<char> mBuffer;
+};
+
+/**
+ * Read raw values from a byte buffer, reads past the end of the buffer set the error flag
+ */
+class BinaryReader {
+public:
+    BinaryReader(const char *data, size_t size) : mData(data), mSize(size), mOffset(0), mError(false) { }
+
+    template <typename T>
+    void read(T *data, unsigned int count) {
+        const T *values = map<T>(count);
+        if (values && count)
+            memcpy(data, values, count * sizeof(T));
+    }
+
+    template <typename T>
+    void read(T &value) {
+        read(&value, 1);
+    }
+
+    void read(std::string &value) {
+        unsigned int size = 0;
+        read(size);
+        const char *chars = map<char>(size);
+        if (chars)
+            value.assign(chars, size);
+    }
+
+    template <typename T>
+    void read(std::vector<T> &values) {
+        unsigned int size = 0;
+        read(size);
+        if (mError || size > (mSize - mOffset) / sizeof(T)) {
+            mError = true;
+            return;
+        }
+        values.resize(size);
+        if (size)
+            read(&(values[0]), size);
+    }
+
+    /**
+     * @return A pointer to the next count values, used in place, NULL on error
+     */
+    template <typename T>
+    const T *map(unsigned int count) {
+        if (mError || count > (mSize - mOffset) / sizeof(T)) {
+            mError = true;
+            return NULL;
+        }
+        const T *values = reinterpret_cast<const T *>(mData + mOffset);
+        mOffset += count * sizeof(T);
+        return values;
+    }
+
+    /**
+     * Skip the padding written by BinaryWriter::align
+     */
+    void align(unsigned int alignment) {
+        size_t aligned = (mOffset + alignment - 1) / alignment * alignment;
+        if (aligned > mSize)
+            mError = true;
+        else
+            mOffset = aligned;
+    }
+
+    bool error() const {
+        return mError;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+private:
+    const char *mData;
+    size_t mSize;
+    size_t mOffset;
+    bool mError;
+};
+
+} // namespace vortex
+
+#endif // BINARYSTREAM_H
@@ -6,6 +6,9 @@
 
 #include "distancefield.h"
 #include "timer.h"
+#include "parallel.h"
+
+#include <algorithm>
 
 namespace vortex {
 using namespace util;
@@ -246,6 +249,80 @@ void DistanceField::DFVoxel::addTriangle(int t, Mesh::VertexData *triangleVertic
 */
 #define index(i, j, k) ( (k*mGridSize.y + j) * mGridSize.x + i)
 
+class DistanceField::SlabRasterizer : public ParallelLoop {
+public:
+    SlabRasterizer(DistanceField *distanceField, const std::vector<std::vector<int> > &slabTriangles) :
+        mDistanceField(distanceField), mSlabTriangles(slabTriangles) {}
+    void operator()(int begin, int end) {
+        for (int slab = begin; slab < end; ++slab)
+            mDistanceField->rasterizeTriangles(slab * SLAB_SLICES, std::min((slab + 1) * SLAB_SLICES, mDistanceField->mGridSize.z),
+                                               mSlabTriangles[slab]);
+    }
+private:
+    DistanceField *mDistanceField;
+    const std::vector<std::vector<int> > &mSlabTriangles;
+};
+
+void DistanceField::triangleExtent(int t, glm::ivec3 &startIndices, glm::ivec3 &endIndices) const{
+    BBox triangleBox;
+    triangleBox += mVertices[mIndices[t]].mVertex;
+    triangleBox += mVertices[mIndices[t+1]].mVertex;
+    triangleBox += mVertices[mIndices[t+2]].mVertex;
+
+    // compute triangle extend in grid coordinates
+#ifdef LIMITTOBBOX
+    startIndices = glm::ivec3( (triangleBox.getMin() - mDistanceFieldBox.getMin() ) / mGridStep);
+    endIndices = glm::ivec3( (triangleBox.getMax() - mDistanceFieldBox.getMin() ) / mGridStep);
+#else
+#define VOXEL_BORDER 4
+    glm::ivec3 imin( (triangleBox.getMin() - mDistanceFieldBox.getMin() ) / mGridStep);
+    glm::ivec3 imax( (triangleBox.getMax() - mDistanceFieldBox.getMin() ) / mGridStep);
+
+    startIndices = glm::max( imin - glm::ivec3(VOXEL_BORDER), glm::ivec3(0) );
+    endIndices = glm::min( imax + glm::ivec3(VOXEL_BORDER), mGridSize-glm::ivec3(1) );
+#endif
+}
+
+void DistanceField::rasterizeTriangles(int kBegin, int kEnd, const std::vector<int> &triangles){
+    for (unsigned int n=0; n<triangles.size(); ++n){
+        int t = triangles[n];
+        // Get triangle info
+        Mesh::VertexData *triangleVertices[3]={&(mVertices[mIndices[t]]), &(mVertices[mIndices[t+1]]), &(mVertices[mIndices[t+2]])};
+        glm::vec4 trianglePlane( glm::cross(
+                                                (triangleVertices[1]->mVertex - triangleVertices[0]->mVertex),
+                                                (triangleVertices[2]->mVertex - triangleVertices[0]->mVertex)
+                                            ),
+                                  0.0);
+        trianglePlane.w = - glm::dot(glm::vec3(trianglePlane), triangleVertices[0]->mVertex);
+        glm::vec3 triangleEdges[2]={
+                    triangleVertices[1]->mVertex - triangleVertices[0]->mVertex,
+                    triangleVertices[2]->mVertex - triangleVertices[0]->mVertex
+        };
+
+        glm::ivec3 startIndices, endIndices;
+        triangleExtent(t, startIndices, endIndices);
+        if (startIndices.z >= kEnd || endIndices.z < kBegin)
+            continue;
+        startIndices.z = std::max(startIndices.z, kBegin);
+        endIndices.z = std::min(endIndices.z, kEnd - 1);
+
+        // Rasterize triangle
+        for (int i=startIndices.x; i<=endIndices.x; i++) {
+            for (int j=startIndices.y; j<=endIndices.y; j++) {
+                for (int k=startIndices.z; k<=endIndices.z; k++){
+                    if ( inVoxel(i, j, k, trianglePlane) ) {
+                         ptrVoxel *theVoxel = &(mVoxelGrid[ index(i, j, k) ]);
+                         if (*theVoxel==NULL) {
+                             *theVoxel=new DFVoxel(mDistanceFieldBox.getMin() + glm::vec3( (i+0.5f), (j+0.5f), (k+0.5f) )*mGridStep);
+                         }
+                         (*theVoxel)->addTriangle(t, triangleVertices, trianglePlane, triangleEdges);
+                    }
+                }
+            }
+        }
+    }
+}
+
 void DistanceField::build(float precision){
     Timer tbuild;
     mGridStep = precision;
@@ -278,54 +355,20 @@ void DistanceField::build(float precision){
     mVoxelGrid = new ptrVoxel[mGridSize.x * mGridSize.y * mGridSize.z];
     memset(mVoxelGrid, 0, mGridSize.x * mGridSize.y * mGridSize.z * sizeof(ptrVoxel));
 
+    // the triangles are binned by the slabs they reach, in order
+    int numSlabs = (mGridSize.z + SLAB_SLICES - 1) / SLAB_SLICES;
+    std::vector<std::vector<int> > slabTriangles(numSlabs);
     for (unsigned int t=0; t<mIndices.size(); t+=3){
-        // Get triangle info
-        Mesh::VertexData *triangleVertices[3]={&(mVertices[mIndices[t]]), &(mVertices[mIndices[t+1]]), &(mVertices[mIndices[t+2]])};
-        glm::vec4 trianglePlane( glm::cross(
-                                                (triangleVertices[1]->mVertex - triangleVertices[0]->mVertex),
-                                                (triangleVertices[2]->mVertex - triangleVertices[0]->mVertex)
-                                            ),
-                                  0.0);
-        trianglePlane.w = - glm::dot(glm::vec3(trianglePlane), triangleVertices[0]->mVertex);
-        glm::vec3 triangleEdges[2]={
-                    triangleVertices[1]->mVertex - triangleVertices[0]->mVertex,
-                    triangleVertices[2]->mVertex - triangleVertices[0]->mVertex
-        };
-
-        BBox triangleBox;
-        triangleBox += triangleVertices[0]->mVertex;
-        triangleBox += triangleVertices[1]->mVertex;
-        triangleBox += triangleVertices[2]->mVertex;
-
-        // compute triangle extend in grid coordinates
-#ifdef LIMITTOBBOX
-        glm::ivec3 startIndices( (triangleBox.getMin() - mDistanceFieldBox.getMin() ) / mGridStep);
-        glm::ivec3 endIndices( (triangleBox.getMax() - mDistanceFieldBox.getMin() ) / mGridStep);
-#else
-#define VOXEL_BORDER 4
-        glm::ivec3 imin( (triangleBox.getMin() - mDistanceFieldBox.getMin() ) / mGridStep);
-        glm::ivec3 imax( (triangleBox.getMax() - mDistanceFieldBox.getMin() ) / mGridStep);
-
-        glm::ivec3 startIndices( glm::max( imin - glm::ivec3(VOXEL_BORDER), glm::ivec3(0) ) );
-        glm::ivec3 endIndices( glm::min( imax + glm::ivec3(VOXEL_BORDER), mGridSize-glm::ivec3(1) ) );
-#endif
-
-        // Rasterize triangle
-        for (int i=startIndices.x; i<=endIndices.x; i++) {
-            for (int j=startIndices.y; j<=endIndices.y; j++) {
-                for (int k=startIndices.z; k<=endIndices.z; k++){
-                    if ( inVoxel(i, j, k, trianglePlane) ) {
-                         ptrVoxel *theVoxel = &(mVoxelGrid[ index(i, j, k) ]);
-                         if (*theVoxel==NULL) {
-                             *theVoxel=new DFVoxel(mDistanceFieldBox.getMin() + glm::vec3( (i+0.5f), (j+0.5f), (k+0.5f) )*mGridStep);
-                         }
-                         (*theVoxel)->addTriangle(t, triangleVertices, trianglePlane, triangleEdges);
-                    }
-                }
-            }
-        }
+        glm::ivec3 startIndices, endIndices;
+        triangleExtent(t, startIndices, endIndices);
+        for (int slab = std::max(startIndices.z, 0) / SLAB_SLICES; slab <= std::min(endIndices.z / SLAB_SLICES, numSlabs - 1); ++slab)
+            slabTriangles[slab].push_back(t);
     }
 
+    // each thread owns a slab of slices : the voxels receive their triangles in order, without locks
+    SlabRasterizer rasterizer(this, slabTriangles);
+    parallelFor(0, numSlabs, rasterizer, 1);
+
     tbuild.stop();
     std::cerr << "Building grid done : " << tbuild.value() << std::endl;
     /* prepare to draw ... (just to debug) ... */
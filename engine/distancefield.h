@@ -65,6 +65,16 @@ class DistanceField
 
     bool inVoxel(int i, int j, int k, const glm::vec4 &triangle);
 
+    /* Slices of a slab, slabs are built in parallel */
+    static const int SLAB_SLICES = 4;
+
+    /* Voxels reached by the triangle starting at the index t : its bounding box, with a border */
+    void triangleExtent(int t, glm::ivec3 &startIndices, glm::ivec3 &endIndices) const;
+
+    /* Rasterize the triangles in the slices [kBegin, kEnd) of the grid : disjoint slabs are built in parallel */
+    void rasterizeTriangles(int kBegin, int kEnd, const std::vector<int> &triangles);
+    class SlabRasterizer;
+
     // far drawing (debug)
     // OpenGL stuffs
     GLuint mVertexArrayObject;
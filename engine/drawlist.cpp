@@ -0,0 +1,271 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "drawlist.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include "renderloop.h"
+#include "timer.h"
+
+namespace vortex {
+
+static const int DEPTH_SHIFT = 0;
+static const int TRANSFORM_SHIFT = DEPTH_SHIFT + DrawList::DEPTH_BITS;
+static const int MATERIAL_SHIFT = TRANSFORM_SHIFT + DrawList::TRANSFORM_BITS;
+static const int SHADER_SHIFT = MATERIAL_SHIFT + DrawList::MATERIAL_BITS;
+
+bool DrawList::MatrixLess::operator() (const glm::mat4x4 &a, const glm::mat4x4 &b) const {
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if (a[i][j] < b[i][j]) {
+                return true;
+            } else if (a[i][j] > b[i][j]) {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+DrawList::DrawList() : Drawable(), mDepthSorting(false)
+{
+}
+
+DrawList::~DrawList()
+{
+}
+
+void DrawList::clear()
+{
+    mItems.clear();
+    mFreeItems.clear();
+    mSorted.clear();
+    mShaders.clear();
+    mMaterials.clear();
+    mTransforms.clear();
+}
+
+uint64_t DrawList::buildKey(int shader, int material, int transform, uint32_t depth) const
+{
+    // indices exceeding their bit range (more distinct states in use than the bits allow) only degrade the state
+    // sharing, items keep their own indices
+    return (uint64_t(shader & ((1 << SHADER_BITS) - 1)) << SHADER_SHIFT) |
+           (uint64_t(material & ((1 << MATERIAL_BITS) - 1)) << MATERIAL_SHIFT) |
+           (uint64_t(transform & ((1 << TRANSFORM_BITS) - 1)) << TRANSFORM_SHIFT) |
+           (uint64_t(depth & ((1 << DEPTH_BITS) - 1)) << DEPTH_SHIFT);
+}
+
+DrawList::ItemId DrawList::insert(ShaderProgram *shader, Material *material, const glm::mat4x4 &transform, Mesh::MeshPtr mesh,
+                                  const SceneGraph::Node *node, int slot)
+{
+    Item item;
+    item.mShader = mShaders.acquire(shader);
+    item.mMaterial = mMaterials.acquire(material);
+    item.mTransform = mTransforms.acquire(transform);
+    item.mMesh = mesh;
+    item.mNode = node;
+    item.mSlot = slot;
+    item.mKey = buildKey(item.mShader, item.mMaterial, item.mTransform, 0);
+
+    ItemId id;
+    if (mFreeItems.empty()) {
+        id = mItems.size();
+        mItems.push_back(item);
+    } else {
+        id = mFreeItems.back();
+        mFreeItems.pop_back();
+        mItems[id] = item;
+    }
+    insertSorted(id);
+    return id;
+}
+
+void DrawList::remove(ItemId id)
+{
+    removeSorted(id);
+    mShaders.release(mItems[id].mShader);
+    mMaterials.release(mItems[id].mMaterial);
+    mTransforms.release(mItems[id].mTransform);
+    mItems[id].mMesh = NULL;
+    mItems[id].mNode = NULL;
+    mFreeItems.push_back(id);
+}
+
+void DrawList::setTransform(ItemId id, const glm::mat4x4 &transform)
+{
+    Item &item = mItems[id];
+    int transformId = mTransforms.acquire(transform);
+    mTransforms.release(item.mTransform);
+    if (transformId == item.mTransform)
+        return;
+    removeSorted(id);
+    item.mTransform = transformId;
+    item.mKey = buildKey(item.mShader, item.mMaterial, item.mTransform, uint32_t(item.mKey & ((1 << DEPTH_BITS) - 1)));
+    insertSorted(id);
+}
+
+void DrawList::insertSorted(ItemId id)
+{
+    SortEntry entry;
+    entry.mKey = mItems[id].mKey;
+    entry.mItem = id;
+    mSorted.insert(std::upper_bound(mSorted.begin(), mSorted.end(), entry), entry);
+}
+
+void DrawList::removeSorted(ItemId id)
+{
+    SortEntry entry;
+    entry.mKey = mItems[id].mKey;
+    entry.mItem = id;
+    std::pair<std::vector<SortEntry>::iterator, std::vector<SortEntry>::iterator> range = std::equal_range(mSorted.begin(), mSorted.end(), entry);
+    for (std::vector<SortEntry>::iterator it = range.first; it != range.second; ++it) {
+        if (it->mItem == id) {
+            mSorted.erase(it);
+            return;
+        }
+    }
+    std::cerr << "DrawList::remove : item " << id << " not found" << std::endl;
+}
+
+void DrawList::updateDepths(const glm::mat4x4 &modelviewMatrix)
+{
+    // view depth of each item bounding box center, normalized on the current depth range
+    std::vector<float> depths(mSorted.size());
+    float minDepth = FLT_MAX;
+    float maxDepth = -FLT_MAX;
+    for (unsigned int i = 0; i < mSorted.size(); ++i) {
+        Item &item = mItems[mSorted[i].mItem];
+        BBox box = item.mMesh->boundingBox();
+        glm::vec3 center = 0.5f * (box.getMin() + box.getMax());
+        glm::vec4 viewCenter = modelviewMatrix * mTransforms[item.mTransform] * glm::vec4(center, 1.f);
+        depths[i] = -viewCenter.z;
+        minDepth = std::min(minDepth, depths[i]);
+        maxDepth = std::max(maxDepth, depths[i]);
+    }
+    float scale = (maxDepth > minDepth) ? float((1 << DEPTH_BITS) - 1) / (maxDepth - minDepth) : 0.f;
+    for (unsigned int i = 0; i < mSorted.size(); ++i) {
+        Item &item = mItems[mSorted[i].mItem];
+        item.mKey = buildKey(item.mShader, item.mMaterial, item.mTransform, uint32_t((depths[i] - minDepth) * scale));
+        mSorted[i].mKey = item.mKey;
+    }
+}
+
+void DrawList::radixSort()
+{
+    // LSD radix sort, 16 bits digits, skipping the digits shared by all the keys
+    const int DIGIT_BITS = 16;
+    const int NUM_BUCKETS = 1 << DIGIT_BITS;
+    mRadixCounts.resize(NUM_BUCKETS);
+    std::vector<int> &counts = mRadixCounts;
+    mSortBuffer.resize(mSorted.size());
+
+    for (int shift = 0; shift < 64; shift += DIGIT_BITS) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (unsigned int i = 0; i < mSorted.size(); ++i)
+            ++counts[(mSorted[i].mKey >> shift) & (NUM_BUCKETS - 1)];
+        if (counts[(mSorted[0].mKey >> shift) & (NUM_BUCKETS - 1)] == int(mSorted.size()))
+            continue;
+        int offset = 0;
+        for (int b = 0; b < NUM_BUCKETS; ++b) {
+            int c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (unsigned int i = 0; i < mSorted.size(); ++i)
+            mSortBuffer[counts[(mSorted[i].mKey >> shift) & (NUM_BUCKETS - 1)]++] = mSorted[i];
+        mSorted.swap(mSortBuffer);
+    }
+}
+
+void DrawList::render(const GlobalParameter *parameters, const glm::mat4x4 *modelviewMatrix, const glm::mat4x4 *projectionMatrix)
+{
+    mStatistics = Statistics();
+    if (mSorted.empty())
+        return;
+
+    if (mDepthSorting && modelviewMatrix) {
+        Timer sortTimer;
+        sortTimer.start();
+        updateDepths(*modelviewMatrix);
+        radixSort();
+        sortTimer.stop();
+        mStatistics.mSortTime = sortTimer.value();
+    }
+
+    int currentShader = -1;
+    int currentMaterial = -1;
+    int currentTransform = -1;
+    ShaderProgram *shader = NULL;
+    for (std::vector<SortEntry>::iterator it = mSorted.begin(); it != mSorted.end(); ++it) {
+        const Item &item = mItems[it->mItem];
+        if (item.mNode && item.mNode->isCulled())
+            continue;
+        if (item.mShader != currentShader) {
+            // uniforms belong to the program : material and transform must be set again
+            shader = mShaders[item.mShader];
+            if (parameters)
+                shader->bind(*parameters);
+            else
+                shader->bind();
+            currentShader = item.mShader;
+            currentMaterial = -1;
+            currentTransform = -1;
+            ++mStatistics.mShaderChanges;
+        }
+        if (item.mMaterial != currentMaterial) {
+            if (mMaterials[item.mMaterial])
+                MaterialState::bind(mMaterials[item.mMaterial], shader);
+            currentMaterial = item.mMaterial;
+            ++mStatistics.mMaterialChanges;
+        }
+        if (item.mTransform != currentTransform) {
+            const glm::mat4x4 &transform = mTransforms[item.mTransform];
+            glm::mat4x4 mv = modelviewMatrix ? (*modelviewMatrix) * transform : transform;
+            glm::mat4x4 projection = projectionMatrix ? *projectionMatrix : glm::mat4x4(1.f);
+            shader->setTransform(mv, projection, projection * mv, glm::transpose(glm::inverse(mv)));
+            currentTransform = item.mTransform;
+            ++mStatistics.mTransformChanges;
+        }
+        if (item.mNode)
+            item.mMesh->lod(item.mNode->lodLevel(item.mSlot))->draw();
+        else
+            item.mMesh->draw();
+        ++mStatistics.mDrawCalls;
+    }
+}
+
+void DrawList::draw()
+{
+    render(NULL, NULL, NULL);
+}
+
+void DrawList::draw(const GlobalParameter& parameters)
+{
+    render(&parameters, NULL, NULL);
+}
+
+void DrawList::draw(const GlobalParameter& parameters, const glm::mat4x4 &modelviewMatrix, const glm::mat4x4 &projectionMatrix)
+{
+    render(&parameters, &modelviewMatrix, &projectionMatrix);
+}
+
+void DrawList::draw(const glm::mat4x4 &modelviewMatrix, const glm::mat4x4 &projectionMatrix)
+{
+    render(NULL, &modelviewMatrix, &projectionMatrix);
+}
+
+std::ostream & operator << (std::ostream &out, const DrawList::Statistics &stats)
+{
+    out << "Draw calls : " << stats.mDrawCalls << std::endl;
+    out << "State changes : " << stats.mShaderChanges << " shaders, " << stats.mMaterialChanges << " materials, "
+        << stats.mTransformChanges << " transforms" << std::endl;
+    out << "Sort time : " << stats.mSortTime*1000. << " ms" << std::endl;
+    return out;
+}
+
+} // vortex
@@ -0,0 +1,206 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <map>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <stdint.h>
+
+#include "drawable.h"
+#include "bindable.h"
+#include "mesh.h"
+#include "shaderobject.h"
+#include "material.h"
+#include "scenegraph.h"
+
+namespace vortex {
+
+/**
+ *  Flat rendering loop : a vector of draw items sorted on a 64 bits key.
+ *  The key is made of, from the most significant bits, the shader, material and transform indices and a quantized depth.
+ *  Sorted this way, consecutive items share most of their state and the draw loop only binds what changed.
+ *
+ *  Items are inserted and removed one by one in the sorted order, without rebuilding the list.
+ *  The whole list is radix sorted only when the depth bits are updated (see setDepthSorting).
+ *  @ingroup RenderingLoops
+ */
+class DrawList : public Drawable {
+public:
+    /// Handle on an item, stable until the item is removed
+    typedef int ItemId;
+
+    static const int SHADER_BITS = 12;
+    static const int MATERIAL_BITS = 16;
+    static const int TRANSFORM_BITS = 16;
+    static const int DEPTH_BITS = 20;
+
+    /**
+     * Statistics of the last drawn frame
+     */
+    struct Statistics {
+        int mDrawCalls;
+        int mShaderChanges;
+        int mMaterialChanges;
+        int mTransformChanges;
+        double mSortTime; /// in seconds
+        Statistics() : mDrawCalls(0), mShaderChanges(0), mMaterialChanges(0), mTransformChanges(0), mSortTime(0.) {}
+    };
+
+    DrawList();
+    ~DrawList();
+
+    /**
+     * Add a mesh to the list.
+     *
+     * @param shader The program used to draw the mesh.
+     * @param material The mesh material, may be NULL.
+     * @param transform The mesh modelview transformation, relative to the camera one when drawing with matrix completion.
+     * @param mesh The mesh to draw.
+     * @param node The graph node holding the mesh, if any. The item is skipped while the node is culled.
+     * @param slot The slot of the mesh in the node, the mesh is drawn at the level of detail selected for the slot.
+     * @return The handle of the new item.
+     */
+    ItemId insert(ShaderProgram *shader, Material *material, const glm::mat4x4 &transform, Mesh::MeshPtr mesh,
+                  const SceneGraph::Node *node = NULL, int slot = 0);
+
+    /**
+     * Remove an item from the list.
+     */
+    void remove(ItemId id);
+
+    /**
+     * Change the transformation of an item, moving it to its new place in the list.
+     */
+    void setTransform(ItemId id, const glm::mat4x4 &transform);
+
+    void clear();
+    bool empty() const { return mSorted.empty(); }
+    int size() const { return mSorted.size(); }
+
+    /**
+     * Sort items sharing the same state front to back. The depth bits are recomputed and the list is radix sorted
+     * each time it is drawn with matrix completion.
+     */
+    void setDepthSorting(bool on) { mDepthSorting = on; }
+
+    void draw();
+    void draw(const GlobalParameter& parameters);
+
+    /**
+     * Draw with matrix completion : the items transforms are multiplied by modelview and projection before being bound.
+     */
+    void draw(const GlobalParameter& parameters, const glm::mat4x4 &modelviewMatrix, const glm::mat4x4 &projectionMatrix);
+    void draw(const glm::mat4x4 &modelviewMatrix, const glm::mat4x4 &projectionMatrix);
+
+    const Statistics &statistics() const { return mStatistics; }
+
+private:
+    struct Item {
+        uint64_t mKey;
+        int mShader;
+        int mMaterial;
+        int mTransform;
+        Mesh::MeshPtr mMesh;
+        const SceneGraph::Node *mNode;
+        int mSlot;
+    };
+
+    struct SortEntry {
+        uint64_t mKey;
+        ItemId mItem;
+        bool operator< (const SortEntry &other) const { return mKey < other.mKey; }
+    };
+
+    struct MatrixLess {
+        bool operator() (const glm::mat4x4 &a, const glm::mat4x4 &b) const;
+    };
+
+    /**
+     * Indices of the states shared by the items. The states are reference counted and the index of a state no more
+     * used is reused, so that the indices stay within their key bits while the items move or change.
+     */
+    template <typename State, typename Less = std::less<State> >
+    class StateTable {
+    public:
+        /** @return The index of a state, added if needed, with one more reference */
+        int acquire(const State &state) {
+            typename std::map<State, int, Less>::iterator it = mIndices.find(state);
+            if (it != mIndices.end()) {
+                ++mReferences[it->second];
+                return it->second;
+            }
+            int index;
+            if (mFree.empty()) {
+                index = mStates.size();
+                mStates.push_back(state);
+                mReferences.push_back(1);
+            } else {
+                index = mFree.back();
+                mFree.pop_back();
+                mStates[index] = state;
+                mReferences[index] = 1;
+            }
+            mIndices[state] = index;
+            return index;
+        }
+
+        /** Drop a reference, the state is removed with its last reference */
+        void release(int index) {
+            if (--mReferences[index] == 0) {
+                mIndices.erase(mStates[index]);
+                mFree.push_back(index);
+            }
+        }
+
+        void clear() {
+            mStates.clear();
+            mReferences.clear();
+            mFree.clear();
+            mIndices.clear();
+        }
+
+        const State &operator[](int index) const { return mStates[index]; }
+
+    private:
+        std::vector<State> mStates;
+        std::vector<int> mReferences;
+        std::vector<int> mFree;
+        std::map<State, int, Less> mIndices;
+    };
+
+    uint64_t buildKey(int shader, int material, int transform, uint32_t depth) const;
+    void insertSorted(ItemId id);
+    void removeSorted(ItemId id);
+    void updateDepths(const glm::mat4x4 &modelviewMatrix);
+    void radixSort();
+
+    void render(const GlobalParameter *parameters, const glm::mat4x4 *modelviewMatrix, const glm::mat4x4 *projectionMatrix);
+
+    std::vector<Item> mItems;
+    std::vector<ItemId> mFreeItems;
+    std::vector<SortEntry> mSorted;
+    std::vector<SortEntry> mSortBuffer;
+
+    // radix sort histogram, kept between the sorts
+    std::vector<int> mRadixCounts;
+
+    StateTable<ShaderProgram *> mShaders;
+    StateTable<Material *> mMaterials;
+    StateTable<glm::mat4x4, MatrixLess> mTransforms;
+
+    bool mDepthSorting;
+    Statistics mStatistics;
+};
+
+std::ostream & operator << (std::ostream &out, const DrawList::Statistics &stats);
+
+} // vortex
+
+#endif // DRAWLIST_H
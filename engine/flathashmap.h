@@ -0,0 +1,109 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef FLATHASHMAP_H
+#define FLATHASHMAP_H
+
+#include <vector>
+#include <cstddef>
+
+namespace vortex {
+
+/**
+ * Open addressing hash map with linear probing, its entries stored in a single array.
+ * Key must be copyable and provide hash() and operator==. Entries are never removed.
+ * The slots are iterated with capacity, used, key and value.
+ */
+template <typename Key, typename Value>
+class FlatHashMap {
+public:
+    FlatHashMap() : mSize(0) {}
+
+    /**
+     * @return A pointer to the value of key, NULL if key is not in the map
+     */
+    Value *find(const Key &key) {
+        if (mSlots.empty())
+            return NULL;
+        unsigned int mask = mSlots.size() - 1;
+        for (unsigned int i = key.hash() & mask; mSlots[i].mUsed; i = (i + 1) & mask) {
+            if (mSlots[i].mKey == key)
+                return &(mSlots[i].mValue);
+        }
+        return NULL;
+    }
+
+    /**
+     * Insert key or replace its value
+     */
+    void insert(const Key &key, const Value &value) {
+        // load factor below 1/2
+        if (2 * (mSize + 1) > mSlots.size())
+            grow();
+        unsigned int mask = mSlots.size() - 1;
+        unsigned int i = key.hash() & mask;
+        for (; mSlots[i].mUsed; i = (i + 1) & mask) {
+            if (mSlots[i].mKey == key) {
+                mSlots[i].mValue = value;
+                return;
+            }
+        }
+        mSlots[i].mKey = key;
+        mSlots[i].mValue = value;
+        mSlots[i].mUsed = true;
+        ++mSize;
+    }
+
+    unsigned int size() const {
+        return mSize;
+    }
+
+    void clear() {
+        mSlots.clear();
+        mSize = 0;
+    }
+
+    unsigned int capacity() const {
+        return mSlots.size();
+    }
+
+    bool used(unsigned int slot) const {
+        return mSlots[slot].mUsed;
+    }
+
+    const Key &key(unsigned int slot) const {
+        return mSlots[slot].mKey;
+    }
+
+    Value &value(unsigned int slot) {
+        return mSlots[slot].mValue;
+    }
+
+private:
+    struct Slot {
+        Slot() : mUsed(false) {}
+        Key mKey;
+        Value mValue;
+        bool mUsed;
+    };
+
+    void grow() {
+        std::vector<Slot> slots(mSlots.empty() ? 16 : 2 * mSlots.size());
+        slots.swap(mSlots);
+        mSize = 0;
+        for (unsigned int i = 0; i < slots.size(); ++i) {
+            if (slots[i].mUsed)
+                insert(slots[i].mKey, slots[i].mValue);
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    unsigned int mSize;
+};
+
+} // namespace vortex
+
+#endif // FLATHASHMAP_H
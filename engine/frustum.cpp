@@ -0,0 +1,59 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "frustum.h"
+
+namespace vortex {
+
+Frustum::Frustum()
+{
+    set(glm::mat4x4(1.f), glm::mat4x4(1.f));
+}
+
+Frustum::Frustum(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
+{
+    set(modelViewMatrix, projectionMatrix);
+}
+
+void Frustum::set(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
+{
+    // Gribb and Hartmann : planes are sums and differences of the clip matrix rows
+    glm::mat4x4 clip = glm::transpose(projectionMatrix * modelViewMatrix);
+    mPlanes[0] = clip[3] + clip[0]; // left
+    mPlanes[1] = clip[3] - clip[0]; // right
+    mPlanes[2] = clip[3] + clip[1]; // bottom
+    mPlanes[3] = clip[3] - clip[1]; // top
+    mPlanes[4] = clip[3] + clip[2]; // near
+    mPlanes[5] = clip[3] - clip[2]; // far
+    for (int i = 0; i < 6; ++i)
+        mPlanes[i] /= glm::length(glm::vec3(mPlanes[i]));
+}
+
+Frustum::Intersection Frustum::intersect(const BBox &box) const
+{
+    if (box.isEmpty())
+        return OUTSIDE;
+    glm::vec3 boxMin = box.getMin();
+    glm::vec3 boxMax = box.getMax();
+    Intersection result = INSIDE;
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4 &plane = mPlanes[i];
+        // corner the farthest along the plane normal, and the opposite one
+        glm::vec3 positive(plane.x >= 0.f ? boxMax.x : boxMin.x,
+                           plane.y >= 0.f ? boxMax.y : boxMin.y,
+                           plane.z >= 0.f ? boxMax.z : boxMin.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.f)
+            return OUTSIDE;
+        glm::vec3 negative(plane.x >= 0.f ? boxMin.x : boxMax.x,
+                           plane.y >= 0.f ? boxMin.y : boxMax.y,
+                           plane.z >= 0.f ? boxMin.z : boxMax.z);
+        if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.f)
+            result = INTERSECT;
+    }
+    return result;
+}
+
+} // namespace vortex
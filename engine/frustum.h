@@ -0,0 +1,47 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "opengl.h"
+#include "bbox.h"
+
+namespace vortex {
+
+/**
+ * View frustum, as six planes extracted from a projection * modelview matrix.
+ * Planes normals point inside the frustum.
+ */
+class Frustum {
+public:
+    enum Intersection {OUTSIDE, INTERSECT, INSIDE};
+
+    Frustum();
+
+    /**
+     * Extract the planes of the frustum.
+     *
+     * @param modelViewMatrix Camera matrix, the planes are expressed in the space this matrix is applied to.
+     * @param projectionMatrix Camera projection.
+     */
+    Frustum(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+
+    void set(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+
+    /**
+     * Classify an axis aligned box against the frustum.
+     * The test is conservative : some boxes outside the frustum near its corners are reported as intersecting.
+     */
+    Intersection intersect(const BBox &box) const;
+
+private:
+    glm::vec4 mPlanes[6];
+};
+
+} // namespace vortex
+
+#endif // FRUSTUM_H
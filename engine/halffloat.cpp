@@ -0,0 +1,123 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "halffloat.h"
+
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace vortex {
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Convert a positive float to an unsigned float with 5 exponent bits and mantissaBits mantissa bits, rounding to nearest even.
+ * This is the half float conversion when mantissaBits is 10, without the sign.
+ */
+static uint32_t toSmallFloat(uint32_t bits, int mantissaBits)
+{
+    const int shift = 23 - mantissaBits;
+    const uint32_t infinity = 0x1fu << mantissaBits;
+    int exponent = int((bits >> 23) & 0xff);
+    if (exponent == 0xff)
+        // infinity or NaN
+        return infinity | ((bits & 0x7fffff) ? (1u << (mantissaBits - 1)) : 0u);
+    if (exponent > 127 + 15)
+        return infinity;
+    if (exponent < 127 - 14) {
+        // denormal or zero
+        if (exponent < 127 - 14 - mantissaBits - 1)
+            return 0;
+        uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+        int denormalShift = shift + (127 - 14 - exponent);
+        uint32_t result = mantissa >> denormalShift;
+        uint32_t remainder = mantissa & ((1u << denormalShift) - 1);
+        uint32_t half = 1u << (denormalShift - 1);
+        if (remainder > half || (remainder == half && (result & 1)))
+            ++result;
+        return result;
+    }
+    uint32_t result = (uint32_t(exponent - 127 + 15) << mantissaBits) | ((bits & 0x7fffff) >> shift);
+    uint32_t remainder = bits & ((1u << shift) - 1);
+    uint32_t half = 1u << (shift - 1);
+    // a carry into the exponent gives the next power of 2, or infinity
+    if (remainder > half || (remainder == half && (result & 1)))
+        ++result;
+    return result;
+}
+
+void floatToHalf(const float *src, uint16_t *dst, int count)
+{
+    int i = 0;
+#ifdef __F16C__
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + i);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < count; ++i) {
+        uint32_t bits = floatBits(src[i]);
+        dst[i] = uint16_t(((bits >> 16) & 0x8000) | toSmallFloat(bits & 0x7fffffff, 10));
+    }
+}
+
+float halfToFloat(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // normalize the denormal
+            exponent = 127 - 14;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t toUnsignedSmallFloat(float value, int mantissaBits)
+{
+    uint32_t bits = floatBits(value);
+    if (bits & 0x80000000)
+        // negative values, and -NaN, are not representable
+        return 0;
+    return toSmallFloat(bits, mantissaBits);
+}
+
+uint32_t packR11G11B10F(float r, float g, float b)
+{
+    return toUnsignedSmallFloat(r, 6) | (toUnsignedSmallFloat(g, 6) << 11) | (toUnsignedSmallFloat(b, 5) << 22);
+}
+
+void floatToR11G11B10F(const float *src, int stride, uint32_t *dst, int count)
+{
+    for (int i = 0; i < count; ++i, src += stride)
+        dst[i] = packR11G11B10F(src[0], src[1], src[2]);
+}
+
+} // namespace vortex
@@ -0,0 +1,37 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef HALFFLOAT_H
+#define HALFFLOAT_H
+
+#include <stdint.h>
+
+namespace vortex {
+
+/**
+ * Convert floats to IEEE half floats, rounding to nearest even. Vectorized when the F16C instructions are available.
+ * Values too large for a half become infinite.
+ */
+void floatToHalf(const float *src, uint16_t *dst, int count);
+
+/**
+ * Convert an IEEE half float to a float.
+ */
+float halfToFloat(uint16_t half);
+
+/**
+ * Pack an RGB color in the GL_R11F_G11F_B10F layout (GL_UNSIGNED_INT_10F_11F_11F_REV). Negative values are clamped to 0.
+ */
+uint32_t packR11G11B10F(float r, float g, float b);
+
+/**
+ * Pack count RGB colors, read every stride floats, in the GL_R11F_G11F_B10F layout.
+ */
+void floatToR11G11B10F(const float *src, int stride, uint32_t *dst, int count);
+
+} // namespace vortex
+
+#endif // HALFFLOAT_H
@@ -6,10 +6,14 @@
 
 #include "light.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace vortex {
 
 Light::Light(aiLight *light){
     mName = std::string(light->mName.data);
+    mIsSun = (light->mType == aiLightSource_DIRECTIONAL);
     mPosition = glm::vec3(light->mPosition[0], light->mPosition[1], light->mPosition[2]);
     mDirection = glm::vec3(light->mDirection[0], light->mDirection[1], light->mDirection[2]);
     mAmbient = glm::vec3(light->mColorAmbient[0], light->mColorAmbient[1], light->mColorAmbient[2]);
@@ -17,6 +21,9 @@ Light::Light(aiLight *light){
     mSpecular = glm::vec3(light->mColorSpecular[0], light->mColorSpecular[1], light->mColorSpecular[2]);
     mAngleInnerCone= light->mAngleInnerCone*0.5; // light->mAngleInnerCone is the total angle
     mAngleOuterCone = light->mAngleOuterCone*0.5;
+    mAttenuationConstant = light->mAttenuationConstant;
+    mAttenuationLinear = light->mAttenuationLinear;
+    mAttenuationQuadratic = light->mAttenuationQuadratic;
 }
 
 Light::Light(std::string name, glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular):
@@ -25,11 +32,15 @@ Light::Light(std::string name, glm::vec3 position, glm::vec3 direction, glm::vec
     mIsSun = (mPosition == glm::vec3(0.));
     mAngleOuterCone = 2.*M_PI;
     mAngleInnerCone = 2.*M_PI;
+    mAttenuationConstant = 1.;
+    mAttenuationLinear = 0.;
+    mAttenuationQuadratic = 0.;
 }
 
 Light::Light(const Light &light, glm::mat4x4 transform)
 {
     mName = light.mName;
+    mIsSun = light.mIsSun;
     mAmbient = light.mAmbient;
     mDiffuse = light.mDiffuse;
     mSpecular = light.mSpecular;
@@ -40,11 +51,15 @@ Light::Light(const Light &light, glm::mat4x4 transform)
     mShadowMatrix = light.mShadowMatrix;
     mAngleOuterCone = light.mAngleOuterCone;
     mAngleInnerCone = light.mAngleInnerCone;
+    mAttenuationConstant = light.mAttenuationConstant;
+    mAttenuationLinear = light.mAttenuationLinear;
+    mAttenuationQuadratic = light.mAttenuationQuadratic;
 }
 
 Light::Light()
 {
     mName = "default";
+    mIsSun = false;
     mPosition = glm::vec3(0.);
     mDirection = glm::vec3(0.,0., -1.);
     mAmbient = glm::vec3(1.);
@@ -52,6 +67,9 @@ Light::Light()
     mSpecular = glm::vec3(1.);
     mAngleOuterCone = 2.*M_PI;
     mAngleInnerCone = 2.*M_PI;
+    mAttenuationConstant = 1.;
+    mAttenuationLinear = 0.;
+    mAttenuationQuadratic = 0.;
     mTransform = glm::mat4(1.0f);
     mShadowMatrix = mTransform;
 
@@ -72,4 +90,19 @@ void Light::bind(GLuint shaderProgramId) const
     glAssert(glUniform1f(glGetUniformLocation(shaderProgramId, "uniLightAngleOuterCone"), mAngleOuterCone));
 }
 
+float Light::influenceRadius(float threshold) const
+{
+    // suns light the whole scene, whatever their attenuation
+    if (mIsSun || (mAttenuationLinear <= 0.f && mAttenuationQuadratic <= 0.f))
+        return -1.f;
+    float intensity = std::max(mDiffuse[0], std::max(mDiffuse[1], mDiffuse[2]));
+    // solve  c + l*d + q*d^2 = intensity/threshold
+    float c = mAttenuationConstant - intensity/threshold;
+    if (c >= 0.f)
+        return 0.f;
+    if (mAttenuationQuadratic > 0.f)
+        return (-mAttenuationLinear + sqrtf(mAttenuationLinear*mAttenuationLinear - 4.f*mAttenuationQuadratic*c)) / (2.f*mAttenuationQuadratic);
+    return -c/mAttenuationLinear;
+}
+
 }
@@ -63,6 +63,14 @@ public:
 
     void bind(GLuint shaderProgramId) const;
 
+    /**
+     * Distance beyond which the light contribution falls under "threshold".
+     *
+     * @param threshold Lowest significant irradiance.
+     * @return The influence radius or a negative value if the light is a sun or is not attenuated.
+     */
+    float influenceRadius(float threshold) const;
+
     void printDebug(){
         using vortex::util::operator <<;
         std::cerr << "light " << mName << " pos " << mPosition << " dir " << mDirection << " diff " << mDiffuse;
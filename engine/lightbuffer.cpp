@@ -0,0 +1,155 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "lightbuffer.h"
+
+#include <algorithm>
+
+namespace vortex {
+
+LightBuffer::LightBuffer() : mNumLights(0), mTilesX(1), mTilesY(1), mTiled(false), mTiledThreshold(32), mCutoff(0.01f), mAttenuation(false)
+{
+    // buffer textures can not be empty : allocate one element of each
+    glm::vec4 noLight[LIGHT_TEXELS];
+    GLint noTile[2] = {0, 0};
+    GLint noIndex = 0;
+
+    mLights = new Texture("lights", GL_TEXTURE_BUFFER);
+    mLights->bufferInitGL(GL_RGBA32F, sizeof(noLight), noLight);
+    mGrid = new Texture("lightGrid", GL_TEXTURE_BUFFER);
+    mGrid->bufferInitGL(GL_RG32I, sizeof(noTile), noTile);
+    mIndices = new Texture("lightIndices", GL_TEXTURE_BUFFER);
+    mIndices->bufferInitGL(GL_R32I, sizeof(noIndex), &noIndex);
+}
+
+LightBuffer::~LightBuffer()
+{
+    mLights->deleteGL();
+    mGrid->deleteGL();
+    mIndices->deleteGL();
+    delete mLights;
+    delete mGrid;
+    delete mIndices;
+}
+
+void LightBuffer::update(const std::vector<Light> &lights, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, int width, int height)
+{
+    mLightData.clear();
+    std::vector<glm::vec4> spheres;
+
+    if (lights.size() > 0) {
+        for (unsigned int i = 0; i < lights.size(); ++i) {
+            Light l = Light(lights[i], modelViewMatrix*lights[i].mTransform);
+            float radius = mAttenuation ? l.influenceRadius(mCutoff) : -1.f;
+            mLightData.push_back(glm::vec4(l.mPosition, mAttenuation && l.mIsSun ? 0.f : 1.f));
+            mLightData.push_back(glm::vec4(l.mDirection, l.mAngleInnerCone));
+            mLightData.push_back(glm::vec4(l.mDiffuse, l.mAngleOuterCone));
+            mLightData.push_back(glm::vec4(l.mSpecular, radius));
+            mLightData.push_back(glm::vec4(l.mAttenuationConstant, l.mAttenuationLinear, l.mAttenuationQuadratic, 0.f));
+            spheres.push_back(glm::vec4(l.mPosition, radius));
+        }
+    } else { // no lights in scene, set up a headlight
+        Light l;
+        l.mDiffuse = glm::vec3(4.0, 4.0, 4.0);
+        mLightData.push_back(glm::vec4(l.mPosition, 1.f));
+        mLightData.push_back(glm::vec4(l.mDirection, l.mAngleInnerCone));
+        mLightData.push_back(glm::vec4(l.mDiffuse, l.mAngleOuterCone));
+        mLightData.push_back(glm::vec4(l.mSpecular, -1.f));
+        mLightData.push_back(glm::vec4(l.mAttenuationConstant, l.mAttenuationLinear, l.mAttenuationQuadratic, 0.f));
+        spheres.push_back(glm::vec4(l.mPosition, -1.f));
+    }
+    mNumLights = spheres.size();
+    mLights->bufferUpdateGL(mLightData.size()*sizeof(glm::vec4), &(mLightData[0]));
+
+    mTiled = (mNumLights > mTiledThreshold);
+    if (mTiled)
+        buildTiles(spheres, projectionMatrix, width, height);
+}
+
+void LightBuffer::buildTiles(const std::vector<glm::vec4> &spheres, const glm::mat4x4 &projectionMatrix, int width, int height)
+{
+    mTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    mTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    int numTiles = mTilesX*mTilesY;
+
+    // screen space tile rectangle of each light : xmin, ymin, xmax, ymax (empty if xmin > xmax)
+    std::vector<glm::ivec4> rects(spheres.size());
+    for (unsigned int i = 0; i < spheres.size(); ++i) {
+        glm::vec3 center = glm::vec3(spheres[i]);
+        float radius = spheres[i][3];
+        glm::ivec4 &r = rects[i];
+        if (radius < 0.f) { // no attenuation : light every tile
+            r = glm::ivec4(0, 0, mTilesX-1, mTilesY-1);
+            continue;
+        }
+        if (radius == 0.f || center.z - radius > 0.f) { // no influence or behind the camera
+            r = glm::ivec4(0, 0, -1, -1);
+            continue;
+        }
+        // project the corners of the view space box bounding the sphere
+        glm::vec2 ndcMin(1.f), ndcMax(-1.f);
+        bool crossCamera = false;
+        for (int c = 0; c < 8 && !crossCamera; ++c) {
+            glm::vec3 corner = center + radius*glm::vec3(c&1 ? 1.f : -1.f, c&2 ? 1.f : -1.f, c&4 ? 1.f : -1.f);
+            glm::vec4 clip = projectionMatrix * glm::vec4(corner, 1.f);
+            if (clip.w <= 0.f) {
+                crossCamera = true;
+            } else {
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+        }
+        if (crossCamera) {
+            r = glm::ivec4(0, 0, mTilesX-1, mTilesY-1);
+            continue;
+        }
+        ndcMin = glm::clamp(ndcMin, glm::vec2(-1.f), glm::vec2(1.f));
+        ndcMax = glm::clamp(ndcMax, glm::vec2(-1.f), glm::vec2(1.f));
+        r[0] = int((ndcMin.x*0.5f + 0.5f) * width) / TILE_SIZE;
+        r[1] = int((ndcMin.y*0.5f + 0.5f) * height) / TILE_SIZE;
+        r[2] = std::min(int((ndcMax.x*0.5f + 0.5f) * width) / TILE_SIZE, mTilesX-1);
+        r[3] = std::min(int((ndcMax.y*0.5f + 0.5f) * height) / TILE_SIZE, mTilesY-1);
+    }
+
+    // count, prefix sum, then scatter the light indices
+    mTileCounts.assign(numTiles, 0);
+    for (unsigned int i = 0; i < rects.size(); ++i)
+        for (int y = rects[i][1]; y <= rects[i][3]; ++y)
+            for (int x = rects[i][0]; x <= rects[i][2]; ++x)
+                ++mTileCounts[y*mTilesX + x];
+
+    mGridData.resize(2*numTiles);
+    int offset = 0;
+    for (int t = 0; t < numTiles; ++t) {
+        mGridData[2*t] = offset;
+        mGridData[2*t+1] = 0;
+        offset += mTileCounts[t];
+    }
+    mIndicesData.resize(std::max(offset, 1));
+    for (unsigned int i = 0; i < rects.size(); ++i)
+        for (int y = rects[i][1]; y <= rects[i][3]; ++y)
+            for (int x = rects[i][0]; x <= rects[i][2]; ++x) {
+                int t = y*mTilesX + x;
+                mIndicesData[mGridData[2*t] + mGridData[2*t+1]++] = i;
+            }
+
+    mGrid->bufferUpdateGL(mGridData.size()*sizeof(GLint), &(mGridData[0]));
+    mIndices->bufferUpdateGL(mIndicesData.size()*sizeof(GLint), &(mIndicesData[0]));
+}
+
+void LightBuffer::addParameters(ShadersGlobalParameters &parameters)
+{
+    parameters.addParameter("uniLights", mLights);
+    parameters.addParameter("uniLightGrid", mGrid);
+    parameters.addParameter("uniLightIndices", mIndices);
+    parameters.addParameter("uniNumLights", mNumLights);
+    parameters.addParameter("uniTiledLighting", mTiled ? 1 : 0);
+    parameters.addParameter("uniTileSize", int(TILE_SIZE));
+    parameters.addParameter("uniTilesX", mTilesX);
+}
+
+}
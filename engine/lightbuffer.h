@@ -0,0 +1,104 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef LIGHTBUFFER_H
+#define LIGHTBUFFER_H
+
+#include <vector>
+
+#include "opengl.h"
+#include "light.h"
+#include "texture.h"
+#include "shaderobject.h"
+
+namespace vortex {
+
+/**
+ * Packs all the lights of a scene into buffer textures so that a single shading pass
+ * can iterate over them.
+ *
+ * Each light is stored as LIGHT_TEXELS RGBA32F texels in the "uniLights" buffer, in view space :
+ *  - position.xyz, w = 0 for directionnal lights
+ *  - direction.xyz, inner cone angle
+ *  - diffuse.rgb, outer cone angle
+ *  - specular.rgb, influence radius (negative if infinite)
+ *  - constant, linear and quadratic attenuation
+ *
+ * Without attenuation (the default) every light is packed as an unattenuated point light with an infinite radius,
+ * as the former per light passes shaded them.
+ *
+ * Above a configurable number of lights, lights are binned into screen tiles of TILE_SIZE pixels.
+ * The "uniLightGrid" buffer then gives for each tile an (offset, count) pair in the "uniLightIndices" buffer.
+ */
+class LightBuffer {
+public:
+    static const int LIGHT_TEXELS = 5;
+    static const int TILE_SIZE = 16;
+
+    LightBuffer();
+    ~LightBuffer();
+
+    /**
+     * Pack the lights for the current frame.
+     *
+     * @param lights Scene lights, in world space. If empty a headlight is used.
+     * @param modelViewMatrix Camera matrix.
+     * @param projectionMatrix Camera projection.
+     * @param width Viewport width.
+     * @param height Viewport height.
+     */
+    void update(const std::vector<Light> &lights, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, int width, int height);
+
+    /**
+     * Add the light buffers and counts to a set of shader parameters.
+     */
+    void addParameters(ShadersGlobalParameters &parameters);
+
+    /**
+     * Number of lights above which the tiled light list is built.
+     */
+    void setTiledThreshold(int threshold) { mTiledThreshold = threshold; }
+    int tiledThreshold() const { return mTiledThreshold; }
+
+    /**
+     * Irradiance under which a light is considered to have no influence.
+     */
+    void setCutoff(float cutoff) { mCutoff = cutoff; }
+
+    /**
+     * Attenuate the point and spot lights with their distance and shade the suns as directionnal lights.
+     */
+    void setAttenuation(bool attenuation) { mAttenuation = attenuation; }
+    bool attenuation() const { return mAttenuation; }
+
+    int numLights() const { return mNumLights; }
+    bool isTiled() const { return mTiled; }
+
+private:
+    void buildTiles(const std::vector<glm::vec4> &spheres, const glm::mat4x4 &projectionMatrix, int width, int height);
+
+    Texture *mLights;
+    Texture *mGrid;
+    Texture *mIndices;
+
+    std::vector<glm::vec4> mLightData;
+    std::vector<GLint> mGridData;
+    std::vector<GLint> mIndicesData;
+    std::vector<GLint> mTileCounts;
+
+    int mNumLights;
+    int mTilesX;
+    int mTilesY;
+    bool mTiled;
+
+    int mTiledThreshold;
+    float mCutoff;
+    bool mAttenuation;
+};
+
+}
+
+#endif // LIGHTBUFFER_H
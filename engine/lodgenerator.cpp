@@ -0,0 +1,164 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "lodgenerator.h"
+#include "meshoptimizer.h"
+#include "animatedmesh.h"
+#include "timer.h"
+
+namespace vortex {
+
+namespace {
+
+/**
+ * Simplify a copy of the data of a Mesh, level after level
+ */
+class GenerateTask : public Task {
+public:
+    GenerateTask(LodGenerator *generator, MeshSimplifier *simplifier, LodGenerator::GeneratedLods *generated) :
+        mGenerator(generator), mSimplifier(simplifier), mGenerated(generated) {}
+
+    void run() {
+        Timer timer;
+        timer.start();
+        const Mesh *previous = mGenerated->mSource;
+        int numTriangles = previous->numIndices() / 3;
+        while (!mGenerator->canceled() && int(mGenerated->mLods.size()) < LodGenerator::MAX_LODS &&
+               numTriangles / LodGenerator::LOD_REDUCTION >= LodGenerator::MIN_LOD_TRIANGLES) {
+            Mesh *level = mSimplifier->simplify(*previous, numTriangles / LodGenerator::LOD_REDUCTION);
+            // a level saving less than a quarter of the triangles is not worth its memory
+            if (!level || level->numIndices() / 3 > numTriangles * 3 / 4 || level->numIndices() == 0) {
+                delete level;
+                break;
+            }
+            optimize(level);
+            mGenerated->mLods.push_back(level);
+            previous = level;
+            numTriangles = level->numIndices() / 3;
+        }
+        timer.stop();
+        mGenerated->mTime = timer.value();
+        mGenerator->generated(mGenerated);
+    }
+
+    const char *name() const {
+        return "generate lods";
+    }
+
+private:
+    /** Reorder a level for the vertex cache */
+    static void optimize(Mesh *level) {
+        std::vector<Mesh::VertexData> vertices(level->vertices(), level->vertices() + level->numVertices());
+        std::vector<int> indices(level->indices(), level->indices() + level->numIndices());
+        optimizeVertexCache(&(indices[0]), indices.size(), vertices.size());
+        std::vector<int> remap;
+        optimizeVertexFetch(&(vertices[0]), vertices.size(), &(indices[0]), indices.size(), remap);
+        level->setData(level->name(), &(vertices[0]), vertices.size(), &(indices[0]), indices.size());
+    }
+
+    LodGenerator *mGenerator;
+    MeshSimplifier *mSimplifier;
+    LodGenerator::GeneratedLods *mGenerated;
+};
+
+}
+
+LodGenerator::LodGenerator() : mSimplifier(NULL), mCanceled(0), mPending(0)
+{}
+
+LodGenerator::~LodGenerator()
+{
+    mCanceled.store(1);
+    mTasks.wait();
+    for (unsigned int i = 0; i < mGenerated.size(); ++i) {
+        for (unsigned int j = 0; j < mGenerated[i]->mLods.size(); ++j)
+            delete mGenerated[i]->mLods[j];
+        delete mGenerated[i]->mSource;
+        delete mGenerated[i];
+    }
+}
+
+void LodGenerator::generate(Mesh *mesh)
+{
+    if (!mSimplifier || dynamic_cast<AnimatedMesh *>(mesh) || mesh->numIndices() / 3 < LOD_REDUCTION * MIN_LOD_TRIANGLES)
+        return;
+    int id = mesh->meshId();
+    if (id >= 0) {
+        if (id < (int) mRevisions.size() && mRevisions[id] == mesh->revision())
+            return;
+        if (id >= (int) mRevisions.size())
+            mRevisions.resize(id + 1, -1);
+        mRevisions[id] = mesh->revision();
+    }
+    ++mPending;
+
+    GeneratedLods *generated = new GeneratedLods;
+    generated->mMesh = mesh;
+    generated->mRevision = mesh->revision();
+    generated->mSource = new Mesh(mesh->name(), mesh->vertices(), mesh->numVertices(), mesh->indices(), mesh->numIndices());
+    generated->mTime = 0.;
+    Task *task = new GenerateTask(this, mSimplifier, generated);
+    // without worker thread the queued tasks would only run once the group is waited
+    if (TaskScheduler::instance().numThreads() > 1) {
+        mTasks.run(task);
+    } else {
+        task->run();
+        delete task;
+    }
+}
+
+void LodGenerator::generated(GeneratedLods *generated)
+{
+    QMutexLocker lock(&mMutex);
+    mGenerated.push_back(generated);
+}
+
+bool LodGenerator::upload()
+{
+    bool uploaded = false;
+    for (;;) {
+        GeneratedLods *generated;
+        {
+            QMutexLocker lock(&mMutex);
+            if (mGenerated.empty())
+                break;
+            generated = mGenerated.front();
+            mGenerated.pop_front();
+        }
+        Mesh *mesh = generated->mMesh;
+        --mPending;
+        mStatistics.mGenerationTime += generated->mTime;
+        // modified meanwhile : the new data needs its own request
+        if (mesh->revision() == generated->mRevision) {
+            for (unsigned int i = 0; i < generated->mLods.size(); ++i)
+                generated->mLods[i]->init();
+            mesh->setLods(generated->mLods);
+            ++mStatistics.mMeshes;
+            mStatistics.mLevels += generated->mLods.size();
+            uploaded = true;
+        } else {
+            for (unsigned int i = 0; i < generated->mLods.size(); ++i)
+                delete generated->mLods[i];
+        }
+        delete generated->mSource;
+        delete generated;
+    }
+    return uploaded;
+}
+
+bool LodGenerator::pending() const
+{
+    return mPending > 0;
+}
+
+std::ostream & operator << (std::ostream &out, const LodGenerator::Statistics &stats)
+{
+    out << "Levels of detail : " << stats.mLevels << " levels for " << stats.mMeshes << " meshes, generated in "
+        << stats.mGenerationTime*1000. << " ms (all threads)" << std::endl;
+    return out;
+}
+
+} // namespace vortex
@@ -0,0 +1,152 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef LODGENERATOR_H
+#define LODGENERATOR_H
+
+#include <vector>
+#include <deque>
+#include <ostream>
+
+/// @todo remove QT dependencies here
+#include <QMutex>
+#include <QAtomicInt>
+
+#include "mesh.h"
+#include "taskscheduler.h"
+
+namespace vortex {
+
+/**
+ * Simplification of triangle meshes, implemented by the applications (the engine does not depend on a mesh library).
+ */
+class MeshSimplifier {
+public:
+    virtual ~MeshSimplifier() {}
+
+    /**
+     * Build a simplified version of a Mesh. Called from a background thread, concurrently for several Meshes.
+     *
+     * @param mesh The Mesh to simplify, without OpenGL data.
+     * @param numTriangles The number of triangles to reach.
+     * @return The simplified Mesh, without OpenGL data, NULL on failure.
+     */
+    virtual Mesh *simplify(const Mesh &mesh, int numTriangles) = 0;
+};
+
+/**
+ * Generation of the levels of detail of Meshes in the background, by tasks of the TaskScheduler : each level is
+ * simplified from the previous one with the MeshSimplifier, to a quarter of its triangles, and reordered for the
+ * vertex cache.
+ * The levels are initialized and given to their Mesh by upload, called once per frame from the OpenGL thread,
+ * if the Mesh was not modified meanwhile (see Mesh::revision). Animated meshes have no levels of detail.
+ */
+class LodGenerator {
+public:
+    /** Each level has about this fraction of the triangles of the previous one */
+    static const int LOD_REDUCTION = 4;
+
+    /** No level is generated under this number of triangles */
+    static const int MIN_LOD_TRIANGLES = 256;
+
+    /** Maximum number of levels, the Mesh itself not included */
+    static const int MAX_LODS = 6;
+
+    /**
+     * Generation metrics
+     */
+    struct Statistics {
+        Statistics() : mMeshes(0), mLevels(0), mGenerationTime(0.) {}
+
+        int mMeshes;
+        int mLevels;
+        double mGenerationTime; // summed over the generation threads, in seconds
+    };
+
+    LodGenerator();
+
+    /**
+     * Cancel the generations not started and wait for the running ones, their levels are dropped.
+     */
+    ~LodGenerator();
+
+    /**
+     * Set the simplification used by the generations, NULL to disable them. The simplifier is not owned.
+     */
+    void setSimplifier(MeshSimplifier *simplifier) {
+        mSimplifier = simplifier;
+    }
+
+    MeshSimplifier *simplifier() const {
+        return mSimplifier;
+    }
+
+    /**
+     * Request the levels of detail of the current data of a Mesh. Does nothing without simplifier.
+     *
+     * @param mesh The Mesh, it must stay alive until the next upload.
+     */
+    void generate(Mesh *mesh);
+
+    /**
+     * Give their levels to the Meshes generated since the last call and not modified meanwhile.
+     * Must be called from the OpenGL thread.
+     *
+     * @return true if some Meshes have new levels
+     */
+    bool upload();
+
+    /**
+     * @return true while some requested levels are not uploaded
+     */
+    bool pending() const;
+
+    const Statistics &statistics() const {
+        return mStatistics;
+    }
+
+    /**
+     * Levels generated for a Mesh
+     */
+    struct GeneratedLods {
+        Mesh *mMesh;
+        int mRevision;          // Mesh::revision when the data was copied
+        Mesh *mSource;          // copy of the Mesh data
+        std::vector<Mesh *> mLods;
+        double mTime;
+    };
+
+    /** Called by the generation tasks */
+    void generated(GeneratedLods *generated);
+
+    /** @return true once the destruction started, the tasks not started give their copy back without levels */
+    bool canceled() const {
+        return mCanceled.load() != 0;
+    }
+
+private:
+    MeshSimplifier *mSimplifier;
+    // the generation tasks, never waited before the destruction
+    TaskGroup mTasks;
+    QAtomicInt mCanceled;
+
+    // generated levels waiting for upload, shared with the generation tasks
+    QMutex mMutex;
+    std::deque<GeneratedLods *> mGenerated;
+
+    // last revision requested or generated of each mesh, by Mesh::meshId, to not generate the same levels twice :
+    // the ids stay valid while the AssetManager lives, the meshes without id are always simplified
+    std::vector<int> mRevisions;
+    int mPending;
+
+    Statistics mStatistics;
+};
+
+std::ostream & operator << (std::ostream &out, const LodGenerator::Statistics &stats);
+
+} // namespace vortex
+
+#endif // LODGENERATOR_H
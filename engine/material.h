@@ -108,7 +108,7 @@ public:
      * @return The Texture use, as a string, of the "i"th Texture stored in the Material.
      *
      */
-    std::string getTextureSemanticString(int i) {
+    const std::string &getTextureSemanticString(int i) {
         std::map<TextureSemantic, Texture *>::iterator it = mTextures.begin();
         while (i--)  ++it;
         return Material::TextureSemanticStrings[it->first];
@@ -5,20 +5,56 @@
  */
 
 #include <cstring>
+#include <cmath>
 #include <iostream>
+#include <algorithm>
 
 #include "mesh.h"
+#include "parallel.h"
 
 
 namespace vortex {
 
+namespace {
+
+/**
+ * Encode vertices in a VertexLayout
+ */
+class VertexPacker : public ParallelLoop {
+public:
+    VertexPacker(const VertexLayout &layout, const Mesh::VertexData *vertices, char *buffer) :
+        mLayout(layout), mVertices(vertices), mBuffer(buffer) {}
+
+    void operator()(int begin, int end) {
+        int stride = mLayout.stride();
+        for (int i = begin; i < end; ++i) {
+            const Mesh::VertexData &vertex = mVertices[i];
+            char *packed = mBuffer + i * stride;
+            mLayout.encode(VertexLayout::POSITION, glm::value_ptr(vertex.mVertex), packed);
+            mLayout.encode(VertexLayout::NORMAL, glm::value_ptr(vertex.mNormal), packed);
+            mLayout.encode(VertexLayout::TANGENT, glm::value_ptr(vertex.mTangent), packed);
+            mLayout.encode(VertexLayout::TEXCOORD, glm::value_ptr(vertex.mTexCoord), packed);
+        }
+    }
+
+private:
+    const VertexLayout &mLayout;
+    const Mesh::VertexData *mVertices;
+    char *mBuffer;
+};
+
+}
+
 
 
 Mesh::Mesh(std::string name) :
     mName(name),
     mVertices(NULL),
     mIndices(NULL),
-    meshId_(-1)
+    mIndexType(GL_UNSIGNED_INT),
+    mStorage(NULL),
+    meshId_(-1),
+    mRevision(0)
 {
 }
 
@@ -30,7 +66,10 @@ Mesh::Mesh(std::string name, const VertexData *vertices, int numVertices, const
     mVertices(NULL),
     mNumIndices(numIndices),
     mIndices(NULL),
-    meshId_(-1)
+    mIndexType(GL_UNSIGNED_INT),
+    mStorage(NULL),
+    meshId_(-1),
+    mRevision(0)
 {
     mVertices = new VertexData[mNumVertices];
     assert(mVertices);
@@ -43,15 +82,63 @@ Mesh::Mesh(std::string name, const VertexData *vertices, int numVertices, const
         mBbox += mVertices[i].mVertex;
 }
 
+Mesh::Mesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, SharedStorage *storage) :
+    mSelected(false),
+    mSelectedFaceId(0),
+    mName(name),
+    mNumVertices(numVertices),
+    mVertices(vertices),
+    mNumIndices(numIndices),
+    mIndices(indices),
+    mIndexType(GL_UNSIGNED_INT),
+    mStorage(storage),
+    meshId_(-1),
+    mRevision(0)
+{
+    mStorage->ref();
+    // compute Bbox
+    for (int i = 0; i < mNumVertices; i++)
+        mBbox += mVertices[i].mVertex;
+}
+
+Mesh::Mesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, const BBox &bbox) :
+    mSelected(false),
+    mSelectedFaceId(0),
+    mName(name),
+    mNumVertices(numVertices),
+    mVertices(vertices),
+    mNumIndices(numIndices),
+    mIndices(indices),
+    mIndexType(GL_UNSIGNED_INT),
+    mBbox(bbox),
+    mStorage(NULL),
+    meshId_(-1),
+    mRevision(0)
+{
+}
+
+void Mesh::releaseData()
+{
+    if (mStorage) {
+        mStorage->unref();
+        mStorage = NULL;
+    } else {
+        delete [] mVertices;
+        delete [] mIndices;
+    }
+    mVertices = NULL;
+    mIndices = NULL;
+}
+
 void Mesh::setData(std::string name, const Mesh::VertexData *vertices, int numVertices, const int *indices, int numIndices)
 {
     mName = name;
     mNumVertices = numVertices;
     mNumIndices = numIndices;
+    ++mRevision;
 
     //! @todo release(); when ensure that gl is initialized
-    delete [] mVertices;
-    delete [] mIndices;
+    releaseData();
     mVertices = new VertexData[mNumVertices];
     assert(mVertices);
     memcpy(mVertices, vertices, mNumVertices * sizeof(VertexData));
@@ -59,6 +146,7 @@ void Mesh::setData(std::string name, const Mesh::VertexData *vertices, int numVe
     assert(mIndices);
     memcpy(mIndices, indices, mNumIndices * sizeof(int));
     // compute Bbox
+    mBbox = BBox();
     for (int i = 0; i < mNumVertices; i++)
         mBbox += mVertices[i].mVertex;
 }
@@ -70,12 +158,15 @@ void Mesh::copy(const Mesh* m){
 
 Mesh::~Mesh()
 {
-    delete [] mVertices;
-    delete [] mIndices;
+    for (unsigned int i = 0; i < mLods.size(); ++i)
+        delete mLods[i];
+    releaseData();
 }
 
 void Mesh::release()
 {
+    setLods(std::vector<Mesh *>());
+
     glAssert(glBindVertexArray(mVertexArrayObject));
     glAssert(glBindBuffer(GL_ARRAY_BUFFER, 0));
     glAssert(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
@@ -91,9 +182,60 @@ void Mesh::reset()
     glAssert(glBindVertexArray(mVertexArrayObject));
 
     //! @warning dlyr : just update vertices data, not index !? i'm not sure it updates vao ptr
-    // bind vertexdata
+    // bind vertexdata, the new content may need another layout
+    VertexLayout layout = contentLayout();
+    std::vector<char> packed;
+    bool layoutChanged = !(layout == mLayout);
+    mLayout = layout;
+    packVertices(mVertices, packed);
     glAssert(glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObjects[VBO_VERTICES]));
-    glAssert(glBufferData(GL_ARRAY_BUFFER, mNumVertices * sizeof(VertexData),  mVertices, GL_STATIC_DRAW));
+    glAssert(glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? NULL : &(packed[0]), GL_STATIC_DRAW));
+    if (layoutChanged)
+        mLayout.setAttributes();
+}
+
+VertexLayout Mesh::contentLayout() const
+{
+    bool hasNormals = false;
+    bool hasTangents = false;
+    bool hasTexCoords = false;
+    bool texCoords2D = true;    // third coordinate null, fourth 0 or 1 : the shaders do not read them
+    bool texCoordsUnit = true;  // in [0, 1]
+    float maxTexCoord = 0.f;
+    for (int i = 0; i < mNumVertices; ++i) {
+        const VertexData &vertex = mVertices[i];
+        hasNormals = hasNormals || vertex.mNormal != glm::vec3(0.f);
+        hasTangents = hasTangents || vertex.mTangent != glm::vec3(0.f);
+        const glm::vec4 &texCoord = vertex.mTexCoord;
+        hasTexCoords = hasTexCoords || texCoord.x != 0.f || texCoord.y != 0.f;
+        texCoords2D = texCoords2D && texCoord.z == 0.f && (texCoord.w == 0.f || texCoord.w == 1.f);
+        texCoordsUnit = texCoordsUnit && texCoord.x >= 0.f && texCoord.x <= 1.f && texCoord.y >= 0.f && texCoord.y <= 1.f;
+        maxTexCoord = std::max(maxTexCoord, std::max(fabsf(texCoord.x), fabsf(texCoord.y)));
+    }
+
+    VertexLayout layout;
+    layout.setEncoding(VertexLayout::NORMAL, hasNormals ? VertexLayout::SNORM_10_10_10_2 : VertexLayout::OMITTED);
+    layout.setEncoding(VertexLayout::TANGENT, hasTangents ? VertexLayout::SNORM_10_10_10_2 : VertexLayout::OMITTED);
+    if (!texCoords2D)
+        layout.setEncoding(VertexLayout::TEXCOORD, VertexLayout::FLOAT4);
+    else if (!hasTexCoords)
+        layout.setEncoding(VertexLayout::TEXCOORD, VertexLayout::OMITTED);
+    else if (texCoordsUnit)
+        layout.setEncoding(VertexLayout::TEXCOORD, VertexLayout::UNORM16_2);
+    else if (maxTexCoord < 65504.f) // largest half float
+        layout.setEncoding(VertexLayout::TEXCOORD, VertexLayout::HALF2);
+    else
+        layout.setEncoding(VertexLayout::TEXCOORD, VertexLayout::FLOAT4);
+    return layout;
+}
+
+void Mesh::packVertices(const VertexData *vertices, std::vector<char> &buffer) const
+{
+    buffer.resize(mNumVertices * mLayout.stride());
+    if (buffer.empty())
+        return;
+    VertexPacker packer(mLayout, vertices, &(buffer[0]));
+    parallelFor(0, mNumVertices, packer, 16384);
 }
 int Mesh::meshId() const
 {
@@ -116,50 +258,76 @@ void Mesh::init()
     // always generate all buffers : one for vertexdata one for indices
     glAssert(glGenBuffers(2, mVertexBufferObjects));
 
-    // bind vertexdata
+    // bind vertexdata, packed in the layout their content needs
+    mLayout = contentLayout();
+    std::vector<char> packed;
+    packVertices(mVertices, packed);
     glAssert(glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObjects[VBO_VERTICES]));
-    glAssert(glBufferData(GL_ARRAY_BUFFER, mNumVertices * sizeof(VertexData),  mVertices, GL_STATIC_DRAW));
-
-    // global values
-    GLuint stride = sizeof(VertexData);
-    GLboolean normalized = GL_FALSE;
-    GLenum type = GL_FLOAT;
+    glAssert(glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? NULL : &(packed[0]), GL_STATIC_DRAW));
+    mLayout.setAttributes();
 
-    // mVertex
-    GLuint index = 0;
-    GLint size = 3;
-    GLvoid *pointer = BUFFER_OFFSET(0);
-
-    glAssert(glVertexAttribPointer(index, size, type, normalized, stride, pointer));
-    glAssert(glEnableVertexAttribArray(index));
+    // bind index data
+    glAssert(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVertexBufferObjects[VBO_INDICES]));
+    uploadIndices();
+}
 
-    // mNormal
-    index = 1;
-    size = 3;
-    pointer = BUFFER_OFFSET(sizeof(glm::vec3));
+void Mesh::uploadIndices()
+{
+    if (mNumVertices <= MAX_SHORT_INDEXED_VERTICES) {
+        mIndexType = GL_UNSIGNED_SHORT;
+        std::vector<GLushort> shortIndices(mIndices, mIndices + mNumIndices);
+        glAssert(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mNumIndices * sizeof(GLushort),
+                              shortIndices.empty() ? NULL : &(shortIndices[0]), GL_STATIC_DRAW));
+    } else {
+        mIndexType = GL_UNSIGNED_INT;
+        glAssert(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mNumIndices * sizeof(int),  mIndices, GL_STATIC_DRAW));
+    }
+}
 
-    glAssert(glVertexAttribPointer(index, size, type, normalized, stride, pointer));
-    glAssert(glEnableVertexAttribArray(index));
+void Mesh::reorder(const VertexData *vertices, const int *indices)
+{
+    memcpy(mVertices, vertices, mNumVertices * sizeof(VertexData));
+    memcpy(mIndices, indices, mNumIndices * sizeof(int));
 
-    // mTangente
-    index = 2;
-    size = 3;
-    pointer = BUFFER_OFFSET(2 * sizeof(glm::vec3));
+    glAssert(glBindVertexArray(mVertexArrayObject));
+    std::vector<char> packed;
+    packVertices(mVertices, packed);
+    glAssert(glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObjects[VBO_VERTICES]));
+    glAssert(glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? NULL : &(packed[0]), GL_STATIC_DRAW));
+    glAssert(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVertexBufferObjects[VBO_INDICES]));
+    uploadIndices();
+}
 
-    glAssert(glVertexAttribPointer(index, size, type, normalized, stride, pointer));
-    glAssert(glEnableVertexAttribArray(index));
+const float Mesh::LOD_PIXELS_PER_TRIANGLE = 4.f;
+const float Mesh::LOD_HYSTERESIS = 0.2f;
 
-    // mTexCoord
-    index = 3;
-    size = 4;
-    pointer = BUFFER_OFFSET(3 * sizeof(glm::vec3));
+void Mesh::setLods(const std::vector<Mesh *> &lods)
+{
+    for (unsigned int i = 0; i < mLods.size(); ++i) {
+        mLods[i]->release();
+        delete mLods[i];
+    }
+    mLods = lods;
+}
 
-    glAssert(glVertexAttribPointer(index, size, type, normalized, stride, pointer));
-    glAssert(glEnableVertexAttribArray(index));
+int Mesh::lodForTriangles(float numTriangles) const
+{
+    int level = 0;
+    while (level < int(mLods.size()) && mLods[level]->numIndices() / 3 >= numTriangles)
+        ++level;
+    return level;
+}
 
-    // bind index data
-    glAssert(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVertexBufferObjects[VBO_INDICES]));
-    glAssert(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mNumIndices * sizeof(int),  mIndices, GL_STATIC_DRAW));
+int Mesh::selectLod(float projectedSize, int currentLevel) const
+{
+    if (mLods.empty())
+        return 0;
+    int level = lodForTriangles(projectedSize * projectedSize / LOD_PIXELS_PER_TRIANGLE);
+    if (level > currentLevel) {
+        float size = projectedSize / (1.f - LOD_HYSTERESIS);
+        level = std::max(currentLevel, lodForTriangles(size * size / LOD_PIXELS_PER_TRIANGLE));
+    }
+    return level;
 }
 
 void Mesh::draw()
@@ -168,7 +336,7 @@ void Mesh::draw()
     glAssert(glBindVertexArray(mVertexArrayObject));
 
     // draw count elements in indices
-    GLenum type = GL_UNSIGNED_INT;
+    GLenum type = mIndexType;
     GLenum mode = GL_TRIANGLES;
     GLint count = mNumIndices;
     void *indices = NULL;
@@ -179,7 +347,7 @@ void Mesh::drawPatch(int patchSize)
 {
     glAssert(glBindVertexArray(mVertexArrayObject));
     // draw count elements in indices
-    GLenum type = GL_UNSIGNED_INT;
+    GLenum type = mIndexType;
     GLenum mode = GL_PATCHES;
     GLint count = mNumIndices;
     void *indices = NULL;
@@ -194,7 +362,7 @@ void Mesh::drawLines()
 {
     glAssert(glBindVertexArray(mVertexArrayObject));
     // draw count elements in indices
-    GLenum type = GL_UNSIGNED_INT;
+    GLenum type = mIndexType;
     GLenum mode = GL_LINES;
     GLint count = mNumIndices;
     void *indices = NULL;
@@ -205,7 +373,7 @@ void Mesh::drawLineStrip()
 {
     glAssert(glBindVertexArray(mVertexArrayObject));
     // draw count elements in indices
-    GLenum type = GL_UNSIGNED_INT;
+    GLenum type = mIndexType;
     GLenum mode = GL_LINE_STRIP;
     GLint count = mNumIndices;
     void *indices = NULL;
@@ -7,15 +7,20 @@
 #ifndef MESH_H
 #define MESH_H
 #include <string>
+#include <vector>
+#include <algorithm>
 
 #include "opengl.h"
 
 #include "bbox.h"
 #include "drawable.h"
+#include "vertexlayout.h"
 
 
 namespace vortex {
 
+class ShaderConfiguration;
+
 /**
  * Mesh representation class.
  *
@@ -44,6 +49,28 @@ public:
      */
     typedef Mesh * MeshPtr;
 
+    /**
+     * Storage of vertices and indices the Meshes use in place (a memory mapped file ...).
+     * It is deleted when the last Mesh using it releases it. Not thread safe.
+     */
+    class SharedStorage {
+    public:
+        SharedStorage() : mRefCount(0) {}
+        virtual ~SharedStorage() {}
+
+        void ref() {
+            ++mRefCount;
+        }
+
+        void unref() {
+            if (--mRefCount == 0)
+                delete this;
+        }
+
+    private:
+        int mRefCount;
+    };
+
     /**
      * Constructor : initialize Mesh attributes.
      *
@@ -62,6 +89,31 @@ public:
      */
     Mesh(std::string name, const VertexData *vertices, int numVertices, const int *indices, int numIndices);
 
+    /**
+     * Constructor, pointed data are used in place, without copy.
+     * The data must be writable : a memory mapped file must be mapped privately.
+     *
+     * @param name The name of the Mesh Object.
+     * @param vertices Pointer to the vertices structures defining the mesh points.
+     * @param numVertices Number of vertices structures in "vertices".
+     * @param indices Pointer to the vertices structures indices that define the triangular faces of the mesh.
+     * @param numIndices Number of indices in "indices".
+     * @param storage Owner of the pointed data, referenced while the Mesh uses them.
+     */
+    Mesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, SharedStorage *storage);
+
+    /**
+     * Constructor, the Mesh takes the ownership of the pointed data, allocated with new[].
+     *
+     * @param name The name of the Mesh Object.
+     * @param vertices Pointer to the vertices structures defining the mesh points.
+     * @param numVertices Number of vertices structures in "vertices".
+     * @param indices Pointer to the vertices structures indices that define the triangular faces of the mesh.
+     * @param numIndices Number of indices in "indices".
+     * @param bbox Bounding box of the vertices, computed by the caller while filling them.
+     */
+    Mesh(std::string name, VertexData *vertices, int numVertices, int *indices, int numIndices, const BBox &bbox);
+
     /**
      * Reinitialize, pointed data are replicated in the constructed object.
      *
@@ -83,15 +135,81 @@ public:
 
     /**
      *  Mesh OpenGL deletion : delete VBOs.
-     *
+     *  The levels of detail are released and deleted : they do not match the next data of the Mesh.
      */
-    void release();
+    virtual void release();
 
     /**
      * Mesh OpenGL creation : create VBOs.
+     * The vertices are stored in the layout given by contentLayout.
+     */
+    virtual void init();
+
+    /**
+     * The most compact layout keeping the content of the vertices :
+     * normals and tangents are packed on 10 bits per component, texture coordinates in [0, 1] on 16 bits,
+     * other 2D texture coordinates as half floats. Attributes null for all the vertices are omitted.
+     */
+    VertexLayout contentLayout() const;
+
+    /** Layout of the vertex buffer, set by init */
+    const VertexLayout &layout() const {
+        return mLayout;
+    }
+
+    /** Size of the vertex buffer, in bytes */
+    int vertexBufferSize() const {
+        return mNumVertices * mLayout.stride();
+    }
+
+    /** Meshes with at most this number of vertices are drawn with 16 bits indices */
+    static const int MAX_SHORT_INDEXED_VERTICES = 65536;
+
+    /** Size of the index buffer, in bytes */
+    int indexBufferSize() const {
+        return mNumIndices * (mIndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    }
+
+    /**
+     * Replace the vertices and indices by a permutation of them (see MeshOptimizer) and upload them again.
+     * The geometry does not change : the revision and the levels of detail are kept.
+     */
+    void reorder(const VertexData *vertices, const int *indices);
+
+    /** Triangles per pixel of the projected bounding box the levels of detail are selected for */
+    static const float LOD_PIXELS_PER_TRIANGLE;
+
+    /** A coarser level is selected once the projected size is this fraction under its threshold */
+    static const float LOD_HYSTERESIS;
+
+    /**
+     * Set the levels of detail, from the finest to the coarsest, initialized. The Mesh owns them,
+     * the previous levels are released and deleted. Must be called from the OpenGL thread.
+     */
+    void setLods(const std::vector<Mesh *> &lods);
+
+    /** Number of levels of detail, the Mesh itself included */
+    int numLods() const {
+        return mLods.size() + 1;
+    }
+
+    /** The level of detail, 0 is the Mesh itself. Levels past the coarsest give the coarsest. */
+    Mesh *lod(int level) {
+        if (level <= 0 || mLods.empty())
+            return this;
+        return mLods[std::min(level, int(mLods.size())) - 1];
+    }
+
+    /**
+     * Level of detail to draw the Mesh with, from its projected size :
+     * the coarsest level with at least one triangle per LOD_PIXELS_PER_TRIANGLE pixels of the projected bounding box.
+     * Moving to a coarser level than the current one needs a projected size LOD_HYSTERESIS under the threshold,
+     * so that the level does not flicker around it.
      *
+     * @param projectedSize Diameter of the projected bounding box, in pixels.
+     * @param currentLevel Level selected at the previous frame.
      */
-    void init();
+    int selectLod(float projectedSize, int currentLevel) const;
 
     /**
      * Mesh drawing method : draw the VBOs.
@@ -171,6 +289,13 @@ public:
 
     virtual void reset();
 
+    /**
+      * Add the shader configuration properties needed to draw this mesh (for GPU skinned meshes ...)
+      */
+    virtual void addShaderProperties(ShaderConfiguration &configuration) const {
+        (void)configuration;
+    }
+
     bool isSelected() const {return mSelected;}
     int numIndices() const { return mNumIndices; }
     int numVertices() const { return mNumVertices;}
@@ -181,7 +306,24 @@ public:
     int meshId() const;
     void setMeshId(int meshId);
 
+    /** Incremented each time the data is replaced by setData */
+    int revision() const {
+        return mRevision;
+    }
+
 protected :
+    /** Free or release the vertices and indices */
+    void releaseData();
+
+    /** Encode mNumVertices vertices in the layout of the vertex buffer */
+    void packVertices(const VertexData *vertices, std::vector<char> &buffer) const;
+
+    /** Upload the indices to the bound index buffer, on 16 bits when they fit */
+    void uploadIndices();
+
+    /** Coarsest level of detail with at least numTriangles triangles, 0 if none */
+    int lodForTriangles(float numTriangles) const;
+
     std::string mName;
     // http://www.opengl.org/wiki/Vertex_Buffer_Object
 
@@ -191,16 +333,26 @@ protected :
     // faces are all triangles, there are nNumIndices/3 faces
     int mNumIndices;
     int *mIndices;
+    GLenum mIndexType; // type of the index buffer, set by init
 
     // OpenGL stuffs
     GLuint mVertexArrayObject;
     enum {VBO_VERTICES, VBO_INDICES};
     GLuint mVertexBufferObjects[2];
+    VertexLayout mLayout;
 
     BBox mBbox;
 
+    // owner of mVertices and mIndices when they are used in place, NULL when the Mesh owns them
+    SharedStorage *mStorage;
+
     int meshId_; // The mesh Id for picking : -1 if mesh not store in assetmanager
 
+    int mRevision;
+
+    // coarser levels of detail, owned, see setLods
+    std::vector<Mesh *> mLods;
+
 };
 
 class MeshBuilder{
@@ -0,0 +1,317 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "meshoptimizer.h"
+#include "animatedmesh.h"
+#include "timer.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace vortex {
+
+namespace {
+
+// parameters of the vertex scores, from Tom Forsyth "Linear-Speed Vertex Cache Optimisation"
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.f;
+const float VALENCE_BOOST_POWER = 0.5f;
+const int MAX_SCORED_VALENCE = 32;
+
+/**
+ * Score of a vertex from its position in the LRU cache (-1 if not in the cache) and its number of remaining triangles
+ */
+class VertexScore {
+public:
+    VertexScore() {
+        for (int i = 0; i < VERTEX_CACHE_SIZE; ++i) {
+            // the vertices of the last triangle have a fixed score : the order inside a triangle does not matter
+            if (i < 3)
+                mCacheScores[i] = LAST_TRIANGLE_SCORE;
+            else
+                mCacheScores[i] = powf(1.f - float(i - 3) / (VERTEX_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        mValenceScores[0] = 0.f;
+        for (int i = 1; i <= MAX_SCORED_VALENCE; ++i)
+            mValenceScores[i] = VALENCE_BOOST_SCALE * powf(float(i), -VALENCE_BOOST_POWER);
+    }
+
+    float operator()(int cachePosition, int remaining) const {
+        // no triangle left : the vertex is never scored again
+        if (remaining == 0)
+            return -1.f;
+        float score = (cachePosition < 0) ? 0.f : mCacheScores[cachePosition];
+        return score + mValenceScores[std::min(remaining, MAX_SCORED_VALENCE)];
+    }
+
+private:
+    float mCacheScores[VERTEX_CACHE_SIZE];
+    float mValenceScores[MAX_SCORED_VALENCE + 1];
+};
+
+/**
+ * Reorder a copy of the data of a Mesh
+ */
+class OptimizeTask : public Task {
+public:
+    OptimizeTask(MeshOptimizer *optimizer, MeshOptimizer::OptimizedMesh *optimized) :
+        mOptimizer(optimizer), mOptimized(optimized) {}
+
+    void run() {
+        Timer timer;
+        timer.start();
+        MeshOptimizer::OptimizedMesh &mesh = *mOptimized;
+        int numVertices = mesh.mVertices.size();
+        int numIndices = mesh.mIndices.size();
+        if (numVertices && numIndices && !mOptimizer->canceled()) {
+            optimizeVertexCache(&(mesh.mIndices[0]), numIndices, numVertices);
+            std::vector<int> remap;
+            optimizeVertexFetch(&(mesh.mVertices[0]), numVertices, &(mesh.mIndices[0]), numIndices, remap);
+        }
+        timer.stop();
+        mesh.mTime = timer.value();
+        mOptimizer->optimized(mOptimized);
+    }
+
+    const char *name() const {
+        return "optimize mesh";
+    }
+
+private:
+    MeshOptimizer *mOptimizer;
+    MeshOptimizer::OptimizedMesh *mOptimized;
+};
+
+}
+
+float averageCacheMissRatio(const int *indices, int numIndices, int numVertices, int cacheSize)
+{
+    int numTriangles = numIndices / 3;
+    if (numTriangles == 0)
+        return 0.f;
+    // a vertex is in the FIFO if less than cacheSize vertices were inserted after it
+    std::vector<int> insertion(numVertices, -cacheSize - 1);
+    int misses = 0;
+    for (int i = 0; i < numTriangles * 3; ++i) {
+        int vertex = indices[i];
+        if (misses - insertion[vertex] > cacheSize) {
+            insertion[vertex] = misses;
+            ++misses;
+        }
+    }
+    return float(misses) / numTriangles;
+}
+
+void optimizeVertexCache(int *indices, int numIndices, int numVertices)
+{
+    int numTriangles = numIndices / 3;
+    if (numTriangles == 0)
+        return;
+    VertexScore vertexScore;
+
+    // triangles of each vertex, the triangles not emitted yet first
+    std::vector<int> firstTriangle(numVertices + 1, 0);
+    for (int i = 0; i < numTriangles * 3; ++i)
+        ++firstTriangle[indices[i] + 1];
+    for (int v = 0; v < numVertices; ++v)
+        firstTriangle[v + 1] += firstTriangle[v];
+    std::vector<int> remaining(numVertices, 0);
+    std::vector<int> triangles(numTriangles * 3);
+    for (int i = 0; i < numTriangles * 3; ++i) {
+        int vertex = indices[i];
+        triangles[firstTriangle[vertex] + remaining[vertex]++] = i / 3;
+    }
+
+    std::vector<float> score(numVertices);
+    for (int v = 0; v < numVertices; ++v)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(numTriangles);
+    for (int t = 0; t < numTriangles; ++t)
+        triangleScore[t] = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+    std::vector<bool> emitted(numTriangles, false);
+
+    std::vector<int> cache, newCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    newCache.reserve(VERTEX_CACHE_SIZE + 3);
+    std::vector<int> ordered(numTriangles * 3);
+    int bestTriangle = 0;
+    int nextTriangle = 0; // dead ends restart from the first triangle not emitted, in the input order
+    for (int n = 0; n < numTriangles; ++n) {
+        if (bestTriangle < 0) {
+            while (emitted[nextTriangle])
+                ++nextTriangle;
+            bestTriangle = nextTriangle;
+        }
+        const int *triangle = indices + 3*bestTriangle;
+        ordered[3*n] = triangle[0];
+        ordered[3*n+1] = triangle[1];
+        ordered[3*n+2] = triangle[2];
+        emitted[bestTriangle] = true;
+
+        // the emitted triangle is moved after the remaining triangles of its vertices
+        for (int k = 0; k < 3; ++k) {
+            int vertex = triangle[k];
+            int *first = &(triangles[firstTriangle[vertex]]);
+            int last = --remaining[vertex];
+            for (int j = 0; j < last; ++j) {
+                if (first[j] == bestTriangle) {
+                    std::swap(first[j], first[last]);
+                    break;
+                }
+            }
+        }
+
+        // the vertices of the triangle go to the front of the LRU cache
+        newCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            if (std::find(newCache.begin(), newCache.end(), triangle[k]) == newCache.end())
+                newCache.push_back(triangle[k]);
+        }
+        for (unsigned int j = 0; j < cache.size(); ++j) {
+            int vertex = cache[j];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache.push_back(vertex);
+        }
+        cache.swap(newCache);
+
+        // rescore the vertices of the cache and the ones pushed out, and their triangles
+        for (unsigned int j = 0; j < cache.size(); ++j) {
+            int vertex = cache[j];
+            int position = (int(j) < VERTEX_CACHE_SIZE) ? j : -1;
+            float newScore = vertexScore(position, remaining[vertex]);
+            float delta = newScore - score[vertex];
+            score[vertex] = newScore;
+            const int *first = &(triangles[firstTriangle[vertex]]);
+            for (int i = 0; i < remaining[vertex]; ++i)
+                triangleScore[first[i]] += delta;
+        }
+        if (int(cache.size()) > VERTEX_CACHE_SIZE)
+            cache.resize(VERTEX_CACHE_SIZE);
+
+        // the next triangle uses a vertex of the cache, unless they have no triangle left
+        bestTriangle = -1;
+        float bestScore = -1.f;
+        for (unsigned int j = 0; j < cache.size(); ++j) {
+            int vertex = cache[j];
+            const int *first = &(triangles[firstTriangle[vertex]]);
+            for (int i = 0; i < remaining[vertex]; ++i) {
+                if (triangleScore[first[i]] > bestScore) {
+                    bestScore = triangleScore[first[i]];
+                    bestTriangle = first[i];
+                }
+            }
+        }
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+void optimizeVertexFetch(Mesh::VertexData *vertices, int numVertices, int *indices, int numIndices, std::vector<int> &remap)
+{
+    remap.assign(numVertices, -1);
+    int next = 0;
+    for (int i = 0; i < numIndices; ++i) {
+        if (remap[indices[i]] < 0)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+    for (int v = 0; v < numVertices; ++v) {
+        if (remap[v] < 0)
+            remap[v] = next++;
+    }
+    std::vector<Mesh::VertexData> copy(vertices, vertices + numVertices);
+    for (int v = 0; v < numVertices; ++v)
+        vertices[remap[v]] = copy[v];
+}
+
+/*
+ * -------------------------------------------------------------------------------
+ */
+MeshOptimizer::MeshOptimizer() : mCanceled(0), mPending(0)
+{}
+
+MeshOptimizer::~MeshOptimizer()
+{
+    mCanceled.store(1);
+    mTasks.wait();
+    for (unsigned int i = 0; i < mOptimized.size(); ++i)
+        delete mOptimized[i];
+}
+
+void MeshOptimizer::optimize(Mesh *mesh)
+{
+    if (dynamic_cast<AnimatedMesh *>(mesh))
+        return;
+    int id = mesh->meshId();
+    if (id >= 0) {
+        if (id < (int) mRevisions.size() && mRevisions[id] == mesh->revision())
+            return;
+        if (id >= (int) mRevisions.size())
+            mRevisions.resize(id + 1, -1);
+        mRevisions[id] = mesh->revision();
+    }
+    ++mPending;
+
+    OptimizedMesh *optimized = new OptimizedMesh;
+    optimized->mMesh = mesh;
+    optimized->mRevision = mesh->revision();
+    optimized->mVertices.assign(mesh->vertices(), mesh->vertices() + mesh->numVertices());
+    optimized->mIndices.assign(mesh->indices(), mesh->indices() + mesh->numIndices());
+    optimized->mTime = 0.;
+    Task *task = new OptimizeTask(this, optimized);
+    // without worker thread the queued tasks would only run once the group is waited
+    if (TaskScheduler::instance().numThreads() > 1) {
+        mTasks.run(task);
+    } else {
+        task->run();
+        delete task;
+    }
+}
+
+void MeshOptimizer::optimized(OptimizedMesh *optimized)
+{
+    QMutexLocker lock(&mMutex);
+    mOptimized.push_back(optimized);
+}
+
+bool MeshOptimizer::upload()
+{
+    bool uploaded = false;
+    for (;;) {
+        OptimizedMesh *optimized;
+        {
+            QMutexLocker lock(&mMutex);
+            if (mOptimized.empty())
+                break;
+            optimized = mOptimized.front();
+            mOptimized.pop_front();
+        }
+        Mesh *mesh = optimized->mMesh;
+        --mPending;
+        // modified meanwhile : the new data needs its own request
+        if (mesh->revision() == optimized->mRevision && !optimized->mIndices.empty()) {
+            mesh->reorder(&(optimized->mVertices[0]), &(optimized->mIndices[0]));
+            ++mStatistics.mMeshes;
+            mStatistics.mOptimizationTime += optimized->mTime;
+            uploaded = true;
+        }
+        delete optimized;
+    }
+    return uploaded;
+}
+
+bool MeshOptimizer::pending() const
+{
+    return mPending > 0;
+}
+
+std::ostream & operator << (std::ostream &out, const MeshOptimizer::Statistics &stats)
+{
+    out << "Optimized meshes : " << stats.mMeshes << " meshes, in " << stats.mOptimizationTime*1000. << " ms" << std::endl;
+    return out;
+}
+
+} // namespace vortex
@@ -0,0 +1,140 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <string>
+
+/// @todo remove QT dependencies here
+#include <QMutex>
+#include <QAtomicInt>
+
+#include "mesh.h"
+#include "taskscheduler.h"
+
+namespace vortex {
+
+/** Size of the post-transform vertex cache the triangles are ordered for */
+const int VERTEX_CACHE_SIZE = 32;
+
+/** Size of the FIFO cache simulated by averageCacheMissRatio, close to the measured caches of current GPUs */
+const int MEASURED_CACHE_SIZE = 16;
+
+/**
+ * Number of vertices transformed per triangle (ACMR) with a FIFO post-transform cache : from 3 to about 0.5 for
+ * a regular mesh drawn in a cache friendly order.
+ */
+float averageCacheMissRatio(const int *indices, int numIndices, int numVertices, int cacheSize = MEASURED_CACHE_SIZE);
+
+/**
+ * Reorder the triangles for the post-transform vertex cache, with the linear time greedy algorithm of Tom Forsyth :
+ * the next triangle is the best scored one using the vertices in a simulated LRU cache, vertices scored by their
+ * position in the cache and the number of triangles left to use them.
+ */
+void optimizeVertexCache(int *indices, int numIndices, int numVertices);
+
+/**
+ * Reorder the vertices in the order of their first use by the triangles, so that the vertex fetches walk the vertex
+ * buffer. The unused vertices are moved at the end.
+ *
+ * @param remap Set to the new index of each vertex, to remap the data referring to the vertices.
+ */
+void optimizeVertexFetch(Mesh::VertexData *vertices, int numVertices, int *indices, int numIndices, std::vector<int> &remap);
+
+/**
+ * Optimization of the vertex and index buffers of Meshes in the background, for meshes modified interactively :
+ * the triangles and vertices of a copy are reordered by a task of the TaskScheduler, the reordered data replace the
+ * Mesh data in upload (see Mesh::reorder), called once per frame from the OpenGL thread, if the Mesh was not modified
+ * meanwhile. Animated meshes are not optimized, their bones refer to the vertices.
+ */
+class MeshOptimizer {
+public:
+    /**
+     * Counters of the uploaded optimizations
+     */
+    struct Statistics {
+        Statistics() : mMeshes(0), mOptimizationTime(0.) {}
+
+        int mMeshes;
+        double mOptimizationTime;   // in seconds
+    };
+
+    MeshOptimizer();
+
+    /**
+     * Cancel the optimizations not started and wait for the running ones, their results are dropped.
+     */
+    ~MeshOptimizer();
+
+    /**
+     * Request the optimization of the current data of a Mesh.
+     *
+     * @param mesh The optimized Mesh, it must stay alive until the next upload.
+     */
+    void optimize(Mesh *mesh);
+
+    /**
+     * Replace the data of the Meshes optimized since the last call and not modified meanwhile.
+     * Must be called from the OpenGL thread.
+     *
+     * @return true if some Meshes were modified
+     */
+    bool upload();
+
+    /**
+     * @return true while some requested optimizations are not uploaded
+     */
+    bool pending() const;
+
+    const Statistics &statistics() const {
+        return mStatistics;
+    }
+
+    /**
+     * Reordered copy of the data of a Mesh
+     */
+    struct OptimizedMesh {
+        Mesh *mMesh;
+        int mRevision;  // Mesh::revision when the data was copied
+        std::vector<Mesh::VertexData> mVertices;
+        std::vector<int> mIndices;
+        double mTime;
+    };
+
+    /** Called by the optimization tasks */
+    void optimized(OptimizedMesh *optimized);
+
+    /** @return true once the destruction started, the tasks not started give their copy back unchanged */
+    bool canceled() const {
+        return mCanceled.load() != 0;
+    }
+
+private:
+    // the optimization tasks, never waited before the destruction
+    TaskGroup mTasks;
+    QAtomicInt mCanceled;
+
+    // optimized meshes waiting for upload, shared with the optimization tasks
+    QMutex mMutex;
+    std::deque<OptimizedMesh *> mOptimized;
+
+    // last revision requested or optimized of each mesh, by Mesh::meshId, to not optimize the same data twice :
+    // the ids stay valid while the AssetManager lives, the meshes without id are always optimized
+    std::vector<int> mRevisions;
+    int mPending;
+
+    Statistics mStatistics;
+};
+
+std::ostream & operator << (std::ostream &out, const MeshOptimizer::Statistics &stats);
+
+} // namespace vortex
+
+#endif // MESHOPTIMIZER_H
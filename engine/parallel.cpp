@@ -0,0 +1,124 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "parallel.h"
+#include "taskscheduler.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace vortex {
+
+namespace {
+
+void runRange(int begin, int end, int grain, ParallelLoop &loop, TaskGroup &group);
+
+/**
+ * Part of a parallelFor range, split again by the thread running it
+ */
+class RangeTask : public Task {
+public:
+    RangeTask(int begin, int end, int grain, ParallelLoop &loop, TaskGroup &group) :
+        mBegin(begin), mEnd(end), mGrain(grain), mLoop(loop), mGroup(group) {}
+
+    void run() {
+        runRange(mBegin, mEnd, mGrain, mLoop, mGroup);
+    }
+
+    const char *name() const {
+        return "parallelFor";
+    }
+
+private:
+    int mBegin;
+    int mEnd;
+    int mGrain;
+    ParallelLoop &mLoop;
+    TaskGroup &mGroup;
+};
+
+void runRange(int begin, int end, int grain, ParallelLoop &loop, TaskGroup &group)
+{
+    // queue the upper halves, the largest first : idle threads steal them, this thread keeps the lower part
+    while (end - begin > grain) {
+        int middle = begin + (end - begin) / 2;
+        group.run(new RangeTask(middle, end, grain, loop, group));
+        end = middle;
+    }
+    loop(begin, end);
+}
+
+/**
+ * Chunks of a parallelReduce, each one reduced by its own body
+ */
+class ReductionChunks : public ParallelLoop {
+public:
+    ReductionChunks(int begin, int end, int grain, std::vector<ParallelReduction *> &bodies) :
+        mBegin(begin), mEnd(end), mGrain(grain), mBodies(bodies) {}
+
+    void operator()(int begin, int end) {
+        for (int chunk = begin; chunk < end; ++chunk) {
+            int chunkBegin = mBegin + chunk * mGrain;
+            (*mBodies[chunk])(chunkBegin, std::min(chunkBegin + mGrain, mEnd));
+        }
+    }
+
+private:
+    int mBegin;
+    int mEnd;
+    int mGrain;
+    std::vector<ParallelReduction *> &mBodies;
+};
+
+}
+
+void parallelFor(int begin, int end, ParallelLoop &loop, int grain)
+{
+    if (begin >= end)
+        return;
+    grain = std::max(grain, 1);
+    if (end - begin <= grain || numWorkerThreads() == 1) {
+        loop(begin, end);
+        return;
+    }
+
+    TaskGroup group;
+    runRange(begin, end, grain, loop, group);
+    group.wait();
+}
+
+void parallelReduce(int begin, int end, ParallelReduction &body, int grain)
+{
+    if (begin >= end)
+        return;
+    grain = std::max(grain, 1);
+    int numChunks = (end - begin + grain - 1) / grain;
+    if (numChunks == 1 || numWorkerThreads() == 1) {
+        body(begin, end);
+        return;
+    }
+
+    // the first chunk is reduced by body itself
+    std::vector<ParallelReduction *> bodies(numChunks);
+    bodies[0] = &body;
+    for (int i = 1; i < numChunks; ++i)
+        bodies[i] = body.split();
+
+    ReductionChunks chunks(begin, end, grain, bodies);
+    parallelFor(0, numChunks, chunks, 1);
+
+    for (int i = 1; i < numChunks; ++i) {
+        body.join(*bodies[i]);
+        delete bodies[i];
+    }
+}
+
+int numWorkerThreads()
+{
+    return TaskScheduler::instance().numThreads();
+}
+
+} // namespace vortex
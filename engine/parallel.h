@@ -0,0 +1,65 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+namespace vortex {
+
+/**
+ * Body of a parallel loop.
+ * Implement operator() to process the iterations [begin, end). It is called concurrently on disjoint ranges.
+ */
+class ParallelLoop {
+public:
+    virtual ~ParallelLoop() {}
+    virtual void operator()(int begin, int end) = 0;
+};
+
+/**
+ * Body of a parallel reduction.
+ * Each body accumulates the result of the ranges given to operator(), join merges the result of the body
+ * that processed the iterations following its own ones.
+ */
+class ParallelReduction {
+public:
+    virtual ~ParallelReduction() {}
+
+    /** @return A new body with an empty result, deleted by parallelReduce */
+    virtual ParallelReduction *split() const = 0;
+
+    virtual void operator()(int begin, int end) = 0;
+
+    virtual void join(ParallelReduction &other) = 0;
+};
+
+/**
+ * Process the iterations [begin, end) by chunks of at most grain iterations on the TaskScheduler threads, the calling
+ * thread included. The range is split in halves handed to the other threads until it fits a chunk.
+ * Returns when all the iterations are processed. Small loops run on the calling thread only.
+ *
+ * @param begin First iteration.
+ * @param end Iteration past the last one.
+ * @param loop The loop body.
+ * @param grain Number of iterations of a chunk.
+ */
+void parallelFor(int begin, int end, ParallelLoop &loop, int grain = 1024);
+
+/**
+ * Reduce the iterations [begin, end) by chunks of grain iterations, as parallelFor.
+ * The chunks are processed by split bodies, then joined to body in the order of the iterations,
+ * so that the result does not depend on the scheduling.
+ */
+void parallelReduce(int begin, int end, ParallelReduction &body, int grain = 1024);
+
+/**
+ * @return The number of threads parallelFor may use, the calling thread included. See TaskScheduler::setNumThreads.
+ */
+int numWorkerThreads();
+
+} // namespace vortex
+
+#endif // PARALLEL_H
@@ -0,0 +1,155 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "pfmreader.h"
+
+#include <algorithm>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+/// @todo remove QT dependencies here
+#include <QFile>
+
+namespace vortex{
+
+// pixels converted at once by rowToRGBA
+static const int PFM_BLOCK = 256;
+
+static bool isBigEndianHost()
+{
+    const unsigned int one = 1;
+    return *reinterpret_cast<const unsigned char *>(&one) == 0;
+}
+
+/**
+ * Read a header line of a mapped file
+ * @return false if no end of line is found in the first 32 bytes
+ */
+static bool readLine(const unsigned char *&cursor, const unsigned char *end, char line[33])
+{
+    int i = 0;
+    while (cursor < end && i < 32) {
+        char c = char(*cursor++);
+        if (c == '\n') {
+            line[i] = 0;
+            return true;
+        }
+        line[i++] = c;
+    }
+    return false;
+}
+
+void PfmReader::swapBytes(const float *src, float *dst, int count)
+{
+    const unsigned int *in = reinterpret_cast<const unsigned int *>(src);
+    unsigned int *out = reinterpret_cast<unsigned int *>(dst);
+    int i = 0;
+#ifdef __SSSE3__
+    const __m128i shuffle = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_shuffle_epi8(v, shuffle));
+    }
+#endif
+    // compilers turn this loop into vector shuffles too when allowed to
+    for (; i < count; ++i) {
+        unsigned int v = in[i];
+        out[i] = (v >> 24) | ((v >> 8) & 0x0000ff00u) | ((v << 8) & 0x00ff0000u) | (v << 24);
+    }
+}
+
+PfmReader::MappedImage::MappedImage() :
+    mFile(NULL), mPixels(NULL), mWidth(0), mHeight(0), mChannels(0), mSwap(false)
+{
+}
+
+PfmReader::MappedImage::~MappedImage()
+{
+    close();
+}
+
+bool PfmReader::MappedImage::open(const std::string &fileName)
+{
+    close();
+    mFile = new QFile(QString::fromStdString(fileName));
+    if (!mFile->open(QIODevice::ReadOnly)) {
+        std::cerr << "could not open " << fileName << std::endl;
+        close();
+        return false;
+    }
+    qint64 size = mFile->size();
+    const unsigned char *data = mFile->map(0, size);
+    if (!data) {
+        std::cerr << "could not map " << fileName << std::endl;
+        close();
+        return false;
+    }
+
+    // header : "PF" (color) or "Pf" (gray), "width height", scale (negative for little endian)
+    const unsigned char *cursor = data;
+    const unsigned char *end = data + size;
+    char line[33];
+    bool valid = readLine(cursor, end, line);
+    if (valid) {
+        if (0 == strncmp("PF", line, 2)) mChannels = 3;
+        else if (0 == strncmp("Pf", line, 2)) mChannels = 1;
+        else valid = false;
+    }
+    valid = valid && readLine(cursor, end, line);
+    if (valid) {
+        char *endptr = NULL;
+        mWidth = strtol(line, &endptr, 10);
+        valid = (endptr != line);
+        mHeight = strtol(endptr, (char **) NULL, 10);
+    }
+    valid = valid && readLine(cursor, end, line);
+    if (valid) {
+        char *endptr = NULL;
+        float aspect = strtof(line, &endptr);
+        valid = (endptr != line);
+        mSwap = (aspect > 0) != isBigEndianHost();
+    }
+    if (!valid || mWidth <= 0 || mHeight <= 0 || qint64(mWidth) * mHeight * mChannels * 4 > end - cursor) {
+        std::cerr << "bad header " << fileName << std::endl;
+        close();
+        return false;
+    }
+    mPixels = cursor;
+    return true;
+}
+
+void PfmReader::MappedImage::close()
+{
+    delete mFile; // unmaps the file
+    mFile = NULL;
+    mPixels = NULL;
+    mWidth = mHeight = mChannels = 0;
+}
+
+void PfmReader::MappedImage::rowToRGBA(int x, int y, int count, float *rgba, bool reverse) const
+{
+    const unsigned char *row = mPixels + (size_t(y) * mWidth + x) * mChannels * sizeof(float);
+    float block[3 * PFM_BLOCK];
+    for (int begin = 0; begin < count; begin += PFM_BLOCK) {
+        int size = std::min(PFM_BLOCK, count - begin);
+        // the mapping may not be aligned on floats : copy then swap in place
+        memcpy(block, row + begin * mChannels * sizeof(float), size * mChannels * sizeof(float));
+        if (mSwap)
+            swapBytes(block, block, size * mChannels);
+        for (int i = 0; i < size; ++i) {
+            float *out = rgba + 4 * (reverse ? count - 1 - (begin + i) : begin + i);
+            const float *in = block + i * mChannels;
+            out[0] = in[0];
+            out[1] = in[(mChannels == 3) ? 1 : 0];
+            out[2] = in[(mChannels == 3) ? 2 : 0];
+            out[3] = 1.f;
+        }
+    }
+}
+
+}
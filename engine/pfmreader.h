@@ -7,9 +7,63 @@
 #ifndef PFMREADER_H
 #define PFMREADER_H
 
+#include <string>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+/// @todo remove QT dependencies here
+class QFile;
+
 namespace vortex{
 class PfmReader{
 public :
+    /**
+     * PFM image mapped in memory : pixels are read in place, no full image copy is made.
+     */
+    class MappedImage {
+    public:
+        MappedImage();
+        ~MappedImage();
+
+        /**
+         * Map a PFM file and parse its header.
+         * @return false if the file can not be mapped or is not a valid PFM file
+         */
+        bool open(const std::string &fileName);
+        void close();
+
+        int width() const { return mWidth; }
+        int height() const { return mHeight; }
+
+        /**
+         * Convert pixels of a row to RGBA floats, swapping their bytes if the file byte order differs from the host one.
+         * Distinct rows may be converted concurrently.
+         *
+         * @param x First pixel of the row
+         * @param y Row, as stored in the file
+         * @param count Number of pixels
+         * @param rgba Destination, 4*count floats
+         * @param reverse Write the pixels from right to left
+         */
+        void rowToRGBA(int x, int y, int count, float *rgba, bool reverse = false) const;
+
+    private:
+        QFile *mFile;
+        const unsigned char *mPixels;
+        int mWidth;
+        int mHeight;
+        int mChannels;
+        bool mSwap;
+    };
+
+    /**
+     * Swap the bytes of count 32 bits values, vectorized when the instruction set allows it.
+     * src and dst may be the same.
+     */
+    static void swapBytes(const float *src, float *dst, int count);
+
     typedef struct {
         float r,g,b;
     } HDRPIXEL;
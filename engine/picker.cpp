@@ -76,10 +76,9 @@ Picker::Picker(AssetManager *assetmanager, SceneGraph *scenegraph, int w, int h)
     glCheckError();
 
     selectionloop_ = new SelectionLoop();
-
-    SelectionLoopBuilder loopBuilder(assetmanager_, scenegraph_, selectionloop_, shader_);
-    SceneGraph::PostOrderVisitor loopBuilderVisitor(scenegraph_, loopBuilder);
-    loopBuilderVisitor.go(glm::mat4(1.0), glm::mat4(1.0));
+    updateSelectionLoop();
+    if (scenegraph_)
+        scenegraph_->addListener(this);
 
     glCheckError();
 
@@ -87,6 +86,8 @@ Picker::Picker(AssetManager *assetmanager, SceneGraph *scenegraph, int w, int h)
 }
 
 Picker::~Picker() {
+    if (scenegraph_)
+        scenegraph_->removeListener(this);
     delete selectionFBO_;
     delete selectionTexture_;
     delete debugTexture_;
@@ -97,11 +98,48 @@ Picker::~Picker() {
 
 void Picker::updateSelectionLoop() {
     selectionloop_->clear();
-    SelectionLoopBuilder loopBuilder(assetmanager_, scenegraph_, selectionloop_, shader_);
+    entries_.clear();
+    if (!scenegraph_)
+        return;
+    entries_.resize(scenegraph_->numMeshSlots());
+    SelectionLoopBuilder loopBuilder(assetmanager_, scenegraph_, selectionloop_, shader_, &entries_);
     SceneGraph::PostOrderVisitor loopBuilderVisitor(scenegraph_, loopBuilder);
     loopBuilderVisitor.go(glm::mat4(1.0), glm::mat4(1.0));
 }
 
+void Picker::updateEntry(SceneGraph::LeafMeshNode *node, int slot) {
+    SelectionEntry &entry = entries_[scenegraph_->meshSlot(node->index()) + slot];
+    if (entry.mMesh)
+        SelectionLoopBuilder::remove(selectionloop_, shader_, entry);
+    entry = SelectionEntry();
+    if ((*node)[slot]) {
+        entry.mMaterial = node->getRenderState(slot)->getMaterial();
+        entry.mTransform = node->worldTransformMatrix();
+        entry.mMesh = (*node)[slot];
+        SelectionLoopBuilder::insert(selectionloop_, shader_, entry);
+    }
+}
+
+void Picker::meshChanged(SceneGraph::LeafMeshNode *node, int slot) {
+    updateEntry(node, slot);
+}
+
+void Picker::materialChanged(SceneGraph::LeafMeshNode *node, int slot) {
+    updateEntry(node, slot);
+}
+
+void Picker::transformChanged(SceneGraph::LeafMeshNode *node) {
+    for (int i = 0; i < node->nMeshes(); ++i)
+        updateEntry(node, i);
+}
+
+void Picker::graphDeleted(SceneGraph *graph) {
+    // the loop refers to the meshes of the graph
+    scenegraph_ = NULL;
+    selectionloop_->clear();
+    entries_.clear();
+}
+
 void Picker::setPickingViewport(int w, int h) {
 
     // fbo and texture : note that texture must be allocated each time the size of the window change
@@ -169,7 +207,12 @@ vortex::SceneGraph *Picker::scenegraph() const {
 }
 
 void Picker::setScenegraph(vortex::SceneGraph *scenegraph) {
+    if (scenegraph_)
+        scenegraph_->removeListener(this);
     scenegraph_ = scenegraph;
+    updateSelectionLoop();
+    if (scenegraph_)
+        scenegraph_->addListener(this);
 }
 
 int Picker::width() const {
@@ -260,23 +303,51 @@ bool IdentifiableMaterialState::operator< (const IdentifiableMaterialState &othe
 /*
  * -------------------------------------------------------------------------------
  */
-SelectionLoopBuilder::SelectionLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, SelectionLoop *loop, ShaderProgram *shader)
-    : mResourcesManager(resourcesManager), mSceneGraph(sceneGraph), mLoop(loop), mShader(shader){
+SelectionLoopBuilder::SelectionLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, SelectionLoop *loop, ShaderProgram *shader,
+                                           std::vector<SelectionEntry> *entries)
+    : mResourcesManager(resourcesManager), mSceneGraph(sceneGraph), mLoop(loop), mShader(shader), mEntries(entries){
 }
 
 void SelectionLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix) {
     if (theNode->isLeaf()) {
         SceneGraph::LeafMeshNode *leafNode = static_cast<SceneGraph::LeafMeshNode *>(theNode);
-        RenderState *state = NULL;
         for (int i = 0; i < leafNode->nMeshes(); ++i) {
             if ((*leafNode)[i]){
-                state = leafNode->getRenderState(i);
-                // build a shaderConfiguration object from material
-                Material *nodeMaterial = state->getMaterial();
-                (*mLoop)[ IdentifiableMaterialState(nodeMaterial, mShader)][ TransformState(modelViewMatrix, projectionMatrix, mShader)].push_back( IdentifiableMesh((*leafNode)[i], mShader) );
+                SelectionEntry entry;
+                entry.mMaterial = leafNode->getRenderState(i)->getMaterial();
+                entry.mTransform = modelViewMatrix;
+                entry.mMesh = (*leafNode)[i];
+                insert(mLoop, mShader, entry);
+                if (mEntries)
+                    (*mEntries)[mSceneGraph->meshSlot(leafNode->index()) + i] = entry;
+            }
+        }
+    }
+}
+
+void SelectionLoopBuilder::insert(SelectionLoop *loop, ShaderProgram *shader, const SelectionEntry &entry) {
+    (*loop)[ IdentifiableMaterialState(entry.mMaterial, shader)][ TransformState(entry.mTransform, glm::mat4(1.0), shader)].push_back( IdentifiableMesh(entry.mMesh, shader) );
+}
+
+void SelectionLoopBuilder::remove(SelectionLoop *loop, ShaderProgram *shader, const SelectionEntry &entry) {
+    SelectionLoop::iterator materialIt = loop->find(IdentifiableMaterialState(entry.mMaterial, shader));
+    if (materialIt == loop->end())
+        return;
+    MeshSelectionLoop &transforms = materialIt->second;
+    MeshSelectionLoop::iterator transformIt = transforms.find(TransformState(entry.mTransform, glm::mat4(1.0), shader));
+    if (transformIt != transforms.end()) {
+        DrawableVector<IdentifiableMesh> &meshes = transformIt->second;
+        for (DrawableVector<IdentifiableMesh>::iterator it = meshes.begin(); it != meshes.end(); ++it) {
+            if (it->mesh() == entry.mMesh) {
+                meshes.erase(it);
+                break;
             }
         }
+        if (meshes.empty())
+            transforms.erase(transformIt);
     }
+    if (transforms.empty())
+        loop->erase(materialIt);
 }
 
 template<>
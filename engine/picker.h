@@ -32,6 +32,7 @@ public :
     IdentifiableMesh(Mesh *themesh, ShaderProgram *shader): Drawable(), themesh_(themesh), shader_(shader){}
     ~IdentifiableMesh(){}
     void draw();
+    Mesh *mesh() const { return themesh_; }
 };
 
 /**
@@ -81,22 +82,42 @@ template<>
 void DrawableMap<TransformState, DrawableVector<IdentifiableMesh>>::draw(const glm::mat4x4 &modelviewMatrix, const glm::mat4x4 &projectionMatrix);
 
 
+/**
+ * @brief The SelectionEntry class
+ * Keys of a mesh in a SelectionLoop, to remove it without rebuilding the loop
+ */
+struct SelectionEntry {
+    SelectionEntry() : mMaterial(NULL), mMesh(NULL) {}
+    Material *mMaterial;
+    glm::mat4x4 mTransform;
+    Mesh *mMesh;
+};
+
 /**
  * @brief The SelectionLoopBuilder class
  * This visitor will be used to construct a selection mode rendering loop
  * Such a loop does not impose a shader but only the interface for this shader : (set of uniform values)
- *
+ * The entries of the meshes are recorded per mesh slot of the graph (see SceneGraph::meshSlot) if entries is not NULL.
  */
 class SelectionLoopBuilder : public SceneGraph::VisitorOperation {
 public:
-    SelectionLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, SelectionLoop *loop, ShaderProgram *shader);
+    SelectionLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, SelectionLoop *loop, ShaderProgram *shader,
+                         std::vector<SelectionEntry> *entries = NULL);
 
     void operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+
+    /** Add a mesh to a selection loop */
+    static void insert(SelectionLoop *loop, ShaderProgram *shader, const SelectionEntry &entry);
+
+    /** Remove a mesh added by insert */
+    static void remove(SelectionLoop *loop, ShaderProgram *shader, const SelectionEntry &entry);
+
 private:
     AssetManager *mResourcesManager;
     SceneGraph *mSceneGraph;
     SelectionLoop *mLoop;
     ShaderProgram *mShader;
+    std::vector<SelectionEntry> *mEntries;
 };
 
 
@@ -105,8 +126,9 @@ private:
  * This class allow to select a material, a mesh and one face of this mesh from the asset.
  * The used ids are indices of the property selected in the asset. (see mesh.h, material.h and assetmanager
  * After running the select() method, one might acces to these indices using the selectedmaterial(), selectedmesh() or selectedface() methods.
+ * The selection loop follows the changes of the scene graph : only the changed meshes are moved in the loop.
  */
-class Picker {
+class Picker : public SceneGraph::Listener {
 public:
     Picker(vortex::AssetManager *assetmanager, vortex::SceneGraph * scenegraph, int w, int h);
     ~Picker();
@@ -115,8 +137,14 @@ public:
 
     int select(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, int x, int y);
 
+    /** Rebuild the whole selection loop */
     void updateSelectionLoop();
 
+    void meshChanged(SceneGraph::LeafMeshNode *node, int slot);
+    void materialChanged(SceneGraph::LeafMeshNode *node, int slot);
+    void transformChanged(SceneGraph::LeafMeshNode *node);
+    void graphDeleted(SceneGraph *graph);
+
     vortex::AssetManager *assetmanager() const;
     void setAssetmanager(vortex::AssetManager *assetmanager);
 
@@ -147,6 +175,10 @@ private:
     ShaderProgram *shader_;
 
     SelectionLoop *selectionloop_;
+    // entry of each mesh slot of the graph, see SelectionLoopBuilder
+    std::vector<SelectionEntry> entries_;
+
+    void updateEntry(SceneGraph::LeafMeshNode *node, int slot);
 
     vortex::AssetManager *assetmanager_;
     vortex::SceneGraph * scenegraph_;
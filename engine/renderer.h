@@ -85,6 +85,13 @@ public:
 
     }
 
+    /**
+     * @return true while some resources are loaded in the background : the scene must be rendered again
+     */
+    virtual bool loading() {
+        return false;
+    }
+
     virtual float readDepthAt(int x, int y) {
         return 1.f;
     }
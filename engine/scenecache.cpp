@@ -0,0 +1,492 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "scenecache.h"
+#include "binarystream.h"
+#include "animatedmesh.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+/// @todo remove QT dependencies here
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+namespace vortex {
+
+namespace {
+
+const char SCENE_CACHE_MAGIC[4] = {'V', 'X', 'S', 'C'};
+// version 2 : meshes stored in the vertex cache order
+// version 3 : source size and modification time, fully mixing hash
+const unsigned int SCENE_CACHE_VERSION = 3;
+
+// magic, version, vertex size, source size, modification time and hash, payload hash and size,
+// padded for the vertex arrays alignment
+const unsigned int HEADER_SIZE = 64;
+const unsigned int ARRAY_ALIGNMENT = 16;
+
+/**
+ * A memory mapped cache file, kept while meshes use its vertex arrays
+ */
+class MappedCacheFile : public Mesh::SharedStorage {
+public:
+    MappedCacheFile() : mData(NULL), mSize(0) {}
+
+    ~MappedCacheFile() {
+        if (mData)
+            mFile.unmap(mData);
+    }
+
+    bool open(const std::string &fileName) {
+        mFile.setFileName(QString::fromStdString(fileName));
+        if (!mFile.open(QIODevice::ReadOnly) || mFile.size() < qint64(HEADER_SIZE))
+            return false;
+        mSize = mFile.size();
+        // private mapping : meshes may modify their vertices in place
+        mData = mFile.map(0, mSize, QFileDevice::MapPrivateOption);
+        return mData != NULL;
+    }
+
+    const char *data() const {
+        return reinterpret_cast<const char *>(mData);
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+private:
+    QFile mFile;
+    uchar *mData;
+    size_t mSize;
+};
+
+/**
+ * Objects read from a cache, added to the AssetManager once the whole cache is read
+ */
+struct CacheContent {
+    struct MaterialData {
+        std::string mName;
+        glm::vec3 mDiffuse;
+        glm::vec3 mSpecular;
+        glm::vec3 mAmbient;
+        float mShininess;
+        std::vector<std::pair<int, std::string> > mTextures;
+    };
+
+    std::vector<MaterialData> mMaterials;
+    // meshes in scene graph order, with their render state and material index
+    std::vector<Mesh *> mMeshes;
+    std::vector<std::pair<RenderState *, int> > mRenderStates;
+};
+
+void writeMesh(BinaryWriter &writer, Mesh *mesh)
+{
+    AnimatedMesh *animatedMesh = dynamic_cast<AnimatedMesh *>(mesh);
+    writer.write(mesh->name());
+    writer.write((unsigned char)(animatedMesh != NULL));
+    writer.write(mesh->numVertices());
+    writer.write(mesh->numIndices());
+    writer.align(ARRAY_ALIGNMENT);
+    writer.write(mesh->vertices(), mesh->numVertices());
+    writer.align(ARRAY_ALIGNMENT);
+    writer.write(mesh->indices(), mesh->numIndices());
+    if (animatedMesh) {
+        writer.write(animatedMesh->nBones());
+        for (unsigned int i = 0; i < animatedMesh->nBones(); ++i) {
+            const AnimatedMesh::BoneData *bone = animatedMesh->getBone(i);
+            writer.write(bone->mName);
+            writer.write(bone->mOffsetMatrix);
+            writer.write(bone->mNumWeights);
+            writer.write(bone->mWeights, bone->mNumWeights);
+        }
+    }
+}
+
+void writeNode(BinaryWriter &writer, SceneGraph::Node *node, const std::vector<Material *> &materials)
+{
+    writer.write((unsigned char)node->isLeaf());
+    writer.write(node->name());
+    writer.write(node->transformMatrix());
+    if (node->isLeaf()) {
+        SceneGraph::LeafMeshNode *leaf = static_cast<SceneGraph::LeafMeshNode *>(node);
+        writer.write(leaf->nMeshes());
+        for (int i = 0; i < leaf->nMeshes(); ++i) {
+            Material *material = leaf->getRenderState(i)->getMaterial();
+            int materialIndex = std::find(materials.begin(), materials.end(), material) - materials.begin();
+            writer.write(materialIndex < int(materials.size()) ? materialIndex : -1);
+            Mesh *mesh = (*leaf)[i];
+            writer.write((unsigned char)(mesh != NULL));
+            if (mesh)
+                writeMesh(writer, mesh);
+        }
+    } else {
+        SceneGraph::InnerNode *inner = static_cast<SceneGraph::InnerNode *>(node);
+        writer.write(inner->nChilds());
+        for (int i = 0; i < inner->nChilds(); ++i)
+            writeNode(writer, (*inner)[i], materials);
+    }
+}
+
+/**
+ * Read a mesh, the static meshes use the cache arrays in place
+ */
+Mesh *readMesh(BinaryReader &reader, AssetManager *resources, Mesh::SharedStorage *storage)
+{
+    std::string name;
+    unsigned char animated = 0;
+    int numVertices = 0;
+    int numIndices = 0;
+    reader.read(name);
+    reader.read(animated);
+    reader.read(numVertices);
+    reader.read(numIndices);
+    reader.align(ARRAY_ALIGNMENT);
+    const Mesh::VertexData *vertices = reader.map<Mesh::VertexData>(numVertices);
+    reader.align(ARRAY_ALIGNMENT);
+    const int *indices = reader.map<int>(numIndices);
+    if (reader.error() || numVertices < 0 || numIndices < 0)
+        return NULL;
+
+    // the mapping is private, the arrays may be written
+    Mesh::VertexData *meshVertices = const_cast<Mesh::VertexData *>(vertices);
+    int *meshIndices = const_cast<int *>(indices);
+    if (!animated)
+        return new Mesh(name, meshVertices, numVertices, meshIndices, numIndices, storage);
+
+    unsigned int numBones = 0;
+    reader.read(numBones);
+    if (reader.error() || numBones > reader.size())
+        return NULL;
+    std::vector<AnimatedMesh::BoneData> bones(numBones);
+    for (unsigned int i = 0; i < numBones && !reader.error(); ++i) {
+        reader.read(bones[i].mName);
+        reader.read(bones[i].mOffsetMatrix);
+        bones[i].mNumWeights = 0;
+        reader.read(bones[i].mNumWeights);
+        // copied by the AnimatedMesh
+        bones[i].mWeights = const_cast<AnimatedMesh::WeightData *>(reader.map<AnimatedMesh::WeightData>(bones[i].mNumWeights));
+    }
+    if (reader.error())
+        return NULL;
+    return new AnimatedMesh(name, meshVertices, numVertices, meshIndices, numIndices,
+                            numBones ? &(bones[0]) : NULL, numBones, resources);
+}
+
+SceneGraph::Node *readNode(BinaryReader &reader, SceneGraph::Node *parent, CacheContent &content,
+                           AssetManager *resources, Mesh::SharedStorage *storage)
+{
+    unsigned char leaf = 0;
+    std::string name;
+    glm::mat4x4 transform;
+    reader.read(leaf);
+    reader.read(name);
+    reader.read(transform);
+    if (reader.error())
+        return NULL;
+
+    if (leaf) {
+        SceneGraph::LeafMeshNode *node = new SceneGraph::LeafMeshNode(name, parent);
+        node->setTransformMatrix(transform);
+        int numMeshes = 0;
+        reader.read(numMeshes);
+        if (numMeshes <= 0 || size_t(numMeshes) > reader.size())
+            return node;
+        node->initMeshes(numMeshes);
+        for (int i = 0; i < numMeshes && !reader.error(); ++i) {
+            int materialIndex = -1;
+            unsigned char hasMesh = 0;
+            reader.read(materialIndex);
+            reader.read(hasMesh);
+            content.mRenderStates.push_back(std::make_pair(node->getRenderState(i), materialIndex));
+            if (hasMesh) {
+                (*node)[i] = readMesh(reader, resources, storage);
+                if ((*node)[i])
+                    content.mMeshes.push_back((*node)[i]);
+            }
+        }
+        return node;
+    } else {
+        SceneGraph::InnerNode *node = new SceneGraph::InnerNode(name, parent);
+        node->setTransformMatrix(transform);
+        int numChilds = 0;
+        reader.read(numChilds);
+        if (numChilds <= 0 || size_t(numChilds) > reader.size())
+            return node;
+        node->initChilds(numChilds);
+        for (int i = 0; i < numChilds; ++i)
+            (*node)[i] = reader.error() ? NULL : readNode(reader, node, content, resources, storage);
+        return node;
+    }
+}
+
+}
+
+bool SceneCache::readSource(const std::string &fileName, Source &source)
+{
+    QFile file(QString::fromStdString(fileName));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    source.mSize = file.size();
+    source.mModified = QFileInfo(file).lastModified().toMSecsSinceEpoch();
+    if (file.size() == 0) {
+        source.mHash = hashBytes(NULL, 0);
+        return true;
+    }
+    uchar *data = file.map(0, file.size());
+    if (data) {
+        source.mHash = hashBytes(reinterpret_cast<const char *>(data), file.size());
+        file.unmap(data);
+        return true;
+    }
+    QByteArray content = file.readAll();
+    source.mHash = hashBytes(content.constData(), content.size());
+    return true;
+}
+
+bool SceneCache::save(const std::string &cacheFile, const Source &source, const std::string &textureFolder,
+                      const std::vector<Material *> &materials, SceneGraph *sceneGraph,
+                      const std::vector<Animation *> &animations)
+{
+    BinaryWriter writer;
+    writer.write(SCENE_CACHE_MAGIC, 4);
+    writer.write(SCENE_CACHE_VERSION);
+    writer.write((unsigned int)sizeof(Mesh::VertexData));
+    writer.write(source.mSize);
+    writer.write(source.mModified);
+    writer.write(source.mHash);
+    // payload hash and size, set once the payload is written
+    size_t payloadHashOffset = writer.mBuffer.size();
+    writer.write(uint64_t(0));
+    writer.write(uint64_t(0));
+    writer.align(HEADER_SIZE);
+
+    writer.write((unsigned int)materials.size());
+    for (unsigned int i = 0; i < materials.size(); ++i) {
+        Material *material = materials[i];
+        writer.write(material->getName());
+        writer.write(material->getDiffuseColor());
+        writer.write(material->getSpecularColor());
+        writer.write(material->getAmbientColor());
+        writer.write(material->getShininess());
+        std::vector<int> semantics;
+        for (int s = Material::TEXTURE_AMBIENT; s <= Material::TEXTURE_UNKNOWN; ++s)
+            if (material->getTexture(Material::TextureSemantic(s)))
+                semantics.push_back(s);
+        writer.write((unsigned int)semantics.size());
+        for (unsigned int t = 0; t < semantics.size(); ++t) {
+            std::string textureName = material->getTexture(Material::TextureSemantic(semantics[t]))->getName();
+            if (textureName.compare(0, textureFolder.size(), textureFolder) == 0)
+                textureName = textureName.substr(textureFolder.size());
+            writer.write(semantics[t]);
+            writer.write(textureName);
+        }
+    }
+
+    SceneGraph::Node *root = sceneGraph->getRootNode();
+    writer.write((unsigned char)(root != NULL));
+    if (root)
+        writeNode(writer, root, materials);
+
+    writer.write((unsigned int)sceneGraph->mLights.size());
+    for (unsigned int i = 0; i < sceneGraph->mLights.size(); ++i) {
+        const Light &light = sceneGraph->mLights[i];
+        writer.write(light.mIsSun);
+        writer.write(light.mName);
+        writer.write(light.mPosition);
+        writer.write(light.mDirection);
+        writer.write(light.mAmbient);
+        writer.write(light.mDiffuse);
+        writer.write(light.mSpecular);
+        writer.write(light.mAngleOuterCone);
+        writer.write(light.mAngleInnerCone);
+        writer.write(light.mAttenuationConstant);
+        writer.write(light.mAttenuationLinear);
+        writer.write(light.mAttenuationQuadratic);
+    }
+
+    writer.write((unsigned int)animations.size());
+    for (unsigned int i = 0; i < animations.size(); ++i)
+        animations[i]->write(writer);
+
+    uint64_t payloadSize = writer.mBuffer.size() - HEADER_SIZE;
+    uint64_t payloadHash = hashBytes(&(writer.mBuffer[HEADER_SIZE]), payloadSize);
+    memcpy(&(writer.mBuffer[payloadHashOffset]), &payloadHash, sizeof(uint64_t));
+    memcpy(&(writer.mBuffer[payloadHashOffset + sizeof(uint64_t)]), &payloadSize, sizeof(uint64_t));
+
+    // an interrupted write leaves the previous cache in place
+    std::string tempFile = cacheFile + ".tmp";
+    {
+        std::ofstream file(tempFile.c_str(), std::ios::out | std::ios::binary);
+        if (!file || !file.write(&(writer.mBuffer[0]), writer.mBuffer.size())) {
+            std::cerr << "SceneCache::save : could not write " << tempFile << std::endl;
+            std::remove(tempFile.c_str());
+            return false;
+        }
+    }
+    std::remove(cacheFile.c_str());
+    if (std::rename(tempFile.c_str(), cacheFile.c_str())) {
+        std::cerr << "SceneCache::save : could not write " << cacheFile << std::endl;
+        std::remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::load(const std::string &cacheFile, const Source &source, AssetManager &assetManager,
+                      SceneGraph **sceneGraph, std::vector<Animation *> &animations)
+{
+    MappedCacheFile *mapped = new MappedCacheFile();
+    // released at the end of the load, the meshes hold their own references
+    mapped->ref();
+    if (!mapped->open(cacheFile)) {
+        mapped->unref();
+        return false;
+    }
+
+    BinaryReader header(mapped->data(), HEADER_SIZE);
+    char magic[4];
+    unsigned int version = 0;
+    unsigned int vertexSize = 0;
+    Source cachedSource;
+    uint64_t payloadHash = 0;
+    uint64_t payloadSize = 0;
+    header.read(magic, 4);
+    header.read(version);
+    header.read(vertexSize);
+    header.read(cachedSource.mSize);
+    header.read(cachedSource.mModified);
+    header.read(cachedSource.mHash);
+    header.read(payloadHash);
+    header.read(payloadSize);
+    if (header.error() || memcmp(magic, SCENE_CACHE_MAGIC, 4) || version != SCENE_CACHE_VERSION ||
+        vertexSize != sizeof(Mesh::VertexData) || cachedSource.mSize != source.mSize ||
+        cachedSource.mModified != source.mModified || cachedSource.mHash != source.mHash) {
+        std::cerr << "SceneCache::load : " << cacheFile << " is out of date" << std::endl;
+        mapped->unref();
+        return false;
+    }
+    if (payloadSize != mapped->size() - HEADER_SIZE || hashBytes(mapped->data() + HEADER_SIZE, payloadSize) != payloadHash) {
+        std::cerr << "SceneCache::load : " << cacheFile << " is corrupted" << std::endl;
+        mapped->unref();
+        return false;
+    }
+
+    // the payload starts aligned : array offsets are aligned in the mapping too
+    BinaryReader reader(mapped->data() + HEADER_SIZE, payloadSize);
+    CacheContent content;
+
+    unsigned int numMaterials = 0;
+    reader.read(numMaterials);
+    if (numMaterials > payloadSize)
+        numMaterials = 0;
+    content.mMaterials.resize(numMaterials);
+    for (unsigned int i = 0; i < numMaterials && !reader.error(); ++i) {
+        CacheContent::MaterialData &material = content.mMaterials[i];
+        reader.read(material.mName);
+        reader.read(material.mDiffuse);
+        reader.read(material.mSpecular);
+        reader.read(material.mAmbient);
+        reader.read(material.mShininess);
+        unsigned int numTextures = 0;
+        reader.read(numTextures);
+        for (unsigned int t = 0; t < numTextures && t <= Material::TEXTURE_UNKNOWN && !reader.error(); ++t) {
+            std::pair<int, std::string> texture;
+            reader.read(texture.first);
+            reader.read(texture.second);
+            material.mTextures.push_back(texture);
+        }
+    }
+
+    unsigned char hasRoot = 0;
+    reader.read(hasRoot);
+    SceneGraph::Node *root = NULL;
+    if (hasRoot)
+        root = readNode(reader, NULL, content, &assetManager, mapped);
+
+    std::vector<Light> lights;
+    unsigned int numLights = 0;
+    reader.read(numLights);
+    for (unsigned int i = 0; i < numLights && i < payloadSize && !reader.error(); ++i) {
+        Light light;
+        reader.read(light.mIsSun);
+        reader.read(light.mName);
+        reader.read(light.mPosition);
+        reader.read(light.mDirection);
+        reader.read(light.mAmbient);
+        reader.read(light.mDiffuse);
+        reader.read(light.mSpecular);
+        reader.read(light.mAngleOuterCone);
+        reader.read(light.mAngleInnerCone);
+        reader.read(light.mAttenuationConstant);
+        reader.read(light.mAttenuationLinear);
+        reader.read(light.mAttenuationQuadratic);
+        lights.push_back(light);
+    }
+
+    std::vector<Animation *> cachedAnimations;
+    unsigned int numAnimations = 0;
+    reader.read(numAnimations);
+    for (unsigned int i = 0; i < numAnimations && i < payloadSize && !reader.error(); ++i) {
+        Animation *animation = Animation::read(reader);
+        if (animation)
+            cachedAnimations.push_back(animation);
+    }
+
+    if (reader.error() || cachedAnimations.size() != numAnimations || lights.size() != numLights) {
+        // nothing is registered yet : deleting the graph drops the meshes
+        std::cerr << "SceneCache::load : " << cacheFile << " is corrupted" << std::endl;
+        delete root;
+        for (unsigned int i = 0; i < cachedAnimations.size(); ++i)
+            delete cachedAnimations[i];
+        mapped->unref();
+        return false;
+    }
+
+    // the whole cache is read, register its content
+    assetManager.expectedValues(0, numMaterials);
+    std::vector<Material *> materials;
+    for (unsigned int i = 0; i < numMaterials; ++i) {
+        const CacheContent::MaterialData &data = content.mMaterials[i];
+        Material *material = assetManager.getMaterial(assetManager.addMaterial(data.mName));
+        material->setDiffuseColor(data.mDiffuse);
+        material->setSpecularColor(data.mSpecular);
+        material->setAmbientColor(data.mAmbient);
+        material->setShininess(data.mShininess);
+        for (unsigned int t = 0; t < data.mTextures.size(); ++t) {
+            int texIndex = assetManager.addTexture(data.mTextures[t].second);
+            material->addTexture(assetManager.getTexture(texIndex), Material::TextureSemantic(data.mTextures[t].first));
+        }
+        materials.push_back(material);
+    }
+    for (unsigned int i = 0; i < content.mRenderStates.size(); ++i) {
+        int materialIndex = content.mRenderStates[i].second;
+        if (materialIndex >= 0 && materialIndex < int(materials.size()))
+            content.mRenderStates[i].first->setMaterial(materials[materialIndex]);
+    }
+    for (unsigned int i = 0; i < content.mMeshes.size(); ++i) {
+        Mesh *mesh = content.mMeshes[i];
+        mesh->init();
+        AnimatedMesh *animatedMesh = dynamic_cast<AnimatedMesh *>(mesh);
+        if (animatedMesh)
+            assetManager.addAnimatedMesh(animatedMesh);
+        assetManager.addMesh(mesh);
+    }
+
+    delete *sceneGraph;
+    *sceneGraph = new SceneGraph(root);
+    (*sceneGraph)->mLights = lights;
+    animations = cachedAnimations;
+
+    mapped->unref();
+    return true;
+}
+
+} // namespace vortex
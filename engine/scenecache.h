@@ -0,0 +1,81 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "assetmanager.h"
+#include "scenegraph.h"
+#include "animation.h"
+
+namespace vortex {
+
+/**
+ * Binary cache of a converted scene, stored next to the source file.
+ * It holds the materials, the scene graph with its meshes, the lights and the animations, as built by the loader,
+ * so that a scene opened again skips the import and its post processing.
+ * The cache is memory mapped on load and the static meshes use their vertex and index arrays in place.
+ * Skeletons and light transforms are not stored : the loader builds them from the loaded scene graph.
+ *
+ * The cache is rejected when its version, the vertex layout or the source file size, modification time or hash differ.
+ * Only the source file is checked : files it references (.mtl ...) do not invalidate the cache.
+ */
+class SceneCache {
+public:
+    /**
+     * Identification of a source file content
+     */
+    struct Source {
+        uint64_t mSize;
+        int64_t mModified;  // milliseconds since the epoch
+        uint64_t mHash;
+    };
+
+    /**
+     * @return The name of the cache file of a source file
+     */
+    static std::string cacheFileName(const std::string &sourceFile) {
+        return sourceFile + ".vxcache";
+    }
+
+    /**
+     * Read the size and modification time of a file and hash its content.
+     * @return false if the file could not be read
+     */
+    static bool readSource(const std::string &fileName, Source &source);
+
+    /**
+     * Write the cache of a scene.
+     *
+     * @param cacheFile Name of the cache file, written through a temporary file.
+     * @param source The source file, see readSource.
+     * @param textureFolder Folder of the textures, stripped from the stored texture names.
+     * @param materials The materials of the scene, in the order of their creation.
+     * @param sceneGraph The scene, its meshes in bind pose.
+     * @param animations The animations of the scene.
+     */
+    static bool save(const std::string &cacheFile, const Source &source, const std::string &textureFolder,
+                     const std::vector<Material *> &materials, SceneGraph *sceneGraph,
+                     const std::vector<Animation *> &animations);
+
+    /**
+     * Load a scene from its cache. The materials, textures and meshes are added to the AssetManager,
+     * the texture folder of the AssetManager must be set.
+     *
+     * @param animations Receives the animations, without skeleton.
+     * @return false if the cache does not exist or is out of date, nothing is created then
+     */
+    static bool load(const std::string &cacheFile, const Source &source, AssetManager &assetManager,
+                     SceneGraph **sceneGraph, std::vector<Animation *> &animations);
+};
+
+} // namespace vortex
+
+#endif // SCENECACHE_H
@@ -6,6 +6,8 @@
 
 #include <iostream>
 #include <stack>
+#include <algorithm>
+#include <cfloat>
 
 #include "scenegraph.h"
 
@@ -15,8 +17,54 @@ namespace vortex {
 SceneGraph::SceneGraph(Node::NodePtr rootNode)
 {
     mRootNode = rootNode;
+
+    // depth first flattening, children in order
+    std::stack<Node *> pending;
+    if (mRootNode)
+        pending.push(mRootNode);
+    while (!pending.empty()) {
+        Node *node = pending.top();
+        pending.pop();
+        node->mIndex = mNodes.size();
+        mNodes.push_back(node);
+        mParents.push_back(node->mParent ? node->mParent->mIndex : -1);
+        mLocalTransforms.push_back(node->mTransform);
+        node->mTransformDirty = true;
+        node->mBoundsDirty = true;
+        if (!node->isLeaf()) {
+            InnerNode *innerNode = static_cast<InnerNode *>(node);
+            for (int i = innerNode->nChilds() - 1; i >= 0; --i) {
+                // the loaders do not always give the parent to the constructor
+                (*innerNode)[i]->mParent = node;
+                pending.push((*innerNode)[i]);
+            }
+        }
+    }
+    mWorldTransforms.resize(mNodes.size());
+    mSubtreeEnds.resize(mNodes.size());
+    for (int i = mNodes.size() - 1; i >= 0; --i) {
+        if (mSubtreeEnds[i] == 0)
+            mSubtreeEnds[i] = i + 1;
+        if (mParents[i] >= 0)
+            mSubtreeEnds[mParents[i]] = std::max(mSubtreeEnds[mParents[i]], mSubtreeEnds[i]);
+    }
+    mMeshSlots.resize(mNodes.size() + 1);
+    mMeshSlots[0] = 0;
+    for (unsigned int i = 0; i < mNodes.size(); ++i) {
+        mNodes[i]->mGraph = this;
+        int numMeshes = mNodes[i]->isLeaf() ? static_cast<LeafMeshNode *>(mNodes[i])->nMeshes() : 0;
+        mMeshSlots[i + 1] = mMeshSlots[i] + numMeshes;
+    }
+    mLodLevels.assign(mMeshSlots.back(), 0);
+}
+
+SceneGraph::~SceneGraph()
+{
+    // a listener may remove itself
+    std::vector<Listener *> listeners(mListeners);
+    for (unsigned int i = 0; i < listeners.size(); ++i)
+        listeners[i]->graphDeleted(this);
 }
-SceneGraph::~SceneGraph() {}
 
 void SceneGraph::printDebug()
 {
@@ -27,6 +75,189 @@ void SceneGraph::printDebug()
         itr->printDebug();
 }
 
+void SceneGraph::updateBounds()
+{
+    int numNodes = mNodes.size();
+
+    // world transforms, parents first ; a moved node moves its subtree
+    mUpdated.clear();
+    mMoved.clear();
+    for (int i = 0; i < numNodes;) {
+        Node *node = mNodes[i];
+        int parent = mParents[i];
+        if (parent >= 0 && mNodes[parent]->mTransformDirty)
+            node->mTransformDirty = true;
+        if (!node->mTransformDirty && !node->mBoundsDirty) {
+            // the ancestors of a dirty node are flagged : the subtree is clean
+            i = mSubtreeEnds[i];
+            continue;
+        }
+        if (node->mTransformDirty) {
+            mWorldTransforms[i] = (parent >= 0) ? mWorldTransforms[parent] * mLocalTransforms[i] : mLocalTransforms[i];
+            if (node->isLeaf() && !mListeners.empty())
+                mMoved.push_back(static_cast<LeafMeshNode *>(node));
+        }
+        mUpdated.push_back(i);
+        ++i;
+    }
+
+    // bounds, children first
+    for (int k = mUpdated.size() - 1; k >= 0; --k) {
+        int i = mUpdated[k];
+        Node *node = mNodes[i];
+        node->mBbox = BBox();
+        if (node->isLeaf()) {
+            LeafMeshNode *leafNode = static_cast<LeafMeshNode *>(node);
+            for (int j = 0; j < leafNode->nMeshes(); ++j) {
+                if ((*leafNode)[j]) {
+                    BBox theBox = (*leafNode)[j]->boundingBox();
+                    if (!theBox.isEmpty())
+                        node->mBbox += theBox.getTransformedBBox(mWorldTransforms[i]);
+                }
+            }
+        } else {
+            for (int child = i + 1; child < mSubtreeEnds[i]; child = mSubtreeEnds[child])
+                node->mBbox += mNodes[child]->mBbox;
+        }
+        node->mTransformDirty = false;
+        node->mBoundsDirty = false;
+    }
+
+    for (unsigned int k = 0; k < mMoved.size(); ++k) {
+        for (unsigned int l = 0; l < mListeners.size(); ++l)
+            mListeners[l]->transformChanged(mMoved[k]);
+    }
+}
+
+void SceneGraph::invalidateBounds(const Mesh *mesh)
+{
+    for (unsigned int i = 0; i < mNodes.size(); ++i) {
+        if (!mNodes[i]->isLeaf())
+            continue;
+        LeafMeshNode *leafNode = static_cast<LeafMeshNode *>(mNodes[i]);
+        for (int j = 0; j < leafNode->nMeshes(); ++j) {
+            if ((*leafNode)[j] == mesh)
+                leafNode->invalidateBounds();
+        }
+    }
+}
+
+void SceneGraph::setMesh(LeafMeshNode *node, int slot, Mesh *mesh)
+{
+    (*node)[slot] = mesh;
+    node->invalidateBounds();
+    for (unsigned int i = 0; i < mListeners.size(); ++i)
+        mListeners[i]->meshChanged(node, slot);
+}
+
+void SceneGraph::replaceMesh(const Mesh *previous, Mesh *mesh)
+{
+    for (unsigned int i = 0; i < mNodes.size(); ++i) {
+        if (!mNodes[i]->isLeaf())
+            continue;
+        LeafMeshNode *leafNode = static_cast<LeafMeshNode *>(mNodes[i]);
+        for (int j = 0; j < leafNode->nMeshes(); ++j) {
+            if ((*leafNode)[j] == previous)
+                setMesh(leafNode, j, mesh);
+        }
+    }
+}
+
+void SceneGraph::setMaterial(LeafMeshNode *node, int slot, Material *material)
+{
+    node->getRenderState(slot)->setMaterial(material);
+    for (unsigned int i = 0; i < mListeners.size(); ++i)
+        mListeners[i]->materialChanged(node, slot);
+}
+
+void SceneGraph::addListener(Listener *listener)
+{
+    if (std::find(mListeners.begin(), mListeners.end(), listener) == mListeners.end())
+        mListeners.push_back(listener);
+}
+
+void SceneGraph::removeListener(Listener *listener)
+{
+    mListeners.erase(std::remove(mListeners.begin(), mListeners.end(), listener), mListeners.end());
+}
+
+void SceneGraph::cull(const Frustum &frustum)
+{
+    mCullingStatistics = CullingStatistics();
+    updateBounds();
+    int numNodes = mNodes.size();
+    for (int i = 0; i < numNodes;) {
+        Frustum::Intersection intersection = frustum.intersect(mNodes[i]->mBbox);
+        if (intersection == Frustum::INTERSECT) {
+            // test the children
+            setCulled(i, i + 1, false);
+            ++i;
+        } else {
+            // the whole subtree is inside or outside
+            setCulled(i, mSubtreeEnds[i], intersection == Frustum::OUTSIDE);
+            i = mSubtreeEnds[i];
+        }
+    }
+}
+
+void SceneGraph::setCulled(int begin, int end, bool culled)
+{
+    for (int i = begin; i < end; ++i) {
+        Node *node = mNodes[i];
+        node->mCulled = culled;
+        if (node->isLeaf()) {
+            int numMeshes = static_cast<LeafMeshNode *>(node)->nMeshes();
+            if (culled)
+                mCullingStatistics.mCulled += numMeshes;
+            else
+                mCullingStatistics.mSubmitted += numMeshes;
+        }
+    }
+}
+
+void SceneGraph::resetCulling()
+{
+    mCullingStatistics = CullingStatistics();
+    setCulled(0, mNodes.size(), false);
+}
+
+void SceneGraph::selectLods(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, int viewportHeight)
+{
+    // a perspective projection divides the sizes by the depth
+    bool perspective = projectionMatrix[2][3] != 0.f;
+    float pixelScale = projectionMatrix[1][1] * viewportHeight;
+    int numNodes = mNodes.size();
+    for (int i = 0; i < numNodes; ++i) {
+        int numSlots = mMeshSlots[i + 1] - mMeshSlots[i];
+        if (numSlots == 0 || mNodes[i]->mCulled)
+            continue;
+        LeafMeshNode *node = static_cast<LeafMeshNode *>(mNodes[i]);
+        glm::mat4x4 modelView = modelViewMatrix * mWorldTransforms[i];
+        float scale = std::max(glm::length(glm::vec3(modelView[0])),
+                               std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+        for (int slot = 0; slot < numSlots; ++slot) {
+            Mesh *mesh = (*node)[slot];
+            unsigned char &level = mLodLevels[mMeshSlots[i] + slot];
+            if (!mesh || mesh->numLods() == 1) {
+                level = 0;
+                continue;
+            }
+            BBox box = mesh->boundingBox();
+            glm::vec3 center = 0.5f * (box.getMin() + box.getMax());
+            float radius = 0.5f * scale * glm::length(box.getMax() - box.getMin());
+            float depth = -(modelView * glm::vec4(center, 1.f)).z;
+            float projectedSize;
+            if (!perspective)
+                projectedSize = radius * pixelScale;
+            else if (depth > radius)
+                projectedSize = radius * pixelScale / depth;
+            else // the camera is inside the bounding sphere
+                projectedSize = FLT_MAX;
+            level = mesh->selectLod(projectedSize, level);
+        }
+    }
+}
+
 void SceneGraph::Node::drawBbox(const glm::mat4x4& modelViewMatrix, const glm::mat4x4& projectionMatrix)
 {
     if (!boxMesh_) {
@@ -59,7 +290,7 @@ void SceneGraph::InnerNode::initChilds(unsigned int numChilds)
 void SceneGraph::InnerNode::draw(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
 {
     for (unsigned int i = 0; i < mNumChilds; ++i)
-        mChilds[i]->draw(mTransform * modelViewMatrix, projectionMatrix);
+        mChilds[i]->draw(transformMatrix() * modelViewMatrix, projectionMatrix);
 }
 
 void SceneGraph::InnerNode::debug(int indentLevel)
@@ -127,56 +358,81 @@ void SceneGraph::LeafMeshNode::debug(int indentLevel)
 /* Visitors implementation */
 SceneGraph::Visitor::NullAction SceneGraph::Visitor::mNullAction;
 
-void SceneGraph::PreOrderVisitor::run(SceneGraph::Node *theNode)
+void SceneGraph::PreOrderVisitor::run(SceneGraph::Node *)
 {
-    if (theNode->acceptVisitors()){
-        mAction(theNode);
-        if (!theNode->isLeaf()) {
-            SceneGraph::InnerNode * innerNode = static_cast<SceneGraph::InnerNode *>(theNode);
-            for (int i = 0; i < innerNode->nChilds(); ++i) {
-                run((*innerNode)[i]);
-            }
+    SceneGraph *graph = mVisitedGraph;
+    int numNodes = graph->mNodes.size();
+    for (int i = 0; i < numNodes;) {
+        SceneGraph::Node *node = graph->mNodes[i];
+        if (!node->acceptVisitors()) {
+            i = graph->mSubtreeEnds[i];
+            continue;
         }
+        mAction(node);
+        ++i;
     }
 }
 
-void SceneGraph::PostOrderVisitor::run(SceneGraph::Node *theNode)
+void SceneGraph::PreOrderVisitor::run(SceneGraph::Node *, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
 {
-    if (theNode->acceptVisitors()){
-        if (!theNode->isLeaf()) {
-            SceneGraph::InnerNode * innerNode = static_cast<SceneGraph::InnerNode *>(theNode);
-            for (int i = 0; i < innerNode->nChilds(); ++i) {
-                run((*innerNode)[i]);
-            }
+    SceneGraph *graph = mVisitedGraph;
+    graph->updateBounds();
+    int numNodes = graph->mNodes.size();
+    for (int i = 0; i < numNodes;) {
+        SceneGraph::Node *node = graph->mNodes[i];
+        if (!node->acceptVisitors()) {
+            i = graph->mSubtreeEnds[i];
+            continue;
         }
-        mAction(theNode);
+        mAction(node, modelViewMatrix * graph->mWorldTransforms[i], projectionMatrix);
+        ++i;
     }
 }
 
-void SceneGraph::PostOrderVisitor::run(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
+/**
+ * Post order of the nodes accepting visitors, from the depth first arrays : an inner node follows its subtree
+ */
+static void postOrder(const std::vector<SceneGraph::Node *> &nodes, const std::vector<int> &subtreeEnds, std::vector<int> &order)
 {
-    if (theNode->acceptVisitors()){
-        if (!theNode->isLeaf()) {
-            SceneGraph::InnerNode * innerNode = static_cast<SceneGraph::InnerNode *>(theNode);
-            for (int i = 0; i < innerNode->nChilds(); ++i) {
-                run((*innerNode)[i],  modelViewMatrix * theNode->transformMatrix(), projectionMatrix);
-            }
+    std::vector<int> open;
+    int numNodes = nodes.size();
+    for (int i = 0; i < numNodes;) {
+        while (!open.empty() && subtreeEnds[open.back()] <= i) {
+            order.push_back(open.back());
+            open.pop_back();
+        }
+        if (!nodes[i]->acceptVisitors()) {
+            i = subtreeEnds[i];
+            continue;
         }
-        mAction(theNode, modelViewMatrix * theNode->transformMatrix() , projectionMatrix);
+        if (subtreeEnds[i] == i + 1)
+            order.push_back(i);
+        else
+            open.push_back(i);
+        ++i;
+    }
+    while (!open.empty()) {
+        order.push_back(open.back());
+        open.pop_back();
     }
 }
 
+void SceneGraph::PostOrderVisitor::run(SceneGraph::Node *)
+{
+    SceneGraph *graph = mVisitedGraph;
+    std::vector<int> order;
+    postOrder(graph->mNodes, graph->mSubtreeEnds, order);
+    for (unsigned int k = 0; k < order.size(); ++k)
+        mAction(graph->mNodes[order[k]]);
+}
 
-void SceneGraph::PreOrderVisitor::run(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
+void SceneGraph::PostOrderVisitor::run(SceneGraph::Node *, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
 {
-    if (theNode->acceptVisitors()){
-        mAction(theNode, modelViewMatrix * theNode->transformMatrix(), projectionMatrix);
-        if (!theNode->isLeaf()) {
-            SceneGraph::InnerNode * innerNode = static_cast<SceneGraph::InnerNode *>(theNode);
-            for (int i = 0; i < innerNode->nChilds(); ++i) {
-                run((*innerNode)[i], modelViewMatrix * theNode->transformMatrix(), projectionMatrix);
-            }
-        }
-    }
+    SceneGraph *graph = mVisitedGraph;
+    graph->updateBounds();
+    std::vector<int> order;
+    postOrder(graph->mNodes, graph->mSubtreeEnds, order);
+    for (unsigned int k = 0; k < order.size(); ++k)
+        mAction(graph->mNodes[order[k]], modelViewMatrix * graph->mWorldTransforms[order[k]], projectionMatrix);
 }
 }//namespace vortex
@@ -7,12 +7,14 @@
 #ifndef SCENEGRAPH_H
 #define SCENEGRAPH_H
 #include <string>
+#include <vector>
 
 #include "opengl.h"
 #include "light.h"
 #include "camera.h"
 #include "mesh.h"
 #include "renderstate.h"
+#include "frustum.h"
 
 namespace vortex {
 /**
@@ -41,7 +43,8 @@ public:
     public :
         typedef Node *NodePtr;
 
-        Node(std::string name, Node *parent = NULL) : mName(name), mParent(parent), boxMesh_(NULL), mAcceptVisitors(true) {
+        Node(std::string name, Node *parent = NULL) : mName(name), mParent(parent), boxMesh_(NULL), mAcceptVisitors(true),
+            mGraph(NULL), mIndex(-1), mTransformDirty(true), mBoundsDirty(true), mCulled(false) {
         }
 
         virtual ~Node() {
@@ -52,13 +55,10 @@ public:
             return mParent;
         }
 
-        void setTransformMatrix(const glm::mat4x4 &transform) {
-            mTransform = transform;
-        }
+        inline void setTransformMatrix(const glm::mat4x4 &transform);
 
-        glm::mat4x4 &transformMatrix() {
-            return mTransform;
-        }
+        /** Transformation from the node space to its parent space, stored by the SceneGraph once the node is in one */
+        inline glm::mat4x4 &transformMatrix();
 
         /** is the node a leaf ? */
         virtual bool isLeaf() {
@@ -86,6 +86,28 @@ public:
             mBbox += box;
         }
 
+        /** Flag the world bounds of the node and of its ancestors to be recomputed by SceneGraph::updateBounds */
+        void invalidateBounds() {
+            for (Node *node = this; node && !node->mBoundsDirty; node = node->mParent)
+                node->mBoundsDirty = true;
+        }
+
+        /** Transformation from the node space to the graph root space, as of the last SceneGraph::updateBounds */
+        inline const glm::mat4x4 &worldTransformMatrix() const;
+
+        /** Position of the node in the depth first order of its SceneGraph, -1 if it is not in a SceneGraph */
+        int index() const {
+            return mIndex;
+        }
+
+        /** Was the node outside the frustum at the last SceneGraph::cull */
+        bool isCulled() const {
+            return mCulled;
+        }
+
+        /** Level of detail of the mesh of a slot of the leaf, as of the last SceneGraph::selectLods */
+        inline int lodLevel(int slot) const;
+
         void setAcceptVisitors(bool b){
             mAcceptVisitors=b;
         }
@@ -95,7 +117,7 @@ public:
         }
 
     protected :
-        glm::mat4x4 mTransform; // default constructor : identiy
+        glm::mat4x4 mTransform; // default constructor : identiy, until the node is in a SceneGraph
         std::string mName;
         Node *mParent;
         BBox mBbox;
@@ -103,8 +125,19 @@ public:
         Mesh *boxMesh_;
 
         bool mAcceptVisitors;
+
+        // the graph storing the node transforms, see SceneGraph::SceneGraph
+        SceneGraph *mGraph;
+        int mIndex;
+
+        // world bounds maintenance, see SceneGraph::updateBounds
+        bool mTransformDirty;
+        bool mBoundsDirty;
+        bool mCulled;
+
+        friend class SceneGraph;
     private :
-        Node() : mParent(NULL) {}
+        Node() : mParent(NULL), mGraph(NULL), mIndex(-1) {}
     };
 
     /** generic node of the graph
@@ -187,6 +220,22 @@ public:
         RenderState::RenderStatePtr *mRenderStates;
     };
 
+    /**
+     * Receives the changes of the graph content, so that the rendering loops update the changed meshes only.
+     * The hierarchy itself never changes, see SceneGraph::SceneGraph.
+     */
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        /** The mesh of a slot of a leaf was replaced, see SceneGraph::setMesh */
+        virtual void meshChanged(LeafMeshNode *node, int slot) {}
+        /** The material of a slot of a leaf was replaced, see SceneGraph::setMaterial */
+        virtual void materialChanged(LeafMeshNode *node, int slot) {}
+        /** The world transform of a leaf changed, sent by SceneGraph::updateBounds */
+        virtual void transformChanged(LeafMeshNode *node) {}
+        /** The graph is being deleted : the listener must not use it any more */
+        virtual void graphDeleted(SceneGraph *graph) {}
+    };
 
 
 
@@ -252,7 +301,9 @@ public:
     };
 
     /** Pre order visitor.
-     * call the visiting operator on a node BEFORE visiting childs
+     * call the visiting operator on a node BEFORE visiting childs.
+     * The whole graph is visited as a sweep of its depth first arrays, the matrices given to the operator
+     * are the cached world transforms.
      * @ingroup GraphVisitorGroup
      */
     class PreOrderVisitor : public Visitor {
@@ -265,7 +316,8 @@ public:
     };
 
     /** Post order visitor.
-     * call the visiting operator on a node AFTER visiting childs
+     * call the visiting operator on a node AFTER visiting childs.
+     * The whole graph is visited as a sweep of its depth first arrays, as PreOrderVisitor.
      * @ingroup GraphVisitorGroup
      */
     class PostOrderVisitor : public Visitor {
@@ -278,9 +330,98 @@ public:
     };
 
 public:
+    /**
+     * Culling results of the last frame, in number of meshes
+     */
+    struct CullingStatistics {
+        int mSubmitted;
+        int mCulled;
+        CullingStatistics() : mSubmitted(0), mCulled(0) {}
+    };
+
+    /**
+     * Build the graph of a complete node hierarchy : the nodes are stored in depth first order,
+     * with their parent index, their subtree end and their transforms in arrays. The hierarchy must not change afterwards.
+     */
     SceneGraph(Node::NodePtr rootNode);
     ~SceneGraph();
 
+    /**
+     * Recompute world transforms and bounding boxes of the nodes flagged by setTransformMatrix or invalidateBounds.
+     * Clean subtrees are skipped.
+     */
+    void updateBounds();
+
+    /** Number of nodes of the graph */
+    int numNodes() const {
+        return mNodes.size();
+    }
+
+    /** The node at index in depth first order */
+    Node *node(int index) const {
+        return mNodes[index];
+    }
+
+    /** Index of the parent of a node, -1 for the root */
+    int parentIndex(int index) const {
+        return mParents[index];
+    }
+
+    /** Index following the last descendant of a node : its subtree is [index, subtreeEnd(index)) */
+    int subtreeEnd(int index) const {
+        return mSubtreeEnds[index];
+    }
+
+    /** Index of the first mesh of a node among all the meshes of the graph, in depth first order */
+    int meshSlot(int index) const {
+        return mMeshSlots[index];
+    }
+
+    /** Number of meshes slots of all the leaves */
+    int numMeshSlots() const {
+        return mMeshSlots.back();
+    }
+
+    /** Flag the bounds of the nodes holding a mesh whose geometry changed */
+    void invalidateBounds(const Mesh *mesh);
+
+    /** Replace the mesh of a slot of a leaf and notify the listeners */
+    void setMesh(LeafMeshNode *node, int slot, Mesh *mesh);
+
+    /**
+     * Replace a mesh in all the slots holding it, see setMesh.
+     * previous may be mesh itself, rebuilt in place : the listeners then update their copies of it.
+     */
+    void replaceMesh(const Mesh *previous, Mesh *mesh);
+
+    /** Replace the material of a slot of a leaf and notify the listeners */
+    void setMaterial(LeafMeshNode *node, int slot, Material *material);
+
+    /** The listener is notified of the changes until it is removed or the graph is deleted */
+    void addListener(Listener *listener);
+    void removeListener(Listener *listener);
+
+    /**
+     * Flag the nodes outside the frustum as culled. Bounds are updated first.
+     * Subtrees entirely inside or outside the frustum are not tested further.
+     */
+    void cull(const Frustum &frustum);
+
+    /** Remove the culled flag of all nodes */
+    void resetCulling();
+
+    const CullingStatistics &cullingStatistics() const {
+        return mCullingStatistics;
+    }
+
+    /**
+     * Select the level of detail of the meshes of the nodes not culled, from the projected size of their bounding box
+     * (see Mesh::selectLod). The world transforms of the last updateBounds are used.
+     *
+     * @param viewportHeight Height of the viewport, in pixels.
+     */
+    void selectLods(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, int viewportHeight);
+
     void draw(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix) {
         if (mRootNode) mRootNode->draw(modelViewMatrix, projectionMatrix);
     }
@@ -302,8 +443,48 @@ public:
 protected:
 private:
     SceneGraph() : mRootNode(NULL) {}
+    /** Set the culled flag of the nodes [begin, end) and count their meshes */
+    void setCulled(int begin, int end, bool culled);
     Node::NodePtr mRootNode;
+    CullingStatistics mCullingStatistics;
+
+    // the nodes in depth first order
+    std::vector<Node *> mNodes;
+    std::vector<int> mParents;
+    std::vector<int> mSubtreeEnds;
+    std::vector<glm::mat4x4> mLocalTransforms;
+    std::vector<glm::mat4x4> mWorldTransforms;
+    // first mesh slot of each node, followed by the number of slots
+    std::vector<int> mMeshSlots;
+    // level of detail of each mesh slot, see selectLods
+    std::vector<unsigned char> mLodLevels;
+
+    // nodes updated by updateBounds, in depth first order
+    std::vector<int> mUpdated;
+    // leaves moved by updateBounds, notified to the listeners
+    std::vector<LeafMeshNode *> mMoved;
+
+    std::vector<Listener *> mListeners;
     };
+
+inline void SceneGraph::Node::setTransformMatrix(const glm::mat4x4 &transform) {
+    transformMatrix() = transform;
+    mTransformDirty = true;
+    invalidateBounds();
+}
+
+inline glm::mat4x4 &SceneGraph::Node::transformMatrix() {
+    return mGraph ? mGraph->mLocalTransforms[mIndex] : mTransform;
+}
+
+inline const glm::mat4x4 &SceneGraph::Node::worldTransformMatrix() const {
+    return mGraph ? mGraph->mWorldTransforms[mIndex] : mTransform;
+}
+
+inline int SceneGraph::Node::lodLevel(int slot) const {
+    return mGraph ? mGraph->mLodLevels[mGraph->mMeshSlots[mIndex] + slot] : 0;
+}
+
 }
 
 
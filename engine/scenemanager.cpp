@@ -34,11 +34,7 @@ bool SceneManager::loadScene(const std::string &filename)
             delete mSceneGraph;
         mSceneGraph = graph;
 
-        {
-            BBoxBuilder bboxBuilder;
-            SceneGraph::PostOrderVisitor visit(mSceneGraph, bboxBuilder);
-            visit.go(glm::mat4(1.f), glm::mat4(1.f));
-        }
+        mSceneGraph->updateBounds();
         //graph->printDebug();
     }
     return res;
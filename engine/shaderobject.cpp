@@ -5,6 +5,7 @@
  */
 
 #include <iostream>
+#include <cstdlib>
 #include "shaderobject.h"
 
 namespace vortex {
@@ -130,20 +131,30 @@ void ShaderObject::create(GLenum type)
 }
 
 void ShaderObject::load(std::string fileName)
+{
+    load(fileName, readSource(fileName, mConfigurationString));
+}
+
+void ShaderObject::load(std::string fileName, const std::string &code)
 {
     mFileName = fileName;
+    const char *fullCode = code.c_str();
+ // std :: cerr << fullCode << std::endl << std::endl << std::endl << std::endl << std::endl;
+    source(&fullCode, 1);
+}
+
+std::string ShaderObject::readSource(const std::string &fileName, const std::string &configurationString)
+{
     char* code = loadFile(fileName.c_str());
-    const char *fullCode[3];
 #ifdef __APPLE__
-    fullCode[0] = "#version 410\n#define __APPLE__\n";
+    std::string fullCode("#version 410\n#define __APPLE__\n");
 #else
-    fullCode[0] = "#version 410\n";
+    std::string fullCode("#version 410\n");
 #endif
-    fullCode[1] = mConfigurationString.c_str();
-    fullCode[2] = code;
- // std :: cerr << fullCode[0] << std::endl << fullCode[1] << std::endl << fullCode[2] << std::endl << std::endl << std::endl << std::endl << std::endl;
-    source(fullCode, 3);
+    fullCode += configurationString;
+    fullCode += code;
     delete [] code;
+    return fullCode;
 }
 
 void ShaderObject::source(const char** codeStrings, int nbStrings)
@@ -233,7 +244,32 @@ void ShaderProgram::add(ShaderObject *s)
     mShaderObjects.push_back(s);
 }
 
+bool ShaderProgram::checkShaders()
+{
+    bool ok = true;
+    for (unsigned int i = 0; i < mShaderObjects.size(); ++i)
+        ok = mShaderObjects[i]->check() && ok;
+    return ok;
+}
+
+void ShaderProgram::clear()
+{
+    for (unsigned int i = 0; i < mShaderObjects.size(); ++i) {
+        glAssert(glDetachShader(mId, mShaderObjects[i]->id()));
+        mShaderObjects[i]->del();
+    }
+    deleteProgram();
+    mShaderObjects.clear();
+    del();
+}
+
 void ShaderProgram::link()
+{
+    startLink();
+    finishLink();
+}
+
+void ShaderProgram::startLink()
 {
 
     //      attach all shaderObjects
@@ -248,12 +284,55 @@ void ShaderProgram::link()
     glAssert(glBindAttribLocation(mId, 1, "inNormal"));
     glAssert(glBindAttribLocation(mId, 2, "inTangent"));
     glAssert(glBindAttribLocation(mId, 3, "inTexCoord"));
+    // skinning influences, see AnimatedMesh::init
+    glAssert(glBindAttribLocation(mId, 4, "inBoneIndices"));
+    glAssert(glBindAttribLocation(mId, 5, "inBoneWeights"));
+    glAssert(glBindAttribLocation(mId, 6, "inBoneIndices2"));
+    glAssert(glBindAttribLocation(mId, 7, "inBoneWeights2"));
 
+    // keep the binary for the program cache, see AssetManager::setProgramCacheFolder
+    glAssert(glProgramParameteri(mId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
 
     glAssert(glLinkProgram(mId));
+}
+
+bool ShaderProgram::finishLink()
+{
     // check link
-    check();
+    int linked = check();
+    setupLocations();
+    return linked;
+}
 
+bool ShaderProgram::loadBinary(GLenum format, const std::vector<char> &binary)
+{
+    if (binary.empty())
+        return false;
+    glAssert(glProgramBinary(mId, format, &(binary[0]), binary.size()));
+    // a rejected binary leaves the program unlinked, without OpenGL error
+    GLint linked;
+    glAssert(glGetProgramiv(mId, GL_LINK_STATUS, &linked));
+    if (!linked)
+        return false;
+    setupLocations();
+    return true;
+}
+
+bool ShaderProgram::getBinary(GLenum &format, std::vector<char> &binary) const
+{
+    GLint length = 0;
+    glAssert(glGetProgramiv(mId, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0)
+        return false;
+    binary.resize(length);
+    GLsizei written = 0;
+    glAssert(glGetProgramBinary(mId, length, &written, &format, &(binary[0])));
+    binary.resize(written);
+    return written > 0;
+}
+
+void ShaderProgram::setupLocations()
+{
     //automatic texture unit and location management
     int texUnit = 0;
     int total = -1;
@@ -274,8 +353,13 @@ void ShaderProgram::link()
             &name_len, &num, &type, name );
         name[name_len] = 0;
 /// TODO : add other sampler type
-        if(type == GL_SAMPLER_2D || type ==GL_SAMPLER_CUBE|| type == GL_SAMPLER_2D_RECT){
+        if(type == GL_SAMPLER_2D || type ==GL_SAMPLER_CUBE|| type == GL_SAMPLER_2D_RECT ||
+           type == GL_SAMPLER_BUFFER || type == GL_INT_SAMPLER_BUFFER || type == GL_UNSIGNED_INT_SAMPLER_BUFFER){
             GLuint location = glGetUniformLocation( mId, name );
+            if (std::string(name) == "uniBonePalette") {
+                glAssert(glProgramUniform1i(mId, location, BONE_PALETTE_UNIT));
+                continue;
+            }
             textureUnits[std::string(name)] = TextureBinding(texUnit++, location);
         }
     }
@@ -324,67 +408,114 @@ bool ShaderProgram::reload()
  */
 
 std::set<std::string> ShaderConfiguration::mDefaultProperties;
+std::vector<std::string> ShaderConfiguration::mProgramNames;
+std::map<std::string, int> ShaderConfiguration::mProgramIds;
+std::vector<std::string> ShaderConfiguration::mPropertyNames;
+std::map<std::string, int> ShaderConfiguration::mPropertyIds;
+
+ShaderConfiguration::ShaderConfiguration(ShaderType type, const std::string &name) : mProperties(0), mProgramId(programId(name)), mType(type)
+{
+    updateHash();
+}
 
-ShaderConfiguration::ShaderConfiguration(ShaderType type, std::string name) : mNumProperties(0), mProgramName(name), mType(type)
+ShaderConfiguration::ShaderConfiguration(ShaderType type, int programId) : mProperties(0), mProgramId(programId), mType(type)
 {
+    updateHash();
 }
 
 ShaderConfiguration::~ShaderConfiguration()
 {
 }
 
-void ShaderConfiguration::addProperty(std::string name)
+int ShaderConfiguration::programId(const std::string &name)
 {
-    mProperties.insert(name);
-    mNumProperties = mProperties.size();
+    std::map<std::string, int>::iterator it = mProgramIds.find(name);
+    if (it != mProgramIds.end())
+        return it->second;
+    mProgramNames.push_back(name);
+    return mProgramIds[name] = mProgramNames.size() - 1;
 }
 
-void ShaderConfiguration::removeProperty(std::string name)
+int ShaderConfiguration::propertyId(const std::string &name)
 {
-    mProperties.erase(name);
-    mNumProperties = mProperties.size();
+    std::map<std::string, int>::iterator it = mPropertyIds.find(name);
+    if (it != mPropertyIds.end())
+        return it->second;
+    if ((int) mPropertyNames.size() == MAX_PROPERTIES) {
+        std::cerr << "ShaderConfiguration : more than " << MAX_PROPERTIES << " properties, can not add " << name << std::endl;
+        std::abort();
+    }
+    mPropertyNames.push_back(name);
+    return mPropertyIds[name] = mPropertyNames.size() - 1;
+}
+
+void ShaderConfiguration::updateHash()
+{
+    // splitmix64 finalizer over the three fields
+    uint64_t h = mProperties ^ (uint64_t(mProgramId) << 32 | uint64_t(mType));
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    mHash = h ^ (h >> 31);
+}
+
+void ShaderConfiguration::addProperty(int propertyId)
+{
+    if (propertyId < 0)
+        return;
+    mProperties |= uint64_t(1) << propertyId;
+    updateHash();
+}
+
+void ShaderConfiguration::removeProperty(const std::string &name)
+{
+    std::map<std::string, int>::iterator it = mPropertyIds.find(name);
+    if (it == mPropertyIds.end())
+        return;
+    mProperties &= ~(uint64_t(1) << it->second);
+    updateHash();
+}
+
+bool ShaderConfiguration::hasProperty(const std::string &name) const
+{
+    std::map<std::string, int>::iterator it = mPropertyIds.find(name);
+    return it != mPropertyIds.end() && hasProperty(it->second);
 }
 
 int ShaderConfiguration::numProperties() const
 {
-    return mProperties.size();
+    int count = 0;
+    for (uint64_t bits = mProperties; bits; bits &= bits - 1)
+        ++count;
+    return count;
 }
 
-std::string ShaderConfiguration::getPropertyName(unsigned int i) const
+const std::string &ShaderConfiguration::getPropertyName(unsigned int i) const
 {
-    std::set<std::string>::iterator it = mProperties.begin();
-    while (i--) ++it;
-    return *it;
+    // the ith set bit
+    uint64_t bits = mProperties;
+    while (i--)
+        bits &= bits - 1;
+    int id = 0;
+    while (!(bits & (uint64_t(1) << id)))
+        ++id;
+    return mPropertyNames[id];
 }
 
 bool ShaderConfiguration::operator<(const ShaderConfiguration& b) const
 {
-    if (mProgramName == b.mProgramName) {
-        if (mNumProperties == b.mNumProperties) {
-            if (mNumProperties == 0)
-                return false;
-            std::set<std::string>::iterator lhs = mProperties.begin();
-            std::set<std::string>::iterator rhs = b.mProperties.begin();
-            while ((lhs != mProperties.end()) && (*lhs == *rhs)) {
-                ++lhs;
-                ++rhs;
-            }
-            if (lhs == mProperties.end())
-                return false;
-            else
-                return (*lhs < *rhs);
-        } else
-            return (mNumProperties < b.mNumProperties);
-    } else
-        return (mProgramName < b.mProgramName);
+    if (mProgramId != b.mProgramId)
+        return mProgramId < b.mProgramId;
+    if (mType != b.mType)
+        return mType < b.mType;
+    return mProperties < b.mProperties;
 }
 
 std::ostream & operator << (std::ostream & out, const ShaderConfiguration configuration)
 {
-    out << "Program Name : " << configuration.mProgramName << std::endl;
-    out << "Configuration string (" << configuration.mNumProperties << ") : " ;
-    for (std::set<std::string>::const_iterator it = configuration.mProperties.begin(); it != configuration.mProperties.end(); ++it) {
-        out << *it << " ";
+    out << "Program Name : " << configuration.getProgramName() << std::endl;
+    out << "Configuration string (" << configuration.numProperties() << ") : " ;
+    for (int i = 0; i < configuration.numProperties(); ++i) {
+        out << configuration.getPropertyName(i) << " ";
     }
     return out;
 }
@@ -12,6 +12,7 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <stdint.h>
 
 #include "opengl.h"
 #include "texture.h"
@@ -33,6 +34,10 @@ class Uniform {
  * <shaderType, filename> and verify that the compilation could be done with this configuration.
  * If no pair are given shaders are loaded form default.vert and default.frag
  * Each shader configuration is identified by its properties and assets manager ensure that only one shaderProgram per configuration exists
+ *
+ * Program names and properties are interned : a configuration stores a program id and a bitset of property ids,
+ * so that it is built, copied, compared and hashed without allocation. The interned names are not thread safe,
+ * configurations are built from the OpenGL thread.
  */
 class ShaderConfiguration {
 public:
@@ -42,24 +47,49 @@ public:
      */
     enum ShaderType { VERTEX_SHADER = 1 << 0, GEOMETRY_SHADER = 1 << 1, FRAGMENT_SHADER = 1 << 2, DEFAULT = VERTEX_SHADER | FRAGMENT_SHADER, ALL = DEFAULT | GEOMETRY_SHADER, INVALID = 0 };
 
+    /// Number of distinct properties, the size of the property bitset
+    static const int MAX_PROPERTIES = 64;
+
 //    ShaderConfiguration(ShaderType type = DEFAULT, std::string name = "../shaders/default");
-    ShaderConfiguration(ShaderType type = INVALID, std::string name = "null");
-    ShaderConfiguration(const ShaderConfiguration &conf){
-        mType = conf.mType;
-        mProgramName = conf.mProgramName;
-        mNumProperties = conf.mNumProperties;
-        mProperties = conf.mProperties;
-    }
+    ShaderConfiguration(ShaderType type = INVALID, const std::string &name = "null");
+    ShaderConfiguration(ShaderType type, int programId);
 
     ~ShaderConfiguration();
 
-    void addProperty(std::string name);
-    void removeProperty(std::string name);
+    /**
+     * @return The id of a program name, interned on its first use
+     */
+    static int programId(const std::string &name);
+
+    /**
+     * @return The id of a property, interned on its first use.
+     * More than MAX_PROPERTIES properties abort the program : a dropped property would silently build wrong programs.
+     */
+    static int propertyId(const std::string &name);
+
+    void addProperty(const std::string &name) {
+        addProperty(propertyId(name));
+    }
+
+    void addProperty(int propertyId);
+
+    void removeProperty(const std::string &name);
+
+    bool hasProperty(const std::string &name) const;
+
+    bool hasProperty(int propertyId) const {
+        return propertyId >= 0 && (mProperties & (uint64_t(1) << propertyId));
+    }
+
     int numProperties() const;
-    std::string getPropertyName(unsigned int i) const;
+    const std::string &getPropertyName(unsigned int i) const;
 
-    std::string getProgramName() const {
-        return mProgramName;
+    const std::string &getProgramName() const {
+        return mProgramNames[mProgramId];
+    }
+
+    int getProgramId() const {
+        return mProgramId;
     }
 
     ShaderType getType() const {
@@ -67,8 +97,18 @@ public:
     }
 
     /**
-     * Comparison operator for map insertion
-     * @todo, define a total order on ShaderConfiguration
+     * @return A hash of the configuration, kept up to date by the modifiers
+     */
+    uint64_t hash() const {
+        return mHash;
+    }
+
+    bool operator==(const ShaderConfiguration& b) const {
+        return mHash == b.mHash && mProgramId == b.mProgramId && mType == b.mType && mProperties == b.mProperties;
+    }
+
+    /**
+     * Comparison operator for map insertion : program, type, then properties
      */
     bool operator<(const ShaderConfiguration& b) const;
 
@@ -91,16 +131,23 @@ public:
 
 
 private:
+    void updateHash();
+
     /**
-     * Vector of properties.
-     * This vector is kept ordered and the ShaderConfiguration order is built on this vector
+     * Bitset of the property ids.
      */
-    std::set<std::string> mProperties;
-    int mNumProperties;
-    std::string mProgramName;
+    uint64_t mProperties;
+    int mProgramId;
     ShaderType mType;
+    uint64_t mHash;
 
     static std::set<std::string> mDefaultProperties;
+
+    // interned names, indexed by their id
+    static std::vector<std::string> mProgramNames;
+    static std::map<std::string, int> mProgramIds;
+    static std::vector<std::string> mPropertyNames;
+    static std::map<std::string, int> mPropertyIds;
 };
 
 
@@ -129,6 +176,19 @@ public:
      */
     void load(std::string fileName);
 
+    /**
+     * Set the full source of the shader, as built by readSource.
+     *
+     * @param fileName The file the code was read from, for reload and error messages.
+     */
+    void load(std::string fileName, const std::string &code);
+
+    /**
+     * Read a shader file and prefix it with the GLSL version and the configuration string.
+     * No OpenGL call is made : it may be called from any thread.
+     */
+    static std::string readSource(const std::string &fileName, const std::string &configurationString);
+
     /**
      * Load the shader from fileName.
      * Note that the source string isn'nt kept in client space.
@@ -183,6 +243,10 @@ private:
  */
 class ShaderProgram : public Bindable {
 public:
+    /**
+     * Texture unit reserved to the "uniBonePalette" sampler of GPU skinned meshes, bound by the meshes themselves.
+     */
+    static const int BONE_PALETTE_UNIT = 15;
 
     ShaderProgram() : Bindable() {
         //mUBO = new UBO();
@@ -276,6 +340,13 @@ public:
      * @param s The ShaderProgram to be added. Must have been checked before calling this method.
      */
     void add(ShaderObject *s);
+
+    /**
+     * Check the compilation status of all the ShaderObjects.
+     *
+     * @return True if all the ShaderObjects are compiled.
+     */
+    bool checkShaders();
     /*
     glBindAttribLocation(p, 0, "inPosition");
     glBindAttribLocation(p, 1, "inNormal");
@@ -288,6 +359,38 @@ public:
      */
     void link();
 
+    /**
+     * Attach all ShaderObjects and start the link without waiting for it, so that the driver may compile
+     * several programs concurrently. finishLink must be called before the ShaderProgram is used.
+     */
+    void startLink();
+
+    /**
+     * Check the link started by startLink and query the uniform locations.
+     *
+     * @return True if the ShaderProgram is correctly linked.
+     */
+    bool finishLink();
+
+    /**
+     * Load the ShaderProgram from a binary returned by getBinary, instead of linking ShaderObjects.
+     *
+     * @return False if the OpenGL implementation rejects the binary (other driver, other version ...)
+     */
+    bool loadBinary(GLenum format, const std::vector<char> &binary);
+
+    /**
+     * Get the binary of the linked ShaderProgram.
+     *
+     * @return False if the OpenGL implementation does not give it.
+     */
+    bool getBinary(GLenum &format, std::vector<char> &binary) const;
+
+    /**
+     * Delete the ShaderObjects and the OpenGL program.
+     */
+    void clear();
+
     /**
      * Check the link status of the ShaderProgram.
      *
@@ -439,6 +542,11 @@ public:
 
 private:
 
+    /**
+     * Query the locations of the default uniforms and assign the texture units, once the ShaderProgram is linked.
+     */
+    void setupLocations();
+
     struct TextureBinding{
         int texUnit_;
         int location_;
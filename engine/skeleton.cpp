@@ -25,6 +25,7 @@ SkeletonGraph::~SkeletonGraph() { }
 SkeletonGraph::Node::Node(std::string name, Node *parent = NULL) :
     mName(name),
     mParent(parent),
+    mIndex(-1),
     mNumChilds(0),
     mChilds()
 {
@@ -43,13 +44,41 @@ SkeletonGraph::Node::~Node() {
 /***************************************************/
 
 void SkeletonGraph::buildBonesMap(Node* node) {
+    if (node == mRootNode) {
+        mJoints.clear();
+        mParents.clear();
+        mLocalTransforms.clear();
+    }
+
     // Add bone to map
     mBonesByName[node->name()] = node;
 
+    // Add joint, after its parent
+    node->mIndex = mJoints.size();
+    mJoints.push_back(node);
+    mParents.push_back(node->parent() ? node->parent()->index() : -1);
+    mLocalTransforms.push_back(node->localTransform());
+
     // Recursive
     for (unsigned int i = 0; i < node->nChilds(); ++i) {
         buildBonesMap(node->child(i));
     }
+
+    if (node == mRootNode) {
+        mGlobalTransforms.resize(mJoints.size());
+        updateGlobalTransforms();
+    }
+}
+
+void SkeletonGraph::updateGlobalTransforms() {
+    // parents come first : their global matrix is up to date
+    for (unsigned int i = 0; i < mJoints.size(); ++i) {
+        if (mParents[i] < 0)
+            mGlobalTransforms[i] = mLocalTransforms[i];
+        else
+            // G * L (G: parent global, L: Child local)
+            mGlobalTransforms[i] = mGlobalTransforms[mParents[i]] * mLocalTransforms[i];
+    }
 }
 
 void SkeletonGraph::drawSkeleton() {
@@ -60,11 +89,9 @@ void SkeletonGraph::drawSkeleton() {
          * First, we list all bsetLocalTransformones an her parents
          */
         std::vector<glm::vec3> bonesList;
-        for (std::map<std::string, SkeletonGraph::Node *>::iterator it = mBonesByName.begin(); it != mBonesByName.end(); ++it) {
-            SkeletonGraph::Node* node = it->second;
-
+        for (unsigned int i = 0; i < mJoints.size(); ++i) {
             // get the translation only
-            glm::mat4x4 global = node->globalTransform();
+            glm::mat4x4 global = mGlobalTransforms[i];
             glm::vec3 vertex = glm::vec3(global[3][0],
                                          global[3][1],
                                          global[3][2]);
@@ -72,8 +99,8 @@ void SkeletonGraph::drawSkeleton() {
             bonesList.push_back(vertex);
 
             // same for parent...
-            if(node->parent() != NULL) {
-                global = node->parent()->globalTransform();
+            if(mParents[i] >= 0) {
+                global = mGlobalTransforms[mParents[i]];
                 vertex = glm::vec3(global[3][0],
                                    global[3][1],
                                    global[3][2]);
@@ -132,11 +132,21 @@ public:
             return mBindTransform;
         }
 
+        /**
+         * @return The index of the node in the flattened skeleton, -1 before buildBonesMap
+         */
+        int index() const {
+            return mIndex;
+        }
+
 
     private:
+        friend class SkeletonGraph;
+
         std::string mName;
 
         Node *mParent;
+        int mIndex;
 
         unsigned int mNumChilds;
         std::vector<Node*> mChilds;
@@ -175,10 +185,56 @@ public:
     /**
      * Build the bones map
      * Name of bone -> Reference in the tree bones (the skeleton)
+     * and flatten the skeleton, in depth first order, when called on the root.
      * @param node Initially the root of tree
      */
     void buildBonesMap(Node *node);
 
+    /*********** Flattened skeleton ***********/
+    /**
+     * Joints are the nodes in depth first order : parents come before their children.
+     * The pose is held by the local and global matrices arrays, not by the nodes.
+     */
+    int nJoints() const {
+        return mJoints.size();
+    }
+
+    /**
+     * @return The index of a joint, -1 if the skeleton has no such joint. Meant to be resolved once, at load.
+     */
+    int jointIndex(const std::string &name) const {
+        std::map<std::string, SkeletonGraph::Node *>::const_iterator it = mBonesByName.find(name);
+        return (it != mBonesByName.end()) ? it->second->index() : -1;
+    }
+
+    /**
+     * @return The parent index of a joint, -1 for the root
+     */
+    int parentIndex(int joint) const {
+        return mParents[joint];
+    }
+
+    void setLocalTransform(int joint, const glm::mat4x4 &local) {
+        mLocalTransforms[joint] = local;
+    }
+
+    const glm::mat4x4 &localTransform(int joint) const {
+        return mLocalTransforms[joint];
+    }
+
+    const glm::mat4x4 &bindTransform(int joint) const {
+        return mJoints[joint]->mBindTransform;
+    }
+
+    const glm::mat4x4 &globalTransform(int joint) const {
+        return mGlobalTransforms[joint];
+    }
+
+    /**
+     * Compute the global matrices from the local ones, in a single pass over the joints.
+     */
+    void updateGlobalTransforms();
+
     SkeletonGraph::Node* getBone(const std::string &name) {
        std::map<std::string, SkeletonGraph::Node *>::iterator it =mBonesByName.find(name);
        if(it != mBonesByName.end()) {
@@ -229,6 +285,12 @@ private:
     // Map of bones
     std::map<std::string, SkeletonGraph::Node *> mBonesByName;
 
+    // Flattened skeleton, in depth first order
+    std::vector<Node *> mJoints;
+    std::vector<int> mParents;
+    std::vector<glm::mat4x4> mLocalTransforms;
+    std::vector<glm::mat4x4> mGlobalTransforms;
+
     // to draw skeleton or not
     bool mDisplaySkeleton;
 };
@@ -0,0 +1,142 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "skinning.h"
+
+#include <algorithm>
+
+namespace vortex {
+
+const char *SkinningEngine::GPU_SKINNING_PROPERTY = "GPU_SKINNING";
+const char *SkinningEngine::GPU_SKINNING_8_PROPERTY = "GPU_SKINNING_8";
+
+const char *SkinningEngine::gpuShaderSource()
+{
+    // same blending as AnimatedMesh::skinVertices : the palette texels of a bone are the 3 rows of its
+    // skinning matrix and the 3 columns of its normal matrix
+    return
+        "uniform samplerBuffer uniBonePalette;\n"
+        "in ivec4 inBoneIndices;\n"
+        "in vec4 inBoneWeights;\n"
+        "#ifdef GPU_SKINNING_8\n"
+        "in ivec4 inBoneIndices2;\n"
+        "in vec4 inBoneWeights2;\n"
+        "#endif\n"
+        "void blendBone(int bone, float weight, inout vec4 r0, inout vec4 r1, inout vec4 r2, inout mat3 n) {\n"
+        "    r0 += weight * texelFetch(uniBonePalette, 6*bone);\n"
+        "    r1 += weight * texelFetch(uniBonePalette, 6*bone + 1);\n"
+        "    r2 += weight * texelFetch(uniBonePalette, 6*bone + 2);\n"
+        "    n[0] += weight * texelFetch(uniBonePalette, 6*bone + 3).xyz;\n"
+        "    n[1] += weight * texelFetch(uniBonePalette, 6*bone + 4).xyz;\n"
+        "    n[2] += weight * texelFetch(uniBonePalette, 6*bone + 5).xyz;\n"
+        "}\n"
+        "void blendBones(out vec4 r0, out vec4 r1, out vec4 r2, out mat3 n) {\n"
+        "    r0 = vec4(0.0); r1 = vec4(0.0); r2 = vec4(0.0); n = mat3(0.0);\n"
+        "    for (int k = 0; k < 4; ++k)\n"
+        "        blendBone(inBoneIndices[k], inBoneWeights[k], r0, r1, r2, n);\n"
+        "#ifdef GPU_SKINNING_8\n"
+        "    for (int k = 0; k < 4; ++k)\n"
+        "        blendBone(inBoneIndices2[k], inBoneWeights2[k], r0, r1, r2, n);\n"
+        "#endif\n"
+        "}\n"
+        "void skinVertex(inout vec3 position, inout vec3 normal) {\n"
+        "    vec4 r0, r1, r2;\n"
+        "    mat3 n;\n"
+        "    blendBones(r0, r1, r2, n);\n"
+        "    vec4 p = vec4(position, 1.0);\n"
+        "    position = vec3(dot(r0, p), dot(r1, p), dot(r2, p));\n"
+        "    normal = n * normal;\n"
+        "}\n"
+        "void skinPosition(inout vec3 position) {\n"
+        "    vec3 normal = vec3(0.0);\n"
+        "    skinVertex(position, normal);\n"
+        "}\n";
+}
+
+namespace {
+
+/**
+ * Compute the bone palettes of a set of meshes, one mesh per iteration
+ */
+class PaletteLoop : public ParallelLoop {
+public:
+    PaletteLoop(const std::vector<AnimatedMesh *> &meshes) : mMeshes(meshes) {}
+
+    void operator()(int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            mMeshes[i]->updateBonePalette();
+    }
+
+private:
+    const std::vector<AnimatedMesh *> &mMeshes;
+};
+
+}
+
+SkinningEngine::SkinningEngine(int grain) : mGrain(std::max(grain, 1))
+{
+}
+
+void SkinningEngine::skin(const std::vector<AnimatedMesh *> &meshes)
+{
+    PaletteLoop palettes(meshes);
+    parallelFor(0, meshes.size(), palettes, 1);
+
+    mChunks.clear();
+    for (unsigned int i = 0; i < meshes.size(); ++i) {
+        AnimatedMesh *mesh = meshes[i];
+        if (mesh->gpuSkinning()) {
+            // the vertices are skinned by the vertex shader, bound the pose by the bind box moved by each bone
+            BBox box;
+            for (unsigned int b = 0; b < mesh->mNumBones; ++b) {
+                const float *entry = &(mesh->mBonePalette[b * AnimatedMesh::BONE_PALETTE_FLOATS]);
+                glm::mat4x4 skinning(1.f);
+                for (int c = 0; c < 4; ++c)
+                    skinning[c] = glm::vec4(entry[3*c], entry[3*c + 1], entry[3*c + 2], c == 3 ? 1.f : 0.f);
+                box += mesh->mBindBbox.getTransformedBBox(skinning);
+            }
+            mesh->mBbox = box;
+            continue;
+        }
+        for (int begin = 0; begin < mesh->numVertices(); begin += mGrain) {
+            Chunk chunk;
+            chunk.mMesh = mesh;
+            chunk.mBegin = begin;
+            chunk.mEnd = std::min(begin + mGrain, mesh->numVertices());
+            mChunks.push_back(chunk);
+        }
+    }
+    mChunkBoxes.assign(mChunks.size(), BBox());
+
+    parallelFor(0, mChunks.size(), *this, 1);
+
+    // chunks of a mesh are consecutive
+    for (unsigned int c = 0; c < mChunks.size(); ) {
+        AnimatedMesh *mesh = mChunks[c].mMesh;
+        BBox box;
+        for (; c < mChunks.size() && mChunks[c].mMesh == mesh; ++c)
+            box += mChunkBoxes[c];
+        mesh->mBbox = box;
+    }
+}
+
+void SkinningEngine::operator()(int begin, int end)
+{
+    for (int c = begin; c < end; ++c)
+        mChunks[c].mMesh->skinVertices(mChunks[c].mBegin, mChunks[c].mEnd, mChunkBoxes[c]);
+}
+
+void SkinningEngine::upload(const std::vector<AnimatedMesh *> &meshes)
+{
+    for (unsigned int i = 0; i < meshes.size(); ++i) {
+        if (meshes[i]->gpuSkinning())
+            meshes[i]->uploadBonePalette();
+        else
+            meshes[i]->uploadSkinnedVertices();
+    }
+}
+
+} // namespace vortex
@@ -0,0 +1,76 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <vector>
+
+#include "animatedmesh.h"
+#include "parallel.h"
+
+namespace vortex {
+
+/**
+ * Skinning of a set of animated meshes.
+ * On the CPU, the vertices of all the meshes are split into chunks skinned in parallel, so that many small meshes
+ * use the worker threads as well as a single big one.
+ * Meshes skinned on the GPU only get their bone palette computed and uploaded.
+ */
+class SkinningEngine : private ParallelLoop {
+public:
+    /**
+     * @param grain Number of vertices skinned by a task.
+     */
+    SkinningEngine(int grain = 2048);
+
+    /**
+     * Skin the meshes into their skinned vertex buffers and update their bounding boxes. No OpenGL call is made.
+     */
+    void skin(const std::vector<AnimatedMesh *> &meshes);
+
+    /**
+     * Upload the skinned vertices of the meshes. Must be called from the OpenGL thread.
+     */
+    void upload(const std::vector<AnimatedMesh *> &meshes);
+
+    void update(const std::vector<AnimatedMesh *> &meshes) {
+        skin(meshes);
+        upload(meshes);
+    }
+
+    /**
+     * Shader configuration properties of the GPU skinned meshes.
+     * GPU_SKINNING_8 is set with GPU_SKINNING when the mesh stores 8 influences per vertex.
+     */
+    static const char *GPU_SKINNING_PROPERTY;
+    static const char *GPU_SKINNING_8_PROPERTY;
+
+    /**
+     * GLSL code of the GPU skinning, inserted in the vertex shaders configured with GPU_SKINNING.
+     * It declares the bone influence attributes, the uniBonePalette sampler and the functions
+     * void skinVertex(inout vec3 position, inout vec3 normal) and void skinPosition(inout vec3 position).
+     */
+    static const char *gpuShaderSource();
+
+private:
+    /** Skin the chunks [begin, end) */
+    void operator()(int begin, int end);
+
+    struct Chunk {
+        AnimatedMesh *mMesh;
+        int mBegin;
+        int mEnd;
+    };
+
+    int mGrain;
+    std::vector<Chunk> mChunks;
+    std::vector<BBox> mChunkBoxes;
+};
+
+} // namespace vortex
+
+#endif // SKINNING_H
@@ -5,15 +5,141 @@
  */
 
 #include "skybox.h"
+#include "parallel.h"
+#include "halffloat.h"
+#include "binarystream.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
 
 /// @todo remove QT dependencies here -> why ???
 #include <QGLWidget>
 #include <QFile>
 #include <QImage>
+#include <QDir>
 
 namespace vortex{
 
-SkyBox::SkyBox() : valid(false), mTex(NULL){
+namespace {
+
+/**
+ * Copy the faces of a vertical cross image to the cube map faces, one face row per iteration
+ */
+class CrossSlicer : public ParallelLoop {
+public:
+    CrossSlicer(const PfmReader::MappedImage &image, int width, int height, float **faces) :
+        mImage(image), mWidth(width), mHeight(height), mFaces(faces) {}
+
+    void operator()(int begin, int end) {
+        for (int row = begin; row < end; ++row) {
+            int imgIdx = row / mHeight;
+            int i = row % mHeight;
+            int xOffset = 0;
+            int yOffset = 0;
+            switch(imgIdx){
+            case 0 : xOffset = 2*mWidth; yOffset = 2*mHeight; break;
+            case 1 : xOffset = 0*mWidth; yOffset = 2*mHeight; break;
+            case 2 : xOffset = 1*mWidth; yOffset = 3*mHeight; break;
+            case 3 : xOffset = 1*mWidth; yOffset = 1*mHeight; break;
+            case 4 : xOffset = 1*mWidth; yOffset = 2*mHeight; break;
+            case 5 : xOffset = 1*mWidth; yOffset = 0*mHeight; break;
+            default: xOffset = 0; yOffset = 0; break;
+            }
+            if (imgIdx != 5)
+                // flipped vertically
+                mImage.rowToRGBA(xOffset, i+yOffset, mWidth, &(mFaces[imgIdx][4*(mHeight-1-i)*mWidth]));
+            else
+                // flipped horizontally
+                mImage.rowToRGBA(xOffset, i+yOffset, mWidth, &(mFaces[imgIdx][4*i*mWidth]), true);
+        }
+    }
+
+private:
+    const PfmReader::MappedImage &mImage;
+    int mWidth;
+    int mHeight;
+    float **mFaces;
+};
+
+const char SH_CACHE_MAGIC[4] = {'V', 'X', 'S', 'H'};
+// version 2 : rows hashed with hashBytes
+const unsigned int SH_CACHE_VERSION = 2;
+
+/**
+ * Hash of the face rows, one face row per iteration
+ */
+class FaceHasher : public ParallelLoop {
+public:
+    FaceHasher(float * const *faces, int width, int height, uint64_t *hashes) :
+        mFaces(faces), mWidth(width), mHeight(height), mHashes(hashes) {}
+
+    void operator()(int begin, int end) {
+        for (int row = begin; row < end; ++row) {
+            const float *pixels = &(mFaces[row / mHeight][4*(row % mHeight)*mWidth]);
+            mHashes[row] = hashBytes(reinterpret_cast<const char *>(pixels), 4*mWidth*sizeof(float));
+        }
+    }
+
+private:
+    float * const *mFaces;
+    int mWidth;
+    int mHeight;
+    uint64_t *mHashes;
+};
+
+/**
+ * Project the face rows on the spherical harmonics, one face row per iteration
+ */
+class SHProjection : public ParallelLoop {
+public:
+    SHProjection(const SkyBox *skyBox, float *rowCoeffs) : mSkyBox(skyBox), mRowCoeffs(rowCoeffs) {}
+
+    void operator()(int begin, int end) {
+        for (int row = begin; row < end; ++row)
+            mSkyBox->projectRow(row / mSkyBox->mHeight, row % mSkyBox->mHeight,
+                                reinterpret_cast<float (*)[3]>(mRowCoeffs + 27*row));
+    }
+
+private:
+    const SkyBox *mSkyBox;
+    float *mRowCoeffs;
+};
+
+/**
+ * Convert the RGBA float faces to a compact HDR layout, one face row per iteration.
+ * Half floats keep the RGBA layout, R11G11B10F texels are packed in one 32 bits word.
+ */
+class FaceEncoder : public ParallelLoop {
+public:
+    FaceEncoder(float * const *faces, int width, int height, GLenum format, void **encoded) :
+        mFaces(faces), mWidth(width), mHeight(height), mFormat(format), mEncoded(encoded) {}
+
+    void operator()(int begin, int end) {
+        for (int row = begin; row < end; ++row) {
+            int face = row / mHeight;
+            int offset = (row % mHeight) * mWidth;
+            const float *src = mFaces[face] + 4*offset;
+            if (mFormat == GL_R11F_G11F_B10F)
+                floatToR11G11B10F(src, 4, static_cast<uint32_t *>(mEncoded[face]) + offset, mWidth);
+            else
+                floatToHalf(src, static_cast<uint16_t *>(mEncoded[face]) + 4*offset, 4*mWidth);
+        }
+    }
+
+private:
+    float * const *mFaces;
+    int mWidth;
+    int mHeight;
+    GLenum mFormat;
+    void **mEncoded;
+};
+
+}
+
+SkyBox::SkyBox() : valid(false), mTex(NULL), mSolidAnglesWidth(0), mSolidAnglesHeight(0), mHdrFormat(GL_RGB16F){
+    for (int i = 0; i < 6; ++i)
+        mData[i] = NULL;
     Mesh::VertexData vertices[8];
     vertices[0].mVertex = glm::vec3(1.000000  ,-1.000000, -1.000000);
     vertices[1].mVertex = glm::vec3(1.000000  ,-1.000000, 1.000000 );
@@ -46,51 +172,81 @@ SkyBox::SkyBox() : valid(false), mTex(NULL){
 }
 
 SkyBox::~SkyBox(){
+    releaseData();
     delete mTex;
     delete mCube;
 }
 
-void SkyBox::setupTextures(std::string name, int type){
+void SkyBox::releaseData(){
+    for (int i = 0; i < 6; ++i) {
+        delete[] mData[i];
+        mData[i] = NULL;
+    }
+}
+
+void SkyBox::setHdrFormat(GLenum format){
+    if (format != GL_RGB16F && format != GL_R11F_G11F_B10F && format != GL_RGBA32F) {
+        std::cerr << "SkyBox::setHdrFormat : unsupported format " << format << ", using GL_RGB16F" << std::endl;
+        format = GL_RGB16F;
+    }
+    mHdrFormat = format;
+}
+
+void SkyBox::uploadFaces(){
+    if (mHdrFormat == GL_RGBA32F) {
+        mTex->cubeInitGL(GL_RGBA32F, mWidth, mHeight, GL_RGBA, GL_FLOAT, reinterpret_cast<void**>(mData));
+        return;
+    }
+
+    int texels = mWidth*mHeight;
+    bool packed = (mHdrFormat == GL_R11F_G11F_B10F);
+    void *encoded[6];
+    for (int i = 0; i < 6; ++i) {
+        if (packed)
+            encoded[i] = new uint32_t[texels];
+        else
+            encoded[i] = new uint16_t[4*texels];
+    }
+    FaceEncoder encoder(mData, mWidth, mHeight, mHdrFormat, encoded);
+    parallelFor(0, 6*mHeight, encoder, 16);
+
+    if (packed)
+        mTex->cubeInitGL(GL_R11F_G11F_B10F, mWidth, mHeight, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, encoded);
+    else
+        mTex->cubeInitGL(GL_RGB16F, mWidth, mHeight, GL_RGBA, GL_HALF_FLOAT, encoded);
+
+    for (int i = 0; i < 6; ++i) {
+        if (packed)
+            delete[] static_cast<uint32_t *>(encoded[i]);
+        else
+            delete[] static_cast<uint16_t *>(encoded[i]);
+    }
+
+    // an RGBA32F texel takes 16 bytes, RGB16F 6 bytes and R11G11B10F 4 bytes
+    long long texelBytes = packed ? 4 : 6;
+    Texture::addHdrMemorySaved(6LL*texels*(16 - texelBytes));
+}
 
+void SkyBox::setupTextures(std::string name, int type){
+    releaseData();
 
     int width;
     int height;
 
     if (type == 0) {
-        PfmReader::HDRIMAGE *img = PfmReader::open(name.c_str());
-        width = img->width/3;
-        height = img->height/4;
-        for(int imgIdx = 0; imgIdx <6; ++imgIdx){
-            mData[imgIdx]=new float[width*height*4];
-            int xOffset = 0;
-            int yOffset = 0;
-            switch(imgIdx){
-            case 0 : xOffset = 2*width; yOffset = 2*height; break;
-            case 1 : xOffset = 0*width; yOffset = 2*height; break;
-            case 2 : xOffset = 1*width; yOffset = 3*height; break;
-            case 3 : xOffset = 1*width; yOffset = 1*height; break;
-            case 4 : xOffset = 1*width; yOffset = 2*height; break;
-            case 5 : xOffset = 1*width; yOffset = 0*height; break;
-            default: xOffset = 0; yOffset = 0; break;
-            }
-            for(int i=0; i<height; ++i)
-                for(int j=0; j<width; ++j){
-                    if( (imgIdx != 5)){
-                        mData[imgIdx][4*((height-1-i)*width+j)+0] = img->pixels[(i+yOffset)*img->width+j+xOffset].r;
-                        mData[imgIdx][4*((height-1-i)*width+j)+1] = img->pixels[(i+yOffset)*img->width+j+xOffset].g;
-                        mData[imgIdx][4*((height-1-i)*width+j)+2] = img->pixels[(i+yOffset)*img->width+j+xOffset].b;
-                        mData[imgIdx][4*((height-1-i)*width+j)+3] = 1.f;
-                    }
-                    if( imgIdx ==5 ){
-                        mData[imgIdx][4*(i*width+width-1-j)+0] = img->pixels[(i+yOffset)*img->width+j+xOffset].r;
-                        mData[imgIdx][4*(i*width+width-1-j)+1] = img->pixels[(i+yOffset)*img->width+j+xOffset].g;
-                        mData[imgIdx][4*(i*width+width-1-j)+2] = img->pixels[(i+yOffset)*img->width+j+xOffset].b;
-                        mData[imgIdx][4*(i*width+width-1-j)+3] = 1.f;
-                    }
-                }
+        PfmReader::MappedImage img;
+        if (!img.open(name)) {
+            std::cerr << "Image " << name << " not loaded" << std::endl;
+            return;
         }
-        delete [] img->pixels;
-        delete img;
+        width = img.width()/3;
+        height = img.height()/4;
+        for(int imgIdx = 0; imgIdx <6; ++imgIdx)
+            mData[imgIdx]=new float[width*height*4];
+
+        // the faces rows are converted in place from the mapped cross
+        CrossSlicer slicer(img, width, height, mData);
+        parallelFor(0, 6*height, slicer, 16);
     } else {
         const float lightFactor = 3.f;
 
@@ -157,11 +313,13 @@ void SkyBox::setupTextures(std::string name, int type){
     mWidth = width;
     mHeight = height;
 
-    mTex->cubeInitGL(GL_RGBA32F, mWidth, mHeight, GL_RGBA, GL_FLOAT, reinterpret_cast<void**>(mData));
-    mTex->useMipMap(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-
+    // the projection reads the float faces, they are released once uploaded
     computeSHMatrices();
 
+    uploadFaces();
+    mTex->useMipMap(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+    releaseData();
+
     valid=true;
 }
 
@@ -208,6 +366,10 @@ void SkyBox::tomatrix(void) {
 
 
 void SkyBox::updateCoeffs(float *hdr, float x, float y, float z, float domega) {
+    accumulateCoeffs(coeffs, hdr, x, y, z, domega);
+}
+
+void SkyBox::accumulateCoeffs(float coeffs[9][3], const float *hdr, float x, float y, float z, float domega) {
 
     /******************************************************************
    Update the coefficients (i.e. compute the next term in the
@@ -291,93 +453,143 @@ float *SkyBox::getPixel(float x, float y, float z){
     int is = (int)(s * mWidth);
     int it = (int)(t * mHeight);
 
+    if (!mData[axis])
+        return NULL;
     return &(mData[axis][4*((mHeight-1-is)*mWidth+it)]);
 }
 
-// http://graphics.stanford.edu/papers/envmap/prefilter.c
-void SkyBox::computeSHMatrices(){
-    float theta;
-    float phi;
-    float x,y,z;
-    for (int i=0; i<9;i++)
-        for (int j=0;j<3; j++)
-            coeffs[i][j]=0.f;
-
-
-#if 1
-    const float dtheta = 0.005;
-    const float dphi = 0.005;
+/**
+ * Direction of the center of a texel, inverse of getPixel
+ */
+glm::vec3 SkyBox::texelDirection(int face, int row, int column) const {
+    float sc = 2.f*(mHeight-1-row + 0.5f)/mWidth - 1.f;
+    float tc = 2.f*(column + 0.5f)/mHeight - 1.f;
+    glm::vec3 direction;
+    switch (face) {
+    case 0 : direction = glm::vec3(-1.f, sc, -tc); break;
+    case 1 : direction = glm::vec3( 1.f, sc,  tc); break;
+    case 2 : direction = glm::vec3(-tc,  1.f, -sc); break;
+    case 3 : direction = glm::vec3(-tc, -1.f,  sc); break;
+    case 4 : direction = glm::vec3(-tc, sc,  1.f); break;
+    default : direction = glm::vec3( tc, sc, -1.f); break;
+    }
+    return glm::normalize(direction);
+}
 
-    for (theta=0.f; theta<M_PI; theta+=dtheta)
-        for (phi=0.f; phi<2.f*M_PI; phi+=dphi) {
-            x = sin(theta)*cos(phi) ;
-            y = sin(theta)*sin(phi) ;
-            z = cos(theta) ;
-            float *thePixel = getPixel(x,y,z);
-            updateCoeffs(thePixel, x, y, z, sin(theta)*dtheta*dphi);
+static float areaElement(float x, float y) {
+    return atan2(x*y, sqrt(x*x + y*y + 1.f));
+}
 
+void SkyBox::updateSolidAngles() {
+    if (mSolidAnglesWidth == mWidth && mSolidAnglesHeight == mHeight)
+        return;
+    // solid angle of a texel of a face spanning [-1, 1]^2, the same for all the faces
+    mSolidAngles.resize(mWidth*mHeight);
+    for (int row = 0; row < mHeight; ++row) {
+        float y0 = 2.f*row/mHeight - 1.f;
+        float y1 = 2.f*(row+1)/mHeight - 1.f;
+        for (int column = 0; column < mWidth; ++column) {
+            float x0 = 2.f*column/mWidth - 1.f;
+            float x1 = 2.f*(column+1)/mWidth - 1.f;
+            mSolidAngles[row*mWidth + column] = areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
         }
-#else
-
-
-
-    int testwidth = 1024;
-
-    unsigned char *sphereimage;
-    sphereimage = new unsigned char[3*testwidth*testwidth];
-
-
-    for (int i = 0 ; i < testwidth ; i++)
-        for (int j = 0 ; j < testwidth ; j++) {
-
-            /* We now find the cartesian components for the point (i,j) */
-            float u,v,r;
+    }
+    mSolidAnglesWidth = mWidth;
+    mSolidAnglesHeight = mHeight;
+}
 
-            v = (testwidth/2.0 - j)/(testwidth/2.0);  /* v ranges from -1 to 1 */
-            u = (testwidth/2.0 - i)/(testwidth/2.0);    /* u ranges from -1 to 1 */
-            r = sqrt(u*u+v*v) ;               /* The "radius" */
-            if (r > 1.0f) {
-                sphereimage[3*(j*testwidth+i) + 0] = 0;
-                sphereimage[3*(j*testwidth+i) + 1] = 0;
-                sphereimage[3*(j*testwidth+i) + 2] = 0;
-                continue ;           /* Consider only circle with r<1 */
-            }
+void SkyBox::projectRow(int face, int row, float rowCoeffs[9][3]) const {
+    for (int column = 0; column < mWidth; ++column) {
+        glm::vec3 d = texelDirection(face, row, column);
+        accumulateCoeffs(rowCoeffs, &(mData[face][4*(row*mWidth + column)]), d.x, d.y, d.z,
+                         mSolidAngles[row*mWidth + column]);
+    }
+}
 
-            theta = M_PI*r ;                    /* theta parameter of (i,j) */
-            phi = atan2(v,u) ;                /* phi parameter */
+/**
+ * Content hash of the faces, rows are hashed in parallel then combined in order
+ */
+uint64_t SkyBox::hashFaces() const {
+    std::vector<uint64_t> rowHashes(6*mHeight);
+    FaceHasher hasher(mData, mWidth, mHeight, &(rowHashes[0]));
+    parallelFor(0, 6*mHeight, hasher, 64);
+    int size[2] = { mWidth, mHeight };
+    uint64_t hash = hashBytes(reinterpret_cast<const char *>(size), sizeof(size));
+    return hashBytes(reinterpret_cast<const char *>(&(rowHashes[0])), rowHashes.size()*sizeof(uint64_t), hash);
+}
 
-            x = sin(theta)*cos(phi) ;         /* Cartesian components */
-            y = sin(theta)*sin(phi) ;
-            z = cos(theta) ;
+std::string SkyBox::shCacheFileName(uint64_t hash) {
+    char name[64];
+    sprintf(name, "/vortex_sh_%016llx.bin", (unsigned long long) hash);
+    return QDir::tempPath().toStdString() + name;
+}
 
-            //float *thePixel = getPixel(data, width, height, x,y,z);
-            float *thePixel = getPixel(x,y,z);
-            updateCoeffs(thePixel, x, y, z, (2.f*M_PI/testwidth)*(2.f*M_PI/testwidth)*sinc(theta));
+bool SkyBox::loadSHCache(uint64_t hash) {
+    std::ifstream file(shCacheFileName(hash).c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+    char magic[4];
+    unsigned int version = 0;
+    uint64_t fileHash = 0;
+    float data[27 + 3*16];
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&fileHash), sizeof(fileHash));
+    file.read(reinterpret_cast<char *>(data), sizeof(data));
+    if (!file || memcmp(magic, SH_CACHE_MAGIC, 4) || version != SH_CACHE_VERSION || fileHash != hash)
+        return false;
+    memcpy(coeffs, data, 27*sizeof(float));
+    for (int m = 0; m < 3; ++m)
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                mShMatrices[m][c][r] = data[27 + 16*m + 4*c + r];
+    return true;
+}
 
+void SkyBox::saveSHCache(uint64_t hash) const {
+    float data[27 + 3*16];
+    memcpy(data, coeffs, 27*sizeof(float));
+    for (int m = 0; m < 3; ++m)
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                data[27 + 16*m + 4*c + r] = mShMatrices[m][c][r];
+    std::ofstream file(shCacheFileName(hash).c_str(), std::ios::out | std::ios::binary);
+    file.write(SH_CACHE_MAGIC, 4);
+    file.write(reinterpret_cast<const char *>(&SH_CACHE_VERSION), sizeof(SH_CACHE_VERSION));
+    file.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    file.write(reinterpret_cast<const char *>(data), sizeof(data));
+    if (!file)
+        std::cerr << "Could not write the irradiance cache " << shCacheFileName(hash) << std::endl;
+}
 
-            glm::vec3 color;
-            color[0] = thePixel[0];
-            color[1] = thePixel[1];
-            color[2] = thePixel[2];
-            color = glm::clamp(color, glm::vec3(0.f), glm::vec3(1.f));
-            sphereimage[3*(j*testwidth+i) + 0] = static_cast<unsigned char>(color[0]*255);
-            sphereimage[3*(j*testwidth+i) + 1] = static_cast<unsigned char>(color[1]*255);
-            sphereimage[3*(j*testwidth+i) + 2] = static_cast<unsigned char>(color[2]*255);
+// http://graphics.stanford.edu/papers/envmap/prefilter.c
+void SkyBox::computeSHMatrices(){
+    uint64_t hash = hashFaces();
+    if (loadSHCache(hash))
+        return;
 
+    updateSolidAngles();
 
-        }
+    // each row of each face is projected on its own, partial sums are added in a fixed order
+    std::vector<float> rowCoeffs(6*mHeight*27, 0.f);
+    SHProjection projection(this, &(rowCoeffs[0]));
+    parallelFor(0, 6*mHeight, projection, 8);
 
-    QImage theInputImage( sphereimage, testwidth, testwidth, testwidth*3, QImage::Format_RGB888 );
-    if (theInputImage.save("sphericalImage.png","PNG"))
-        std::cerr << "Saved to sphericalImage.png "<< std::endl;
-    else
-        std::cerr << "Not Saved" << std::endl;
-    delete [] sphereimage;
+    for (int i=0; i<9;i++)
+        for (int j=0;j<3; j++)
+            coeffs[i][j]=0.f;
+    for (int row = 0; row < 6*mHeight; ++row)
+        for (int i=0; i<9;i++)
+            for (int j=0;j<3; j++)
+                coeffs[i][j] += rowCoeffs[27*row + 3*i + j];
 
-#endif
     tomatrix();
+    saveSHCache(hash);
 
 #if 0
+    float theta;
+    float phi;
+    float x,y,z;
     int ambientWidth = 1024;
     unsigned char *ambientImage;
     ambientImage = new unsigned char[3*ambientWidth*ambientWidth];
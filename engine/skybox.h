@@ -7,6 +7,8 @@
 #ifndef __SKYBOX_H__
 #define __SKYBOX_H__
 #include <string>
+#include <vector>
+#include <stdint.h>
 
 /// @todo remove QT dependencies here
 #include <QImage>
@@ -28,6 +30,13 @@ public:
 
     void draw();
 
+    /**
+     * Set the internal format of the cube map : GL_RGB16F (default), GL_R11F_G11F_B10F or GL_RGBA32F.
+     * Used by the next setupTextures.
+     */
+    void setHdrFormat(GLenum format);
+    GLenum hdrFormat() const { return mHdrFormat; }
+
     bool valid;
 
     Texture *mTex;
@@ -42,10 +51,43 @@ public:
 
     void updateCoeffs(float *hdr, float x, float y, float z, float domega);
 
+    /**
+     * @return The RGBA float texel in direction (x, y, z), NULL once the faces are uploaded and released
+     */
     float *getPixel(float x, float y, float z);
 
+    static void accumulateCoeffs(float coeffs[9][3], const float *hdr, float x, float y, float z, float domega);
+
+    /**
+     * Project the environment on the spherical harmonics, the faces rows are projected in parallel.
+     * The result is cached on disk, keyed by a hash of the faces content.
+     */
     // http://graphics.stanford.edu/papers/envmap/prefilter.c
     void computeSHMatrices();
+
+    /**
+     * Add the projection of a face row to rowCoeffs, the solid angles must be up to date.
+     */
+    void projectRow(int face, int row, float rowCoeffs[9][3]) const;
+
+private:
+    void uploadFaces();
+    void releaseData();
+
+    glm::vec3 texelDirection(int face, int row, int column) const;
+    void updateSolidAngles();
+
+    uint64_t hashFaces() const;
+    static std::string shCacheFileName(uint64_t hash);
+    bool loadSHCache(uint64_t hash);
+    void saveSHCache(uint64_t hash) const;
+
+    // Solid angle of the texels of a face, for the resolution mSolidAnglesWidth x mSolidAnglesHeight
+    std::vector<float> mSolidAngles;
+    int mSolidAnglesWidth;
+    int mSolidAnglesHeight;
+
+    GLenum mHdrFormat;
 };
 
 }
@@ -0,0 +1,219 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "taskscheduler.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+/// @todo remove QT dependencies here
+#include <QThread>
+
+namespace vortex {
+
+class TaskScheduler::Worker : public QThread {
+public:
+    Worker(TaskScheduler *scheduler, int thread) : mScheduler(scheduler), mThread(thread) {}
+
+    void run() {
+        mScheduler->mThreadIndex.setLocalData(mThread);
+        mScheduler->workerLoop(mThread);
+    }
+
+private:
+    TaskScheduler *mScheduler;
+    int mThread;
+};
+
+/*
+ * -------------------------------------------------------------------------------
+ */
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::run(Task *task)
+{
+    task->mGroup = this;
+    mPending.ref();
+    TaskScheduler::instance().push(task);
+}
+
+void TaskGroup::wait()
+{
+    TaskScheduler &scheduler = TaskScheduler::instance();
+    int thread = scheduler.threadIndex();
+    // help before sleeping : the tasks of the group may be queued in the deque of this thread
+    while (mPending.load() > 0) {
+        if (scheduler.runOne(thread))
+            continue;
+        // the remaining tasks run on the workers
+        QMutexLocker lock(&mMutex);
+        if (mPending.load() > 0)
+            mFinished.wait(&mMutex);
+    }
+    // the thread finishing the last task may still hold the mutex : the group must outlive it
+    QMutexLocker lock(&mMutex);
+}
+
+/*
+ * -------------------------------------------------------------------------------
+ */
+TaskScheduler &TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler() : mQueued(0), mQuit(false), mTracer(NULL), mRun(0), mStolen(0)
+{
+    int numThreads = QThread::idealThreadCount();
+    const char *variable = getenv("VORTEX_NUM_THREADS");
+    if (variable && atoi(variable) > 0)
+        numThreads = atoi(variable);
+    start(numThreads);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    stop();
+}
+
+void TaskScheduler::setNumThreads(int numThreads)
+{
+    stop();
+    start(numThreads);
+}
+
+void TaskScheduler::start(int numThreads)
+{
+    numThreads = std::max(numThreads, 1);
+    mQuit = false;
+    for (int i = 0; i < numThreads; ++i)
+        mQueues.push_back(new Queue);
+    for (int i = 1; i < numThreads; ++i) {
+        mWorkers.push_back(new Worker(this, i));
+        mWorkers.back()->start();
+    }
+}
+
+void TaskScheduler::stop()
+{
+    {
+        QMutexLocker lock(&mSleepMutex);
+        mQuit = true;
+        mWakeUp.wakeAll();
+    }
+    for (unsigned int i = 0; i < mWorkers.size(); ++i) {
+        mWorkers[i]->wait();
+        delete mWorkers[i];
+    }
+    mWorkers.clear();
+    for (unsigned int i = 0; i < mQueues.size(); ++i)
+        delete mQueues[i];
+    mQueues.clear();
+}
+
+int TaskScheduler::threadIndex()
+{
+    return mThreadIndex.hasLocalData() ? mThreadIndex.localData() : 0;
+}
+
+void TaskScheduler::push(Task *task)
+{
+    Queue *queue = mQueues[threadIndex()];
+    {
+        QMutexLocker lock(&queue->mMutex);
+        queue->mTasks.push_back(task);
+    }
+    mQueued.ref();
+    // counted before the wake up : a worker going to sleep sees the task
+    QMutexLocker lock(&mSleepMutex);
+    mWakeUp.wakeOne();
+}
+
+Task *TaskScheduler::take(int thread)
+{
+    Task *task = NULL;
+    {
+        Queue *queue = mQueues[thread];
+        QMutexLocker lock(&queue->mMutex);
+        if (!queue->mTasks.empty()) {
+            task = queue->mTasks.back();
+            queue->mTasks.pop_back();
+        }
+    }
+    int numQueues = mQueues.size();
+    for (int i = 1; !task && i < numQueues; ++i) {
+        Queue *victim = mQueues[(thread + i) % numQueues];
+        QMutexLocker lock(&victim->mMutex);
+        if (!victim->mTasks.empty()) {
+            task = victim->mTasks.front();
+            victim->mTasks.pop_front();
+            mStolen.ref();
+        }
+    }
+    if (task)
+        mQueued.deref();
+    return task;
+}
+
+void TaskScheduler::execute(Task *task, int thread)
+{
+    TaskGroup *group = task->mGroup;
+    if (mTracer)
+        mTracer->taskStarted(task, thread);
+    task->run();
+    if (mTracer)
+        mTracer->taskFinished(task, thread);
+    delete task;
+    mRun.ref();
+    QMutexLocker lock(&group->mMutex);
+    if (!group->mPending.deref())
+        group->mFinished.wakeAll();
+}
+
+bool TaskScheduler::runOne(int thread)
+{
+    if (mQueued.load() <= 0)
+        return false;
+    Task *task = take(thread);
+    if (!task)
+        return false;
+    execute(task, thread);
+    return true;
+}
+
+void TaskScheduler::workerLoop(int thread)
+{
+    for (;;) {
+        if (runOne(thread))
+            continue;
+        QMutexLocker lock(&mSleepMutex);
+        if (mQuit)
+            return;
+        if (mQueued.load() <= 0)
+            mWakeUp.wait(&mSleepMutex);
+    }
+}
+
+TaskScheduler::Statistics TaskScheduler::statistics() const
+{
+    Statistics stats;
+    stats.mThreads = mQueues.size();
+    stats.mRun = mRun.load();
+    stats.mStolen = mStolen.load();
+    return stats;
+}
+
+std::ostream & operator << (std::ostream &out, const TaskScheduler::Statistics &stats)
+{
+    out << "Tasks : " << stats.mRun << " run, " << stats.mStolen << " stolen, on " << stats.mThreads << " threads" << std::endl;
+    return out;
+}
+
+} // namespace vortex
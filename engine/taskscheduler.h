@@ -0,0 +1,177 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <ostream>
+
+/// @todo remove QT dependencies here
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadStorage>
+
+namespace vortex {
+
+class TaskGroup;
+
+/**
+ * Unit of work of the TaskScheduler : implement run().
+ */
+class Task {
+public:
+    Task() : mGroup(NULL) {}
+    virtual ~Task() {}
+
+    virtual void run() = 0;
+
+    /** Name of the task given to the TaskTracer */
+    virtual const char *name() const {
+        return "task";
+    }
+
+private:
+    TaskGroup *mGroup;
+    friend class TaskGroup;
+    friend class TaskScheduler;
+};
+
+/**
+ * Hooks called around each task by the thread running it, to profile the parallel parts.
+ * They are called concurrently from all the threads.
+ */
+class TaskTracer {
+public:
+    virtual ~TaskTracer() {}
+    virtual void taskStarted(const Task *task, int thread) = 0;
+    virtual void taskFinished(const Task *task, int thread) = 0;
+};
+
+/**
+ * Tasks waited together. Tasks may add tasks to their own group.
+ */
+class TaskGroup {
+public:
+    TaskGroup() : mPending(0) {}
+
+    /** Wait for the tasks not finished */
+    ~TaskGroup();
+
+    /**
+     * Queue a task on the TaskScheduler.
+     * @param task The task, deleted once run.
+     */
+    void run(Task *task);
+
+    /**
+     * Return once all the tasks of the group are run. The calling thread runs queued tasks meanwhile,
+     * and sleeps once none is left until the last task of the group finishes.
+     */
+    void wait();
+
+private:
+    QAtomicInt mPending;
+    // the last task of the group wakes up the waiting thread
+    QMutex mMutex;
+    QWaitCondition mFinished;
+    friend class TaskScheduler;
+};
+
+/**
+ * Fixed pool of worker threads with one task deque per thread.
+ * A thread pushes and pops its own tasks at the back of its deque, so that it works on the most recent, smallest tasks,
+ * and steals at the front of the other deques when its own is empty, taking the oldest, largest tasks.
+ * Threads outside the pool share the deque 0, they run tasks only while waiting for a TaskGroup.
+ */
+class TaskScheduler {
+public:
+    /**
+     * Counters since the start of the pool
+     */
+    struct Statistics {
+        int mThreads;
+        int mRun;
+        int mStolen;
+        Statistics() : mThreads(0), mRun(0), mStolen(0) {}
+    };
+
+    /**
+     * The scheduler of the engine, started on first use with numThreads threads : the value of the environment
+     * variable VORTEX_NUM_THREADS if set, the number of cores otherwise.
+     */
+    static TaskScheduler &instance();
+
+    /**
+     * Restart the pool with numThreads threads, the calling thread included. No task may be queued.
+     */
+    void setNumThreads(int numThreads);
+
+    /** @return The number of threads running tasks, the calling thread included */
+    int numThreads() const {
+        return mQueues.size();
+    }
+
+    /** Set the hooks called around each task, NULL to remove them. No task may be queued. */
+    void setTracer(TaskTracer *tracer) {
+        mTracer = tracer;
+    }
+
+    /** @return The index of the calling thread : 0 outside the pool, from 1 to numThreads()-1 for the workers */
+    int threadIndex();
+
+    Statistics statistics() const;
+
+private:
+    class Worker;
+    struct Queue {
+        QMutex mMutex;
+        std::deque<Task *> mTasks;
+    };
+
+    TaskScheduler();
+    ~TaskScheduler();
+
+    void start(int numThreads);
+    void stop();
+
+    /** Queue a task in the deque of the calling thread */
+    void push(Task *task);
+
+    /** Pop a task of the deque of thread, or steal one, NULL if all the deques are empty */
+    Task *take(int thread);
+
+    void execute(Task *task, int thread);
+
+    /** Run a queued task, false if there is none */
+    bool runOne(int thread);
+
+    void workerLoop(int thread);
+
+    std::vector<Queue *> mQueues;
+    std::vector<Worker *> mWorkers;
+    QThreadStorage<int> mThreadIndex;
+
+    // sleeping workers wait for queued tasks
+    QMutex mSleepMutex;
+    QWaitCondition mWakeUp;
+    QAtomicInt mQueued;
+    bool mQuit;
+
+    TaskTracer *mTracer;
+    QAtomicInt mRun;
+    QAtomicInt mStolen;
+
+    friend class TaskGroup;
+};
+
+std::ostream & operator << (std::ostream &out, const TaskScheduler::Statistics &stats);
+
+} // namespace vortex
+
+#endif // TASKSCHEDULER_H
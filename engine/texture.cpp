@@ -10,23 +10,34 @@
 #include <iostream>
 
 namespace vortex {
+
+long long Texture::sHdrMemorySaved = 0;
+
 Texture::Texture(std::string name, GLenum target, TexType type, GLuint zOffset)
-: mName(name), mPixels(NULL), mTexId(0), mZOffset(zOffset), mTarget(target), mType(type) {
+: mName(name), mPixels(NULL), mTexId(0), mBufferId(0), mBufferSize(0), mZOffset(zOffset), mTarget(target), mType(type),
+  mPlaceholder(NULL) {
 }
 
 Texture *Texture::loadFromImage(std::string fileName)
+{
+        Texture * theTexture = new Texture(fileName, GL_TEXTURE_2D);
+        theTexture->initFromImage(decodeImage(fileName));
+        return theTexture;
+}
+
+QImage Texture::decodeImage(const std::string &fileName)
 {
         QImage img;
-        QImage glImg;
         if(!img.load(fileName.c_str())){
             std::cerr << "texture not found (Texture::loadFromImage) " << fileName << std::endl;
             img = QImage(2,2,QImage::Format_RGB32);
             img.fill(QColor().green());
         }
+        return QGLWidget::convertToGLFormat(img);
+}
 
-        glImg = QGLWidget::convertToGLFormat(img);
-        Texture * theTexture = new Texture(fileName, GL_TEXTURE_2D);
-
+void Texture::initFromImage(const QImage &glImg)
+{
         int bpp = GL_RGB;
         GLenum format = GL_RGB;
         if(glImg.hasAlphaChannel()){
@@ -34,10 +45,8 @@ Texture *Texture::loadFromImage(std::string fileName)
             format = GL_RGBA;
         }
 
-        theTexture->initGL(bpp, glImg.width(), glImg.height(), format, GL_UNSIGNED_BYTE, glImg.bits());
-        theTexture->useMipMap(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-
-        return theTexture;
+        initGL(bpp, glImg.width(), glImg.height(), format, GL_UNSIGNED_BYTE, const_cast<uchar *>(glImg.bits()));
+        useMipMap(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
 }
 
 int clamp(float i){
@@ -99,12 +108,12 @@ void Texture::cubeInitGL(int bytesperpixel, int width, int height, int format, i
 {
     glAssert(glGenTextures(1, &mTexId));
     glAssert(glBindTexture(mTarget, mTexId));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[0]));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[1]));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[2]));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[3]));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[4]));
-    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, bytesperpixel, width, height, 0, format, GL_FLOAT, data[5]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, bytesperpixel, width, height, 0, format, type, data[0]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, bytesperpixel, width, height, 0, format, type, data[1]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, bytesperpixel, width, height, 0, format, type, data[2]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, bytesperpixel, width, height, 0, format, type, data[3]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, bytesperpixel, width, height, 0, format, type, data[4]));
+    glAssert(glTexImage2D( GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, bytesperpixel, width, height, 0, format, type, data[5]));
     /*
     glAssert(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     glAssert(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
@@ -131,6 +140,31 @@ void Texture::volumeInitGL(int bytesperpixel, int width, int height, int depth,
     glAssert(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
 }
 
+void Texture::bufferInitGL(int internalFormat, int size, void *data)
+{
+    glAssert(glGenBuffers(1, &mBufferId));
+    glAssert(glBindBuffer(GL_TEXTURE_BUFFER, mBufferId));
+    glAssert(glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW));
+    glAssert(glGenTextures(1, &mTexId));
+    glAssert(glBindTexture(GL_TEXTURE_BUFFER, mTexId));
+    glAssert(glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, mBufferId));
+    glAssert(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+    mBufferSize = size;
+}
+
+void Texture::bufferUpdateGL(int size, void *data)
+{
+    glAssert(glBindBuffer(GL_TEXTURE_BUFFER, mBufferId));
+    if (size > mBufferSize) {
+        // the texture keeps referencing the buffer object, only its storage changes
+        glAssert(glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW));
+        mBufferSize = size;
+    } else {
+        glAssert(glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data));
+    }
+    glAssert(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
 void Texture::useMipMap(GLenum minFliter, GLenum magFilter)
 {
     glAssert(glBindTexture(mTarget, mTexId));
@@ -162,6 +196,10 @@ void Texture::setClamp(GLenum warpS, GLenum warpT, GLenum warpR) {
 
 void Texture::bind(int unit)
 {
+    if (mTexId == 0 && mPlaceholder) {
+        mPlaceholder->bind(unit);
+        return;
+    }
     GLenum texUnit = GL_TEXTURE0+unit;
     glAssert(glActiveTexture(texUnit));
     glAssert(glBindTexture(mTarget, mTexId));
@@ -170,9 +208,17 @@ void Texture::bind(int unit)
 void Texture::deleteGL()
 {
    glAssert( glDeleteTextures(1, &mTexId));
+   if (mBufferId != 0) {
+       glAssert( glDeleteBuffers(1, &mBufferId));
+       mBufferId = 0;
+       mBufferSize = 0;
+   }
 }
 
 glm::vec4 Texture::getTexel(float u, float v){
+    if (!mPixels)
+        // not loaded yet
+        return glm::vec4(1.f);
 
     float scaledU = fmodf(u * mWidth, mWidth);
     float scaledV = fmodf(v * mHeight, mHeight);
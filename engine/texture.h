@@ -10,6 +10,7 @@
 
 #include "opengl.h"
 
+class QImage;
 
 namespace vortex {
 
@@ -42,6 +43,24 @@ public:
     Texture(std::string name, GLenum target, TexType type = TEX_2D, GLuint zOffset = 0); // default = 2D as it is the most commonly used
 
     static Texture *loadFromImage(std::string fileName);
+
+    /**
+     * Decode an image file and convert it to the OpenGL layout. No OpenGL call is made, may be called from any thread.
+     * A missing file gives a small green image.
+     */
+    static QImage decodeImage(const std::string &fileName);
+
+    /**
+     * Create the OpenGL Texture, with mipmaps, from an image returned by decodeImage.
+     */
+    void initFromImage(const QImage &glImage);
+
+    /**
+     * Set the Texture bound instead of this one until it is initialized.
+     */
+    void setPlaceholder(Texture *placeholder) {
+        mPlaceholder = placeholder;
+    }
     void saveToImage(std::string fileName);
     /**
      * Texture OpenGL creation : the parameters accepted values are the same as for "glTexImage*".
@@ -57,6 +76,23 @@ public:
     void cubeInitGL(int bytesperpixel, int width, int height, int format, int type, void** data); // for cube texture
     void volumeInitGL(int bytesperpixel, int width, int height, int depth, int format, int type, void * data);
 
+    /**
+     * Buffer Texture OpenGL creation (target GL_TEXTURE_BUFFER) : the texels are stored in a buffer object.
+     *
+     * @param internalFormat Sized internal format of the texels (GL_RGBA32F, GL_R32I ...).
+     * @param size Size, in bytes, of the data.
+     * @param data Specify the memory location to which the Texture have to take its texel data.
+     */
+    void bufferInitGL(int internalFormat, int size, void *data);
+
+    /**
+     * Replace the content of a Buffer Texture, reallocating the storage if it is too small.
+     *
+     * @param size Size, in bytes, of the data.
+     * @param data Specify the memory location to which the Texture have to take its texel data.
+     */
+    void bufferUpdateGL(int size, void *data);
+
     /**
      * Activate MipMap use for the Texture.
      *
@@ -119,6 +155,20 @@ public:
 
     glm::vec4 getTexel(float u, float v);
 
+    /**
+     * Account for the video memory saved by an HDR texture stored in a compact format instead of GL_RGBA32F.
+     */
+    static void addHdrMemorySaved(long long bytes) {
+        sHdrMemorySaved += bytes;
+    }
+
+    /**
+     * @return The video memory, in bytes, saved by the compact HDR textures created so far
+     */
+    static long long hdrMemorySaved() {
+        return sHdrMemorySaved;
+    }
+
     int width() const {return mWidth;}
     int height() const {return mHeight;}
 protected:
@@ -130,9 +180,14 @@ protected:
     int mHeight;
 
     GLuint mTexId;
+    GLuint mBufferId;
+    int mBufferSize;
     GLuint mZOffset;
     GLenum mTarget;
     TexType mType;
+    Texture *mPlaceholder;
+
+    static long long sHdrMemorySaved;
 
 
 };
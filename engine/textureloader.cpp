@@ -0,0 +1,149 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "textureloader.h"
+
+#include <algorithm>
+
+/// @todo remove QT dependencies here
+#include <QRunnable>
+#include <QThread>
+
+namespace vortex {
+
+namespace {
+
+/**
+ * Decode an image file and convert it to the OpenGL layout
+ */
+class DecodeTask : public QRunnable {
+public:
+    DecodeTask(TextureLoader *loader, Texture *texture, const std::string &fileName) :
+        mLoader(loader), mTexture(texture), mFileName(fileName) {}
+
+    void run() {
+        Timer decodeTimer;
+        decodeTimer.start();
+        QImage image = Texture::decodeImage(mFileName);
+        decodeTimer.stop();
+        mLoader->decoded(mTexture, image, decodeTimer.value());
+    }
+
+private:
+    TextureLoader *mLoader;
+    Texture *mTexture;
+    std::string mFileName;
+};
+
+}
+
+TextureLoader::TextureLoader() : mDecoding(0), mDecodeTime(0.)
+{
+    // keep a thread for the OpenGL thread and the parallel loops
+    mPool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+TextureLoader::~TextureLoader()
+{
+    mPool.clear();
+    mPool.waitForDone();
+}
+
+void TextureLoader::load(Texture *texture, const std::string &fileName)
+{
+    if (mStatistics.mRequested == mStatistics.mUploaded) {
+        mLoadTimer.reset();
+        mLoadTimer.start();
+    }
+    ++mStatistics.mRequested;
+    {
+        QMutexLocker lock(&mMutex);
+        ++mDecoding;
+    }
+    mPool.start(new DecodeTask(this, texture, fileName));
+}
+
+void TextureLoader::decoded(Texture *texture, const QImage &image, double decodeTime)
+{
+    DecodedImage decoded;
+    decoded.mTexture = texture;
+    decoded.mImage = image;
+    QMutexLocker lock(&mMutex);
+    mDecoded.push_back(decoded);
+    mDecodeTime += decodeTime;
+    --mDecoding;
+    mDecodedCondition.wakeAll();
+}
+
+void TextureLoader::uploadImage(const DecodedImage &decoded)
+{
+    Timer uploadTimer;
+    uploadTimer.start();
+    decoded.mTexture->initFromImage(decoded.mImage);
+    uploadTimer.stop();
+    mStatistics.mUploadTime += uploadTimer.value();
+    mStatistics.mUploadedBytes += decoded.mImage.byteCount();
+    if (++mStatistics.mUploaded == mStatistics.mRequested) {
+        mLoadTimer.stop();
+        mStatistics.mLoadTime = mLoadTimer.value();
+    }
+}
+
+bool TextureLoader::upload(int byteBudget)
+{
+    int uploadedBytes = 0;
+    bool uploaded = false;
+    while (uploadedBytes < byteBudget) {
+        DecodedImage decoded;
+        {
+            QMutexLocker lock(&mMutex);
+            mStatistics.mDecodeTime = mDecodeTime;
+            if (mDecoded.empty())
+                break;
+            decoded = mDecoded.front();
+            mDecoded.pop_front();
+        }
+        uploadImage(decoded);
+        uploadedBytes += decoded.mImage.byteCount();
+        uploaded = true;
+    }
+    return uploaded;
+}
+
+void TextureLoader::finish()
+{
+    for (;;) {
+        DecodedImage decoded;
+        {
+            QMutexLocker lock(&mMutex);
+            while (mDecoded.empty() && mDecoding > 0)
+                mDecodedCondition.wait(&mMutex);
+            mStatistics.mDecodeTime = mDecodeTime;
+            if (mDecoded.empty())
+                return;
+            decoded = mDecoded.front();
+            mDecoded.pop_front();
+        }
+        uploadImage(decoded);
+    }
+}
+
+bool TextureLoader::pending() const
+{
+    return mStatistics.mUploaded < mStatistics.mRequested;
+}
+
+std::ostream & operator << (std::ostream &out, const TextureLoader::Statistics &stats)
+{
+    out << "Textures : " << stats.mUploaded << " uploaded / " << stats.mRequested << " requested, "
+        << stats.mUploadedBytes / (1024*1024) << " MB" << std::endl;
+    out << "Decode time (all threads) : " << stats.mDecodeTime*1000. << " ms" << std::endl;
+    out << "Upload time : " << stats.mUploadTime*1000. << " ms" << std::endl;
+    out << "Load time : " << stats.mLoadTime*1000. << " ms" << std::endl;
+    return out;
+}
+
+} // namespace vortex
@@ -0,0 +1,112 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <string>
+#include <deque>
+#include <iostream>
+
+/// @todo remove QT dependencies here
+#include <QImage>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "texture.h"
+#include "timer.h"
+
+namespace vortex {
+
+/**
+ * Asynchronous loading of image Textures.
+ * The images are decoded and converted to the OpenGL layout on a thread pool, the decoded images are uploaded
+ * by upload, called once per frame from the OpenGL thread with a budget, so that a large scene loads over several frames.
+ * The Textures exist from the request on : they bind their placeholder until their image is uploaded.
+ */
+class TextureLoader {
+public:
+    /**
+     * Load metrics, times in seconds
+     */
+    struct Statistics {
+        Statistics() : mRequested(0), mUploaded(0), mUploadedBytes(0), mDecodeTime(0.), mUploadTime(0.), mLoadTime(0.) {}
+
+        int mRequested;
+        int mUploaded;
+        long long mUploadedBytes;
+        double mDecodeTime; // summed over the decoding threads
+        double mUploadTime;
+        double mLoadTime;   // from the first request to the last upload
+    };
+
+    TextureLoader();
+
+    /**
+     * Cancel the decodes not started and wait for the running ones, the decoded images are dropped.
+     */
+    ~TextureLoader();
+
+    /**
+     * Request the decode of an image file for a Texture not yet initialized.
+     *
+     * @param texture The Texture receiving the image, it must stay alive until its upload.
+     * @param fileName Path of the image file.
+     */
+    void load(Texture *texture, const std::string &fileName);
+
+    /**
+     * Upload the decoded images, until byteBudget bytes are uploaded. At least one image is uploaded if one is ready.
+     * Must be called from the OpenGL thread.
+     *
+     * @return true if some Textures were uploaded
+     */
+    bool upload(int byteBudget);
+
+    /**
+     * Wait for all the requested images and upload them. Must be called from the OpenGL thread.
+     */
+    void finish();
+
+    /**
+     * @return true while some requested Textures are not uploaded
+     */
+    bool pending() const;
+
+    const Statistics &statistics() const {
+        return mStatistics;
+    }
+
+    /** Called by the decoding tasks */
+    void decoded(Texture *texture, const QImage &image, double decodeTime);
+
+private:
+    struct DecodedImage {
+        Texture *mTexture;
+        QImage mImage;
+    };
+
+    void uploadImage(const DecodedImage &decoded);
+
+    QThreadPool mPool;
+
+    // decoded images waiting for upload, shared with the decoding tasks
+    QMutex mMutex;
+    QWaitCondition mDecodedCondition;
+    std::deque<DecodedImage> mDecoded;
+    int mDecoding;
+    double mDecodeTime;
+
+    Statistics mStatistics;
+    Timer mLoadTimer;
+};
+
+std::ostream & operator << (std::ostream &out, const TextureLoader::Statistics &stats);
+
+} // namespace vortex
+
+#endif // TEXTURELOADER_H
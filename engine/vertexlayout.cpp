@@ -0,0 +1,138 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#include "vertexlayout.h"
+#include "halffloat.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace vortex {
+
+VertexLayout::VertexLayout()
+{
+    mEncodings[POSITION] = FLOAT3;
+    mEncodings[NORMAL] = FLOAT3;
+    mEncodings[TANGENT] = FLOAT3;
+    mEncodings[TEXCOORD] = FLOAT4;
+    setEncoding(POSITION, FLOAT3);
+}
+
+void VertexLayout::setEncoding(Attribute attribute, Encoding encoding)
+{
+    mEncodings[attribute] = encoding;
+    // attributes are interleaved in order, all the encodings are multiple of 4 bytes
+    mStride = 0;
+    for (int i = 0; i < NUM_ATTRIBUTES; ++i) {
+        mOffsets[i] = mStride;
+        mStride += size(mEncodings[i]);
+    }
+}
+
+int VertexLayout::size(Encoding encoding)
+{
+    switch (encoding) {
+    case FLOAT3 :
+        return 3 * sizeof(float);
+    case FLOAT4 :
+        return 4 * sizeof(float);
+    case SNORM_10_10_10_2 :
+    case UNORM16_2 :
+    case HALF2 :
+        return 4;
+    default :
+        return 0;
+    }
+}
+
+uint32_t VertexLayout::packSnorm1010102(float x, float y, float z)
+{
+    // skinned normals may be scaled : keep their direction
+    float length = sqrtf(x*x + y*y + z*z);
+    float scale = (length > 1.f) ? 1.f / length : 1.f;
+    float components[3] = {x * scale, y * scale, z * scale};
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; ++i) {
+        int value = int(floorf(std::max(-1.f, std::min(components[i], 1.f)) * 511.f + 0.5f));
+        packed |= (uint32_t(value) & 0x3ff) << (10 * i);
+    }
+    return packed;
+}
+
+void VertexLayout::encode(Attribute attribute, const float *value, char *vertex) const
+{
+    char *dst = vertex + mOffsets[attribute];
+    switch (mEncodings[attribute]) {
+    case FLOAT3 :
+        memcpy(dst, value, 3 * sizeof(float));
+        break;
+    case FLOAT4 :
+        memcpy(dst, value, 4 * sizeof(float));
+        break;
+    case SNORM_10_10_10_2 : {
+        uint32_t packed = packSnorm1010102(value[0], value[1], value[2]);
+        memcpy(dst, &packed, sizeof(packed));
+        break;
+    }
+    case UNORM16_2 : {
+        uint16_t packed[2];
+        for (int i = 0; i < 2; ++i)
+            packed[i] = uint16_t(std::max(0.f, std::min(value[i], 1.f)) * 65535.f + 0.5f);
+        memcpy(dst, packed, sizeof(packed));
+        break;
+    }
+    case HALF2 : {
+        uint16_t packed[2];
+        floatToHalf(value, packed, 2);
+        memcpy(dst, packed, sizeof(packed));
+        break;
+    }
+    default :
+        break;
+    }
+}
+
+void VertexLayout::setAttributes() const
+{
+    for (int i = 0; i < NUM_ATTRIBUTES; ++i) {
+        GLvoid *pointer = BUFFER_OFFSET(mOffsets[i]);
+        switch (mEncodings[i]) {
+        case FLOAT3 :
+            glAssert( glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, mStride, pointer) );
+            break;
+        case FLOAT4 :
+            glAssert( glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, mStride, pointer) );
+            break;
+        case SNORM_10_10_10_2 :
+            glAssert( glVertexAttribPointer(i, 4, GL_INT_2_10_10_10_REV, GL_TRUE, mStride, pointer) );
+            break;
+        case UNORM16_2 :
+            glAssert( glVertexAttribPointer(i, 2, GL_UNSIGNED_SHORT, GL_TRUE, mStride, pointer) );
+            break;
+        case HALF2 :
+            glAssert( glVertexAttribPointer(i, 2, GL_HALF_FLOAT, GL_FALSE, mStride, pointer) );
+            break;
+        default :
+            // the current value of a disabled attribute is not part of the vertex array state
+            glAssert( glDisableVertexAttribArray(i) );
+            glAssert( glVertexAttrib4f(i, 0.f, 0.f, 0.f, 0.f) );
+            continue;
+        }
+        glAssert( glEnableVertexAttribArray(i) );
+    }
+}
+
+bool VertexLayout::operator== (const VertexLayout &other) const
+{
+    for (int i = 0; i < NUM_ATTRIBUTES; ++i) {
+        if (mEncodings[i] != other.mEncodings[i])
+            return false;
+    }
+    return true;
+}
+
+} // namespace vortex
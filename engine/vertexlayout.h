@@ -0,0 +1,85 @@
+/*
+ *   Copyright (C) 2008-2013 by Mathias Paulin, David Vanderhaeghe
+ *   Mathias.Paulin@irit.fr
+ *   vdh@irit.fr
+ */
+
+#ifndef VERTEXLAYOUT_H
+#define VERTEXLAYOUT_H
+
+#include <stdint.h>
+
+#include "opengl.h"
+
+namespace vortex {
+
+/**
+ * Layout of the vertices in a vertex buffer : the encoding of each attribute and its offset in an interleaved vertex.
+ * The vertex array attributes are set from this description, see Mesh::contentLayout for the choice of the encodings.
+ */
+class VertexLayout {
+public:
+    /** The vertex attributes, in the order of their shader locations */
+    enum Attribute {POSITION, NORMAL, TANGENT, TEXCOORD, NUM_ATTRIBUTES};
+
+    enum Encoding {
+        OMITTED,            /// not stored, the shaders read (0, 0, 0, 0)
+        FLOAT3,             /// 12 bytes
+        FLOAT4,             /// 16 bytes
+        SNORM_10_10_10_2,   /// 4 bytes, 3 components in [-1, 1] : unit vectors
+        UNORM16_2,          /// 4 bytes, 2 components in [0, 1], read as (x, y, 0, 1)
+        HALF2               /// 4 bytes, 2 half floats, read as (x, y, 0, 1)
+    };
+
+    /**
+     * The layout of Mesh::VertexData : the position, normal and tangent as 3 floats, the texture coordinates as 4 floats.
+     */
+    VertexLayout();
+
+    void setEncoding(Attribute attribute, Encoding encoding);
+
+    Encoding encoding(Attribute attribute) const {
+        return mEncodings[attribute];
+    }
+
+    /** Offset of an attribute in a vertex, in bytes */
+    int offset(Attribute attribute) const {
+        return mOffsets[attribute];
+    }
+
+    /** Size of a vertex, in bytes */
+    int stride() const {
+        return mStride;
+    }
+
+    /**
+     * Encode the value of an attribute of a vertex.
+     *
+     * @param value The 3 components of the position, normal or tangent, the 4 components of the texture coordinates.
+     * @param vertex The encoded vertex, the attribute is written at its offset.
+     */
+    void encode(Attribute attribute, const float *value, char *vertex) const;
+
+    /**
+     * Set the attribute arrays of the bound vertex array object from the bound GL_ARRAY_BUFFER.
+     * The arrays of the omitted attributes are disabled.
+     */
+    void setAttributes() const;
+
+    bool operator== (const VertexLayout &other) const;
+
+    /** Size of an encoded attribute, in bytes */
+    static int size(Encoding encoding);
+
+    /** Pack a vector in the GL_INT_2_10_10_10_REV layout, vectors longer than 1 are normalized */
+    static uint32_t packSnorm1010102(float x, float y, float z);
+
+private:
+    Encoding mEncodings[NUM_ATTRIBUTES];
+    int mOffsets[NUM_ATTRIBUTES];
+    int mStride;
+};
+
+} // namespace vortex
+
+#endif // VERTEXLAYOUT_H
@@ -8,6 +8,13 @@
 
 namespace vortex {
 
+/**
+ * Add the properties a mesh needs in its shaders (GPU skinning ...) to a configuration.
+ */
+static void addMeshProperties(const Mesh *mesh, ShaderConfiguration &configuration)
+{
+    mesh->addShaderProperties(configuration);
+}
 
 void PrintNodeInfo::operator()(SceneGraph::Node* theNode)
 {
@@ -59,8 +66,82 @@ void BBoxRenderer::operator()(SceneGraph::Node *theNode) {
 /*
  * -------------------------------------------------------------------------------
  */
-DefaultLoopBuilder::DefaultLoopBuilder(SceneGraph *sceneGraph, ShaderLoop *loop) : mSceneGraph(sceneGraph), mLoop(loop)
+LoopBuilder::LoopBuilder(SceneGraph *sceneGraph, DrawList *list) : mSceneGraph(sceneGraph), mList(list), mListening(false)
+{
+    if (mList && mSceneGraph)
+        mItems.resize(mSceneGraph->numMeshSlots(), -1);
+}
+
+LoopBuilder::~LoopBuilder()
+{
+    if (mListening && mSceneGraph)
+        mSceneGraph->removeListener(this);
+}
+
+void LoopBuilder::listen()
+{
+    if (mList && mSceneGraph && !mListening) {
+        mSceneGraph->addListener(this);
+        mListening = true;
+    }
+}
+
+void LoopBuilder::insertItem(SceneGraph::LeafMeshNode *node, int slot, const glm::mat4x4 &transform)
 {
+    mItems[mSceneGraph->meshSlot(node->index()) + slot] =
+            mList->insert(meshProgram(node, slot), node->getRenderState(slot)->getMaterial(), transform, (*node)[slot], node, slot);
+}
+
+void LoopBuilder::removeItem(SceneGraph::LeafMeshNode *node, int slot)
+{
+    DrawList::ItemId &item = mItems[mSceneGraph->meshSlot(node->index()) + slot];
+    if (item >= 0)
+        mList->remove(item);
+    item = -1;
+}
+
+void LoopBuilder::meshChanged(SceneGraph::LeafMeshNode *node, int slot)
+{
+    removeItem(node, slot);
+    if ((*node)[slot])
+        insertItem(node, slot, node->worldTransformMatrix());
+}
+
+void LoopBuilder::materialChanged(SceneGraph::LeafMeshNode *node, int slot)
+{
+    // the material may change the program
+    meshChanged(node, slot);
+}
+
+void LoopBuilder::transformChanged(SceneGraph::LeafMeshNode *node)
+{
+    int first = mSceneGraph->meshSlot(node->index());
+    for (int i = 0; i < node->nMeshes(); ++i) {
+        if (mItems[first + i] >= 0)
+            mList->setTransform(mItems[first + i], node->worldTransformMatrix());
+    }
+}
+
+void LoopBuilder::graphDeleted(SceneGraph *graph)
+{
+    mSceneGraph = NULL;
+    mListening = false;
+}
+
+/*
+ * -------------------------------------------------------------------------------
+ */
+DefaultLoopBuilder::DefaultLoopBuilder(SceneGraph *sceneGraph, ShaderLoop *loop) : LoopBuilder(sceneGraph, NULL), mLoop(loop)
+{
+}
+
+DefaultLoopBuilder::DefaultLoopBuilder(SceneGraph *sceneGraph, DrawList *list) : LoopBuilder(sceneGraph, list), mLoop(NULL)
+{
+}
+
+ShaderProgram *DefaultLoopBuilder::meshProgram(SceneGraph::LeafMeshNode *node, int slot)
+{
+    return node->getRenderState(slot)->getShaderProgram();
 }
 
 void DefaultLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
@@ -72,6 +153,10 @@ void DefaultLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4
         ShaderProgram *prog = NULL;
         for (int i = 0; i < leafNode->nMeshes(); ++i) {
             if ((*leafNode)[i]) {
+            if (mList) {
+                insertItem(leafNode, i, modelViewMatrix);
+                continue;
+            }
             state = leafNode->getRenderState(i);
             prog = state->getShaderProgram();
             //@TODO check not needed data duplication, allocation ... !!! *prog is copied instead of linked ...
@@ -85,10 +170,37 @@ void DefaultLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4
 /*
  * -------------------------------------------------------------------------------
  */
-ShaderLoopBuilder::ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, ShaderLoop *loop, std::string shaderName)
-    : mResourcesManager(resourcesManager), mSceneGraph(sceneGraph), mLoop(loop), mPropertiesFilter(NULL)
+ShaderLoopBuilder::ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, ShaderLoop *loop, std::string shaderName,
+                                     ShaderConfiguration::ShaderType shaderType)
+    : LoopBuilder(sceneGraph, NULL), mResourcesManager(resourcesManager), mLoop(loop), mShaderType(shaderType), mPropertiesFilter(NULL)
+{
+    mShaderName = mResourcesManager->getShaderBasePath() +  shaderName;
+    mProgramId = ShaderConfiguration::programId(mShaderName);
+}
+
+ShaderLoopBuilder::ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, DrawList *list, std::string shaderName,
+                                     ShaderConfiguration::ShaderType shaderType)
+    : LoopBuilder(sceneGraph, list), mResourcesManager(resourcesManager), mLoop(NULL), mShaderType(shaderType), mPropertiesFilter(NULL)
 {
     mShaderName = mResourcesManager->getShaderBasePath() +  shaderName;
+    mProgramId = ShaderConfiguration::programId(mShaderName);
+}
+
+ShaderProgram *ShaderLoopBuilder::meshProgram(SceneGraph::LeafMeshNode *node, int slot)
+{
+    // build a shaderConfiguration object from material
+    ShaderConfiguration nodeShaderConfiguration(mShaderType, mProgramId);
+    Material * nodeMaterial = node->getRenderState(slot)->getMaterial();
+    for (int j = 0; j < nodeMaterial->numTexture(); ++j) {
+        if ( !mPropertiesFilter || mPropertiesFilter->match(nodeMaterial->getTextureSemantic(j)) )
+            nodeShaderConfiguration.addProperty(nodeMaterial->getTextureSemanticString(j));
+    }
+    addMeshProperties((*node)[slot], nodeShaderConfiguration);
+
+    // get or generate the shader associated with this configuration
+    ShaderProgram *prog = mResourcesManager->getShaderProgram(nodeShaderConfiguration);
+    prog->setConfiguration(nodeShaderConfiguration); // TODO Useless ???
+    return prog;
 }
 
 void ShaderLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix)
@@ -96,23 +208,14 @@ void ShaderLoopBuilder::operator()(SceneGraph::Node *theNode, const glm::mat4x4
 //    std::cerr << " -- ShaderLoopBuilder::operator()" << std::endl;
     if (theNode->isLeaf()) {
         SceneGraph::LeafMeshNode *leafNode = static_cast<SceneGraph::LeafMeshNode *>(theNode);
-        RenderState *state = NULL;
-        ShaderProgram *prog = NULL;
         for (int i = 0; i < leafNode->nMeshes(); ++i) {
             if ((*leafNode)[i]){
-                state = leafNode->getRenderState(i);
-
-                // build a shaderConfiguration object from material
-                ShaderConfiguration nodeShaderConfiguration(ShaderConfiguration::DEFAULT, mShaderName);
-                Material * nodeMaterial = state->getMaterial();
-                for (int j = 0; j < nodeMaterial->numTexture(); ++j) {
-                    if ( !mPropertiesFilter || mPropertiesFilter->match(nodeMaterial->getTextureSemantic(j)) )
-                        nodeShaderConfiguration.addProperty(nodeMaterial->getTextureSemanticString(j));
+                if (mList) {
+                    insertItem(leafNode, i, modelViewMatrix);
+                    continue;
                 }
-
-                // get or generate the shader associated with this configuration
-                prog = mResourcesManager->getShaderProgram(nodeShaderConfiguration);
-                prog->setConfiguration(nodeShaderConfiguration); // TODO Useless ???
+                ShaderProgram *prog = meshProgram(leafNode, i);
+                Material * nodeMaterial = leafNode->getRenderState(i)->getMaterial();
                 (*mLoop)[ *prog ][ TransformState(modelViewMatrix, projectionMatrix, prog)]
                 [ MaterialState(nodeMaterial, prog)].push_back((*leafNode)[i]);
             }
@@ -187,11 +290,14 @@ void LightTransformVisitor::operator()(SceneGraph::Node *theNode, const glm::mat
  */
 // ShaderCreatorVisitor
 
-ShaderBuilder::ShaderBuilder(vortex::AssetManager *resourcesManager, std::string shaderName, bool setDefault) :
+ShaderBuilder::ShaderBuilder(vortex::AssetManager *resourcesManager, std::string shaderName, bool setDefault,
+                             ShaderConfiguration::ShaderType shaderType) :
     mResourcesManager(resourcesManager),
     mShaderName(shaderName),
-    mSetAsDefault(setDefault), mPropertiesFilter(NULL){
+    mShaderType(shaderType),
+    mSetAsDefault(setDefault), mPropertiesFilter(NULL), mConfigurations(NULL){
     mShaderName = mResourcesManager->getShaderBasePath() + shaderName;
+    mProgramId = ShaderConfiguration::programId(mShaderName);
     //std::cerr << "Shader builder visitor : " << mShaderName << std::endl;
 }
 
@@ -205,9 +311,8 @@ void ShaderBuilder::operator()(SceneGraph::Node *theNode)
                 stateObject->setAssetManager(mResourcesManager);
 
             // build a shaderConfiguration object from material
-            ///@todo make ShaderConfiguration::DEFAULT configurable
-    // TODO allow tesss and geom shader
-                ShaderConfiguration nodeShaderConfiguration(ShaderConfiguration::DEFAULT, mShaderName);
+    // TODO allow tesss shader
+                ShaderConfiguration nodeShaderConfiguration(mShaderType, mProgramId);
                 Material * nodeMaterial = stateObject->getMaterial();
                 for (int j = 0; j < nodeMaterial->numTexture(); ++j) {
                     if ( mPropertiesFilter ) {
@@ -217,6 +322,11 @@ void ShaderBuilder::operator()(SceneGraph::Node *theNode)
                         nodeShaderConfiguration.addProperty(nodeMaterial->getTextureSemanticString(j));
                     }
                 }
+                addMeshProperties((*leafNode)[i], nodeShaderConfiguration);
+                if (mConfigurations) {
+                    mConfigurations->push_back(nodeShaderConfiguration);
+                    continue;
+                }
                 // get or generate the shader associated with this configuration
                 ShaderProgram *theNodeProgram = mResourcesManager->getShaderProgram(nodeShaderConfiguration);
                 if (mSetAsDefault){
@@ -231,7 +341,8 @@ void ShaderBuilder::operator()(SceneGraph::Node *theNode)
 /*
  * -------------------------------------------------------------------------------
  */
-GraphStatistic::GraphStatistic() : leafCount(0), innerCount(0), meshCount(0), faceCount(0), verticesCount(0){
+GraphStatistic::GraphStatistic() : leafCount(0), innerCount(0), meshCount(0), faceCount(0), verticesCount(0),
+    lodCount(0), lodFaceCount(0), lodMemory(0), drawnFaceCount(0){
 
 }
 
@@ -245,6 +356,13 @@ void GraphStatistic::operator()(SceneGraph::Node *theNode){
                 Mesh::MeshPtr theMesh= (*leafNode)[i];
                 faceCount += theMesh->numIndices()/3;
                 verticesCount += theMesh->numVertices();
+                for (int level = 1; level < theMesh->numLods(); ++level) {
+                    Mesh::MeshPtr lod = theMesh->lod(level);
+                    lodCount += 1;
+                    lodFaceCount += lod->numIndices()/3;
+                    lodMemory += lod->vertexBufferSize() + lod->indexBufferSize();
+                }
+                drawnFaceCount += theMesh->lod(theNode->lodLevel(i))->numIndices()/3;
             }
         }
     } else {
@@ -255,6 +373,8 @@ void GraphStatistic::operator()(SceneGraph::Node *theNode){
 std::ostream & operator << (std::ostream &out, const GraphStatistic &stat){
     out << "Inner nodes : " << stat.innerCount << " / leaf nodes : " << stat.leafCount;
     out << " --- Meshes : " << stat.meshCount << " - Faces : " << stat.faceCount << " - Vertex : " << stat.verticesCount;
+    out << " --- Levels of detail : " << stat.lodCount << " - Faces : " << stat.lodFaceCount << " - Memory : "
+        << stat.lodMemory / 1024 << " KB - Faces drawn : " << stat.drawnFaceCount;
     return out;
 }
 
@@ -288,7 +408,8 @@ void MeshUpdater::operator()(SceneGraph::Node *theNode) {
  * -------------------------------------------------------------------------------
  */
 
-MaterialSetter::MaterialSetter(Material *material, std::string name) : mMaterial(material), mName(name) {
+MaterialSetter::MaterialSetter(SceneGraph *sceneGraph, Material *material, std::string name) : mSceneGraph(sceneGraph),
+    mMaterial(material), mName(name) {
 }
 
 void MaterialSetter::operator ()(SceneGraph::Node *theNode) {
@@ -297,7 +418,7 @@ void MaterialSetter::operator ()(SceneGraph::Node *theNode) {
 
         for (int i = 0; i < leafNode->nMeshes(); ++i) {
             if ((*leafNode)[i]->name() == mName)
-                leafNode->getRenderState(i)->setMaterial(mMaterial);
+                mSceneGraph->setMaterial(leafNode, i, mMaterial);
         }
     }
 }
@@ -12,6 +12,7 @@
 #include "scenegraph.h"
 
 #include "renderloop.h"
+#include "drawlist.h"
 
 namespace vortex {
 
@@ -52,17 +53,58 @@ public:
 
 
 
+/**
+ * Base of the builders of the mesh rendering loops.
+ * Filling a DrawList, the builder records the item of each mesh slot of the graph (see SceneGraph::meshSlot).
+ * Once the list is built, listen() keeps it up to date : the item of a mesh whose mesh, material or transform
+ * changed is removed and inserted again, without visiting the graph.
+ * @ingroup GraphOperationGroup
+ */
+class LoopBuilder : public SceneGraph::VisitorOperation, public SceneGraph::Listener {
+public:
+    LoopBuilder(SceneGraph *sceneGraph, DrawList *list);
+    virtual ~LoopBuilder();
+
+    /** Update the list on the graph changes, until the builder is deleted */
+    void listen();
+
+    void meshChanged(SceneGraph::LeafMeshNode *node, int slot);
+    void materialChanged(SceneGraph::LeafMeshNode *node, int slot);
+    void transformChanged(SceneGraph::LeafMeshNode *node);
+    void graphDeleted(SceneGraph *graph);
+
+protected:
+    /** The program drawing a mesh of a leaf */
+    virtual ShaderProgram *meshProgram(SceneGraph::LeafMeshNode *node, int slot) = 0;
+
+    /** Insert a mesh of a leaf in the list and record its item */
+    void insertItem(SceneGraph::LeafMeshNode *node, int slot, const glm::mat4x4 &transform);
+
+    /** Remove the item of a mesh of a leaf, if any */
+    void removeItem(SceneGraph::LeafMeshNode *node, int slot);
+
+    SceneGraph *mSceneGraph;
+    DrawList *mList;
+
+private:
+    // item of each mesh slot of the graph, -1 if the mesh is not in the list
+    std::vector<DrawList::ItemId> mItems;
+    bool mListening;
+};
+
 /**
  * Build the scene default RenderLoop
  * use the default shader : the one store in the renderstate of a node
  * @ingroup GraphOperationGroup
  */
-class DefaultLoopBuilder : public SceneGraph::VisitorOperation {
+class DefaultLoopBuilder : public LoopBuilder {
 public:
     DefaultLoopBuilder(SceneGraph *sceneGraph, ShaderLoop *loop);
+    DefaultLoopBuilder(SceneGraph *sceneGraph, DrawList *list);
     void operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+protected:
+    ShaderProgram *meshProgram(SceneGraph::LeafMeshNode *node, int slot);
 private:
-    SceneGraph *mSceneGraph;
     ShaderLoop *mLoop;
 };
 
@@ -70,20 +112,26 @@ private:
  * Build the scene default RenderLoop using the particular shader with material properties filtering
  * @ingroup GraphOperationGroup
  */
-class ShaderLoopBuilder : public SceneGraph::VisitorOperation {
+class ShaderLoopBuilder : public LoopBuilder {
 public:
-    ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, ShaderLoop *loop, std::string shaderName);
+    ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, ShaderLoop *loop, std::string shaderName,
+                      ShaderConfiguration::ShaderType shaderType = ShaderConfiguration::DEFAULT);
+    ShaderLoopBuilder(AssetManager *resourcesManager, SceneGraph *sceneGraph, DrawList *list, std::string shaderName,
+                      ShaderConfiguration::ShaderType shaderType = ShaderConfiguration::DEFAULT);
 
     void setFilter(MaterialPropertyFilter *filter) {
         mPropertiesFilter = filter;
     }
 
     void operator()(SceneGraph::Node *theNode, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+protected:
+    ShaderProgram *meshProgram(SceneGraph::LeafMeshNode *node, int slot);
 private:
     AssetManager *mResourcesManager;
-    SceneGraph *mSceneGraph;
     ShaderLoop *mLoop;
     std::string mShaderName;
+    int mProgramId;
+    ShaderConfiguration::ShaderType mShaderType;
     MaterialPropertyFilter *mPropertiesFilter;
 };
 
@@ -136,19 +184,31 @@ private:
   */
 class ShaderBuilder : public vortex::SceneGraph::VisitorOperation {
 public:
-    ShaderBuilder(vortex::AssetManager *resourcesManager, std::string shaderName, bool setDefault=true);
+    ShaderBuilder(vortex::AssetManager *resourcesManager, std::string shaderName, bool setDefault=true,
+                  ShaderConfiguration::ShaderType shaderType = ShaderConfiguration::DEFAULT);
 
     void setFilter(vortex::MaterialPropertyFilter *filter) {
         mPropertiesFilter = filter;
     }
 
+    /**
+     * Append the configurations to configurations instead of building the programs, to warm them up at once
+     * with AssetManager::warmUpShaderPrograms. NULL builds the programs again.
+     */
+    void collectConfigurations(std::vector<ShaderConfiguration> *configurations) {
+        mConfigurations = configurations;
+    }
+
     void operator()(vortex::SceneGraph::Node *theNode);
 
 private :
     vortex::AssetManager *mResourcesManager;
     std::string mShaderName;
+    int mProgramId;
+    ShaderConfiguration::ShaderType mShaderType;
     bool mSetAsDefault;
     vortex::MaterialPropertyFilter *mPropertiesFilter;
+    std::vector<ShaderConfiguration> *mConfigurations;
 
 };
 
@@ -168,24 +228,32 @@ private:
     int meshCount;
     int faceCount;
     int verticesCount;
+    // levels of detail, the meshes themselves excluded
+    int lodCount;
+    int lodFaceCount;
+    long long lodMemory;
+    // faces at the levels of detail selected at the last frame
+    int drawnFaceCount;
 };
 
 /**
- * Set a material for one mesh (by name)
+ * Set a material for one mesh (by name), the graph listeners are notified
  * @ingroup GraphOperationGroup
  */
 class MaterialSetter : public SceneGraph::VisitorOperation {
 public:
-    MaterialSetter(Material *material, std::string name);
+    MaterialSetter(SceneGraph *sceneGraph, Material *material, std::string name);
     void operator()(SceneGraph::Node *theNode);
 private :
+    SceneGraph *mSceneGraph;
     Material *mMaterial;
     std::string mName;
 };
 
 
 /**
- * Update the mesh position (animation)
+ * Update the mesh position (animation), one mesh after the other.
+ * AssetManager::updateAnimations and uploadAnimatedMeshes update all the animated meshes in parallel.
  * @author Alexandre Bonhomme
  * @date 02/05/2012
  */
@@ -8,28 +8,41 @@
 #include "meshconverter.h"
 #include "../engine/camera.h"
 
+#include <QStandardPaths>
+#include <QDir>
+
 using namespace vortex;
 using namespace vortex::util;
 
 static GLenum bufs[]={GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4};
 
-FtylRenderer::FtylRenderer(SceneManager *sceneManager, int width, int height) :  mRenderMode(0), mSceneManager(sceneManager) {
+FtylRenderer::FtylRenderer(SceneManager *sceneManager, int width, int height) :  mRenderMode(0), mFrustumCulling(true), mGpuSkinning(false),
+    mWireColor(0.7, 0.7, 1.0, 1.0), mWireWidth(1.f), mWireFadeMin(2.f), mWireFadeMax(8.f), mSceneManager(sceneManager) {
 
     glCheckError();
 
     mFbo = new FBO(FBO::Components(FBO::DEPTH | FBO::COLOR), width, height);
+    mLightFbo = new FBO(FBO::COLOR, width, height);
 
     glCheckError();
 
     mTextures[DEPTH_TEXTURE] = new Texture("depth", GL_TEXTURE_2D);
     mTextures[NORMAL_TEXTURE] = new Texture("normal", GL_TEXTURE_2D);
     mTextures[COLOR_TEXTURE] = new Texture("color", GL_TEXTURE_2D );
+    mTextures[ALBEDO_TEXTURE] = new Texture("albedo", GL_TEXTURE_2D );
+    mTextures[SPECULAR_TEXTURE] = new Texture("specular", GL_TEXTURE_2D );
 
     glCheckError();
 
     mScreenQuad = ScreenQuadBuilder().build("ScreenQuad");
     mScreenQuad->init();
 
+    mLightBuffer = new LightBuffer();
+
+    // the passes writing depth first are drawn front to back within each state
+    mAmbientAndNormalLoop.setDepthSorting(true);
+    mGBufferLoop.setDepthSorting(true);
+
     glCheckError();
 
     FBO::bindDefault();
@@ -41,11 +54,15 @@ FtylRenderer::FtylRenderer(SceneManager *sceneManager, int width, int height) :
 
 FtylRenderer::~FtylRenderer() {
     delete mFbo;
+    delete mLightFbo;
 
     for (int i=0; i<NUM_TEXTURE; i++)
             delete mTextures[i];
 
     delete mScreenQuad;
+    delete mLightBuffer;
+
+    clearLoopBuilders();
 }
 
 void FtylRenderer::displayTexture(Texture * theTexture){
@@ -60,36 +77,64 @@ void FtylRenderer::displayTexture(Texture * theTexture){
     glAssert( glDepthFunc(GL_LESS) );
 }
 
-void FtylRenderer::ambientPass(vortex::ShaderLoop &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix){
+void FtylRenderer::ambientPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix){
     // render ambient and normal
     ShadersGlobalParameters  ambientAndNormalParamameters;
     ambientAndNormalParamameters.addParameter("view2worldMatrix", viewToWorldMatrix);
     ambientAndNormalParamameters.addParameter("ambientIntensity", 1.0f );
+    // the triangulation is drawn over the ambient color, the lighting pass fades out under it
+    addWireframeParameters(ambientAndNormalParamameters);
     theRenderingLoop.draw(ambientAndNormalParamameters, modelViewMatrix, projectionMatrix);
 }
 
-void FtylRenderer::lightsPass(vortex::ShaderLoop &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix){
-    if(mSceneManager->sceneGraph()->mLights.size()>0){
-        for(unsigned int i = 0; i<mSceneManager->sceneGraph()->mLights.size(); ++i ){
-            glm::mat4x4 lightMatrix = modelViewMatrix*mSceneManager->sceneGraph()->mLights[i].mTransform;
-            Light l = Light(mSceneManager->sceneGraph()->mLights[i], lightMatrix);
-            LightGlobalParameters lightParamameters(l);
-            lightParamameters.addParameter("inverseViewMatrix", viewToWorldMatrix);
-            lightParamameters.addParameter("vertexSelected", glm::vec4(mVertexSelected, 1.0));
-            lightParamameters.addParameter("validSelection", mValidSelection);
-            lightParamameters.addParameter("toolRadius", mToolRadius);
-            theRenderingLoop.draw(lightParamameters, modelViewMatrix, projectionMatrix);
-        }
-    } else { // no lights in scene, set up a headlight
-        Light l;
-        l.mDiffuse=glm::vec3(4.0,4.0,4.0);
-        LightGlobalParameters lightParamameters(l);
-        lightParamameters.addParameter("inverseViewMatrix", viewToWorldMatrix);
-        lightParamameters.addParameter("vertexSelected", glm::vec4(mVertexSelected, 1.0));
-        lightParamameters.addParameter("validSelection", mValidSelection);
-        lightParamameters.addParameter("toolRadius", mToolRadius);
-        theRenderingLoop.draw(lightParamameters, modelViewMatrix, projectionMatrix);
-    }
+void FtylRenderer::lightsPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix){
+    // all the lights are shaded in one geometry pass
+    mLightBuffer->update(mSceneManager->sceneGraph()->mLights, modelViewMatrix, projectionMatrix, mWidth, mHeight);
+    ShadersGlobalParameters lightParamameters;
+    mLightBuffer->addParameters(lightParamameters);
+    lightParamameters.addParameter("inverseViewMatrix", viewToWorldMatrix);
+    lightParamameters.addParameter("vertexSelected", glm::vec4(mVertexSelected, 1.0));
+    lightParamameters.addParameter("validSelection", mValidSelection);
+    lightParamameters.addParameter("toolRadius", mToolRadius);
+    // the lighting is faded out under the triangulation drawn by the ambient pass
+    addWireframeParameters(lightParamameters);
+    theRenderingLoop.draw(lightParamameters, modelViewMatrix, projectionMatrix);
+}
+
+void FtylRenderer::gBufferPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix){
+    // render ambient, normal and material properties
+    ShadersGlobalParameters gBufferParamameters;
+    gBufferParamameters.addParameter("view2worldMatrix", viewToWorldMatrix);
+    gBufferParamameters.addParameter("ambientIntensity", 1.0f );
+    gBufferParamameters.addParameter("vertexSelected", glm::vec4(mVertexSelected, 1.0));
+    gBufferParamameters.addParameter("validSelection", mValidSelection);
+    gBufferParamameters.addParameter("toolRadius", mToolRadius);
+    addWireframeParameters(gBufferParamameters);
+    theRenderingLoop.draw(gBufferParamameters, modelViewMatrix, projectionMatrix);
+}
+
+void FtylRenderer::deferredLightsPass(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix){
+    // all the lights are applied by one screen space pass reading the G-buffer
+    mLightBuffer->update(mSceneManager->sceneGraph()->mLights, modelViewMatrix, projectionMatrix, mWidth, mHeight);
+    ShaderProgram *shader = mSceneManager->getAsset()->getShaderProgram(mDeferredLightShaderId);
+    shader->bind();
+    ShadersGlobalParameters lightParamameters;
+    mLightBuffer->addParameters(lightParamameters);
+    lightParamameters.addParameter("depth", mTextures[DEPTH_TEXTURE]);
+    lightParamameters.addParameter("normal", mTextures[NORMAL_TEXTURE]);
+    lightParamameters.addParameter("albedo", mTextures[ALBEDO_TEXTURE]);
+    lightParamameters.addParameter("specular", mTextures[SPECULAR_TEXTURE]);
+    lightParamameters.addParameter("inverseProjectionMatrix", glm::inverse(projectionMatrix));
+    lightParamameters.set(shader);
+    mScreenQuad->draw();
+}
+
+void FtylRenderer::addWireframeParameters(vortex::ShadersGlobalParameters &parameters){
+    parameters.addParameter("viewport", glm::vec4(mWidth, mHeight, 0, 0));
+    parameters.addParameter("wireColor", mWireColor);
+    parameters.addParameter("wireWidth", mWireWidth);
+    parameters.addParameter("wireFadeMin", mWireFadeMin);
+    parameters.addParameter("wireFadeMax", mWireFadeMax);
 }
 
 void FtylRenderer::renderFilled(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix){
@@ -113,7 +158,7 @@ void FtylRenderer::renderFilled(const glm::mat4x4 &modelViewMatrix, const glm::m
     // render ambient and normal
     ambientPass(mAmbientAndNormalLoop, modelViewMatrix, projectionMatrix, viewToWorldMatrix);
 
-    // setup per light rendering : blend each pass onto the previous one
+    // setup lights rendering : blend the lighting pass onto the ambient one
     glAssert(glDrawBuffers(1, bufs));
     glAssert(glDepthFunc(GL_LEQUAL));
     glAssert(glEnable(GL_BLEND));
@@ -122,42 +167,52 @@ void FtylRenderer::renderFilled(const glm::mat4x4 &modelViewMatrix, const glm::m
 
     glAssert(glEnable(GL_POLYGON_OFFSET_FILL));
 
-    // render for each light
+    // render all lights
     lightsPass(mMainDrawLoop, modelViewMatrix, projectionMatrix, viewToWorldMatrix);
 
     glAssert(glDisable(GL_POLYGON_OFFSET_FILL));
 
-    glEnable(GL_POLYGON_OFFSET_LINE);
-    glPolygonOffset(-1,-1);
+    // restore parameter
+    glAssert( glDisable(GL_BLEND) );
+    glAssert( glDepthFunc(GL_LESS) );
+    glDepthMask(GL_TRUE);
 
-    glAssert(glPolygonMode(GL_FRONT_AND_BACK, GL_LINE));
-    glAssert(glEnable(GL_LINE_SMOOTH));
-    glAssert(glLineWidth(1.f) );
+    glDepthFunc(GL_LESS);
 
+}
+
+void FtylRenderer::renderDeferred(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix){
+    //
+    // Important note before modifying this method :
+    // see FtylRenderer::setViewport for FBO configurations
+    //
+    glm::mat4x4 viewToWorldMatrix = glm::inverse(modelViewMatrix);
+
+    // rasterize the scene once into the G-buffer
+    mFbo->useAsTarget(mWidth, mHeight);
+    glAssert(glDrawBuffers(4, bufs));
+    glAssert(glClearColor(0.1, 0.1, 0.1, 1.));
+    glAssert(glClearDepth(1.0));
+    glAssert(glDepthFunc(GL_LESS));
+    glAssert(glDisable(GL_BLEND));
+
+    mFbo->clear(FBO::ALL);// to clear all attached texture
+
+    gBufferPass(mGBufferLoop, modelViewMatrix, projectionMatrix, viewToWorldMatrix);
+
+    // lights are accumulated onto the ambient color in a target without the sampled G-buffer textures
+    mLightFbo->useAsTarget(mWidth, mHeight);
     glAssert(glDrawBuffers(1, bufs));
-    glAssert(glDepthFunc(GL_LEQUAL));
-    glAssert(glEnable(GL_BLEND));
-    glAssert(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    glAssert(glDepthFunc(GL_ALWAYS));
     glAssert(glDepthMask(GL_FALSE));
+    glAssert(glEnable(GL_BLEND));
+    glAssert(glBlendFunc(GL_ONE, GL_ONE));
 
-    ShadersGlobalParameters ambientAndNormalParamameters;
-    ambientAndNormalParamameters.addParameter("color", glm::vec4(0.7,0.7,1.0,1));
-    mAmbientAndNormalLoop.draw(ambientAndNormalParamameters, modelViewMatrix, projectionMatrix);
+    deferredLightsPass(modelViewMatrix, projectionMatrix);
 
     glAssert( glDisable(GL_BLEND) );
     glAssert( glDepthFunc(GL_LESS) );
     glAssert( glDepthMask(GL_TRUE) );
-    glDisable(GL_POLYGON_OFFSET_LINE);
-
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-    // restore parameter
-    glAssert( glDisable(GL_BLEND) );
-    glAssert( glDepthFunc(GL_LESS) );
-    glDepthMask(GL_TRUE);
-
-    glDepthFunc(GL_LESS);
-
 }
 
 void FtylRenderer::renderWireframe(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix){
@@ -211,12 +266,38 @@ void FtylRenderer::render(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4
 
     if ( ! mSceneManager->sceneGraph())
         return;
+    // textures decoded, meshes optimized and levels of detail generated in the background since the last frame
+    AssetManager *assetManager = mSceneManager->getAsset();
+    assetManager->uploadTextures();
+    assetManager->uploadOptimizedMeshes();
+    assetManager->uploadLods();
     {
+        // flag the nodes out of view, the draw lists skip their meshes
+        if (mFrustumCulling)
+            mSceneManager->sceneGraph()->cull(Frustum(modelViewMatrix, projectionMatrix));
+        else // moved nodes update the draw lists
+            mSceneManager->sceneGraph()->updateBounds();
+        mSceneManager->sceneGraph()->selectLods(modelViewMatrix, projectionMatrix, height());
         (*(mRenderOperators[mRenderMode]))(modelViewMatrix, projectionMatrix);
         displayTexture(mTextures[COLOR_TEXTURE]);
     }
 }
 
+bool FtylRenderer::loading(){
+    AssetManager *assetManager = mSceneManager->getAsset();
+    return assetManager->texturesPending() || assetManager->meshesOptimizing() || assetManager->lodsPending();
+}
+
+void FtylRenderer::updateAnimations(double time){
+    AssetManager *assetManager = mSceneManager->getAsset();
+    if (!mSceneManager->sceneGraph() || !assetManager->updateAnimations(time))
+        return;
+    assetManager->uploadAnimatedMeshes();
+    // skinned meshes moved, culling needs their new bounds
+    for (unsigned int i = 0; i < assetManager->nAnimatedMesh(); ++i)
+        mSceneManager->sceneGraph()->invalidateBounds(assetManager->getAnimatedMesh(i));
+}
+
 void FtylRenderer::setViewport(int width, int height)
 {
     //Renderer::setViewport(width, height);
@@ -232,17 +313,31 @@ void FtylRenderer::setViewport(int width, int height)
         mTextures[NORMAL_TEXTURE]->deleteGL();
     if (mTextures[COLOR_TEXTURE]->getId() != 0)
         mTextures[COLOR_TEXTURE]->deleteGL();
+    if (mTextures[ALBEDO_TEXTURE]->getId() != 0)
+        mTextures[ALBEDO_TEXTURE]->deleteGL();
+    if (mTextures[SPECULAR_TEXTURE]->getId() != 0)
+        mTextures[SPECULAR_TEXTURE]->deleteGL();
 
     mTextures[NORMAL_TEXTURE]->initGL(GL_RGBA32F, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     mTextures[COLOR_TEXTURE]->initGL(GL_RGBA32F, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    mTextures[ALBEDO_TEXTURE]->initGL(GL_RGBA16F, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    mTextures[SPECULAR_TEXTURE]->initGL(GL_RGBA8, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
     mFbo->bind();
     mFbo->attachTexture(GL_COLOR_ATTACHMENT0, mTextures[COLOR_TEXTURE]);
     mFbo->attachTexture(GL_COLOR_ATTACHMENT1, mTextures[NORMAL_TEXTURE]);
+    mFbo->attachTexture(GL_COLOR_ATTACHMENT2, mTextures[ALBEDO_TEXTURE]);
+    mFbo->attachTexture(GL_COLOR_ATTACHMENT3, mTextures[SPECULAR_TEXTURE]);
     mFbo->attachTexture(GL_DEPTH_ATTACHMENT, mTextures[DEPTH_TEXTURE]);
     mFbo->check();
     mFbo->unbind();
 
+    mLightFbo->setSize(mWidth, mHeight);
+    mLightFbo->bind();
+    mLightFbo->attachTexture(GL_COLOR_ATTACHMENT0, mTextures[COLOR_TEXTURE]);
+    mLightFbo->check();
+    mLightFbo->unbind();
+
     FBO::bindDefault();
     glAssert (glDrawBuffer(GL_BACK); );
     glAssert (glReadBuffer(GL_BACK); );
@@ -254,32 +349,25 @@ void FtylRenderer::initRessources(AssetManager *assetManager){
     assetManager->setShaderFileExtentions(std::string(".vert.glsl"), std::string(".frag.glsl"));
     assetManager->setShaderBasePath(std::string("../freestyle/freestyle/shaders/"));
 
+    // compiled programs are kept between the launches
+    QString programCacheFolder = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/programs";
+    if (QDir().mkpath(programCacheFolder))
+        assetManager->setProgramCacheFolder(programCacheFolder.toStdString());
+
     /*
      * Image Computation shaders
      */
     if(mSceneManager->sceneGraph()){
-        // Ambient and normal computation
-        {
-            ShaderBuilder shaderCreatorVisitor(assetManager, "ambient", false);
-            mAmbientAndNormalFilter = new MaterialPropertiesSelectorFilter;
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_OPACITY);
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_HEIGHT);
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_NORMALS);
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_AMBIENT);
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_DIFFUSE);
-            mAmbientAndNormalFilter->addProperty(Material::TEXTURE_SPECULAR);
-            shaderCreatorVisitor.setFilter(mAmbientAndNormalFilter);
-            SceneGraph::PreOrderVisitor visit(mSceneManager->sceneGraph(), shaderCreatorVisitor);
-            visit.go();
-        }
-
-        // Lighting computation
-        {
-            ShaderBuilder shaderCreatorVisitor(assetManager, "phong");
-            SceneGraph::PreOrderVisitor visit(mSceneManager->sceneGraph(), shaderCreatorVisitor);
-            visit.go();
-        }
-
+        mAmbientAndNormalFilter = new MaterialPropertiesSelectorFilter;
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_OPACITY);
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_HEIGHT);
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_NORMALS);
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_AMBIENT);
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_DIFFUSE);
+        mAmbientAndNormalFilter->addProperty(Material::TEXTURE_SPECULAR);
+        if (mGpuSkinning)
+            assetManager->setGpuSkinning(true);
+        buildShaderPrograms(assetManager);
         buildRenderingLoops();
     }
 
@@ -287,45 +375,112 @@ void FtylRenderer::initRessources(AssetManager *assetManager){
      * Image post-processing shaders
      */
     mDisplayShaderId = assetManager->addShaderProgram("display");
+    mDeferredLightShaderId = assetManager->addShaderProgram("deferredlight");
     mRenderOperators.push_back(new FilledRenderOperator(this));
     mRenderOperators.push_back(new WireRenderOperator(this));
+    mRenderOperators.push_back(new DeferredRenderOperator(this));
+
+    printStatistics();
+}
 
+void FtylRenderer::printStatistics(){
     if(mSceneManager->sceneGraph()){
-        assetManager->statistics();
+        mSceneManager->getAsset()->statistics();
         GraphStatistic statistic;
         SceneGraph::PreOrderVisitor statisticVisitor(mSceneManager->sceneGraph(), statistic);
         statisticVisitor.go();
         std::cerr << statistic << std::endl;
     }
+}
+
+void FtylRenderer::buildShaderPrograms(AssetManager *assetManager){
+    // Ambient and normal computation
+    ShaderBuilder ambientBuilder(assetManager, "ambient", false, ShaderConfiguration::ALL);
+    ambientBuilder.setFilter(mAmbientAndNormalFilter);
+
+    // Lighting computation
+    ShaderBuilder phongBuilder(assetManager, "phong", true, ShaderConfiguration::ALL);
+
+    // G-buffer for deferred lighting
+    ShaderBuilder gBufferBuilder(assetManager, "gbuffer", false, ShaderConfiguration::ALL);
+
+    ShaderBuilder *builders[] = { &ambientBuilder, &phongBuilder, &gBufferBuilder };
+
+    // build all the programs of the scene at once, then assign them
+    std::vector<ShaderConfiguration> configurations;
+    for (int i = 0; i < 3; ++i) {
+        builders[i]->collectConfigurations(&configurations);
+        SceneGraph::PreOrderVisitor visit(mSceneManager->sceneGraph(), *builders[i]);
+        visit.go();
+        builders[i]->collectConfigurations(NULL);
+    }
+    assetManager->warmUpShaderPrograms(configurations);
 
+    for (int i = 0; i < 3; ++i) {
+        SceneGraph::PreOrderVisitor visit(mSceneManager->sceneGraph(), *builders[i]);
+        visit.go();
+    }
+}
+
+bool FtylRenderer::setGpuSkinning(bool enable){
+    mGpuSkinning = enable;
+    if (!mSceneManager->sceneGraph())
+        return true;
+    bool allSet = mSceneManager->getAsset()->setGpuSkinning(enable);
+    // the programs of the animated meshes change with their GPU_SKINNING property
+    buildShaderPrograms(mSceneManager->getAsset());
+    buildRenderingLoops();
+    return allSet;
+}
+
+void FtylRenderer::reloadShaders(){
+    mSceneManager->getAsset()->reloadShaders();
+    // the rendering loops are keyed by copies of the programs
+    if(mSceneManager->sceneGraph())
+        buildRenderingLoops();
+}
+
+void FtylRenderer::clearLoopBuilders(){
+    for (unsigned int i = 0; i < mLoopBuilders.size(); ++i)
+        delete mLoopBuilders[i];
+    mLoopBuilders.clear();
 }
 
 void FtylRenderer::buildRenderingLoops(){
 
     mMainDrawLoop.clear();
     mAmbientAndNormalLoop.clear();
-    if (mRenderMode == 0) { // Fill mode
+    mGBufferLoop.clear();
+    clearLoopBuilders();
+    if (mRenderMode == FILLED_MODE) { // Fill mode
         // Light loop builder
-        DefaultLoopBuilder mainDrawLoopBuilder(mSceneManager->sceneGraph(), &mMainDrawLoop);
+        mLoopBuilders.push_back(new DefaultLoopBuilder(mSceneManager->sceneGraph(), &mMainDrawLoop));
 
         // Ambient and normal loop builder
-        ShaderLoopBuilder ambientAndNormalLoopBuilder(mSceneManager->getAsset(), mSceneManager->sceneGraph(), &mAmbientAndNormalLoop, "ambient");
-        ambientAndNormalLoopBuilder.setFilter(mAmbientAndNormalFilter);
+        ShaderLoopBuilder *ambientAndNormalLoopBuilder = new ShaderLoopBuilder(mSceneManager->getAsset(), mSceneManager->sceneGraph(), &mAmbientAndNormalLoop, "ambient", ShaderConfiguration::ALL);
+        ambientAndNormalLoopBuilder->setFilter(mAmbientAndNormalFilter);
+        mLoopBuilders.push_back(ambientAndNormalLoopBuilder);
 
-        // Setup loop builder
-        SetOfLoopBuilder renderPassesBuilder;
-        renderPassesBuilder.addLoopBuilder(&mainDrawLoopBuilder);
-        renderPassesBuilder.addLoopBuilder(&ambientAndNormalLoopBuilder);
-        SceneGraph::PostOrderVisitor renderPassesVisitor(mSceneManager->sceneGraph(), renderPassesBuilder);
-        renderPassesVisitor.go(glm::mat4(1.0), glm::mat4(1.0));
+    } else if (mRenderMode == DEFERRED_MODE) {
+        // G-buffer loop builder
+        mLoopBuilders.push_back(new ShaderLoopBuilder(mSceneManager->getAsset(), mSceneManager->sceneGraph(), &mGBufferLoop, "gbuffer", ShaderConfiguration::ALL));
 
     } else { // WireMode
-        ShaderLoopBuilder ambientAndNormalLoopBuilder(mSceneManager->getAsset(), mSceneManager->sceneGraph(), &mAmbientAndNormalLoop, "fill");
-        ambientAndNormalLoopBuilder.setFilter(mAmbientAndNormalFilter);
-        // Setup loop builder
-        SceneGraph::PostOrderVisitor renderPassesVisitor(mSceneManager->sceneGraph(), ambientAndNormalLoopBuilder);
-        renderPassesVisitor.go(glm::mat4(1.0), glm::mat4(1.0));
+        ShaderLoopBuilder *ambientAndNormalLoopBuilder = new ShaderLoopBuilder(mSceneManager->getAsset(), mSceneManager->sceneGraph(), &mAmbientAndNormalLoop, "fill");
+        ambientAndNormalLoopBuilder->setFilter(mAmbientAndNormalFilter);
+        mLoopBuilders.push_back(ambientAndNormalLoopBuilder);
     }
+
+    // Setup loop builder
+    SetOfLoopBuilder renderPassesBuilder;
+    for (unsigned int i = 0; i < mLoopBuilders.size(); ++i)
+        renderPassesBuilder.addLoopBuilder(mLoopBuilders[i]);
+    SceneGraph::PostOrderVisitor renderPassesVisitor(mSceneManager->sceneGraph(), renderPassesBuilder);
+    renderPassesVisitor.go(glm::mat4(1.0), glm::mat4(1.0));
+
+    // from now on, the changed meshes are updated one by one
+    for (unsigned int i = 0; i < mLoopBuilders.size(); ++i)
+        mLoopBuilders[i]->listen();
 }
 
 float FtylRenderer::readDepthAt(int x, int y){
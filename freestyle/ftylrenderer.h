@@ -5,12 +5,15 @@
 #include "../engine/skybox.h"
 #include "../engine/scenemanager.h"
 #include "../engine/camera.h"
+#include "../engine/lightbuffer.h"
+#include "../engine/drawlist.h"
 
 #include <string>
 
 class FtylRenderer {
 public:
-    enum TextureId {COLOR_TEXTURE, DEPTH_TEXTURE, NORMAL_TEXTURE, NUM_TEXTURE};
+    enum TextureId {COLOR_TEXTURE, DEPTH_TEXTURE, NORMAL_TEXTURE, ALBEDO_TEXTURE, SPECULAR_TEXTURE, NUM_TEXTURE};
+    enum RenderMode {FILLED_MODE, WIRE_MODE, DEFERRED_MODE, NUM_MODE};
 
     // Constructors -- Destructors
     FtylRenderer(vortex::SceneManager *sceneManager, int width = 1, int height = 1);
@@ -28,6 +31,11 @@ public:
     };
 
     // Public methods
+
+    /**
+     * Fill the rendering loops of the current mode from the scene graph. The loops then follow the graph changes
+     * (see SceneGraph::Listener) : call it again only when the mode or the programs change.
+     */
     void buildRenderingLoops();
     void render(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
 
@@ -35,15 +43,39 @@ public:
 
     void initRessources(vortex::AssetManager *assetManager);
 
+    /**
+     * Pose and skin the animated meshes on the worker threads, then upload them.
+     */
+    void updateAnimations(double time);
+
+    bool loading();
+
+    /**
+     * Print the asset and scene graph statistics, the levels of detail included.
+     */
+    void printStatistics();
+
     void setRenderingMode(int mode) {
         bool needLoopRebuild = (mRenderMode != mode);
         mRenderMode=mode;
         if (needLoopRebuild)
             buildRenderingLoops();
     }
-    bool getRenderMode() const {
-        return (mRenderMode==0);
+    int getRenderMode() const {
+        return mRenderMode;
     }
+
+    /**
+     * Skin the animated meshes on the GPU, the meshes it can not skin accurately stay on the CPU.
+     * The programs and the rendering loops are built again, the choice is kept for the next scenes.
+     *
+     * @return true if all the animated meshes use the requested path
+     */
+    bool setGpuSkinning(bool enable);
+    bool getGpuSkinning() const {
+        return mGpuSkinning;
+    }
+
     float readDepthAt(int x, int y);
 
     void toolRadiusChanged(float radius) {
@@ -59,6 +91,31 @@ public:
         mValidSelection = false;
     }
 
+    /**
+     * Wireframe overlay drawn by the filled and deferred modes.
+     *
+     * @param width Line width, in pixels.
+     * @param fadeMin Triangle size, in pixels, under which the lines are hidden.
+     * @param fadeMax Triangle size, in pixels, above which the lines are fully drawn.
+     */
+    void setWireframeOverlay(float width, float fadeMin, float fadeMax) {
+        mWireWidth = width;
+        mWireFadeMin = fadeMin;
+        mWireFadeMax = fadeMax;
+    }
+    void setWireframeColor(const glm::vec4 &color) {
+        mWireColor = color;
+    }
+
+    /// Number of lights above which the lights are culled per screen tile
+    void setTiledLightingThreshold(int threshold) {
+        mLightBuffer->setTiledThreshold(threshold);
+    }
+    /// Distance attenuation of the lights and directionnal suns, off by default
+    void setLightAttenuation(bool attenuation) {
+        mLightBuffer->setAttenuation(attenuation);
+    }
+
     void drawScreenQuad() { mScreenQuad->draw(); }
     void reloadShaders();
 
@@ -86,36 +143,70 @@ private:
         }
     };
 
+    class DeferredRenderOperator : public RenderOperator{
+        DeferredRenderOperator() :  RenderOperator(){}
+    public:
+        DeferredRenderOperator(FtylRenderer *theRenderer) : RenderOperator(theRenderer) {}
+        ~DeferredRenderOperator(){}
+        void operator()(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix){
+            mAssociatedRenderer->renderDeferred(modelViewMatrix, projectionMatrix);
+        }
+    };
+
     std::vector<RenderOperator*> mRenderOperators;
 
     void renderFilled(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
     void renderWireframe(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+    void renderDeferred(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
 
     void drawSkyBox(int shaderId, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
-    void ambientPass(vortex::ShaderLoop &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix);
-    void lightsPass(vortex::ShaderLoop &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix);
+    void ambientPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix);
+    void lightsPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix);
+    void gBufferPass(vortex::DrawList &theRenderingLoop, const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewToWorldMatrix);
+    void deferredLightsPass(const glm::mat4x4 &modelViewMatrix, const glm::mat4x4 &projectionMatrix);
+    void addWireframeParameters(vortex::ShadersGlobalParameters &parameters);
     void displayTexture(vortex::Texture * theTexture);
+    /// Assign the programs of the meshes for the ambient, lights and G-buffer passes
+    void buildShaderPrograms(vortex::AssetManager *assetManager);
 
     vortex::FBO *mFbo;
+    /// Color only target of the deferred lights, the G-buffer textures it reads are not attached to it
+    vortex::FBO *mLightFbo;
     vortex::Mesh *mScreenQuad;
 
+    /// All the scene lights, shaded in a single pass
+    vortex::LightBuffer *mLightBuffer;
+
     /* Image processing shaders */
     int mDisplayShaderId;
+    int mDeferredLightShaderId;
 
     vortex::MaterialPropertyFilter *mAmbientAndNormalFilter;
     vortex::MaterialPropertyFilter *mDepthFilter;
 
     int mRenderMode;
+    bool mFrustumCulling;
+    bool mGpuSkinning;
 
     // render loops
-    vortex::ShaderLoop mMainDrawLoop;
-    vortex::ShaderLoop mAmbientAndNormalLoop;
+    vortex::DrawList mMainDrawLoop;
+    vortex::DrawList mAmbientAndNormalLoop;
+    vortex::DrawList mGBufferLoop;
+    // builders of the current loops, updating them on the graph changes
+    std::vector<vortex::LoopBuilder *> mLoopBuilders;
+    void clearLoopBuilders();
 
     // For picking
     glm::vec3 mVertexSelected;
     bool mValidSelection;
 
     float mToolRadius;
+
+    // Wireframe overlay
+    glm::vec4 mWireColor;
+    float mWireWidth;
+    float mWireFadeMin;
+    float mWireFadeMax;
 public:
 
     int width(){ return mWidth; }
@@ -127,6 +218,22 @@ public:
 
     vortex::SceneManager *getScene() {return mSceneManager; }
 
+    void setFrustumCulling(bool on) {
+        mFrustumCulling = on;
+        if (!on && mSceneManager->sceneGraph())
+            mSceneManager->sceneGraph()->resetCulling();
+    }
+
+    /// Meshes submitted and culled at the last frame
+    const vortex::SceneGraph::CullingStatistics &getCullingStatistics() const {
+        return mSceneManager->sceneGraph()->cullingStatistics();
+    }
+
+    /// Draw calls and state changes of the last frame geometry pass
+    const vortex::DrawList::Statistics &getDrawStatistics() const {
+        return (mRenderMode == DEFERRED_MODE) ? mGBufferLoop.statistics() : mAmbientAndNormalLoop.statistics();
+    }
+
 protected:
     vortex::SceneManager *mSceneManager;
     vortex::Camera *mCamera;
@@ -63,6 +63,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
     connect(ui->actionResetCamera, SIGNAL(triggered()), SLOT(resetCamera()));
     ui->actionFillWireframe->setChecked(true);
     connect(ui->actionFillWireframe, SIGNAL(triggered(bool)), SLOT(switchRenderingMode(bool)));
+    connect(ui->actionDeferredShading, SIGNAL(triggered(bool)), SLOT(switchDeferredShading(bool)));
+    connect(ui->actionGpuSkinning, SIGNAL(triggered(bool)), SLOT(switchGpuSkinning(bool)));
 
     connect(ui->actionShowHideTools, SIGNAL(triggered(bool)), SLOT(switchToolsVisibility(bool)));
     connect(ui->actionParameters, SIGNAL(triggered()), SLOT(openParameters()));
@@ -79,6 +81,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
     addAction(ui->actionExit);
     addAction(ui->actionResetCamera);
     addAction(ui->actionFillWireframe);
+    addAction(ui->actionDeferredShading);
+    addAction(ui->actionGpuSkinning);
     addAction(ui->actionShowHideTools);
     addAction(ui->actionParameters);
     addAction(ui->actionManual);
@@ -133,6 +137,7 @@ void MainWindow::loadFile(const QString &fileName)
     QApplication::setOverrideCursor(Qt::WaitCursor);
     openGLWidget->makeCurrent();
 
+    sculptorController->sceneClosed();
     bool succeed = openGLWidget->loadScene(fileName.toStdString());
 
     QApplication::restoreOverrideCursor();
@@ -246,7 +251,25 @@ void MainWindow::resetCamera() {
 }
 
 void MainWindow::switchRenderingMode(bool on) {
-    openGLWidget->switchRenderingMode(!on);
+    updateRenderingMode();
+}
+
+void MainWindow::switchDeferredShading(bool on) {
+    updateRenderingMode();
+}
+
+void MainWindow::switchGpuSkinning(bool on) {
+    if (!openGLWidget->setGpuSkinning(on))
+        statusBar()->showMessage(tr("Some animated meshes can not be skinned on the GPU, they stay on the CPU"), 5000);
+}
+
+void MainWindow::updateRenderingMode() {
+    if (!ui->actionFillWireframe->isChecked())
+        openGLWidget->setRenderingMode(FtylRenderer::WIRE_MODE);
+    else if (ui->actionDeferredShading->isChecked())
+        openGLWidget->setRenderingMode(FtylRenderer::DEFERRED_MODE);
+    else
+        openGLWidget->setRenderingMode(FtylRenderer::FILLED_MODE);
 }
 
 void MainWindow::switchToolsVisibility(bool on) {
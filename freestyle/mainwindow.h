@@ -51,6 +51,8 @@ private slots:
 
     void resetCamera();
     void switchRenderingMode(bool);
+    void switchDeferredShading(bool);
+    void switchGpuSkinning(bool);
 
     void openParameters();
 
@@ -67,6 +69,7 @@ private:
     void setCurrentFile(const QString &fileName);
     QString strippedName(const QString &fullFileName);
     void reset();
+    void updateRenderingMode();
 
     Ui::MainWindow *ui;
 
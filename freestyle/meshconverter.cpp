@@ -131,3 +131,90 @@ void MeshConverter::convert(vortex::Mesh *in, QuasiUniformMesh *out){
         }
     }
 }
+
+bool MeshConverter::appendChunk(ChunkStore *in, int chunk, std::map<int, int> &vertexIndices,
+                                std::vector<vortex::Mesh::VertexData> &meshVertices, std::vector<int> &meshIndices){
+    const ChunkStore::Chunk *data = in->lock(chunk);
+    if(!data)
+        return false;
+    for(unsigned int i=0; i<data->vertices.size(); i++){
+        const ChunkStore::Vertex &v = data->vertices[i];
+        std::map<int, int>::iterator vtr = vertexIndices.find(v.id);
+        if(vtr == vertexIndices.end()){
+            vortex::Mesh::VertexData vertex;
+            vertex.mVertex = glm::vec3(v.position[0], v.position[1], v.position[2]);
+            vertex.mNormal = glm::vec3(0.f);
+            vertex.mTangent = glm::vec3(0.f);
+            vertex.mTexCoord = glm::vec4(0.f);
+            vertexIndices.insert(vtr, std::map<int, int>::value_type(v.id, meshVertices.size()));
+            meshVertices.push_back(vertex);
+        }
+    }
+    for(unsigned int i=0; i<data->triangles.size(); i++){
+        int indices[3];
+        for(int j=0; j<3; j++)
+            indices[j] = vertexIndices[data->triangles[i].vertices[j]];
+        // smooth normals, weighted by the face areas
+        glm::vec3 n = glm::cross(meshVertices[indices[1]].mVertex - meshVertices[indices[0]].mVertex,
+                                 meshVertices[indices[2]].mVertex - meshVertices[indices[0]].mVertex);
+        for(int j=0; j<3; j++){
+            meshVertices[indices[j]].mNormal += n;
+            meshIndices.push_back(indices[j]);
+        }
+    }
+    in->unlock(chunk, false);
+    return true;
+}
+
+void MeshConverter::normalize(std::vector<vortex::Mesh::VertexData> &vertices){
+    for(unsigned int i=0; i<vertices.size(); i++){
+        float length = glm::length(vertices[i].mNormal);
+        if(length > 0.f)
+            vertices[i].mNormal /= length;
+    }
+}
+
+void MeshConverter::convert(ChunkStore *in, const std::vector<int> &chunks, const std::vector<const vortex::Mesh *> &coarse, vortex::Mesh *out){
+    vortex::Timer timer;
+    timer.start();
+
+    std::map<int, int> vertexIndices;
+    std::vector<int> meshIndices;
+    std::vector<vortex::Mesh::VertexData> meshVertices;
+
+    // a chunk lost from the chunk file is not displayed
+    for(unsigned int c=0; c<chunks.size(); c++)
+        appendChunk(in, chunks[c], vertexIndices, meshVertices, meshIndices);
+    normalize(meshVertices);
+
+    // the coarse copies keep their own vertices and normals
+    for(unsigned int c=0; c<coarse.size(); c++){
+        int offset = meshVertices.size();
+        meshVertices.insert(meshVertices.end(), coarse[c]->vertices(), coarse[c]->vertices() + coarse[c]->numVertices());
+        for(int i=0; i<coarse[c]->numIndices(); i++)
+            meshIndices.push_back(offset + coarse[c]->indices()[i]);
+    }
+
+    timer.stop();
+    std::cout << "timer chunks conversion " << timer.value() << std::endl;
+
+    if(meshIndices.empty())
+        out->setData(out->name(), NULL, 0, NULL, 0);
+    else
+        out->setData(out->name(), &(meshVertices[0]), meshVertices.size(), &(meshIndices[0]), meshIndices.size());
+}
+
+vortex::Mesh *MeshConverter::simplify(ChunkStore *in, int chunk, vortex::MeshSimplifier *simplifier, int numTriangles){
+    std::map<int, int> vertexIndices;
+    std::vector<int> meshIndices;
+    std::vector<vortex::Mesh::VertexData> meshVertices;
+    if(!appendChunk(in, chunk, vertexIndices, meshVertices, meshIndices) || meshIndices.empty())
+        return NULL;
+    normalize(meshVertices);
+
+    vortex::Mesh source("chunk", &(meshVertices[0]), meshVertices.size(), &(meshIndices[0]), meshIndices.size());
+    vortex::Mesh *simplified = simplifier->simplify(source, numTriangles);
+    if(simplified)
+        return simplified;
+    return new vortex::Mesh("chunk", &(meshVertices[0]), meshVertices.size(), &(meshIndices[0]), meshIndices.size());
+}
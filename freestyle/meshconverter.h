@@ -1,13 +1,36 @@
 #ifndef MESHCONVERTER_H
 #define MESHCONVERTER_H
 
+#include <map>
+#include <vector>
+
 #include <../engine/mesh.h>
+#include "../engine/lodgenerator.h"
 #include "../sculptor/quasiuniformmesh.h"
+#include "../sculptor/chunkstore.h"
 
 class MeshConverter{
 public:
     static void convert(QuasiUniformMesh *in, vortex::Mesh *out);
     static void convert(vortex::Mesh *in, QuasiUniformMesh *out);
+    /**
+     * Merge some chunks of a store, the vertices shared by several chunks are merged with their normal.
+     * The coarse meshes, simplified copies of other chunks (see simplify), are appended as they are.
+     */
+    static void convert(ChunkStore *in, const std::vector<int> &chunks, const std::vector<const vortex::Mesh *> &coarse, vortex::Mesh *out);
+    /**
+     * Simplified copy of a chunk of a store, without OpenGL data. The simplifier should keep the boundaries for the
+     * copy to join the neighbouring chunks.
+     *
+     * @return The copy, the chunk itself if it could not be simplified, NULL if it could not be read.
+     */
+    static vortex::Mesh *simplify(ChunkStore *in, int chunk, vortex::MeshSimplifier *simplifier, int numTriangles);
+
+private:
+    /** Append the triangles of a chunk, accumulating the area weighted normals, false if it could not be read */
+    static bool appendChunk(ChunkStore *in, int chunk, std::map<int, int> &vertexIndices,
+                            std::vector<vortex::Mesh::VertexData> &vertices, std::vector<int> &indices);
+    static void normalize(std::vector<vortex::Mesh::VertexData> &vertices);
 };
 
 
@@ -44,9 +44,11 @@ OpenGLWidget::OpenGLWidget (MainWindow *mw ) : QGLWidget ( mw ), camera_(NULL) {
     cerrInfoGL(this);
     mainWindow = mw;
     assetManager_ = new AssetManager();
+    assetManager_->setMeshSimplifier(&simplifier_);
     sceneManager_ = new SceneManager(assetManager_);
     renderer_ = new FtylRenderer(sceneManager_);
     cameraController_ = NULL;
+    lodsPending_ = false;
 }
 
 //#endif
@@ -95,7 +97,20 @@ void OpenGLWidget::paintGL() {
     glm::mat4x4 modelViewMatrix = camera_->getModelViewMatrix();
     glm::mat4x4 projectionMatrix = camera_->getProjectionMatrix();
 
+    // page in the sculpted chunks entering the view
+    mainWindow->getSculptorController()->viewChanged();
+
     renderer_->render(modelViewMatrix, projectionMatrix);
+
+    // all the levels of detail are uploaded : report their memory once
+    bool lodsPending = assetManager_->lodsPending();
+    if (lodsPending_ && !lodsPending)
+        renderer_->printStatistics();
+    lodsPending_ = lodsPending;
+
+    // draw again with the resources loaded meanwhile
+    if (renderer_->loading())
+        QTimer::singleShot(16, this, SLOT(updateGL()));
 }
 
 void OpenGLWidget::keyPressEvent ( QKeyEvent * e ) {
@@ -188,6 +203,18 @@ void OpenGLWidget::switchRenderingMode(bool on){
     updateGL();
 }
 
+void OpenGLWidget::setRenderingMode(int mode){
+    renderer_->setRenderingMode(mode);
+    updateGL();
+}
+
+bool OpenGLWidget::setGpuSkinning(bool on){
+    makeCurrent();
+    bool allSet = renderer_->setGpuSkinning(on);
+    updateGL();
+    return allSet;
+}
+
 void OpenGLWidget::resetCamera(){
     if (camera_){
         delete camera_;
@@ -216,6 +243,7 @@ bool OpenGLWidget::loadScene(std::string fileName){
     sceneManager_->newScene();
     delete assetManager_;
     assetManager_ = new AssetManager();
+    assetManager_->setMeshSimplifier(&simplifier_);
     sceneManager_->setAssetManager(assetManager_);
 
     bool ret = sceneManager_->loadScene(fileName);
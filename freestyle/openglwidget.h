@@ -35,6 +35,7 @@
 
 #include "sculptor.h"
 #include "sculptorcontroller.h"
+#include "quadricsimplifier.h"
 #include "timer.h"
 
 /**
@@ -60,6 +61,8 @@ public:
     void resetCamera();
     vortex::SceneManager *sceneManager(){ return sceneManager_; }
     void switchRenderingMode(bool on);
+    void setRenderingMode(int mode);
+    bool setGpuSkinning(bool on);
 
     FtylRenderer *getRenderer() {
         return renderer_;
@@ -85,10 +88,14 @@ private:
     vortex::Camera *camera_;
     vortex::SceneManager* sceneManager_;
     vortex::AssetManager* assetManager_;
+    QuadricSimplifier simplifier_;
 
     int width_;
     int height_;
 
+    // levels of detail generated in the background at the previous frame
+    bool lodsPending_;
+
     vortex::ui::CameraController *cameraController_;
 };
 
@@ -0,0 +1,93 @@
+#include "quadricsimplifier.h"
+
+#include <map>
+
+#include <OpenMesh/Tools/Decimater/DecimaterT.hh>
+#include <OpenMesh/Tools/Decimater/ModQuadricT.hh>
+
+typedef OpenMesh::Decimater::DecimaterT<QuasiUniformMesh> Decimater;
+typedef OpenMesh::Decimater::ModQuadricT<QuasiUniformMesh>::Handle ModQuadric;
+
+namespace {
+
+struct comp_vec{
+    bool operator()(const glm::vec3 &lhv, const glm::vec3 &rhv) const{
+        return lhv.x<rhv.x || (lhv.x==rhv.x && lhv.y<rhv.y ) || (lhv.x==rhv.x && lhv.y==rhv.y && lhv.z<rhv.z );
+    }
+};
+
+typedef std::map<glm::vec3, QuasiUniformMesh::VertexHandle, comp_vec> vMap;
+
+}
+
+vortex::Mesh *QuadricSimplifier::simplify(const vortex::Mesh &mesh, int numTriangles)
+{
+    // vertices merged by position, each one remembers the vertex of the vortex mesh it comes from
+    QuasiUniformMesh omesh;
+    OpenMesh::VPropHandleT<int> source;
+    omesh.add_property(source);
+    vMap vertexHandles;
+    std::vector<QuasiUniformMesh::VertexHandle> face_vhandles;
+    for (int i = 0; i < mesh.numIndices(); ++i) {
+        int index = mesh.indices()[i];
+        glm::vec3 p = mesh.vertices()[index].mVertex;
+        vMap::iterator vtr = vertexHandles.find(p);
+        QuasiUniformMesh::VertexHandle vh;
+        if (vtr == vertexHandles.end()) {
+            vh = omesh.add_vertex(QuasiUniformMesh::Point(p.x, p.y, p.z));
+            omesh.property(source, vh) = index;
+            vertexHandles.insert(vtr, vMap::value_type(p, vh));
+        } else {
+            vh = vtr->second;
+        }
+        face_vhandles.push_back(vh);
+        if (face_vhandles.size() == 3) {
+            // degenerate faces are skipped, add_face rejects the non manifold ones
+            if (face_vhandles[0] != face_vhandles[1] && face_vhandles[1] != face_vhandles[2] && face_vhandles[0] != face_vhandles[2])
+                omesh.add_face(face_vhandles);
+            face_vhandles.clear();
+        }
+    }
+
+    // the seams with the other pieces are not moved
+    if (keepBoundaries) {
+        omesh.request_vertex_status();
+        for (QuasiUniformMesh::VertexIter v_it = omesh.vertices_begin(); v_it != omesh.vertices_end(); ++v_it) {
+            if (omesh.is_boundary(*v_it))
+                omesh.status(*v_it).set_locked(true);
+        }
+    }
+
+    {
+        Decimater decimater(omesh);
+        ModQuadric quadric;
+        decimater.add(quadric);
+        decimater.module(quadric).unset_max_err();
+        if (!decimater.initialize())
+            return NULL;
+        decimater.decimate_to_faces(0, numTriangles);
+    }
+    omesh.garbage_collection();
+
+    omesh.update_face_normals();
+    omesh.update_vertex_normals();
+
+    std::vector<vortex::Mesh::VertexData> vertices(omesh.n_vertices());
+    for (QuasiUniformMesh::VertexIter v_it = omesh.vertices_begin(); v_it != omesh.vertices_end(); ++v_it) {
+        vortex::Mesh::VertexData &v = vertices[v_it->idx()];
+        v = mesh.vertices()[omesh.property(source, *v_it)];
+        QuasiUniformMesh::Point p = omesh.point(*v_it);
+        QuasiUniformMesh::Normal n = omesh.normal(*v_it);
+        v.mVertex = glm::vec3(p[0], p[1], p[2]);
+        v.mNormal = glm::vec3(n[0], n[1], n[2]);
+    }
+    std::vector<int> indices;
+    indices.reserve(omesh.n_faces() * 3);
+    for (QuasiUniformMesh::FaceIter f_it = omesh.faces_begin(); f_it != omesh.faces_end(); ++f_it) {
+        for (QuasiUniformMesh::FaceVertexIter fv_it = omesh.fv_iter(*f_it); fv_it.is_valid(); ++fv_it)
+            indices.push_back(fv_it->idx());
+    }
+    if (vertices.empty() || indices.empty())
+        return NULL;
+    return new vortex::Mesh(mesh.name() + "_lod", &(vertices[0]), vertices.size(), &(indices[0]), indices.size());
+}
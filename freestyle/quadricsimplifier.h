@@ -0,0 +1,25 @@
+#ifndef QUADRICSIMPLIFIER_H
+#define QUADRICSIMPLIFIER_H
+
+#include "../engine/lodgenerator.h"
+#include "../sculptor/quasiuniformmesh.h"
+
+/**
+ * Simplification of the vortex meshes by quadric edge collapses, with the OpenMesh decimater.
+ * The vertices sharing a position are merged before the decimation, the kept vertices keep the attributes
+ * (texture coordinates, tangents) of the first of them : texture seams are approximated. Normals are recomputed.
+ */
+class QuadricSimplifier : public vortex::MeshSimplifier {
+public:
+    /**
+     * @param keepBoundaries true to keep the boundary vertices, for pieces of a mesh simplified separately
+     */
+    QuadricSimplifier(bool keepBoundaries = false) : keepBoundaries(keepBoundaries) {}
+
+    vortex::Mesh *simplify(const vortex::Mesh &mesh, int numTriangles);
+
+private:
+    bool keepBoundaries;
+};
+
+#endif // QUADRICSIMPLIFIER_H
@@ -1,19 +1,29 @@
 #include "sculptorcontroller.h"
 
 #include <QCoreApplication>
+#include <QStatusBar>
 
 #include "mainwindow.h"
 #include "meshconverter.h"
 #include "operator.h"
 #include "subdivider.h"
 
+#include "../engine/frustum.h"
+
+#include <algorithm>
+
 SculptorController::SculptorController(MainWindow *mw) :
     sculptor(),
+    coarseSimplifier(true),
     mainWindow(mw),
     minToolRadius(0.25f),
     maxToolRadius(1.f)
 {
     validSelection = false;
+    existMesh = false;
+    numWriteFailures = 0;
+
+    sculptor.setStore(&store);
 
     sculptor.addOperator(new SweepOperator());
     sculptor.addOperator(new InfDefOperator());
@@ -29,6 +39,7 @@ SculptorController::SculptorController(MainWindow *mw) :
     objectpicker = NULL;
 
     mouseClicked = false;
+    strokeModified = false;
     timeRefreshClick = 1./50.; // 5 fps
     timerClick.start();
 }
@@ -36,6 +47,7 @@ SculptorController::SculptorController(MainWindow *mw) :
 SculptorController::~SculptorController() {
     if (objectpicker != NULL)
         delete objectpicker;
+    clearCoarseChunks();
 }
 
 SculptorParameters SculptorController::getParameters() {
@@ -90,14 +102,15 @@ void SculptorController::mouseMoveEvent(QMouseEvent *e) {
             vortex::Timer t;
             t.start();
 
-            sculptor.loop(QuasiUniformMesh::Point(vertexSelected.mVertex.x, vertexSelected.mVertex.y, vertexSelected.mVertex.z));
-
-            vortex::Mesh *m = renderer->getScene()->getAsset()->getMesh(0);
-            m->release();
-            QuasiUniformMesh pm;
-            sculptor.getMesh(pm);
-            MeshConverter::convert(&pm, m);
-            m->init();
+            if (!sculptor.loop(QuasiUniformMesh::Point(vertexSelected.mVertex.x, vertexSelected.mVertex.y, vertexSelected.mVertex.z)))
+                mainWindow->statusBar()->showMessage(QString::fromStdString(sculptor.getLastError()), 5000);
+            else if (store.getNumWriteFailures() > numWriteFailures)
+                mainWindow->statusBar()->showMessage(QCoreApplication::translate("SculptorController", "The chunk file is full, the sculpted mesh stays in memory above its budget"), 5000);
+            numWriteFailures = store.getNumWriteFailures();
+            if (sculptor.isStepModified()) {
+                strokeModified = true;
+                updateDisplay(true);
+            }
 
             t.stop();
             std::cout << "Timer deformation : " << t.value() << std::endl;
@@ -179,7 +192,14 @@ void SculptorController::mousePressEvent(QMouseEvent *e) {
 }
 
 void SculptorController::mouseReleaseEvent(QMouseEvent *e) {
+    // the stroke is over : reorder the sculpted mesh for the vertex cache and rebuild its levels of detail
+    if (strokeModified && existMesh) {
+        vortex::AssetManager *asset = mainWindow->getOGLWidget()->getRenderer()->getScene()->getAsset();
+        asset->optimizeMesh(asset->getMesh(0));
+        asset->generateLods(asset->getMesh(0));
+    }
     mouseClicked = false;
+    strokeModified = false;
 }
 
 void SculptorController::sceneLoaded() {
@@ -188,16 +208,18 @@ void SculptorController::sceneLoaded() {
 
     vortex::Mesh *m = asset->getMesh(0);
 
-    QuasiUniformMesh *pm = new QuasiUniformMesh(), pm2;
+    QuasiUniformMesh pm;
 
-    MeshConverter::convert(m, pm);
-    m->release();
+    MeshConverter::convert(m, &pm);
 
-    sculptor.setMesh(*pm);
-    sculptor.getMesh(pm2);
+    // the mesh is moved to the chunk store
+    sculptor.setMesh(pm);
 
-    MeshConverter::convert(&pm2, m);
-    m->init();
+    displayedChunks.clear();
+    clearCoarseChunks();
+    updateDisplay(true);
+    asset->optimizeMesh(m);
+    asset->generateLods(m);
 
     mainWindow->getParametersDialog()->setParameters(sculptor.getParameters());
 
@@ -208,6 +230,15 @@ void SculptorController::sceneLoaded() {
     existMesh = true;
 }
 
+void SculptorController::sceneClosed() {
+    // the chunks belong to the previous scene mesh, their memory and their file are released
+    existMesh = false;
+    displayedChunks.clear();
+    clearCoarseChunks();
+    store.clear();
+    strokeModified = false;
+}
+
 void SculptorController::toolRadiusChanged(float value) {
     assert(value >= minToolRadius && value <= maxToolRadius);
     sculptor.setRadius(value);
@@ -229,22 +260,114 @@ float SculptorController::getMaxToolRadius() const {
 
 void SculptorController::subdivide()
 {
-    QuasiUniformMesh *pm = new QuasiUniformMesh(), pm2;
-    sculptor.getMesh(*pm);
+    // the subdivision works on the whole mesh, loaded from all the chunks
+    QuasiUniformMesh pm;
+    if (!sculptor.getMesh(pm)) {
+        mainWindow->statusBar()->showMessage(QString::fromStdString(sculptor.getLastError()), 5000);
+        return;
+    }
 
-    Subdivider::subdivide(*pm);
+    Subdivider::subdivide(pm);
 
-    FtylRenderer *renderer = mainWindow->getOGLWidget()->getRenderer();
-    vortex::AssetManager *asset = renderer->getScene()->getAsset();
+    vortex::AssetManager *asset = mainWindow->getOGLWidget()->getRenderer()->getScene()->getAsset();
     vortex::Mesh *m = asset->getMesh(0);
 
-    m->release();
+    sculptor.setMesh(pm);
+
+    clearCoarseChunks();
+    updateDisplay(true);
+    asset->optimizeMesh(m);
+    asset->generateLods(m);
+}
+
+void SculptorController::viewChanged()
+{
+    if (!existMesh || mouseClicked)
+        return;
 
-    sculptor.setMesh(*pm);
-    sculptor.getMesh(pm2);
+    if (updateDisplay(false)) {
+        vortex::AssetManager *asset = mainWindow->getOGLWidget()->getRenderer()->getScene()->getAsset();
+        asset->optimizeMesh(asset->getMesh(0));
+        asset->generateLods(asset->getMesh(0));
+    }
+}
+
+bool SculptorController::updateDisplay(bool modified)
+{
+    FtylRenderer *renderer = mainWindow->getOGLWidget()->getRenderer();
+    vortex::Camera *camera = renderer->getCamera();
+    vortex::Frustum frustum(camera->getModelViewMatrix(), camera->getProjectionMatrix());
+    glm::vec3 eye = glm::vec3(glm::inverse(camera->getModelViewMatrix())[3]);
+
+    // the visible chunks, nearest first
+    std::vector<std::pair<float, int> > visible;
+    for (int c = 0; c < store.getNumChunks(); ++c) {
+        if (store.getNumTriangles(c) == 0)
+            continue;
+        float min[3], max[3];
+        store.getBounds(c, min, max);
+        vortex::BBox box;
+        box += glm::vec3(min[0], min[1], min[2]);
+        box += glm::vec3(max[0], max[1], max[2]);
+        if (frustum.intersect(box) != vortex::Frustum::OUTSIDE)
+            visible.push_back(std::make_pair(glm::distance(eye, (box.getMin() + box.getMax()) * 0.5f), c));
+    }
+    std::sort(visible.begin(), visible.end());
+
+    // half of the memory budget for the display, the other half for the strokes : the farther chunks are coarse
+    std::vector<int> chunks, coarse;
+    std::size_t size = 0;
+    for (unsigned int i = 0; i < visible.size(); ++i) {
+        size += store.getChunkSize(visible[i].second);
+        if (!chunks.empty() && size > store.getMemoryBudget() / 2)
+            coarse.push_back(visible[i].second);
+        else
+            chunks.push_back(visible[i].second);
+    }
+    std::sort(chunks.begin(), chunks.end());
+    std::sort(coarse.begin(), coarse.end());
+
+    if (chunks.empty() || (!modified && chunks == displayedChunks && coarse == displayedCoarseChunks))
+        return false;
+    displayedChunks = chunks;
+    displayedCoarseChunks = coarse;
+
+    std::vector<const vortex::Mesh *> coarseMeshes;
+    for (unsigned int i = 0; i < coarse.size(); ++i) {
+        const vortex::Mesh *coarseMesh = getCoarseChunk(coarse[i]);
+        if (coarseMesh)
+            coarseMeshes.push_back(coarseMesh);
+    }
 
-    MeshConverter::convert(&pm2, m);
+    vortex::Mesh *m = renderer->getScene()->getAsset()->getMesh(0);
+    m->release();
+    MeshConverter::convert(&store, chunks, coarseMeshes, m);
     m->init();
+    // the draw lists and the picker take the new geometry
+    renderer->getScene()->sceneGraph()->replaceMesh(m, m);
+    return true;
+}
+
+const vortex::Mesh *SculptorController::getCoarseChunk(int chunk)
+{
+    if (chunk >= (int) coarseChunks.size())
+        coarseChunks.resize(store.getNumChunks());
+    CoarseChunk &coarse = coarseChunks[chunk];
+    if (!coarse.mesh || coarse.revision != store.getRevision(chunk)) {
+        // the chunk is paged in only to be simplified, its boundaries are kept to join its neighbours
+        delete coarse.mesh;
+        coarse.mesh = MeshConverter::simplify(&store, chunk, &coarseSimplifier, std::max(store.getNumTriangles(chunk) / COARSE_REDUCTION, 1));
+        coarse.revision = store.getRevision(chunk);
+    }
+    return coarse.mesh;
+}
+
+void SculptorController::clearCoarseChunks()
+{
+    for (unsigned int i = 0; i < coarseChunks.size(); ++i)
+        delete coarseChunks[i].mesh;
+    coarseChunks.clear();
+    displayedCoarseChunks.clear();
 }
 
 void SculptorController::select(int i, int j) {
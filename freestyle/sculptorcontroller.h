@@ -3,6 +3,7 @@
 
 #include "ftylrenderer.h"
 #include "sculptor.h"
+#include "quadricsimplifier.h"
 #include "picker.h"
 #include "timer.h"
 
@@ -59,6 +60,7 @@ public:
     void mouseReleaseEvent(QMouseEvent *e);
 
     void sceneLoaded();
+    void sceneClosed();
 
     void toolRadiusChanged(float value);
     float getToolRadius() const;
@@ -68,8 +70,36 @@ public:
 
     void subdivide();
 
+    /**
+     * Display the chunks of the sculpted mesh entering the view frustum. Called before each frame.
+     * The nearest chunks are displayed up to half of the memory budget of the store, the farther ones from
+     * simplified copies.
+     */
+    void viewChanged();
+
+    /** Each simplified copy of a chunk has about this fraction of its triangles */
+    static const int COARSE_REDUCTION = 16;
+
 private:
     Sculptor sculptor;
+    // the sculpted mesh, only its visible chunks are displayed
+    ChunkStore store;
+    std::vector<int> displayedChunks;
+    std::vector<int> displayedCoarseChunks;
+    // simplified copies of the chunks drawn past the budget, by chunk, kept until the chunk is modified
+    struct CoarseChunk {
+        CoarseChunk() : revision(0), mesh(NULL) {}
+        unsigned int revision;
+        vortex::Mesh *mesh;
+    };
+    std::vector<CoarseChunk> coarseChunks;
+    QuadricSimplifier coarseSimplifier;
+    const vortex::Mesh *getCoarseChunk(int chunk);
+    void clearCoarseChunks();
+    // write failures already reported to the user
+    int numWriteFailures;
+    bool updateDisplay(bool modified);
+
     MainWindow *mainWindow;
     vortex::Mesh::VertexData vertexSelected;
     bool validSelection;
@@ -80,6 +110,8 @@ private:
     vortex::Timer timerClick;
     float timeRefreshClick;
     bool mouseClicked;
+    // a step of the current stroke deformed the mesh
+    bool strokeModified;
 
     vortex::Timer timerPicking;
     float timeRefreshPicking;
@@ -7,7 +7,14 @@ uniform vec3 Ka;
 in vec3 varNormal;
 in vec4 varTexCoord;
 
-in float varDist;
+/// wireframe overlay, the lighting pass blended on this one is faded out under the lines
+uniform vec4 wireColor;
+uniform float wireWidth; /// line width, in pixels
+uniform float wireFadeMin; /// triangle size, in pixels, under which the wireframe is hidden
+uniform float wireFadeMax; /// triangle size, in pixels, above which the wireframe is fully drawn
+
+noperspective in vec3 varBarycentric;
+flat in float varTriangleSize;
 
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec4 outNormal;
@@ -40,8 +47,17 @@ vec3 getKa(){
     return amb;
 }
 
+float wireframe(){
+    // distance to the closest edge, antialiased over one pixel
+    vec3 d = fwidth(varBarycentric);
+    vec3 a = smoothstep(d*(wireWidth-0.5), d*(wireWidth+0.5), varBarycentric);
+    float edge = 1.0 - min(min(a.x, a.y), a.z);
+    // dense triangulations would end as a uniform color : fade the lines out
+    return edge * wireColor.a * smoothstep(wireFadeMin, wireFadeMax, varTriangleSize);
+}
+
 void main(void)
 {
-    outColor = vec4(ambientIntensity*getKa(), 1.0);
+    outColor = vec4(mix(ambientIntensity*getKa(), wireColor.rgb, wireframe()), 1.0);
     outNormal = vec4(normalize(-varNormal+vec3(0,0,.5))*.5+.5, 1);
 }
@@ -0,0 +1,35 @@
+// Geometry Shader – file "ambient.glsl"
+// pass the triangle through, adding what is needed to draw the wireframe overlay in the fragment shader
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+uniform vec4 viewport;
+
+in vec3 vertNormal[];
+in vec4 vertTexCoord[];
+
+out vec3 varNormal;
+out vec4 varTexCoord;
+
+noperspective out vec3 varBarycentric;
+flat out float varTriangleSize;
+
+void main(void)
+{
+    // smallest edge of the triangle, in pixels
+    vec2 p0 = 0.5*viewport.xy*gl_in[0].gl_Position.xy/gl_in[0].gl_Position.w;
+    vec2 p1 = 0.5*viewport.xy*gl_in[1].gl_Position.xy/gl_in[1].gl_Position.w;
+    vec2 p2 = 0.5*viewport.xy*gl_in[2].gl_Position.xy/gl_in[2].gl_Position.w;
+    float size = min(distance(p0, p1), min(distance(p1, p2), distance(p2, p0)));
+
+    for (int i = 0; i < 3; ++i) {
+        gl_Position = gl_in[i].gl_Position;
+        varNormal = vertNormal[i];
+        varTexCoord = vertTexCoord[i];
+        varBarycentric = vec3(i == 0, i == 1, i == 2);
+        varTriangleSize = size;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
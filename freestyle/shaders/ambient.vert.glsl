@@ -17,14 +17,18 @@ in vec3 inNormal;
 in vec3 inTangent;
 in vec4 inTexCoord;
 
-out vec3 varNormal;
-out vec4 varTexCoord;
-
-out float varDist;
+out vec3 vertNormal;
+out vec4 vertTexCoord;
 
 void main(void)
 {
-  varNormal = (normalMatrix*vec4(inNormal,0.0)).xyz;
-  gl_Position = MVP*vec4(inPosition.xyz, 1.0);
-  varTexCoord = inTexCoord;
+  vec3 position = inPosition;
+  vec3 normal = inNormal;
+#ifdef GPU_SKINNING
+  skinVertex(position, normal);
+#endif
+
+  vertNormal = (normalMatrix*vec4(normal,0.0)).xyz;
+  gl_Position = MVP*vec4(position, 1.0);
+  vertTexCoord = inTexCoord;
 }
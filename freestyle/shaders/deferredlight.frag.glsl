@@ -0,0 +1,99 @@
+precision highp float; // needed only for version 1.30
+
+/// G-buffer
+uniform sampler2D depth;
+uniform sampler2D normal;
+uniform sampler2D albedo;
+uniform sampler2D specular;
+
+uniform mat4 inverseProjectionMatrix;
+
+/// wireframe overlay coverage is stored in the specular alpha, its color is written by the G-buffer pass
+
+/// packed lights (see vortex::LightBuffer), view space
+uniform samplerBuffer uniLights;
+uniform int uniNumLights;
+
+/// tiled light list, used above a given number of lights
+uniform isamplerBuffer uniLightGrid;
+uniform isamplerBuffer uniLightIndices;
+uniform int uniTiledLighting;
+uniform int uniTileSize;
+uniform int uniTilesX;
+
+const int LIGHT_TEXELS = 5;
+
+in vec4 varTexCoord;
+
+out vec4 outColor;
+
+const float PI=3.14159265;
+
+vec3 safeNormalize(vec3 v){
+    float len = length(v);
+    return len>0.0?v/len:vec3(0.0,0.0,0.0);
+}
+
+vec3 phong(vec3 normal, vec3 light, vec3 eye, vec3 Kd, float Ns, vec3 Ks, vec3 Ed, vec3 Es){
+    float cosTr = clamp(dot(reflect(-light, normal), eye), 0.0, 1.0);
+    float cosTi = clamp(dot(normal, light), 0.0, 1.0);
+    vec3 Rf0 = 2*Ks/(Ns+2);
+
+    return cosTi*(Kd/PI*Ed + (Ns+2)/(2*PI)*Rf0*pow(cosTr, Ns)*Es);
+}
+
+vec3 shadeLight(int lightIndex, vec3 viewPosition, vec3 normal, vec3 eye, vec3 Kd, float Ns, vec3 Ks){
+    int base = lightIndex*LIGHT_TEXELS;
+    vec4 position = texelFetch(uniLights, base);
+    vec4 direction = texelFetch(uniLights, base+1); // w : inner cone
+    vec4 diffuse = texelFetch(uniLights, base+2);   // w : outer cone
+    vec4 spec = texelFetch(uniLights, base+3);      // w : influence radius
+    vec3 attenuation = texelFetch(uniLights, base+4).xyz;
+
+    vec3 light;
+    float lightAttenuation = 1.0;
+    if (position.w == 0.0) { // directionnal light
+        light = safeNormalize(-direction.xyz);
+    } else {
+        vec3 lightVec = position.xyz-viewPosition;
+        float lightDist = length(lightVec);
+        light = lightVec/lightDist;
+        lightAttenuation = 1.0-smoothstep(direction.w, direction.w+ (diffuse.w-direction.w)/20., acos(dot(light, normalize(-direction.xyz))));
+        if (spec.w >= 0.0) {
+            float window = clamp(1.0-pow(lightDist/max(spec.w, 0.0001), 4.0), 0.0, 1.0);
+            lightAttenuation *= window*window/(attenuation.x + attenuation.y*lightDist + attenuation.z*lightDist*lightDist);
+        }
+    }
+
+    return phong(normal, light, eye, Kd, Ns, Ks, diffuse.rgb*lightAttenuation, spec.rgb*lightAttenuation);
+}
+
+void main(void)
+{
+    float d = texture(depth, varTexCoord.xy).r;
+    if (d == 1.0) // background
+        discard;
+
+    // view space position from depth
+    vec4 viewPosition = inverseProjectionMatrix * vec4(vec3(varTexCoord.xy, d)*2.0-1.0, 1.0);
+    viewPosition /= viewPosition.w;
+
+    vec3 n = normalize(texture(normal, varTexCoord.xy).xyz);
+    vec4 kd = texture(albedo, varTexCoord.xy);
+    vec4 ks = texture(specular, varTexCoord.xy);
+    vec3 Ks = ks.rgb;
+    vec3 eye = safeNormalize(-viewPosition.xyz);
+
+    vec3 color = vec3(0.0);
+    if (uniTiledLighting != 0) {
+        ivec2 tile = ivec2(gl_FragCoord.xy) / uniTileSize;
+        ivec2 range = texelFetch(uniLightGrid, tile.y*uniTilesX + tile.x).xy;
+        for (int i = 0; i < range.y; ++i)
+            color += shadeLight(texelFetch(uniLightIndices, range.x+i).x, viewPosition.xyz, n, eye, kd.rgb, kd.a, Ks);
+    } else {
+        for (int i = 0; i < uniNumLights; ++i)
+            color += shadeLight(i, viewPosition.xyz, n, eye, kd.rgb, kd.a, Ks);
+    }
+    // blended on mix(ambient, wireColor, w) : the sum is mix(ambient + lighting, wireColor, w)
+    outColor = vec4(max(color, vec3(0.0))*(1.0-ks.a), 1.0);
+}
@@ -7,5 +7,9 @@ in vec3 inPosition;
 
 void main(void)
 {
-  gl_Position = MVP*vec4(inPosition.xyz, 1.0);
+  vec3 position = inPosition;
+#ifdef GPU_SKINNING
+  skinPosition(position);
+#endif
+  gl_Position = MVP*vec4(position, 1.0);
 }
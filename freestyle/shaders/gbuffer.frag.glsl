@@ -0,0 +1,89 @@
+precision highp float; // needed only for version 1.30
+#extension GL_ARB_explicit_attrib_location : enable
+
+uniform float ambientIntensity;
+uniform vec3 Ka; /// ambient color
+uniform vec3 Ks; /// specular color
+uniform vec3 Kd; /// diffuse color
+uniform float Ns; /// shininess
+
+uniform float toolRadius;
+
+in vec3 varNormal;
+in vec4 varTexCoord;
+
+in float varDist;
+
+/// wireframe overlay
+uniform vec4 wireColor;
+uniform float wireWidth; /// line width, in pixels
+uniform float wireFadeMin; /// triangle size, in pixels, under which the wireframe is hidden
+uniform float wireFadeMax; /// triangle size, in pixels, above which the wireframe is fully drawn
+
+noperspective in vec3 varBarycentric;
+flat in float varTriangleSize;
+
+layout(location = 0) out vec4 outColor;    // ambient, lights are accumulated on it
+layout(location = 1) out vec4 outNormal;   // view space normal
+layout(location = 2) out vec4 outAlbedo;   // diffuse color, shininess
+layout(location = 3) out vec4 outSpecular; // specular color, wireframe coverage
+
+#ifdef TEXTURE_DIFFUSE
+uniform sampler2D map_diffuse;
+#endif
+
+#ifdef TEXTURE_SPECULAR
+uniform sampler2D map_specular;
+#endif
+
+vec3 getKd(){
+    vec3 rho;
+#ifdef TEXTURE_DIFFUSE
+    rho = texture(map_diffuse, varTexCoord.st).rgb;
+#else
+    rho = Kd;
+#endif
+
+    if (varDist < toolRadius && varDist > 0)
+        rho = 1 - rho;
+
+    return pow(rho, vec3(2.2));
+}
+
+float getNs(){
+#ifdef TEXTURE_SPECULAR
+    float shineTex = texture(map_specular, varTexCoord.st).a;
+    return max(Ns*shineTex, 0.01);
+#else
+    return max(Ns, 00.01);
+#endif
+}
+
+vec3 getKs(){
+    vec3 rho;
+#ifdef TEXTURE_SPECULAR
+    rho =  Ks*texture(map_specular, varTexCoord.st).rgb;
+#else
+    rho = Ks;
+#endif
+    return rho;
+}
+
+float wireframe(){
+    // distance to the closest edge, antialiased over one pixel
+    vec3 d = fwidth(varBarycentric);
+    vec3 a = smoothstep(d*(wireWidth-0.5), d*(wireWidth+0.5), varBarycentric);
+    float edge = 1.0 - min(min(a.x, a.y), a.z);
+    // dense triangulations would end as a uniform color : fade the lines out
+    return edge * wireColor.a * smoothstep(wireFadeMin, wireFadeMax, varTriangleSize);
+}
+
+void main(void)
+{
+    // the lines are drawn over the ambient color, the lights are faded out under them
+    float wire = wireframe();
+    outColor = vec4(mix(ambientIntensity*max(vec3(0.001), Ka), wireColor.rgb, wire), 1.0);
+    outNormal = vec4(normalize(varNormal), 1.0);
+    outAlbedo = vec4(getKd(), getNs());
+    outSpecular = vec4(getKs(), wire);
+}
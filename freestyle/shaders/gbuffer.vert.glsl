@@ -0,0 +1,38 @@
+// Vertex Shader – file "gbuffer.vert"
+
+uniform	mat4 modelViewMatrix;
+uniform	mat4 MVP;
+uniform	mat4 normalMatrix;
+
+uniform vec4 vertexSelected;
+uniform bool validSelection;
+uniform float toolRadius;
+
+in vec3 inPosition;
+in vec3 inNormal;
+in vec4 inTexCoord;
+
+out vec3 vertNormal;
+out vec4 vertTexCoord;
+
+out float vertDist;
+
+void main(void)
+{
+  vec3 position = inPosition;
+  vec3 normal = inNormal;
+#ifdef GPU_SKINNING
+  skinVertex(position, normal);
+#endif
+
+  vertNormal   = (normalMatrix * vec4(normal,0.0)).xyz;
+
+  vertTexCoord = inTexCoord;
+
+  if (validSelection)
+      vertDist = distance(position, vertexSelected.xyz);
+  else
+      vertDist = -1;
+
+  gl_Position = MVP*vec4(position, 1.0);
+}
@@ -1,10 +1,17 @@
 precision highp float; // needed only for version 1.30
 
-uniform vec3 uniLightSpecular;  ///light specular color
-uniform vec3 uniLightDiffuse; /// light diffuse color
-uniform float uniLightAngleOuterCone; /// spotlight cone size
+/// packed lights (see vortex::LightBuffer), view space
+uniform samplerBuffer uniLights;
+uniform int uniNumLights;
 
-uniform float uniLightAngleInnerCone; /// spotlight  inner cone size
+/// tiled light list, used above a given number of lights
+uniform isamplerBuffer uniLightGrid;
+uniform isamplerBuffer uniLightIndices;
+uniform int uniTiledLighting;
+uniform int uniTileSize;
+uniform int uniTilesX;
+
+const int LIGHT_TEXELS = 5;
 
 uniform vec3 Ks; /// specular color
 uniform vec3 Kd; /// diffuse color
@@ -15,12 +22,20 @@ uniform float toolRadius;
 in vec3 varColor;
 in vec3 varEyeVec;
 in vec3 varNormal;
-in vec3 varLightVec;
-in vec3 varLightSpotDir;
+in vec3 varViewPosition;
 in vec4 varTexCoord;
 
 in float varDist;
 
+/// wireframe overlay, its color is written by the ambient pass
+uniform vec4 wireColor;
+uniform float wireWidth; /// line width, in pixels
+uniform float wireFadeMin; /// triangle size, in pixels, under which the wireframe is hidden
+uniform float wireFadeMax; /// triangle size, in pixels, above which the wireframe is fully drawn
+
+noperspective in vec3 varBarycentric;
+flat in float varTriangleSize;
+
 out vec4 outColor;
 
 #ifdef TEXTURE_DIFFUSE
@@ -82,35 +97,73 @@ vec3 getNormal(){
     return dir*normalize(varNormal);
 }
 
+float wireframe(){
+    // distance to the closest edge, antialiased over one pixel
+    vec3 d = fwidth(varBarycentric);
+    vec3 a = smoothstep(d*(wireWidth-0.5), d*(wireWidth+0.5), varBarycentric);
+    float edge = 1.0 - min(min(a.x, a.y), a.z);
+    // dense triangulations would end as a uniform color : fade the lines out
+    return edge * wireColor.a * smoothstep(wireFadeMin, wireFadeMax, varTriangleSize);
+}
+
 vec3 safeNormalize(vec3 v){
     float len = length(v);
     return len>0.0?v/len:vec3(0.0,0.0,0.0);
 }
 
-float lightAttenuation=1.0;
-
-vec4 phong(vec3 normal, vec3 light, vec3 eye){
+vec3 phong(vec3 normal, vec3 light, vec3 eye, vec3 Kd, float Ns, vec3 Ks, vec3 Ed, vec3 Es){
     float cosTr = clamp(dot(reflect(-light, normal), eye), 0.0, 1.0);
     float cosTi = clamp(dot(normal, light), 0.0, 1.0);
-    vec3 Kd = getKd();
-    float Ns = getNs();
-    vec3 Ks = getKs();
     vec3 Rf0 = 2*Ks/(Ns+2);
 
-    float spotLightCoef = lightAttenuation;
-    vec3 Ed = uniLightDiffuse*spotLightCoef;
-    vec3 Es = uniLightSpecular*spotLightCoef;
+    return cosTi*(Kd/PI*Ed + (Ns+2)/(2*PI)*Rf0*pow(cosTr, Ns)*Es);
+}
 
-    return vec4( cosTi*(Kd/PI*Ed + (Ns+2)/(2*PI)*Rf0*pow(cosTr, Ns)*Es), 1.0  );
+vec3 shadeLight(int lightIndex, vec3 normal, vec3 eye, vec3 Kd, float Ns, vec3 Ks){
+    int base = lightIndex*LIGHT_TEXELS;
+    vec4 position = texelFetch(uniLights, base);
+    vec4 direction = texelFetch(uniLights, base+1); // w : inner cone
+    vec4 diffuse = texelFetch(uniLights, base+2);   // w : outer cone
+    vec4 specular = texelFetch(uniLights, base+3);  // w : influence radius
+    vec3 attenuation = texelFetch(uniLights, base+4).xyz;
+
+    vec3 light;
+    float lightAttenuation = 1.0;
+    if (position.w == 0.0) { // directionnal light
+        light = safeNormalize(-direction.xyz);
+    } else {
+        vec3 lightVec = position.xyz-varViewPosition;
+        float lightDist = length(lightVec);
+        light = lightVec/lightDist;
+        lightAttenuation = 1.0-smoothstep(direction.w, direction.w+ (diffuse.w-direction.w)/20., acos(dot(light, normalize(-direction.xyz))));
+        if (specular.w >= 0.0) {
+            // distance attenuation, windowed to reach 0 at the influence radius used by the tiled light list
+            float window = clamp(1.0-pow(lightDist/max(specular.w, 0.0001), 4.0), 0.0, 1.0);
+            lightAttenuation *= window*window/(attenuation.x + attenuation.y*lightDist + attenuation.z*lightDist*lightDist);
+        }
+    }
+
+    return phong(normal, light, eye, Kd, Ns, Ks, diffuse.rgb*lightAttenuation, specular.rgb*lightAttenuation);
 }
 
 void main(void)
 {
     vec3 normal = getNormal();
     vec3 eye = safeNormalize(varEyeVec);
-    float lightDist = length(varLightVec);
-    vec3 light = (varLightVec)/lightDist;
-    //lightAttenuation = (1-smoothstep(.5*uniLightAngleInnerCone, 0.5*uniLightAngleOuterCone, acos(dot(light, normalize(-varLightSpotDir.xyz)))));
-    lightAttenuation = 1.0-smoothstep(uniLightAngleInnerCone, uniLightAngleInnerCone+ (uniLightAngleOuterCone-uniLightAngleInnerCone)/20., acos(dot(light, normalize(-varLightSpotDir.xyz))));
-    outColor = max(phong(normal, light, eye), vec4(0.0));
+    vec3 Kd = getKd();
+    float Ns = getNs();
+    vec3 Ks = getKs();
+
+    vec3 color = vec3(0.0);
+    if (uniTiledLighting != 0) {
+        ivec2 tile = ivec2(gl_FragCoord.xy) / uniTileSize;
+        ivec2 range = texelFetch(uniLightGrid, tile.y*uniTilesX + tile.x).xy;
+        for (int i = 0; i < range.y; ++i)
+            color += shadeLight(texelFetch(uniLightIndices, range.x+i).x, normal, eye, Kd, Ns, Ks);
+    } else {
+        for (int i = 0; i < uniNumLights; ++i)
+            color += shadeLight(i, normal, eye, Kd, Ns, Ks);
+    }
+    // blended on mix(ambient, wireColor, w) : the sum is mix(ambient + lighting, wireColor, w)
+    outColor = vec4(max(color, vec3(0.0))*(1.0-wireframe()), 1.0);
 }
@@ -11,8 +11,6 @@ uniform	mat4 MVP;
 uniform	mat4 normalMatrix;
 //};
 //****************************
-uniform vec3 uniLightPosition; /// spot light position
-uniform vec3 uniLightDirection; /// spot light direction
 
 uniform vec4 vertexSelected;
 uniform bool validSelection;
@@ -22,14 +20,13 @@ in vec3 inPosition;
 in vec3 inNormal;
 in vec4 inTexCoord;
 
-out vec3 varNormal;
-out vec3 varEyeVec;
-out vec3 varLightVec;
+out vec3 vertNormal;
+out vec3 vertEyeVec;
+out vec3 vertViewPosition;
 
-out vec3 varLightSpotDir;
-out vec4 varTexCoord;
+out vec4 vertTexCoord;
 
-out float varDist;
+out float vertDist;
 
 float dist(vec3 p1, vec3 p2) {
     return sqrt(pow(p1.x - p2.x, 2) + pow(p1.y - p2.y, 2) + pow(p1.z - p2.z, 2));
@@ -37,23 +34,28 @@ float dist(vec3 p1, vec3 p2) {
 
 void main(void)
 {
-  varNormal   = (normalMatrix * vec4(inNormal,0.0)).xyz;
+  vec3 position = inPosition;
+  vec3 normal = inNormal;
+#ifdef GPU_SKINNING
+  skinVertex(position, normal);
+#endif
 
-  varTexCoord = inTexCoord;
+  vertNormal   = (normalMatrix * vec4(normal,0.0)).xyz;
+
+  vertTexCoord = inTexCoord;
 
   if (validSelection)
-      varDist = dist(inPosition, vertexSelected.xyz);
+      vertDist = dist(position, vertexSelected.xyz);
   else
-      varDist = -1;
+      vertDist = -1;
 
-  vec4 viewPosition = (modelViewMatrix * vec4(inPosition, 1.));
+  vec4 viewPosition = (modelViewMatrix * vec4(position, 1.));
   viewPosition /= viewPosition.w;
 
-  // lighting
-  varLightVec = (uniLightPosition-viewPosition.xyz);
-  varEyeVec = -viewPosition.xyz;
-  varLightSpotDir = uniLightDirection;
+  // lighting, light vectors are computed per fragment for each light of the light buffer
+  vertViewPosition = viewPosition.xyz;
+  vertEyeVec = -viewPosition.xyz;
 
-  gl_Position = MVP*vec4(inPosition.xyz, 1.0);
+  gl_Position = MVP*vec4(position, 1.0);
 
 }
@@ -0,0 +1,277 @@
+#include "chunkstore.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+// cells are keyed by their 3 coordinates on 21 bits
+const qint64 CELL_BITS = 21;
+const qint64 CELL_OFFSET = qint64(1) << (CELL_BITS - 1);
+
+qint64 cellKey(const int cell[3])
+{
+    return ((qint64(cell[0]) + CELL_OFFSET) << (2 * CELL_BITS)) | ((qint64(cell[1]) + CELL_OFFSET) << CELL_BITS) | (qint64(cell[2]) + CELL_OFFSET);
+}
+
+// extents are allocated by powers of 2 to be reused by the chunks growing slowly
+const qint64 MIN_EXTENT = 4096;
+const qint64 MIN_FILE_SIZE = 1 << 20;
+
+}
+
+ChunkStore::ChunkStore(std::size_t memoryBudget) :
+    cellSize(1.f),
+    nextVertexId(1),
+    revisionCounter(0),
+    memoryBudget(memoryBudget),
+    residentSize(0),
+    useCounter(0),
+    mapping(NULL),
+    fileSize(0),
+    fileEnd(0),
+    numPageIns(0),
+    numWrites(0),
+    numWriteFailures(0)
+{}
+
+ChunkStore::~ChunkStore() {
+    for (unsigned int i = 0; i < entries.size(); ++i)
+        delete entries[i].data;
+    if (mapping)
+        file.unmap(mapping);
+}
+
+void ChunkStore::clear(float cellSize) {
+    for (unsigned int i = 0; i < entries.size(); ++i)
+        delete entries[i].data;
+    entries.clear();
+    cells.clear();
+    this->cellSize = cellSize;
+    nextVertexId = 1;
+    residentSize = 0;
+    // the file is kept open but emptied, it grows again with the next chunks
+    freeExtents.clear();
+    fileEnd = 0;
+    if (mapping)
+        file.unmap(mapping);
+    mapping = NULL;
+    if (file.isOpen() && !file.resize(0))
+        std::cerr << "ChunkStore : unable to empty the chunk file " << file.errorString().toStdString() << std::endl;
+    fileSize = 0;
+}
+
+int ChunkStore::getChunk(const float point[3]) {
+    int cell[3];
+    for (int i = 0; i < 3; ++i)
+        cell[i] = int(std::floor(point[i] / cellSize));
+    qint64 key = cellKey(cell);
+    std::map<qint64, int>::iterator known = cells.find(key);
+    if (known != cells.end())
+        return known->second;
+
+    Entry entry;
+    for (int i = 0; i < 3; ++i) {
+        entry.cell[i] = cell[i];
+        entry.min[i] = FLT_MAX;
+        entry.max[i] = -FLT_MAX;
+    }
+    entry.numVertices = 0;
+    entry.numTriangles = 0;
+    entry.offset = -1;
+    entry.capacity = 0;
+    entry.data = new Chunk;
+    entry.dirty = false;
+    entry.locks = 0;
+    entry.lastUse = ++useCounter;
+    entry.revision = ++revisionCounter;
+    entries.push_back(entry);
+    cells[key] = entries.size() - 1;
+    return entries.size() - 1;
+}
+
+ChunkStore::Chunk *ChunkStore::lock(int chunk) {
+    Entry &entry = entries[chunk];
+    if (!entry.data) {
+        // the paged out data is lost if the file could not be mapped back
+        if (getDataSize(entry) > 0 && (!mapping || entry.offset < 0 || entry.offset + qint64(getDataSize(entry)) > fileSize)) {
+            std::cerr << "ChunkStore : the chunk " << chunk << " can not be read back from the chunk file" << std::endl;
+            return NULL;
+        }
+        entry.data = new Chunk;
+        entry.data->vertices.resize(entry.numVertices);
+        entry.data->triangles.resize(entry.numTriangles);
+        const uchar *source = mapping + entry.offset;
+        if (entry.numVertices)
+            std::memcpy(&(entry.data->vertices[0]), source, entry.numVertices * sizeof(Vertex));
+        if (entry.numTriangles)
+            std::memcpy(&(entry.data->triangles[0]), source + entry.numVertices * sizeof(Vertex), entry.numTriangles * sizeof(Triangle));
+        residentSize += getDataSize(entry);
+        ++numPageIns;
+    }
+    ++entry.locks;
+    entry.lastUse = ++useCounter;
+    evict();
+    return entry.data;
+}
+
+void ChunkStore::unlock(int chunk, bool modified) {
+    Entry &entry = entries[chunk];
+    assert(entry.locks > 0);
+    if (modified) {
+        residentSize -= getDataSize(entry);
+        entry.numVertices = entry.data->vertices.size();
+        entry.numTriangles = entry.data->triangles.size();
+        residentSize += getDataSize(entry);
+        updateBounds(entry);
+        entry.dirty = true;
+        entry.revision = ++revisionCounter;
+    }
+    --entry.locks;
+    entry.lastUse = ++useCounter;
+    evict();
+}
+
+void ChunkStore::findChunks(const float center[3], float radius, std::vector<int> &chunks) const {
+    chunks.clear();
+    for (unsigned int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        if (entry.numTriangles == 0)
+            continue;
+        float distance2 = 0.f;
+        for (int j = 0; j < 3; ++j) {
+            float d = std::max(std::max(entry.min[j] - center[j], center[j] - entry.max[j]), 0.f);
+            distance2 += d * d;
+        }
+        if (distance2 <= radius * radius)
+            chunks.push_back(i);
+    }
+}
+
+void ChunkStore::getBounds(int chunk, float min[3], float max[3]) const {
+    for (int i = 0; i < 3; ++i) {
+        min[i] = entries[chunk].min[i];
+        max[i] = entries[chunk].max[i];
+    }
+}
+
+std::size_t ChunkStore::getChunkSize(int chunk) const {
+    return getDataSize(entries[chunk]);
+}
+
+void ChunkStore::setMemoryBudget(std::size_t bytes) {
+    memoryBudget = bytes;
+    evict();
+}
+
+std::size_t ChunkStore::getDataSize(const Entry &entry) const {
+    return entry.numVertices * sizeof(Vertex) + entry.numTriangles * sizeof(Triangle);
+}
+
+void ChunkStore::updateBounds(Entry &entry) {
+    for (int i = 0; i < 3; ++i) {
+        entry.min[i] = FLT_MAX;
+        entry.max[i] = -FLT_MAX;
+    }
+    for (unsigned int v = 0; v < entry.data->vertices.size(); ++v) {
+        const float *p = entry.data->vertices[v].position;
+        for (int i = 0; i < 3; ++i) {
+            entry.min[i] = std::min(entry.min[i], p[i]);
+            entry.max[i] = std::max(entry.max[i], p[i]);
+        }
+    }
+}
+
+bool ChunkStore::write(Entry &entry) {
+    qint64 size = getDataSize(entry);
+    if (size > entry.capacity) {
+        if (entry.capacity > 0)
+            freeExtents.insert(std::make_pair(entry.capacity, entry.offset));
+        entry.offset = -1;
+        entry.capacity = 0;
+        if (!allocate(size, entry.offset, entry.capacity))
+            return false;
+    }
+    uchar *target = mapping + entry.offset;
+    if (entry.numVertices)
+        std::memcpy(target, &(entry.data->vertices[0]), entry.numVertices * sizeof(Vertex));
+    if (entry.numTriangles)
+        std::memcpy(target + entry.numVertices * sizeof(Vertex), &(entry.data->triangles[0]), entry.numTriangles * sizeof(Triangle));
+    entry.dirty = false;
+    ++numWrites;
+    return true;
+}
+
+bool ChunkStore::allocate(qint64 size, qint64 &offset, qint64 &capacity) {
+    capacity = MIN_EXTENT;
+    while (capacity < size)
+        capacity *= 2;
+    std::multimap<qint64, qint64>::iterator extent = freeExtents.find(capacity);
+    if (extent != freeExtents.end()) {
+        offset = extent->second;
+        freeExtents.erase(extent);
+        return true;
+    }
+    if (fileEnd + capacity > fileSize && !grow(fileEnd + capacity))
+        return false;
+    offset = fileEnd;
+    fileEnd += capacity;
+    return true;
+}
+
+bool ChunkStore::grow(qint64 size) {
+    if (!file.isOpen() && !file.open()) {
+        std::cerr << "ChunkStore : unable to create the chunk file " << file.errorString().toStdString() << std::endl;
+        return false;
+    }
+    qint64 newSize = std::max(std::max(fileSize * 2, size), MIN_FILE_SIZE);
+    // the mapping is moved with the file size
+    if (mapping)
+        file.unmap(mapping);
+    mapping = NULL;
+    if (file.resize(newSize)) {
+        mapping = file.map(0, newSize);
+        if (mapping) {
+            fileSize = newSize;
+            return true;
+        }
+        std::cerr << "ChunkStore : unable to map the chunk file " << file.errorString().toStdString() << std::endl;
+    } else {
+        std::cerr << "ChunkStore : unable to grow the chunk file to " << newSize << " bytes" << std::endl;
+    }
+    // the previous extents stay usable at their place
+    if (fileSize > 0) {
+        mapping = file.map(0, fileSize);
+        if (!mapping)
+            std::cerr << "ChunkStore : unable to map back the chunk file " << file.errorString().toStdString() << std::endl;
+    }
+    return false;
+}
+
+void ChunkStore::evict() {
+    if (residentSize <= memoryBudget)
+        return;
+    // the least recently used first
+    std::vector<std::pair<unsigned int, int> > candidates;
+    for (unsigned int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        if (entry.data && entry.locks == 0)
+            candidates.push_back(std::make_pair(entry.lastUse, i));
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (unsigned int i = 0; i < candidates.size() && residentSize > memoryBudget; ++i) {
+        Entry &entry = entries[candidates[i].second];
+        // a chunk not written stays in memory, the next ones may still be evicted
+        if (entry.dirty && !write(entry)) {
+            ++numWriteFailures;
+            continue;
+        }
+        residentSize -= getDataSize(entry);
+        delete entry.data;
+        entry.data = NULL;
+    }
+}
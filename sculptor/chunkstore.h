@@ -0,0 +1,147 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include <QTemporaryFile>
+
+/**
+ * Out-of-core storage of a triangle mesh larger than the memory : the triangles are partitioned in the cells of a
+ * regular grid (the chunks) by their center, the chunks are saved in a memory mapped file and paged in on demand.
+ * The chunks in memory follow a memory budget, the least recently used ones being written back and evicted first.
+ *
+ * The vertices have a global id. A vertex used by the triangles of several chunks is copied in each of them : the
+ * seams stay consistent as long as a vertex is only modified with all the chunks using it in memory (see Sculptor).
+ */
+class ChunkStore
+{
+public:
+    static const std::size_t DEFAULT_MEMORY_BUDGET = 256 << 20;
+
+    struct Vertex {
+        float position[3];
+        int id;
+    };
+
+    struct Triangle {
+        int vertices[3]; // global ids
+    };
+
+    /**
+     * Data of a chunk in memory
+     */
+    struct Chunk {
+        std::vector<Vertex> vertices;
+        std::vector<Triangle> triangles;
+    };
+
+    ChunkStore(std::size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+    ~ChunkStore();
+
+    /**
+     * Remove all the chunks, the backing file is emptied and unmapped.
+     *
+     * @param cellSize Size of the grid cells.
+     */
+    void clear(float cellSize = 1.f);
+
+    /**
+     * @return The chunk of the cell containing a point, created empty if needed.
+     */
+    int getChunk(const float point[3]);
+
+    /**
+     * Page in the data of a chunk and keep it in memory until unlock.
+     *
+     * @return The data, NULL if it could not be read back from the file : the chunk is not locked then.
+     */
+    Chunk *lock(int chunk);
+
+    /**
+     * Allow the eviction of a chunk.
+     *
+     * @param modified true if the data was modified since lock, to write it back on eviction.
+     */
+    void unlock(int chunk, bool modified);
+
+    /**
+     * @return The non empty chunks whose bounding box intersects a sphere.
+     */
+    void findChunks(const float center[3], float radius, std::vector<int> &chunks) const;
+
+    inline int getNumChunks() const { return entries.size(); }
+    inline int getNumTriangles(int chunk) const { return entries[chunk].numTriangles; }
+    /** Changed each time the chunk is modified, unique over all the chunks even after clear */
+    inline unsigned int getRevision(int chunk) const { return entries[chunk].revision; }
+
+    /** Bounding box of the vertices of a chunk, they may be outside of its cell */
+    void getBounds(int chunk, float min[3], float max[3]) const;
+
+    /** Memory used by a chunk when paged in, in bytes */
+    std::size_t getChunkSize(int chunk) const;
+
+    /** @return An id for a new vertex, the ids start at 1 */
+    inline int newVertexId() { return nextVertexId++; }
+    /** @return An upper bound of the vertex ids */
+    inline int getVertexIdBound() const { return nextVertexId; }
+
+    void setMemoryBudget(std::size_t bytes);
+    inline std::size_t getMemoryBudget() const { return memoryBudget; }
+    inline std::size_t getResidentSize() const { return residentSize; }
+
+    inline int getNumPageIns() const { return numPageIns; }
+    inline int getNumWrites() const { return numWrites; }
+    /** Chunks that could not be written back : they stay in memory, above the budget if needed */
+    inline int getNumWriteFailures() const { return numWriteFailures; }
+
+private:
+    struct Entry {
+        int cell[3];
+        float min[3], max[3];
+        int numVertices, numTriangles;
+        qint64 offset;      // extent in the file, -1 if none
+        qint64 capacity;
+        Chunk *data;        // NULL when paged out
+        bool dirty;
+        int locks;
+        unsigned int lastUse;
+        unsigned int revision;
+    };
+
+    // the chunks, always in memory, and the chunk of each cell
+    std::vector<Entry> entries;
+    std::map<qint64, int> cells;
+    float cellSize;
+    int nextVertexId;
+    unsigned int revisionCounter; // not reset by clear
+
+    // paged in data
+    std::size_t memoryBudget;
+    std::size_t residentSize;
+    unsigned int useCounter;
+
+    // backing file and its free extents, by capacity
+    QTemporaryFile file;
+    uchar *mapping;
+    qint64 fileSize;
+    qint64 fileEnd;
+    std::multimap<qint64, qint64> freeExtents;
+
+    int numPageIns;
+    int numWrites;
+    int numWriteFailures;
+
+    std::size_t getDataSize(const Entry &entry) const;
+    void updateBounds(Entry &entry);
+
+    bool write(Entry &entry);
+    bool allocate(qint64 size, qint64 &offset, qint64 &capacity);
+    bool grow(qint64 size);
+
+    /** Write back and evict the least recently used chunks above the memory budget, the ones not written are kept */
+    void evict();
+};
+
+#endif // CHUNKSTORE_H
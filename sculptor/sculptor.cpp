@@ -1,9 +1,15 @@
 #include "sculptor.h"
 #include "../engine/timer.h"
 
+#include <set>
+#include <algorithm>
+
 Sculptor::Sculptor() :
     topHandler(this),
-    currentOp(-1)
+    currentOp(-1),
+    qum(NULL),
+    store(NULL),
+    stepModified(false)
 {}
 
 Sculptor::~Sculptor() {
@@ -11,13 +17,28 @@ Sculptor::~Sculptor() {
         delete ops[i];
 }
 
-void Sculptor::loop(QuasiUniformMesh::Point vCenterPos) {
+bool Sculptor::loop(QuasiUniformMesh::Point vCenterPos) {
+    bool saved = true;
+    stepModified = false;
     if (currentOp != -1) {
         vortex::Timer t, tswitch, tbuild, top;
         t.start();
 
         assert(params.valid());
 
+        // out-of-core : only the chunks around the tool are sculpted, with their seams to the other chunks kept
+        if (store) {
+            float regionRadius = radius + REGION_MARGIN * params.getMaxEdgeLength();
+            RegionStatus status = loadRegion(vCenterPos, regionRadius);
+            // the faces of the neighbouring chunks may join a vertex cut at the border of the region
+            for (int retry = 0; status == REGION_NON_MANIFOLD && retry < REGION_RETRIES; ++retry) {
+                regionRadius += CHUNK_EDGES * params.getMaxEdgeLength();
+                status = loadRegion(vCenterPos, regionRadius);
+            }
+            if (status != REGION_LOADED)
+                return false;
+        }
+
         tbuild.start();
         buildField(vCenterPos);
         tbuild.stop();
@@ -25,6 +46,7 @@ void Sculptor::loop(QuasiUniformMesh::Point vCenterPos) {
 
         if(field_vertices.size() > 1)
         {
+            stepModified = true;
             top.start();
             Operator *op = getOperator(currentOp);
             qum->update_normals();
@@ -61,6 +83,10 @@ void Sculptor::loop(QuasiUniformMesh::Point vCenterPos) {
                                 bool sommetAdjacent = false;
                                 vParcours = *v_it;
 
+                                // the seams with the chunks not loaded are not joined
+                                if (store && qum->is_boundary(vParcours))
+                                    continue;
+
                                 //Parcours du premier anneau de vCourant
                                 for(QuasiUniformMesh::VertexVertexIter vv_it = qum->vv_iter(vCourant); vv_it.is_valid(); ++vv_it)
                                 {
@@ -111,9 +137,17 @@ void Sculptor::loop(QuasiUniformMesh::Point vCenterPos) {
             //*/
         }
 
+        if (store) {
+            if (field_vertices.size() > 1)
+                saved = saveRegion();
+            else
+                releaseRegion();
+        }
+
         t.stop();
         std::cout << "Timer loop : " << t.value() << std::endl;
    }
+   return saved;
 }
 
 float Sculptor::getRadius() const {
@@ -132,6 +166,10 @@ void Sculptor::buildField(QuasiUniformMesh::Point vCenterPos)
 
     for(QuasiUniformMesh::VertexIter v_it = qum->vertices_sbegin(); v_it != qum->vertices_end(); ++v_it)
     {
+        // the region boundary is the seam with the chunks not loaded
+        if (store && qum->is_boundary(*v_it))
+            continue;
+
         float dist = calcDist(qum->point(*v_it), vCenterPos);
 
         if(dist < radius) {
@@ -187,3 +225,191 @@ void Sculptor::getMinMaxAvgEdgeLength(float &min, float &max, float &avg)
 
     avg /= qum->n_edges();
 }
+
+void Sculptor::storeMesh()
+{
+    store->clear(CHUNK_EDGES * params.getMaxEdgeLength());
+
+    OpenMesh::VPropHandleT<int> ids;
+    qum->add_property(ids);
+    for(QuasiUniformMesh::VertexIter v_it = qum->vertices_begin(); v_it != qum->vertices_end(); ++v_it)
+        qum->property(ids, *v_it) = 0;
+
+    regionChunks.clear();
+    if (!writeChunks(*qum, ids))
+        std::cerr << "Sculptor : " << lastError << std::endl;
+    qum->remove_property(ids);
+
+    // the strokes now work on the regions loaded from the store
+    qum = &region;
+}
+
+bool Sculptor::loadStoredMesh(QuasiUniformMesh &m)
+{
+    bool complete = true;
+    m = QuasiUniformMesh();
+    std::vector<QuasiUniformMesh::VertexHandle> handles(store->getVertexIdBound());
+    std::vector<QuasiUniformMesh::VertexHandle> face_vhandles(3);
+
+    for(int c = 0; c < store->getNumChunks(); ++c)
+    {
+        if (store->getNumTriangles(c) == 0)
+            continue;
+
+        const ChunkStore::Chunk *chunk = store->lock(c);
+        if (!chunk)
+        {
+            lastError = "Some chunks of the mesh could not be read back from the chunk file";
+            complete = false;
+            continue;
+        }
+        for(unsigned int i = 0; i < chunk->vertices.size(); ++i)
+        {
+            const ChunkStore::Vertex &v = chunk->vertices[i];
+            if (!handles[v.id].is_valid())
+                handles[v.id] = m.add_vertex(QuasiUniformMesh::Point(v.position[0], v.position[1], v.position[2]));
+        }
+        for(unsigned int i = 0; i < chunk->triangles.size(); ++i)
+        {
+            for(int j = 0; j < 3; ++j)
+                face_vhandles[j] = handles[chunk->triangles[i].vertices[j]];
+            m.add_face(face_vhandles);
+        }
+        store->unlock(c, false);
+    }
+    return complete;
+}
+
+Sculptor::RegionStatus Sculptor::loadRegion(QuasiUniformMesh::Point center, float radius)
+{
+    store->findChunks(center.data(), radius, regionChunks);
+    region = QuasiUniformMesh();
+    region.add_property(vertexIds);
+
+    std::map<int, QuasiUniformMesh::VertexHandle> handles;
+    std::vector<QuasiUniformMesh::VertexHandle> face_vhandles(3);
+    bool valid = true;
+
+    for(unsigned int c = 0; c < regionChunks.size(); ++c)
+    {
+        const ChunkStore::Chunk *chunk = store->lock(regionChunks[c]);
+        if (!chunk)
+        {
+            // only the previous chunks are locked
+            regionChunks.resize(c);
+            releaseRegion();
+            lastError = "The chunks around the tool could not be read back from the chunk file, the step is skipped";
+            return REGION_UNREADABLE;
+        }
+        for(unsigned int i = 0; i < chunk->vertices.size(); ++i)
+        {
+            const ChunkStore::Vertex &v = chunk->vertices[i];
+            if (handles.find(v.id) == handles.end())
+            {
+                QuasiUniformMesh::VertexHandle vh = region.add_vertex(QuasiUniformMesh::Point(v.position[0], v.position[1], v.position[2]));
+                region.property(vertexIds, vh) = v.id;
+                handles[v.id] = vh;
+            }
+        }
+        for(unsigned int i = 0; valid && i < chunk->triangles.size(); ++i)
+        {
+            for(int j = 0; j < 3; ++j)
+                face_vhandles[j] = handles[chunk->triangles[i].vertices[j]];
+            valid = region.add_face(face_vhandles).is_valid();
+        }
+    }
+
+    // a face missing from the region would be lost when it is saved
+    if (!valid)
+    {
+        releaseRegion();
+        lastError = "The mesh is not manifold around the tool, the step is skipped";
+        return REGION_NON_MANIFOLD;
+    }
+    return REGION_LOADED;
+}
+
+bool Sculptor::saveRegion()
+{
+    // the region chunks are rewritten from the region faces, they are in memory while the region is loaded
+    for(unsigned int c = 0; c < regionChunks.size(); ++c)
+    {
+        ChunkStore::Chunk *chunk = store->lock(regionChunks[c]);
+        chunk->vertices.clear();
+        chunk->triangles.clear();
+        store->unlock(regionChunks[c], true);
+    }
+    bool saved = writeChunks(region, vertexIds);
+    releaseRegion();
+    return saved;
+}
+
+void Sculptor::releaseRegion()
+{
+    for(unsigned int c = 0; c < regionChunks.size(); ++c)
+        store->unlock(regionChunks[c], false);
+    regionChunks.clear();
+    region = QuasiUniformMesh();
+}
+
+bool Sculptor::writeChunks(QuasiUniformMesh &mesh, OpenMesh::VPropHandleT<int> ids)
+{
+    bool written = true;
+    for(QuasiUniformMesh::VertexIter v_it = mesh.vertices_sbegin(); v_it != mesh.vertices_end(); ++v_it)
+    {
+        if (mesh.property(ids, *v_it) == 0)
+            mesh.property(ids, *v_it) = store->newVertexId();
+    }
+
+    // each face goes to the chunk of its center, which may have moved out of the region
+    std::vector<std::pair<int, int> > faces;
+    faces.reserve(mesh.n_faces());
+    for(QuasiUniformMesh::FaceIter f_it = mesh.faces_sbegin(); f_it != mesh.faces_end(); ++f_it)
+    {
+        QuasiUniformMesh::Point center(0, 0, 0);
+        for(QuasiUniformMesh::FaceVertexIter fv_it = mesh.fv_iter(*f_it); fv_it.is_valid(); ++fv_it)
+            center += mesh.point(*fv_it);
+        center /= 3.f;
+        faces.push_back(std::make_pair(store->getChunk(center.data()), f_it->idx()));
+    }
+    std::sort(faces.begin(), faces.end());
+
+    for(unsigned int i = 0; i < faces.size(); )
+    {
+        int c = faces[i].first;
+        ChunkStore::Chunk *chunk = store->lock(c);
+        if (!chunk)
+        {
+            // the faces moved to a chunk lost from the file are lost too
+            for(; i < faces.size() && faces[i].first == c; ++i)
+                ;
+            lastError = "Some chunks could not be read back from the chunk file, faces of the mesh are lost";
+            written = false;
+            continue;
+        }
+
+        std::set<int> known;
+        for(unsigned int v = 0; v < chunk->vertices.size(); ++v)
+            known.insert(chunk->vertices[v].id);
+
+        for(; i < faces.size() && faces[i].first == c; ++i)
+        {
+            ChunkStore::Triangle t;
+            int j = 0;
+            for(QuasiUniformMesh::FaceVertexIter fv_it = mesh.fv_iter(QuasiUniformMesh::FaceHandle(faces[i].second)); fv_it.is_valid(); ++fv_it)
+            {
+                int id = mesh.property(ids, *fv_it);
+                t.vertices[j++] = id;
+                if (known.insert(id).second)
+                {
+                    QuasiUniformMesh::Point p = mesh.point(*fv_it);
+                    ChunkStore::Vertex v = {{p[0], p[1], p[2]}, id};
+                    chunk->vertices.push_back(v);
+                }
+            }
+            chunk->triangles.push_back(t);
+        }
+        store->unlock(c, true);
+    }
+    return written;
+}
@@ -5,14 +5,37 @@
 #include "sculptorparameters.h"
 #include "operator.h"
 #include "topologicalhandler.h"
+#include "chunkstore.h"
+
+#include <string>
 
 class Sculptor
 {
 public:
+    /** Size of the chunks of the store, in maximum edge lengths : about 16k triangles for a surface crossing a chunk */
+    static const int CHUNK_EDGES = 64;
+
+    /** Distance around the tool of the chunks loaded by a step of a stroke, in maximum edge lengths */
+    static const int REGION_MARGIN = 2;
+
+    /** Times a non manifold region is loaded again with the neighbouring chunks before the step is skipped */
+    static const int REGION_RETRIES = 2;
+
     Sculptor();
     ~Sculptor();
 
-    void loop(QuasiUniformMesh::Point vCenterPos);
+    /**
+     * Apply a step of the current operator around a point.
+     *
+     * @return false if the step was skipped or only partly saved in the store, see getLastError.
+     */
+    bool loop(QuasiUniformMesh::Point vCenterPos);
+
+    /** Reason of the last failed step */
+    inline const std::string &getLastError() const { return lastError; }
+
+    /** true if the last step deformed the mesh, even if it was only partly saved */
+    inline bool isStepModified() const { return stepModified; }
 
     void setMesh(QuasiUniformMesh &mesh)
     {
@@ -66,13 +89,37 @@ public:
         getMinMaxAvgEdgeLength(min, max, avg);
 
         std::cout << "min: " << min << "  max: " << max << "  avg: " << avg << std::endl;
+
+        if (store)
+            storeMesh();
     }
 
+    /**
+     * Keep the sculpted mesh in a ChunkStore : setMesh moves the mesh into the store (it can then be destroyed), and
+     * each step of a stroke only loads the chunks around the tool. Must be set before setMesh, NULL to sculpt the
+     * whole mesh in memory.
+     */
+    void setStore(ChunkStore *store) {
+        this->store = store;
+    }
+
+    inline ChunkStore *getStore() { return this->store; }
+
     inline QuasiUniformMesh* getQUM() {return this->qum;}
     inline SculptorParameters getParams() {return this->params;}
     inline void addToConnectingEdges(QuasiUniformMesh::EdgeHandle eh) { connecting_edges.push_back(eh); }
 
-    inline void getMesh(QuasiUniformMesh &m) { m = *qum; }
+    /**
+     * Copy of the whole mesh, loaded from all the chunks with a store.
+     *
+     * @return false if some chunks could not be read, see getLastError : the copy misses their faces.
+     */
+    inline bool getMesh(QuasiUniformMesh &m) {
+        if (store)
+            return loadStoredMesh(m);
+        m = *qum;
+        return true;
+    }
 
     inline float calcDist(QuasiUniformMesh::Point &p1, QuasiUniformMesh::Point &p2){ return sqrt(pow(p1[0]-p2[0], 2) + pow(p1[1]-p2[1], 2) + pow(p1[2]-p2[2], 2)); }
 
@@ -112,6 +159,16 @@ private:
 
     QuasiUniformMesh *qum;
 
+    // Out-of-core sculpting : the chunks around the tool are loaded in region for a step of a stroke
+    ChunkStore *store;
+    QuasiUniformMesh region;
+    OpenMesh::VPropHandleT<int> vertexIds;  // global ids of the region vertices, 0 for the new ones
+    std::vector<int> regionChunks;
+    enum RegionStatus { REGION_LOADED, REGION_NON_MANIFOLD, REGION_UNREADABLE };
+
+    std::string lastError;
+    bool stepModified;
+
     // Informations about current deformation
     std::vector<std::pair<QuasiUniformMesh::VertexHandle, float>> field_vertices;
     std::vector<QuasiUniformMesh::EdgeHandle> field_edges;
@@ -123,6 +180,13 @@ private:
     void buildField(QuasiUniformMesh::Point vCenterPos);
 
     void getMinMaxAvgEdgeLength(float &min, float &max, float &avg);
+
+    void storeMesh();
+    bool loadStoredMesh(QuasiUniformMesh &m);
+    RegionStatus loadRegion(QuasiUniformMesh::Point center, float radius);
+    bool saveRegion();
+    void releaseRegion();
+    bool writeChunks(QuasiUniformMesh &mesh, OpenMesh::VPropHandleT<int> ids);
 };
 
 #endif // SCULPTOR_H